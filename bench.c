@@ -0,0 +1,1527 @@
+/*
+ * Benchmarks of the encoders and decoders on synthetic packs.
+ *
+ * Every case runs in a child process of its own, so that the peak RSS it reports belongs to that
+ * case alone. Results are written to stdout as one JSON object per line, which makes the output
+ * of two commits easy to diff or load into a script.
+ *
+ * Usage: senml_bench [--quick] [--filter=SUBSTRING] [--min-time=SECONDS]
+ *
+ * Built with BENCH_LIBCBOR defined and linked with libcbor, it also runs the libcbor encoder the
+ * CBOR writer replaced. libcbor allocates with malloc(3) directly, so its allocations are not
+ * counted.
+ */
+
+#include "senml.h"
+#include "senml_private.h"
+#include "senml_jansson.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <jansson.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef BENCH_LIBCBOR
+#include <cbor.h>
+#endif
+
+
+#define BENCH_MAX_SAMPLES (1 << 20)   //!< Latencies kept per case for the percentiles
+#define BENCH_MIN_ITERS   (5)         //!< Iterations every case runs at least
+#define BENCH_BATCH_DOCS  (64)        //!< Documents per call of the batch functions
+#define BENCH_DOUBLES     (1000)      //!< Numbers per iteration of the number cases
+#define BENCH_FILE_COPIES (256)       //!< Copies of the pack in the file of the file cases
+#define BENCH_SAMPLES     (10000)     //!< Samples of the series and store cases
+#define BENCH_SENSORS     (16)        //!< Sensors the samples of the store cases are spread over
+#define BENCH_QUERIES     (1000)      //!< Lookups per iteration of the store cases
+
+
+/*! Shape of the generated pack */
+typedef struct {
+	const char   *name;        //!< Label of the configuration in the output
+	size_t        records;     //!< Number of records
+	size_t        name_len;    //!< Length of the record names, without the base name
+	size_t        string_len;  //!< Length of string values
+	unsigned int  floats;      //!< Percentage of records with a float value
+	unsigned int  strings;     //!< Percentage of records with a string value, the rest are booleans
+	bool          base;        //!< Factor out base name, time and unit
+	bool          scaling;     //!< Also run the batch functions with 1 to N threads
+} bench_config_t;
+
+
+/*! Inputs and state shared by the cases of one configuration */
+typedef struct {
+	const bench_config_t *config;
+	senml_pack_t         *pack;        //!< The generated pack
+	char                 *json;        //!< The pack encoded as JSON
+	size_t                json_len;
+	unsigned char        *cbor;        //!< The pack encoded as CBOR
+	size_t                cbor_len;
+	unsigned char        *flat;        //!< The pack as a flat pack
+	size_t                flat_len;
+	char                 *buf;         //!< Output buffer of the *_s encoders
+	size_t                buf_len;
+	senml_pack_t         *reused;      //!< Pack the reuse case decodes into
+	senml_columns_t      *columns;     //!< Input of the aggregation cases
+	senml_aggregate_t    *results;     //!< Output of the aggregation cases
+	senml_names_t        *names;       //!< Table of the names case
+	senml_filter_t       *filter;      //!< Filter of the selective cases
+	senml_template_t     *tmpl;        //!< Template of the template cases
+	senml_series_t       *series;      //!< Series of the series cases
+	senml_store_t        *store;       //!< Store of the store cases
+	senml_pool_t         *pool;        //!< Pool of the batch cases
+	unsigned int          threads;     //!< Threads of the pool
+	const char          **inputs;      //!< Input of the batch cases
+	senml_pack_t        **packs;       //!< Output of the batch decode and input of the batch encode
+	char                **outputs;     //!< Output of the batch encode
+	double               *doubles;     //!< Input of the number cases
+	char                 *numbers;     //!< Input of the number parse cases, NUL separated
+	char                  file[32];    //!< Path of the input of the file cases
+	size_t                bytes;       //!< Bytes processed per iteration
+	size_t                records;     //!< Records processed per iteration
+	size_t                sink;        //!< Keeps the compiler from dropping results
+} bench_ctx_t;
+
+
+/*! One benchmark case */
+typedef struct {
+	const char  *name;
+	int        (*setup)(bench_ctx_t *ctx);  //!< Prepares ctx, not timed, may be NULL
+	int        (*run)(bench_ctx_t *ctx);    //!< One timed iteration, returns 0 on success
+} bench_case_t;
+
+
+static size_t bench_allocs;       //!< Calls of malloc and realloc made by the library
+static size_t bench_alloc_bytes;  //!< Bytes requested by those calls
+
+
+static void *bench_malloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	__atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&bench_alloc_bytes, size, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+
+static void *bench_realloc(void *ptr, size_t size, void *ctx)
+{
+	(void)ctx;
+	__atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&bench_alloc_bytes, size, __ATOMIC_RELAXED);
+	return realloc(ptr, size);
+}
+
+
+static void bench_free(void *ptr, void *ctx)
+{
+	(void)ctx;
+	free(ptr);
+}
+
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/*! xorshift64*, the generated packs must not depend on the platform */
+static inline uint64_t bench_random(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717u;
+}
+
+
+static char *bench_string(senml_arena_t *arena, const char *prefix, unsigned int number, size_t len)
+{
+	char   digits[16];
+	size_t prefix_len = strlen(prefix);
+	size_t n          = (size_t)snprintf(digits, sizeof(digits), "%u", number);
+	char  *s;
+	
+	if (len < n)
+		len = n;
+	
+	if (!(s = senml_arena_alloc(arena, prefix_len + len + 1)))
+		return NULL;
+	
+	memcpy(s, prefix, prefix_len);
+	
+	for (size_t i = 0; i < len - n; i++)
+		s[prefix_len + i] = (char)('a' + (number + i) % 26);
+	
+	memcpy(s + prefix_len + len - n, digits, n);
+	s[prefix_len + len] = '\0';
+	
+	return s;
+}
+
+
+static senml_pack_t *bench_generate(const bench_config_t *config)
+{
+	static const char *units[] = { "Cel", "%RH", "W", "V" };
+	const char        *base_name = "urn:dev:mac:0024befffe804ff1:";
+	double             base_time = 1700000000.0;
+	uint64_t           state     = 88172645463325252u;
+	senml_pack_t      *pack      = senml_arena_new_pack(config->records * (sizeof(senml_record_t) +
+	                                                                         config->name_len * 2));
+	
+	if (!pack || !(pack->records = senml_arena_alloc(pack->arena,
+	                                                 sizeof(senml_record_t) * config->records + 1)))
+		goto error;
+	
+	if (config->base) {
+		if (!(pack->base_info = senml_arena_alloc(pack->arena, sizeof(senml_base_info_t))))
+			goto error;
+		
+		memset(pack->base_info, 0, sizeof(senml_base_info_t));
+		pack->base_info->base_name = (char *)base_name;
+		pack->base_info->base_time = base_time;
+		pack->base_info->base_unit = (char *)units[0];
+	}
+	
+	for (size_t i = 0; i < config->records; i++) {
+		senml_record_t *record = &pack->records[i];
+		unsigned int    kind   = (unsigned int)(bench_random(&state) % 100);
+		
+		memset(record, 0, sizeof(senml_record_t));
+		record->name_id = SENML_NO_ID;
+		
+		// a handful of sensors reporting in turn, like a gateway would forward them
+		if (!(record->name = bench_string(pack->arena, config->base ? "" : base_name,
+		                                  (unsigned int)(i % 16), config->name_len)))
+			goto error;
+		
+		record->time = (config->base ? 0 : base_time) + (double)i * 0.25;
+		
+		if (!config->base || i % 8 == 7)
+			record->unit = (char *)units[i % 8 == 7 ? 1 + i / 8 % 3 : 0];
+		
+		if (kind < config->floats) {
+			record->value_type    = SENML_TYPE_FLOAT;
+			record->value.value_f = 20.0 + (double)(bench_random(&state) % 100000) / 1000.0;
+		} else if (kind < config->floats + config->strings) {
+			record->value_type = SENML_TYPE_STRING;
+			
+			if (!(record->value.value_s = bench_string(pack->arena, "", (unsigned int)i,
+			                                           config->string_len)))
+				goto error;
+		} else {
+			record->value_type    = SENML_TYPE_BOOL;
+			record->value.value_b = bench_random(&state) & 1;
+		}
+		
+		pack->num++;
+	}
+	
+	return pack;
+	
+	error:
+	senml_pack_free(pack);
+	return NULL;
+}
+
+
+static int bench_json_input(bench_ctx_t *ctx)
+{
+	ctx->bytes = ctx->json_len;
+	return 0;
+}
+
+
+static int bench_cbor_input(bench_ctx_t *ctx)
+{
+	ctx->bytes = ctx->cbor_len;
+	return 0;
+}
+
+
+/*! The stats cases run the plain ones with the counters on, to show what they cost */
+static int bench_setup_stats(bench_ctx_t *ctx)
+{
+	senml_stats_enable(SENML_STATS_COUNTERS);
+	return bench_json_input(ctx);
+}
+
+
+static int bench_setup_timing(bench_ctx_t *ctx)
+{
+	senml_stats_enable(SENML_STATS_TIMING);
+	return bench_json_input(ctx);
+}
+
+
+static int bench_decode_json(bench_ctx_t *ctx)
+{
+	senml_pack_t *pack = senml_decode_json(ctx->json, ctx->json_len);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_validate_json(bench_ctx_t *ctx)
+{
+	senml_json_info_t info;
+	
+	if (senml_validate_json(ctx->json, ctx->json_len, &info))
+		return -1;
+	
+	ctx->sink += info.records;
+	return 0;
+}
+
+
+static int bench_decode_json_zero_copy(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_ZERO_COPY };
+	senml_pack_t       *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_decode_json_presize(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_PRESIZE };
+	senml_pack_t       *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_setup_reuse(bench_ctx_t *ctx)
+{
+	if (!(ctx->reused = senml_decode_json(ctx->json, ctx->json_len)))
+		return -1;
+	
+	return bench_json_input(ctx);
+}
+
+
+static int bench_decode_json_reuse(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_ZERO_COPY, .pack = ctx->reused };
+	
+	return senml_decode_json_ex(ctx->json, ctx->json_len, &opts) ? 0 : -1;
+}
+
+
+static int bench_decode_json_jansson(bench_ctx_t *ctx)
+{
+	senml_pack_t *pack = senml_decode_json_jansson(ctx->json, ctx->json_len);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_count_record(const senml_record_t *record, const senml_base_info_t *base_info,
+                              void *ctx)
+{
+	(void)base_info;
+	((bench_ctx_t *)ctx)->sink += record->name_view.len;
+	return 0;
+}
+
+
+static int bench_decode_json_each(bench_ctx_t *ctx)
+{
+	return senml_decode_json_each(ctx->json, ctx->json_len, bench_count_record, ctx);
+}
+
+
+static int bench_parser_feed(bench_ctx_t *ctx)
+{
+	senml_parser_t *parser = senml_parser_new(bench_count_record, ctx);
+	int             rc     = parser ? 0 : -2;
+	
+	// one TCP segment at a time
+	for (size_t offset = 0; rc == 0 && offset < ctx->json_len; offset += 1460) {
+		size_t len = ctx->json_len - offset < 1460 ? ctx->json_len - offset : 1460;
+		
+		rc = senml_parser_feed(parser, ctx->json + offset, len);
+	}
+	
+	if (parser && senml_parser_finish(parser))
+		rc = -1;
+	
+	return rc;
+}
+
+
+static int bench_decode_json_columns(bench_ctx_t *ctx)
+{
+	senml_columns_t *columns = senml_decode_json_columns(ctx->json, ctx->json_len);
+	
+	senml_columns_free(columns);
+	return columns ? 0 : -1;
+}
+
+
+static int bench_setup_names(bench_ctx_t *ctx)
+{
+	if (!(ctx->names = senml_names_new()))
+		return -1;
+	
+	return bench_json_input(ctx);
+}
+
+
+static int bench_decode_json_names(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .names = ctx->names };
+	senml_pack_t       *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+/*! The selective cases want a single sensor out of the 16 of every pack */
+static int bench_setup_filter(bench_ctx_t *ctx)
+{
+	const senml_base_info_t *base_info = ctx->pack->base_info;
+	const char              *name      = ctx->pack->records[0].name;
+	char                     resolved[256];
+	const char              *names[]   = { resolved };
+	
+	snprintf(resolved, sizeof(resolved), "%s%s", base_info ? base_info->base_name : "", name);
+	
+	if (!(ctx->filter = senml_filter_names(names, 1)))
+		return -1;
+	
+	return 0;
+}
+
+
+static int bench_setup_filter_json(bench_ctx_t *ctx)
+{
+	return bench_setup_filter(ctx) || bench_json_input(ctx);
+}
+
+
+static int bench_setup_filter_cbor(bench_ctx_t *ctx)
+{
+	return bench_setup_filter(ctx) || bench_cbor_input(ctx);
+}
+
+
+static int bench_decode_json_fields(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .fields = SENML_FIELD_TIME | SENML_FIELD_VALUE };
+	senml_pack_t       *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_decode_json_filter(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = {
+		.fields = SENML_FIELD_TIME | SENML_FIELD_VALUE,
+		.filter = ctx->filter
+	};
+	senml_pack_t *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_decode_cbor(bench_ctx_t *ctx)
+{
+	senml_pack_t *pack = senml_decode_cbor(ctx->cbor, ctx->cbor_len);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_decode_cbor_filter(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = {
+		.fields = SENML_FIELD_TIME | SENML_FIELD_VALUE,
+		.filter = ctx->filter
+	};
+	senml_pack_t *pack = senml_decode_cbor_ex(ctx->cbor, ctx->cbor_len, &opts);
+	
+	senml_pack_free(pack);
+	return pack ? 0 : -1;
+}
+
+
+static int bench_decode_cbor_each(bench_ctx_t *ctx)
+{
+	return senml_decode_cbor_each(ctx->cbor, ctx->cbor_len, bench_count_record, ctx);
+}
+
+
+static int bench_decode_cbor_columns(bench_ctx_t *ctx)
+{
+	senml_columns_t *columns = senml_decode_cbor_columns(ctx->cbor, ctx->cbor_len);
+	
+	senml_columns_free(columns);
+	return columns ? 0 : -1;
+}
+
+
+static int bench_setup_flat(bench_ctx_t *ctx)
+{
+	if (!(ctx->flat = senml_encode_flat(ctx->pack, &ctx->flat_len)))
+		return -1;
+	
+	ctx->bytes = ctx->flat_len;
+	return 0;
+}
+
+
+/*! Opening a flat pack is all there is to loading it */
+static int bench_flat_open(bench_ctx_t *ctx)
+{
+	senml_flat_t flat;
+	
+	if (senml_flat_open(ctx->flat, ctx->flat_len, &flat))
+		return -1;
+	
+	ctx->sink += flat.num;
+	return 0;
+}
+
+
+/*! Reads every record, to compare with decoding a pack and walking it */
+static int bench_flat_read(bench_ctx_t *ctx)
+{
+	senml_flat_t   flat;
+	senml_record_t record;
+	
+	if (senml_flat_open(ctx->flat, ctx->flat_len, &flat))
+		return -1;
+	
+	for (size_t i = 0; i < flat.num; i++) {
+		senml_flat_record(&flat, i, &record);
+		ctx->sink += record.name_view.len + (size_t)record.value_type;
+	}
+	
+	return 0;
+}
+
+
+/*! The templates write every time and value, so their documents differ in size from the others */
+static int bench_setup_template(bench_ctx_t *ctx, senml_template_t *tmpl)
+{
+	if (!(ctx->tmpl = tmpl) || !senml_template_encode(tmpl, ctx->pack, &ctx->bytes))
+		return -1;
+	
+	return 0;
+}
+
+
+static int bench_setup_template_json(bench_ctx_t *ctx)
+{
+	return bench_setup_template(ctx, senml_template_json(ctx->pack, 0));
+}
+
+
+static int bench_setup_template_cbor(bench_ctx_t *ctx)
+{
+	return bench_setup_template(ctx, senml_template_cbor(ctx->pack, 0));
+}
+
+
+/*! Encodes the pack with the template it was compiled into, to compare with the full encoders */
+static int bench_encode_template(bench_ctx_t *ctx)
+{
+	size_t len;
+	
+	if (!senml_template_encode(ctx->tmpl, ctx->pack, &len))
+		return -1;
+	
+	ctx->sink += len;
+	return 0;
+}
+
+
+static int bench_encode_flat(bench_ctx_t *ctx)
+{
+	size_t         len;
+	unsigned char *flat = senml_encode_flat(ctx->pack, &len);
+	
+	senml_free(flat);
+	return flat ? 0 : -1;
+}
+
+
+static int bench_encode_json(bench_ctx_t *ctx)
+{
+	char *json = senml_encode_json(ctx->pack);
+	
+	senml_free(json);
+	return json ? 0 : -1;
+}
+
+
+static int bench_setup_buf(bench_ctx_t *ctx)
+{
+	// room for the longer document and the terminator of the JSON one
+	ctx->buf_len = (ctx->json_len > ctx->cbor_len ? ctx->json_len : ctx->cbor_len) + 1;
+	
+	if (!(ctx->buf = malloc(ctx->buf_len)))
+		return -1;
+	
+	return 0;
+}
+
+
+static int bench_setup_encode_json_s(bench_ctx_t *ctx)
+{
+	return bench_setup_buf(ctx) || bench_json_input(ctx);
+}
+
+
+static int bench_encode_json_s(bench_ctx_t *ctx)
+{
+	return senml_encode_json_s(ctx->pack, ctx->buf, ctx->buf_len);
+}
+
+
+static int bench_setup_encode_json_compact(bench_ctx_t *ctx)
+{
+	senml_encode_opts_t opts = { .flags = SENML_ENCODE_COMPACT };
+	char               *json = senml_encode_json_ex(ctx->pack, &opts);
+	
+	if (!json)
+		return -1;
+	
+	ctx->bytes = strlen(json);
+	senml_free(json);
+	return 0;
+}
+
+
+static int bench_encode_json_compact(bench_ctx_t *ctx)
+{
+	senml_encode_opts_t opts = { .flags = SENML_ENCODE_COMPACT };
+	char               *json = senml_encode_json_ex(ctx->pack, &opts);
+	
+	senml_free(json);
+	return json ? 0 : -1;
+}
+
+
+static int bench_encode_cbor(bench_ctx_t *ctx)
+{
+	size_t         len;
+	unsigned char *cbor = senml_encode_cbor(ctx->pack, &len);
+	
+	senml_free(cbor);
+	return cbor ? 0 : -1;
+}
+
+
+#ifdef BENCH_LIBCBOR
+static inline cbor_item_t *bench_libcbor_negint(int8_t value)
+{
+	cbor_item_t *item = cbor_new_int8();
+	
+	cbor_mark_negint(item);
+	cbor_set_uint8(item, (uint8_t)(-1 * value - 1));
+	return item;
+}
+
+
+static inline void bench_libcbor_add(cbor_item_t *map, cbor_item_t *key, cbor_item_t *value)
+{
+	cbor_map_add(map, (struct cbor_pair){ .key = key, .value = value });
+	cbor_decref(&key);
+	cbor_decref(&value);
+}
+
+
+/**
+ * The encoder senml_encode_cbor replaced, which builds a libcbor item for every key and value
+ * and serializes the tree. Unlike the original, it keys boolean values with SC_BOOL_VALUE and
+ * does not leak the keys and values it adds to a map.
+ * @return The document, to be released with free(3) since libcbor does not use the hooks.
+ */
+static unsigned char *bench_libcbor_encode(const senml_pack_t *pack, size_t *len)
+{
+	cbor_item_t   *array = cbor_new_indefinite_array();
+	senml_str_t    str;
+	unsigned char *result;
+	size_t         buf_size;
+	
+	if (pack->base_info) {
+		cbor_item_t *map = cbor_new_indefinite_map();
+		
+		if (pack->base_info->version)
+			bench_libcbor_add(map, bench_libcbor_negint(SC_VERSION),
+			                  cbor_build_uint8(pack->base_info->version));
+		
+		if ((str = senml_str_of(pack->base_info->base_name, &pack->base_info->base_name_view)).p)
+			bench_libcbor_add(map, bench_libcbor_negint(SC_BASE_NAME),
+			                  cbor_build_stringn(str.p, str.len));
+		
+		if (pack->base_info->base_time > 0)
+			bench_libcbor_add(map, bench_libcbor_negint(SC_BASE_TIME),
+			                  cbor_build_float4((float)pack->base_info->base_time));
+		
+		if ((str = senml_str_of(pack->base_info->base_unit, &pack->base_info->base_unit_view)).p)
+			bench_libcbor_add(map, bench_libcbor_negint(SC_BASE_UNIT),
+			                  cbor_build_stringn(str.p, str.len));
+		
+		cbor_array_push(array, map);
+		cbor_decref(&map);
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		cbor_item_t          *map    = cbor_new_indefinite_map();
+		
+		if ((str = senml_str_of(record->name, &record->name_view)).p)
+			bench_libcbor_add(map, cbor_build_uint8(SC_NAME), cbor_build_stringn(str.p, str.len));
+		
+		if ((str = senml_str_of(record->unit, &record->unit_view)).p)
+			bench_libcbor_add(map, cbor_build_uint8(SC_UNIT), cbor_build_stringn(str.p, str.len));
+		
+		if (record->time != 0)
+			bench_libcbor_add(map, cbor_build_uint8(SC_TIME), cbor_build_float8(record->time));
+		
+		if (record->update_time != 0)
+			bench_libcbor_add(map, cbor_build_uint8(SC_UPDATE_TIME),
+			                  cbor_build_uint32(record->update_time));
+		
+		if (record->value_type == SENML_TYPE_FLOAT) {
+			bench_libcbor_add(map, cbor_build_uint8(SC_VALUE),
+			                  cbor_build_float8(record->value.value_f));
+		} else if (record->value_type == SENML_TYPE_STRING) {
+			str = senml_str_of(record->value.value_s, &record->value_view);
+			bench_libcbor_add(map, cbor_build_uint8(SC_STRING_VALUE),
+			                  cbor_build_stringn(str.p, str.len));
+		} else if (record->value_type == SENML_TYPE_BOOL) {
+			bench_libcbor_add(map, cbor_build_uint8(SC_BOOL_VALUE),
+			                  cbor_build_bool(record->value.value_b));
+		}
+		
+		cbor_array_push(array, map);
+		cbor_decref(&map);
+	}
+	
+	*len = cbor_serialize_alloc(array, &result, &buf_size);
+	cbor_decref(&array);
+	
+	return *len ? result : NULL;
+}
+
+
+static int bench_setup_encode_cbor_libcbor(bench_ctx_t *ctx)
+{
+	unsigned char *cbor = bench_libcbor_encode(ctx->pack, &ctx->bytes);
+	
+	free(cbor);
+	return cbor ? 0 : -1;
+}
+
+
+static int bench_encode_cbor_libcbor(bench_ctx_t *ctx)
+{
+	size_t         len;
+	unsigned char *cbor = bench_libcbor_encode(ctx->pack, &len);
+	
+	free(cbor);
+	return cbor ? 0 : -1;
+}
+#endif
+
+
+static int bench_setup_encode_cbor_s(bench_ctx_t *ctx)
+{
+	return bench_setup_buf(ctx) || bench_cbor_input(ctx);
+}
+
+
+static int bench_encode_cbor_s(bench_ctx_t *ctx)
+{
+	size_t len = ctx->buf_len;
+	
+	return senml_encode_cbor_s(ctx->pack, (unsigned char *)ctx->buf, &len);
+}
+
+
+static int bench_setup_encode_cbor_compact(bench_ctx_t *ctx)
+{
+	senml_encode_opts_t opts = { .flags = SENML_ENCODE_COMPACT };
+	unsigned char      *cbor = senml_encode_cbor_ex(ctx->pack, &ctx->bytes, &opts);
+	
+	senml_free(cbor);
+	return cbor ? 0 : -1;
+}
+
+
+static int bench_encode_cbor_compact(bench_ctx_t *ctx)
+{
+	senml_encode_opts_t opts = { .flags = SENML_ENCODE_COMPACT };
+	size_t              len;
+	unsigned char      *cbor = senml_encode_cbor_ex(ctx->pack, &len, &opts);
+	
+	senml_free(cbor);
+	return cbor ? 0 : -1;
+}
+
+
+static int bench_json_to_cbor(bench_ctx_t *ctx)
+{
+	size_t         len;
+	unsigned char *cbor = senml_transcode_json_to_cbor(ctx->json, ctx->json_len, &len);
+	
+	senml_free(cbor);
+	return cbor ? 0 : -1;
+}
+
+
+/*! What a gateway did before the transcoders, for comparison */
+static int bench_json_to_cbor_pack(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_ZERO_COPY };
+	senml_pack_t       *pack = senml_decode_json_ex(ctx->json, ctx->json_len, &opts);
+	size_t              len;
+	unsigned char      *cbor = pack ? senml_encode_cbor(pack, &len) : NULL;
+	
+	senml_free(cbor);
+	senml_pack_free(pack);
+	return cbor ? 0 : -1;
+}
+
+
+static int bench_cbor_to_json(bench_ctx_t *ctx)
+{
+	char *json = senml_transcode_cbor_to_json(ctx->cbor, ctx->cbor_len);
+	
+	senml_free(json);
+	return json ? 0 : -1;
+}
+
+
+static int bench_cbor_to_json_pack(bench_ctx_t *ctx)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_ZERO_COPY };
+	senml_pack_t       *pack = senml_decode_cbor_ex(ctx->cbor, ctx->cbor_len, &opts);
+	char               *json = pack ? senml_encode_json(pack) : NULL;
+	
+	senml_free(json);
+	senml_pack_free(pack);
+	return json ? 0 : -1;
+}
+
+
+static int bench_setup_columns(bench_ctx_t *ctx)
+{
+	if (!(ctx->columns = senml_columns_from_pack(ctx->pack)) ||
+	    !(ctx->results = malloc(sizeof(senml_aggregate_t) * (ctx->columns->num_strings + 64))))
+		return -1;
+	
+	ctx->bytes = 0;
+	return 0;
+}
+
+
+static int bench_aggregate(bench_ctx_t *ctx)
+{
+	senml_aggregate(ctx->columns, ctx->results);
+	return 0;
+}
+
+
+static int bench_aggregate_by_name(bench_ctx_t *ctx)
+{
+	senml_aggregate_by_name(ctx->columns, ctx->results);
+	return 0;
+}
+
+
+static int bench_aggregate_windows(bench_ctx_t *ctx)
+{
+	// 64 windows cover all records, their resolved times start there and are 0.25 s apart
+	return senml_aggregate_windows(ctx->columns, 1700000000.0,
+	                               (double)ctx->config->records / 256 + 0.25, ctx->results, 64);
+}
+
+
+static int bench_setup_batch(bench_ctx_t *ctx)
+{
+	if (!(ctx->inputs = malloc(sizeof(char *) * BENCH_BATCH_DOCS)) ||
+	    !(ctx->packs = calloc(BENCH_BATCH_DOCS, sizeof(senml_pack_t *))) ||
+	    !(ctx->outputs = calloc(BENCH_BATCH_DOCS, sizeof(char *))) ||
+	    (ctx->threads > 0 && !(ctx->pool = senml_pool_new(ctx->threads))))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_BATCH_DOCS; i++)
+		ctx->inputs[i] = ctx->json;
+	
+	ctx->bytes   = ctx->json_len * BENCH_BATCH_DOCS;
+	ctx->records = ctx->config->records * BENCH_BATCH_DOCS;
+	return 0;
+}
+
+
+static int bench_setup_encode_batch(bench_ctx_t *ctx)
+{
+	if (bench_setup_batch(ctx))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_BATCH_DOCS; i++)
+		ctx->packs[i] = ctx->pack;
+	
+	return 0;
+}
+
+
+static int bench_decode_json_batch(bench_ctx_t *ctx)
+{
+	int rc = senml_decode_json_batch(ctx->pool, ctx->inputs, NULL, BENCH_BATCH_DOCS, ctx->packs);
+	
+	for (size_t i = 0; i < BENCH_BATCH_DOCS; i++)
+		senml_pack_free(ctx->packs[i]);
+	
+	return rc;
+}
+
+
+static int bench_encode_json_batch(bench_ctx_t *ctx)
+{
+	int rc = senml_encode_json_batch(ctx->pool, (const senml_pack_t *const *)ctx->packs,
+	                                 BENCH_BATCH_DOCS, ctx->outputs);
+	
+	for (size_t i = 0; i < BENCH_BATCH_DOCS; i++)
+		senml_free(ctx->outputs[i]);
+	
+	return rc;
+}
+
+
+static int bench_setup_numbers(bench_ctx_t *ctx)
+{
+	uint64_t state = 2463534242u;
+	char    *p;
+	
+	if (!(ctx->doubles = malloc(sizeof(double) * BENCH_DOUBLES)) ||
+	    !(p = ctx->numbers = malloc((SENML_DOUBLE_MAX_LEN + 1) * BENCH_DOUBLES)))
+		return -1;
+	
+	// measurements with a few decimals, the common case in SenML
+	for (size_t i = 0; i < BENCH_DOUBLES; i++) {
+		ctx->doubles[i] = (double)(int64_t)(bench_random(&state) % 2000000 - 1000000) / 1000.0;
+		p += senml_double_format(ctx->doubles[i], p);
+		*p++ = '\0';
+	}
+	
+	ctx->bytes   = (size_t)(p - ctx->numbers);
+	ctx->records = BENCH_DOUBLES;
+	return 0;
+}
+
+
+static int bench_double_format(bench_ctx_t *ctx)
+{
+	char buf[SENML_DOUBLE_MAX_LEN];
+	
+	for (size_t i = 0; i < BENCH_DOUBLES; i++)
+		ctx->sink += senml_double_format(ctx->doubles[i], buf);
+	
+	return 0;
+}
+
+
+static int bench_double_format_snprintf(bench_ctx_t *ctx)
+{
+	char buf[SENML_DOUBLE_MAX_LEN];
+	
+	for (size_t i = 0; i < BENCH_DOUBLES; i++)
+		ctx->sink += (size_t)snprintf(buf, sizeof(buf), "%.17g", ctx->doubles[i]);
+	
+	return 0;
+}
+
+
+static int bench_double_parse(bench_ctx_t *ctx)
+{
+	const char *p = ctx->numbers;
+	double      value;
+	
+	for (size_t i = 0; i < BENCH_DOUBLES; i++) {
+		size_t len = strlen(p);
+		
+		senml_double_parse(p, p + len, &value);
+		
+		ctx->sink += (size_t)value;
+		p         += len + 1;
+	}
+	
+	return 0;
+}
+
+
+static int bench_double_parse_strtod(bench_ctx_t *ctx)
+{
+	const char *p = ctx->numbers;
+	
+	for (size_t i = 0; i < BENCH_DOUBLES; i++) {
+		ctx->sink += (size_t)strtod(p, NULL);
+		p         += strlen(p) + 1;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Generates the samples of a sensor read every 10 seconds, a few milliseconds late now and then,
+ * whose value wanders by hundredths. The times are in doubles, the values behind them.
+ */
+static int bench_setup_samples(bench_ctx_t *ctx)
+{
+	uint64_t state = 2463534242u;
+	double   time  = 1700000000.0;
+	double   value = 21.5;
+	
+	if (!(ctx->doubles = malloc(sizeof(double) * 2 * BENCH_SAMPLES)))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		time  += 10.0;
+		value += (double)((int64_t)(bench_random(&state) % 5) - 2) / 100.0;
+		
+		ctx->doubles[i]                 = bench_random(&state) % 20 == 0 ?
+		                                  time + (double)(bench_random(&state) % 50) / 1000.0 : time;
+		ctx->doubles[BENCH_SAMPLES + i] = round(value * 100.0) / 100.0;
+	}
+	
+	ctx->records = BENCH_SAMPLES;
+	return 0;
+}
+
+
+static int bench_setup_series(bench_ctx_t *ctx)
+{
+	if (bench_setup_samples(ctx) || !(ctx->series = senml_series_new("sensor/temp", "Cel")))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		if (senml_series_append(ctx->series, ctx->doubles[i], ctx->doubles[BENCH_SAMPLES + i]))
+			return -1;
+	}
+	
+	ctx->bytes = senml_series_size(ctx->series);
+	return 0;
+}
+
+
+static int bench_series_append(bench_ctx_t *ctx)
+{
+	senml_series_t *series = senml_series_new("sensor/temp", "Cel");
+	int             rc     = series ? 0 : -1;
+	
+	for (size_t i = 0; rc == 0 && i < BENCH_SAMPLES; i++)
+		rc = senml_series_append(series, ctx->doubles[i], ctx->doubles[BENCH_SAMPLES + i]);
+	
+	if (series)
+		ctx->sink += senml_series_size(series);
+	
+	senml_series_free(series);
+	return rc;
+}
+
+
+static int bench_series_decode(bench_ctx_t *ctx)
+{
+	double times[256];
+	double values[256];
+	
+	for (size_t i = 0; i < BENCH_SAMPLES; i += 256)
+		ctx->sink += senml_series_decode(ctx->series, i, times, values, 256);
+	
+	return 0;
+}
+
+
+/*! One seek per sample, each followed by a read, in the order of their times */
+static int bench_series_seek(bench_ctx_t *ctx)
+{
+	senml_series_iter_t iter;
+	double              time, value;
+	
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		senml_series_seek(ctx->series, ctx->doubles[i], &iter);
+		
+		if (!senml_series_next(&iter, &time, &value))
+			return -1;
+		
+		ctx->sink += (size_t)value;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Spreads the samples over a few sensors that report in turn, as one pack.
+ */
+static int bench_setup_store_pack(bench_ctx_t *ctx)
+{
+	senml_pack_t *pack;
+	
+	if (bench_setup_samples(ctx) ||
+	    !(pack = ctx->pack = senml_arena_new_pack(sizeof(senml_record_t) * BENCH_SAMPLES)) ||
+	    !(pack->records = senml_arena_alloc(pack->arena, sizeof(senml_record_t) * BENCH_SAMPLES)))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		senml_record_t *record = &pack->records[i];
+		
+		memset(record, 0, sizeof(senml_record_t));
+		record->name_id       = SENML_NO_ID;
+		record->value_type    = SENML_TYPE_FLOAT;
+		record->time          = ctx->doubles[i];
+		record->value.value_f = ctx->doubles[BENCH_SAMPLES + i];
+		
+		if (!(record->name = bench_string(pack->arena, "sensor/", (unsigned int)(i % BENCH_SENSORS),
+		                                  0)))
+			return -1;
+		
+		pack->num++;
+	}
+	
+	ctx->bytes = sizeof(double) * 2 * BENCH_SAMPLES;
+	return 0;
+}
+
+
+static int bench_setup_store(bench_ctx_t *ctx)
+{
+	if (bench_setup_store_pack(ctx) || !(ctx->store = senml_store_new(NULL)) ||
+	    senml_store_add(ctx->store, ctx->pack))
+		return -1;
+	
+	ctx->bytes   = senml_store_size(ctx->store);
+	ctx->records = BENCH_QUERIES;
+	return 0;
+}
+
+
+static int bench_store_add(bench_ctx_t *ctx)
+{
+	senml_store_t *store = senml_store_new(NULL);
+	int            rc    = store ? senml_store_add(store, ctx->pack) : -1;
+	
+	senml_store_free(store);
+	return rc;
+}
+
+
+static int bench_count_samples(const double *times, const double *values, size_t count, void *ctx)
+{
+	(void)times;
+	(void)values;
+	*(size_t *)ctx += count;
+	return 0;
+}
+
+
+/*! Ten minutes of one sensor, starting at the time of a sample */
+static int bench_store_range(bench_ctx_t *ctx)
+{
+	char name[16];
+	
+	for (size_t i = 0; i < BENCH_QUERIES; i++) {
+		size_t sample = i * (BENCH_SAMPLES / BENCH_QUERIES);
+		
+		snprintf(name, sizeof(name), "sensor/%zu", sample % BENCH_SENSORS);
+		
+		if (senml_store_range(ctx->store, name, ctx->doubles[sample], ctx->doubles[sample] + 600,
+		                      bench_count_samples, &ctx->sink))
+			return -1;
+	}
+	
+	return 0;
+}
+
+
+static int bench_store_latest(bench_ctx_t *ctx)
+{
+	char   name[16];
+	double time, value;
+	
+	for (size_t i = 0; i < BENCH_QUERIES; i++) {
+		snprintf(name, sizeof(name), "sensor/%zu", i % BENCH_SENSORS);
+		
+		if (!senml_store_latest(ctx->store, name, &time, &value))
+			return -1;
+		
+		ctx->sink += (size_t)value;
+	}
+	
+	return 0;
+}
+
+
+static const bench_case_t bench_cases[] = {
+	{ "validate_json",          bench_json_input,                bench_validate_json },
+	{ "decode_json",            bench_json_input,                bench_decode_json },
+	{ "decode_json_zero_copy",  bench_json_input,                bench_decode_json_zero_copy },
+	{ "decode_json_presize",    bench_json_input,                bench_decode_json_presize },
+	{ "decode_json_reuse",      bench_setup_reuse,               bench_decode_json_reuse },
+	{ "decode_json_jansson",    bench_json_input,                bench_decode_json_jansson },
+	{ "decode_json_each",       bench_json_input,                bench_decode_json_each },
+	{ "decode_json_columns",    bench_json_input,                bench_decode_json_columns },
+	{ "decode_json_names",      bench_setup_names,               bench_decode_json_names },
+	{ "decode_json_fields",     bench_json_input,                bench_decode_json_fields },
+	{ "decode_json_filter",     bench_setup_filter_json,         bench_decode_json_filter },
+	{ "decode_json_stats",      bench_setup_stats,               bench_decode_json },
+	{ "decode_json_timing",     bench_setup_timing,              bench_decode_json },
+	{ "decode_json_each_stats", bench_setup_stats,               bench_decode_json_each },
+	{ "parser_feed",            bench_json_input,                bench_parser_feed },
+	{ "decode_cbor",            bench_cbor_input,                bench_decode_cbor },
+	{ "decode_cbor_filter",     bench_setup_filter_cbor,         bench_decode_cbor_filter },
+	{ "decode_cbor_each",       bench_cbor_input,                bench_decode_cbor_each },
+	{ "decode_cbor_columns",    bench_cbor_input,                bench_decode_cbor_columns },
+	{ "flat_open",              bench_setup_flat,                bench_flat_open },
+	{ "flat_read",              bench_setup_flat,                bench_flat_read },
+	{ "encode_json",            bench_json_input,                bench_encode_json },
+	{ "encode_json_s",          bench_setup_encode_json_s,       bench_encode_json_s },
+	{ "encode_json_compact",    bench_setup_encode_json_compact, bench_encode_json_compact },
+	{ "encode_json_stats",      bench_setup_stats,               bench_encode_json },
+	{ "encode_json_timing",     bench_setup_timing,              bench_encode_json },
+	{ "encode_cbor",            bench_cbor_input,                bench_encode_cbor },
+	{ "encode_cbor_s",          bench_setup_encode_cbor_s,       bench_encode_cbor_s },
+	{ "encode_cbor_compact",    bench_setup_encode_cbor_compact, bench_encode_cbor_compact },
+#ifdef BENCH_LIBCBOR
+	{ "encode_cbor_libcbor",    bench_setup_encode_cbor_libcbor, bench_encode_cbor_libcbor },
+#endif
+	{ "encode_flat",            bench_setup_flat,                bench_encode_flat },
+	{ "encode_template_json",   bench_setup_template_json,       bench_encode_template },
+	{ "encode_template_cbor",   bench_setup_template_cbor,       bench_encode_template },
+	{ "json_to_cbor",           bench_json_input,                bench_json_to_cbor },
+	{ "json_to_cbor_pack",      bench_json_input,                bench_json_to_cbor_pack },
+	{ "cbor_to_json",           bench_cbor_input,                bench_cbor_to_json },
+	{ "cbor_to_json_pack",      bench_cbor_input,                bench_cbor_to_json_pack },
+	{ "aggregate",              bench_setup_columns,             bench_aggregate },
+	{ "aggregate_by_name",      bench_setup_columns,             bench_aggregate_by_name },
+	{ "aggregate_windows",      bench_setup_columns,             bench_aggregate_windows },
+};
+
+
+static int bench_write(int fd, const char *p, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		
+		if (n <= 0)
+			return -1;
+		
+		p   += n;
+		len -= (size_t)n;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Writes copies of the pack to a file, either as one big pack or as one pack per line.
+ */
+static int bench_setup_file(bench_ctx_t *ctx, bool lines)
+{
+	char name[] = "/tmp/senml_bench_XXXXXX";
+	int  fd     = mkstemp(name);
+	
+	// the file disappears with the process but stays reachable through the descriptor
+	if (fd < 0 || unlink(name))
+		return -1;
+	
+	snprintf(ctx->file, sizeof(ctx->file), "/dev/fd/%d", fd);
+	
+	if (!lines && bench_write(fd, "[", 1))
+		return -1;
+	
+	for (size_t i = 0; i < BENCH_FILE_COPIES; i++) {
+		if (lines && (bench_write(fd, ctx->json, ctx->json_len) || bench_write(fd, "\n", 1)))
+			return -1;
+		
+		// the records of every copy without the brackets
+		if (!lines && ((i > 0 && bench_write(fd, ",", 1)) ||
+		               bench_write(fd, ctx->json + 1, ctx->json_len - 2)))
+			return -1;
+	}
+	
+	if (!lines && bench_write(fd, "]", 1))
+		return -1;
+	
+	if (ctx->threads > 0 && !(ctx->pool = senml_pool_new(ctx->threads)))
+		return -1;
+	
+	ctx->bytes   = (size_t)lseek(fd, 0, SEEK_END);
+	ctx->records = ctx->config->records * BENCH_FILE_COPIES;
+	return 0;
+}
+
+
+static int bench_setup_file_array(bench_ctx_t *ctx)
+{
+	return bench_setup_file(ctx, false);
+}
+
+
+static int bench_setup_file_lines(bench_ctx_t *ctx)
+{
+	return bench_setup_file(ctx, true);
+}
+
+
+static int bench_count_pack(const senml_pack_t *pack, size_t offset, void *ctx)
+{
+	(void)offset;
+	__atomic_add_fetch(&((bench_ctx_t *)ctx)->sink, pack->num, __ATOMIC_RELAXED);
+	return 0;
+}
+
+
+static int bench_decode_file(bench_ctx_t *ctx)
+{
+	return senml_decode_file(ctx->pool, ctx->file, 0, bench_count_pack, ctx);
+}
+
+
+static int bench_decode_file_lines(bench_ctx_t *ctx)
+{
+	return senml_decode_file(ctx->pool, ctx->file, SENML_FILE_LINES, bench_count_pack, ctx);
+}
+
+
+/*! Cases that scale with the number of threads, run with 1, 2, 4, ... threads */
+static const bench_case_t bench_scaling_cases[] = {
+	{ "decode_json_batch", bench_setup_batch,        bench_decode_json_batch },
+	{ "encode_json_batch", bench_setup_encode_batch, bench_encode_json_batch },
+	{ "decode_file",       bench_setup_file_array,   bench_decode_file },
+	{ "decode_file_lines", bench_setup_file_lines,   bench_decode_file_lines },
+};
+
+
+/*! Cases that do not depend on the configuration */
+static const bench_case_t bench_number_cases[] = {
+	{ "double_format",          bench_setup_numbers,    bench_double_format },
+	{ "double_format_snprintf", bench_setup_numbers,    bench_double_format_snprintf },
+	{ "double_parse",           bench_setup_numbers,    bench_double_parse },
+	{ "double_parse_strtod",    bench_setup_numbers,    bench_double_parse_strtod },
+	{ "series_append",          bench_setup_series,     bench_series_append },
+	{ "series_decode",          bench_setup_series,     bench_series_decode },
+	{ "series_seek",            bench_setup_series,     bench_series_seek },
+	{ "store_add",              bench_setup_store_pack, bench_store_add },
+	{ "store_range",            bench_setup_store,      bench_store_range },
+	{ "store_latest",           bench_setup_store,      bench_store_latest },
+};
+
+
+/*! The baseline first, then one dimension changed at a time */
+static const bench_config_t bench_configs[] = {
+	{ "baseline",      1000,   16, 16, 100, 0,   false, true },
+	{ "records_10",    10,     16, 16, 100, 0,   false, false },
+	{ "records_100k",  100000, 16, 16, 100, 0,   false, false },
+	{ "names_4",       1000,   4,  16, 100, 0,   false, false },
+	{ "names_64",      1000,   64, 16, 100, 0,   false, false },
+	{ "mixed_values",  1000,   16, 16, 60,  20,  false, false },
+	{ "string_values", 1000,   16, 64, 0,   100, false, false },
+	{ "base_info",     1000,   16, 16, 100, 0,   true,  false },
+};
+
+
+static int bench_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+
+static inline double bench_percentile(const uint64_t *sorted, size_t n, double p)
+{
+	return (double)sorted[(size_t)(p * (double)(n - 1) + 0.5)] / 1000.0;
+}
+
+
+/**
+ * Runs one case and prints its line. Called in the child process.
+ * @return 0 on success, -1 if the case failed.
+ */
+static int bench_run(const bench_config_t *config, const bench_case_t *c, unsigned int threads,
+                     double min_time)
+{
+	bench_ctx_t    ctx = { .config = config, .threads = threads };
+	uint64_t      *samples = malloc(sizeof(uint64_t) * BENCH_MAX_SAMPLES);
+	uint64_t       deadline, start, total = 0;
+	size_t         iters = 0, allocs, alloc_bytes;
+	struct rusage  usage;
+	long           rss_before;
+	
+	if (!samples)
+		return -1;
+	
+	if (config) {
+		if (!(ctx.pack = bench_generate(config)) || !(ctx.json = senml_encode_json(ctx.pack)) ||
+		    !(ctx.cbor = senml_encode_cbor(ctx.pack, &ctx.cbor_len)))
+			return -1;
+		
+		ctx.json_len = strlen(ctx.json);
+		ctx.records  = config->records;
+	}
+	
+	if (c->setup && c->setup(&ctx))
+		return -1;
+	
+	// one untimed run to warm up caches and let the arenas reach their size
+	if (c->run(&ctx))
+		return -1;
+	
+	getrusage(RUSAGE_SELF, &usage);
+	rss_before  = usage.ru_maxrss;
+	allocs      = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED);
+	alloc_bytes = __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED);
+	deadline    = bench_now() + (uint64_t)(min_time * 1e9);
+	
+	do {
+		start = bench_now();
+		
+		if (c->run(&ctx))
+			return -1;
+		
+		samples[iters % BENCH_MAX_SAMPLES] = bench_now() - start;
+		total += samples[iters % BENCH_MAX_SAMPLES];
+		iters++;
+	} while (iters < BENCH_MIN_ITERS || bench_now() < deadline);
+	
+	allocs      = __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED) - allocs;
+	alloc_bytes = __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED) - alloc_bytes;
+	getrusage(RUSAGE_SELF, &usage);
+	
+	size_t n = iters < BENCH_MAX_SAMPLES ? iters : BENCH_MAX_SAMPLES;
+	
+	qsort(samples, n, sizeof(uint64_t), bench_compare);
+	
+	printf("{\"case\":\"%s\",\"config\":\"%s\",\"threads\":%u,\"records\":%zu,\"bytes\":%zu,"
+	       "\"iters\":%zu,\"mb_s\":%.2f,\"records_s\":%.0f,\"p50_us\":%.3f,\"p90_us\":%.3f,"
+	       "\"p99_us\":%.3f,\"max_us\":%.3f,\"allocs\":%.2f,\"alloc_bytes\":%.0f,"
+	       "\"rss_before_kb\":%ld,\"peak_rss_kb\":%ld}\n",
+	       c->name, config ? config->name : "numbers", threads, ctx.records, ctx.bytes, iters,
+	       (double)ctx.bytes * (double)iters / ((double)total / 1e9) / 1e6,
+	       (double)ctx.records * (double)iters / ((double)total / 1e9),
+	       bench_percentile(samples, n, 0.5), bench_percentile(samples, n, 0.9),
+	       bench_percentile(samples, n, 0.99), (double)samples[n - 1] / 1000.0,
+	       (double)allocs / (double)iters, (double)alloc_bytes / (double)iters,
+	       rss_before, usage.ru_maxrss);
+	
+	// the process exits right after without flushing, everything else is left to the kernel
+	fflush(stdout);
+	return 0;
+}
+
+
+/**
+ * Runs a case in a child process so that its peak RSS is not inflated by earlier cases.
+ */
+static void bench_fork(const bench_config_t *config, const bench_case_t *c, unsigned int threads,
+                       double min_time, const char *filter, int *failures)
+{
+	char  label[128];
+	pid_t pid;
+	int   status;
+	
+	snprintf(label, sizeof(label), "%s/%s", c->name, config ? config->name : "numbers");
+	
+	if (filter && !strstr(label, filter))
+		return;
+	
+	fflush(stdout);
+	
+	if ((pid = fork()) == 0)
+		_exit(bench_run(config, c, threads, min_time) ? 1 : 0);
+	
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		printf("{\"case\":\"%s\",\"config\":\"%s\",\"threads\":%u,\"error\":true}\n",
+		       c->name, config ? config->name : "numbers", threads);
+		(*failures)++;
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	senml_allocator_t allocator = {
+		.malloc  = bench_malloc,
+		.realloc = bench_realloc,
+		.free    = bench_free
+	};
+	
+	double       min_time = 0.2;
+	const char  *filter   = NULL;
+	int          failures = 0;
+	long         online   = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int cpus     = online > 0 ? (unsigned int)online : 1;
+	
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			min_time = 0.02;
+		} else if (strncmp(argv[i], "--filter=", 9) == 0) {
+			filter = argv[i] + 9;
+		} else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+			min_time = atof(argv[i] + 11);
+		} else {
+			fprintf(stderr, "usage: %s [--quick] [--filter=SUBSTRING] [--min-time=SECONDS]\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+	
+	senml_set_allocator(&allocator);
+	
+	// the jansson tree of the reference decoder counts too, through the library's trampolines
+	json_set_alloc_funcs(senml_malloc, senml_free);
+	
+	for (size_t i = 0; i < sizeof(bench_configs) / sizeof(bench_configs[0]); i++) {
+		const bench_config_t *config = &bench_configs[i];
+		
+		for (size_t j = 0; j < sizeof(bench_cases) / sizeof(bench_cases[0]); j++)
+			bench_fork(config, &bench_cases[j], 1, min_time, filter, &failures);
+		
+		if (!config->scaling)
+			continue;
+		
+		// 0 threads runs on the calling thread without a pool
+		for (size_t j = 0; j < sizeof(bench_scaling_cases) / sizeof(bench_scaling_cases[0]); j++) {
+			bench_fork(config, &bench_scaling_cases[j], 0, min_time, filter, &failures);
+			
+			for (unsigned int threads = 1; threads <= cpus; threads *= 2)
+				bench_fork(config, &bench_scaling_cases[j], threads, min_time, filter, &failures);
+		}
+	}
+	
+	for (size_t j = 0; j < sizeof(bench_number_cases) / sizeof(bench_number_cases[0]); j++)
+		bench_fork(NULL, &bench_number_cases[j], 1, min_time, filter, &failures);
+	
+	return failures ? 1 : 0;
+}
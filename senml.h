@@ -63,6 +63,13 @@ typedef struct {
 } senml_bin_data_t;
 
 
+/*! A string that is not necessarily NUL terminated, e.g. one that points into a decoder's input */
+typedef struct {
+	const char *p;    //!< Pointer to the first character, NULL if the string is not set
+	size_t      len;  //!< Length of the string in bytes
+} senml_str_t;
+
+
 /*! struct that contains base information which applies to all subsequent entries */
 typedef struct {
 	uint8_t             version;         //!< SenML version of this pack
@@ -76,9 +83,14 @@ typedef struct {
 		bool              base_value_b;    //!< A boolean base value (FIXME is this sensible?)
 		senml_bin_data_t  base_value_bin;  //!< A binary base value (FIXME is this sensible?)
 	} base_value;
+	senml_str_t         base_name_view;  //!< View of the base name, the only one set in zero-copy packs
+	senml_str_t         base_unit_view;  //!< View of the base unit, the only one set in zero-copy packs
 } senml_base_info_t;
 
 
+#define SENML_NO_ID (UINT32_MAX)   //!< String ID of an attribute that is not set
+
+
 /*! struct that contains the values of a SenML record */
 typedef struct {
 	char              *name;        //!< Sensor's name, will be appended to base name if provided
@@ -93,17 +105,285 @@ typedef struct {
 		bool              value_b;   //!< A boolean value
 		senml_bin_data_t  value_bin; //!< A binary value (FIXME don't know how to handle this yet)
 	} value;
+	senml_str_t        name_view;   //!< View of the name, the only one set in zero-copy packs
+	senml_str_t        unit_view;   //!< View of the unit, the only one set in zero-copy packs
+	senml_str_t        value_view;  //!< View of the string value, the only one set in zero-copy packs
+	uint32_t           name_id;     //!< ID of the resolved name if decoded with a names table, or SENML_NO_ID
 } senml_record_t;
 
 
+/*! Region allocator that owns all memory of a decoded pack */
+typedef struct senml_arena senml_arena_t;
+
+
 /*! struct that holds a SenML pack (optional base info and 1..n records) */
 typedef struct {
 	senml_base_info_t  *base_info;  //!< Pointer to the base info, may be NULL
 	senml_record_t     *records;    //!< Pointer to the beginning of an array of records
 	size_t              num;        //!< Number of records in the array
+	senml_arena_t      *arena;      //!< Memory the pack was decoded into, NULL if built by hand
 } senml_pack_t;
 
 
+/*! struct that holds a SenML pack as one array per attribute (struct-of-arrays) */
+typedef struct {
+	senml_base_info_t  *base_info;    //!< Pointer to the base info, may be NULL
+	size_t              num;          //!< Number of records, i.e. the length of every column
+	double             *time;         //!< Time of each record
+	double             *value_f;      //!< Float values, 1 or 0 for boolean values, 0 otherwise
+	uint8_t            *value_type;   //!< Type of each value, a <code>senml_value_type_t</code>
+	unsigned int       *update_time;  //!< Update time of each record
+	uint32_t           *name_id;      //!< Index of each name in strings, or SENML_NO_ID
+	uint32_t           *unit_id;      //!< Index of each unit in strings, or SENML_NO_ID
+	senml_str_t        *value_s;      //!< String and binary values, <code>p</code> is NULL for others
+	senml_str_t        *strings;      //!< Every distinct name and unit once, NUL terminated
+	size_t              num_strings;  //!< Number of entries in strings
+	size_t              capacity;     //!< Internal: number of records the columns can hold
+	uint32_t           *index;        //!< Internal: hash table of strings
+	size_t              index_size;   //!< Internal: number of slots in index
+	senml_arena_t      *arena;        //!< Internal: memory of the strings and the base info
+} senml_columns_t;
+
+
+#define SENML_FLAT_VERSION (1)   //!< Version of the flat format written and read by this library
+
+
+/*! A pack compiled for encoding the same shape repeatedly, see <code>senml_template_json</code> */
+typedef struct senml_template senml_template_t;
+
+
+/*! Compressed times and float values of one sensor, see <code>senml_series_new</code> */
+typedef struct senml_series senml_series_t;
+
+
+/*! Position in a series, see <code>senml_series_seek</code> */
+typedef struct {
+	const senml_series_t *series;
+	size_t                index;     //!< Index of the sample <code>senml_series_next</code> returns
+	size_t                bit;       //!< Internal: offset of the next sample in bits
+	int64_t               ticks;     //!< Internal: time of the previous sample
+	int64_t               delta;     //!< Internal: difference between the previous two times
+	uint64_t              value;     //!< Internal: bits of the previous value
+	unsigned int          leading;   //!< Internal: leading zeros of the current window
+	unsigned int          trailing;  //!< Internal: trailing zeros of the current window
+} senml_series_iter_t;
+
+
+/*! A flat pack opened for reading, see <code>senml_flat_open</code> */
+typedef struct {
+	const void         *buf;          //!< The flat pack
+	size_t              size;         //!< Size of the flat pack in bytes
+	size_t              num;          //!< Number of records
+	const void         *records;      //!< Internal: first record
+	const char         *strings;      //!< Internal: string table
+	size_t              strings_len;  //!< Internal: size of the string table in bytes
+	size_t              mapped;       //!< Internal: bytes mapped by senml_flat_map, 0 otherwise
+} senml_flat_t;
+
+
+/*! Summary of the numeric values of a set of records, all zero if there are none */
+typedef struct {
+	size_t  count;  //!< Number of records with a numeric value
+	double  min;    //!< Smallest value
+	double  max;    //!< Largest value
+	double  sum;    //!< Sum of the values
+	double  mean;   //!< Average of the values
+} senml_aggregate_t;
+
+
+/*! Allocation functions used for all memory the library allocates */
+typedef struct {
+	void *(*malloc)(size_t size, void *ctx);              //!< Same semantics as malloc(3)
+	void *(*realloc)(void *ptr, size_t size, void *ctx);  //!< Same semantics as realloc(3)
+	void  (*free)(void *ptr, void *ctx);                  //!< Same semantics as free(3)
+	void   *ctx;                                          //!< Passed to every call
+} senml_allocator_t;
+
+
+/*! Kinds of errors the encoders and decoders report, see <code>senml_last_error</code> */
+typedef enum {
+	SENML_OK = 0,              //!< The call succeeded
+	SENML_ERROR_SYNTAX,        //!< The document is not well-formed JSON or CBOR
+	SENML_ERROR_TRUNCATED,     //!< The document ends in the middle of a value
+	SENML_ERROR_DEPTH,         //!< Values are nested deeper than the decoders allow
+	SENML_ERROR_NOT_ARRAY,     //!< The document is not an array of records
+	SENML_ERROR_RECORD,        //!< A record is not an object or one of its attributes has the wrong type
+	SENML_ERROR_TRAILING,      //!< Something follows the pack
+	SENML_ERROR_INVALID_PACK,  //!< A pack to encode contains data that cannot be encoded
+	SENML_ERROR_NO_MEMORY,     //!< Memory could not be allocated
+	SENML_ERROR_NO_SPACE,      //!< A buffer or arena provided by the caller is too small
+	SENML_ERROR_CALLBACK,      //!< A record callback stopped decoding
+	SENML_ERROR_IO,            //!< A file could not be opened or mapped
+	SENML_ERROR_COUNT          //!< Number of kinds, not an error itself
+} senml_error_code_t;
+
+
+/*! Description of the error of the most recent call on a thread */
+typedef struct {
+	senml_error_code_t  code;          //!< What went wrong, SENML_OK if the call succeeded
+	size_t              record;        //!< Number of the record that is affected, starting at 1, or 0
+	size_t              offset;        //!< Position of the error in the input in bytes, if known
+	unsigned int        line;          //!< Line of the error in a JSON document, or 0
+	char                message[96];   //!< Human readable description, NUL terminated
+} senml_error_t;
+
+
+/*! Steps of an encode or decode call that are timed separately */
+typedef enum {
+	SENML_PHASE_PARSE = 0,   //!< Scanning and validating the input of a decoder
+	SENML_PHASE_CONVERT,     //!< Building records from the scanned attributes
+	SENML_PHASE_SERIALIZE,   //!< Writing the output of an encoder
+	SENML_PHASE_COUNT        //!< Number of phases, not a phase itself
+} senml_phase_t;
+
+
+#define SENML_STATS_COUNTERS (1 << 0) //!< Count bytes, records, packs, allocations and errors
+#define SENML_STATS_TIMING   (1 << 1) //!< Also time the phases of every call
+
+
+/*! Activity of the library since it was loaded or the last <code>senml_stats_reset</code> */
+typedef struct {
+	uint64_t  bytes_in;                    //!< Bytes of the documents passed to the decoders
+	uint64_t  bytes_out;                   //!< Bytes of the documents produced by the encoders
+	uint64_t  records_decoded;             //!< Records the decoders produced
+	uint64_t  records_encoded;             //!< Records the encoders wrote
+	uint64_t  packs_decoded;               //!< Documents decoded successfully
+	uint64_t  packs_encoded;               //!< Documents encoded successfully
+	uint64_t  allocs;                      //!< Calls of the allocator's malloc and realloc
+	uint64_t  alloc_bytes;                 //!< Bytes requested by those calls
+	uint64_t  errors[SENML_ERROR_COUNT];   //!< Failed calls by kind of error
+	uint64_t  ticks[SENML_PHASE_COUNT];    //!< Time spent in each phase, see senml_stats_get
+} senml_stats_t;
+
+
+/*! Fixed set of worker threads for the batch functions */
+typedef struct senml_pool senml_pool_t;
+
+
+/*! Thread-safe table that maps names to stable IDs, shared across decode calls */
+typedef struct senml_names senml_names_t;
+
+
+/*! Incremental JSON parser that keeps its state between chunks of input */
+typedef struct senml_parser senml_parser_t;
+
+
+/*! Immutable set of names the decoders keep records of, may be shared across threads */
+typedef struct senml_filter senml_filter_t;
+
+
+/*! Recent samples of many sensors by time, see <code>senml_store_new</code> */
+typedef struct senml_store senml_store_t;
+
+
+/*! What a full store does when a sensor needs room for more samples */
+typedef enum {
+	SENML_STORE_EVICT_OLDEST = 0,  //!< Drop the oldest samples of the whole store
+	SENML_STORE_EVICT_SENSOR,      //!< Drop the oldest samples of the same sensor, if it has any
+	SENML_STORE_REJECT             //!< Keep what is stored and fail to add the sample
+} senml_store_evict_t;
+
+
+/*! Limits of a store */
+typedef struct {
+	size_t               max_bytes;  //!< Memory the samples may take, 0 for no limit
+	double               max_age;    //!< Seconds samples are kept behind the newest one, 0 for ever
+	senml_store_evict_t  evict;      //!< What to do when max_bytes is reached
+} senml_store_opts_t;
+
+
+/**
+ * Decides whether a record is kept, see <code>senml_filter_match</code>.
+ * @param[in] name The resolved name of the record, i.e. base name and name, not NUL terminated.
+ * @param[in] len The length of \p name in bytes.
+ * @param[in] ctx The pointer passed to <code>senml_filter_match</code>.
+ * @return true to keep the record.
+ */
+typedef bool (*senml_match_t)(const char *name, size_t len, void *ctx);
+
+
+/**
+ * Receives the records of a <code>senml_parser_t</code> one by one. The record, its strings and
+ * the base info are only valid until the callback returns.
+ * @param[in] record The record that has just been completed.
+ * @param[in] base_info The base info of the pack, may be NULL.
+ * @param[in] ctx The pointer passed to <code>senml_parser_new</code>.
+ * @return 0 to continue parsing, anything else to stop.
+ */
+typedef int (*senml_record_cb_t)(const senml_record_t *record, const senml_base_info_t *base_info,
+                                 void *ctx);
+
+
+/**
+ * Receives the packs <code>senml_decode_file</code> decodes, possibly from several threads at once.
+ * The pack and its strings, which point into the mapped file, are only valid until the callback
+ * returns.
+ * @param[in] pack A chunk of the records of the file, or one pack of a file of JSON lines.
+ * @param[in] offset Offset of the chunk or line in the file, which orders the packs.
+ * @param[in] ctx The pointer passed to <code>senml_decode_file</code>.
+ * @return 0 to continue decoding, anything else to stop.
+ */
+typedef int (*senml_pack_cb_t)(const senml_pack_t *pack, size_t offset, void *ctx);
+
+
+/**
+ * Receives the samples of a range scan, see <code>senml_store_range</code>. The arrays are only
+ * valid until the callback returns.
+ * @param[in] times The times of the samples, in ascending order.
+ * @param[in] values The values of the samples.
+ * @param[in] count The number of samples, at least 1.
+ * @param[in] ctx The pointer passed to <code>senml_store_range</code>.
+ * @return 0 to continue, anything else to stop.
+ */
+typedef int (*senml_sample_cb_t)(const double *times, const double *values, size_t count,
+                                 void *ctx);
+
+
+#define SENML_DECODE_ZERO_COPY (1 << 0) //!< Let strings point into the input instead of copying them
+#define SENML_DECODE_PRESIZE   (1 << 1) //!< Validate first and allocate the pack only once
+
+
+#define SENML_FIELD_NAME        (1 << 0)  //!< The name of a record
+#define SENML_FIELD_UNIT        (1 << 1)  //!< The unit of a record
+#define SENML_FIELD_VALUE       (1 << 2)  //!< The value of a record, whichever type it has
+#define SENML_FIELD_TIME        (1 << 3)  //!< The time of a record
+#define SENML_FIELD_UPDATE_TIME (1 << 4)  //!< The update time of a record
+#define SENML_FIELD_ALL         (0x1f)    //!< Every attribute of a record
+
+
+#define SENML_FILE_LINES (1 << 0) //!< The file holds one JSON pack per line instead of a single pack
+
+
+#define SENML_ENCODE_COMPACT (1 << 0) //!< Factor out a base name, time and unit chosen for the pack
+
+
+/*! What <code>senml_validate_json</code> found in a document */
+typedef struct {
+	size_t  records;       //!< Number of records
+	size_t  base_records;  //!< Records with base attributes
+	size_t  strings;       //!< Number of string values, keys not included
+	size_t  string_bytes;  //!< Bytes of the string values in the input, never less than decoded
+} senml_json_info_t;
+
+
+/*! Options that change how a document is encoded */
+typedef struct {
+	unsigned int flags;  //!< Combination of SENML_ENCODE_* flags
+} senml_encode_opts_t;
+
+
+/*! Options that change how a document is decoded */
+typedef struct {
+	unsigned int          flags;       //!< Combination of SENML_DECODE_* flags
+	senml_pack_t         *pack;        //!< Pack emptied with <code>senml_pack_reset</code> to decode into, or NULL
+	senml_names_t        *names;       //!< Table the resolved names are interned in to set name_id, or NULL
+	unsigned int          fields;      //!< SENML_FIELD_* attributes to decode, 0 for all of them
+	const senml_filter_t *filter;      //!< Records to decode by their resolved name, NULL for all
+	size_t                max_records; //!< Records a document may have, 0 for no limit
+	size_t                max_bytes;   //!< Memory SENML_DECODE_PRESIZE may allocate, 0 for no limit
+} senml_decode_opts_t;
+
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
@@ -112,11 +392,17 @@ typedef struct {
  * @param[in]     input The JSON document containing the SenML pack.
  * @param[in,out] pack The <code>senml_pack_t</code> structure in which the records will be stored.
  * <code>pack->num</code> must indicate the number of <code>senml_record_t</code> elements
- * <code>pack->records</code> can hold.
+ * <code>pack->records</code> can hold and is set to the number of decoded records.
+ * 
+ * No memory is allocated: strings are returned as views into \p input (see
+ * <code>SENML_DECODE_ZERO_COPY</code>). Strings that contain escape sequences are unescaped into
+ * <code>pack->arena</code>, which must then have been set up with <code>senml_arena_init</code>.
+ * The base info is stored in <code>pack->base_info</code> if it is set, otherwise it is allocated
+ * from <code>pack->arena</code> as well; it is set to NULL if \p input has none.
  * @return 0 on success, -1 if \p input is not a valid SenML document, or -2 if \p input contains
- * more records than <code>pack->records</code> can hold.
+ * more records than <code>pack->records</code> can hold or needs more memory than provided.
  */
-// int senml_decode_json_s(const char *input, senml_pack_t *pack);
+int senml_decode_json_s(const char *input, senml_pack_t *pack);
 
 
 /**
@@ -125,32 +411,113 @@ typedef struct {
  * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
  * @param[in,out] output The char buffer that will contain the finished JSON document.
  * @param[in] len The size of the allocated memory that \p output points to in bytes.
+ * The document is written directly into \p output and terminated, no memory is allocated.
  * @return 0 on success, -1 if \p pack contains invalid data or options, or -2 if not enough memory
  * was allocated.
  */
-// int senml_encode_json_s(const senml_pack_t *pack, char *output, size_t len);
+int senml_encode_json_s(const senml_pack_t *pack, char *output, size_t len);
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 
 /**
  * Decodes a SenML pack in JSON format and writes the results in \p pack. The memory necessary to 
- * store the decoded records will be allocated automatically.
+ * store the decoded records will be allocated automatically. The document is parsed in a single
+ * pass without building an intermediate tree.
  * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if \p input is NUL terminated.
  * @return A valid pointer to a <code>senml_pack_t</code> elements, or NULL on failure.
  */
 senml_pack_t *senml_decode_json(const char *input, size_t len);
 
 
+/**
+ * Same as <code>senml_decode_json</code>, but with additional options.
+ * 
+ * With <code>SENML_DECODE_ZERO_COPY</code> the strings of the pack are only available through
+ * the <code>*_view</code> members and the <code>char *</code> members are NULL. The views point
+ * directly into \p input unless the string contained escape sequences, in which case an unescaped
+ * copy is made. Such a pack must not be used after \p input has been freed or modified.
+ * 
+ * If <code>opts->pack</code> is set, that pack is reset and the document is decoded into its
+ * arena. It is returned on success and left empty on failure.
+ * 
+ * <code>opts->fields</code> and <code>opts->filter</code> push a query down into the decoder.
+ * Attributes outside of the mask are skipped without being converted or copied, they are only
+ * checked to be well-formed JSON. Records whose resolved name the filter rejects are left out of
+ * the pack entirely. The scanner tests the name as soon as it has been read, so the rest of such a
+ * record is skipped as well. The base info is always decoded, and errors still report the
+ * position of a record among all records of the document.
+ * 
+ * With <code>SENML_DECODE_PRESIZE</code> a first pass checks that the document is well-formed and
+ * counts its records and strings (see <code>senml_validate_json</code>), so that a malformed
+ * document is rejected before anything is allocated and the pack is allocated once. The extra pass
+ * costs about a third of the throughput, it pays off when memory matters more than time.
+ * <code>opts->max_records</code> fails a document with more records, before the pack is sized if
+ * the document is presized, and <code>opts->max_bytes</code> fails one whose presized pack would
+ * take more memory, both with <code>SENML_ERROR_NO_SPACE</code>.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if \p input is NUL terminated.
+ * @param[in] opts The decoding options, or NULL for the defaults.
+ * @return A valid pointer to a <code>senml_pack_t</code> elements, or NULL on failure.
+ */
+senml_pack_t *senml_decode_json_ex(const char *input, size_t len, const senml_decode_opts_t *opts);
+
+
+/**
+ * Checks that a document is well-formed: a JSON array with valid UTF-8 and nothing after it. The
+ * attributes of the records are not looked at. This is the first step of
+ * <code>senml_decode_json_ex</code> with <code>SENML_DECODE_PRESIZE</code>, which uses the counts
+ * to allocate the pack at once, so a malformed or truncated document is rejected before any memory
+ * is allocated.
+ * @param[in] input The JSON document.
+ * @param[in] len The length of \p input, or 0 if it is NUL terminated.
+ * @param[out] info What the document contains, may be NULL.
+ * @return 0 if the document is well-formed, -1 otherwise.
+ */
+int senml_validate_json(const char *input, size_t len, senml_json_info_t *info);
+
+
 /**
  * Creates a SenML document in JSON format. The memory necessary to store the resulting JSON 
- * document will be allocated automatically.
+ * document will be allocated automatically and must be released with <code>senml_free</code>.
  * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
  * @return A valid pointer to the finished JSON document, or NULL on failure.
  */
 char *senml_encode_json(const senml_pack_t *pack);
 
 
+/**
+ * Creates a SenML document in JSON format like <code>senml_encode_json</code>, with options.
+ * With SENML_ENCODE_COMPACT the records are resolved against the base info of \p pack first.
+ * Then the longest common prefix of the names becomes the base name, the earliest time the base
+ * time and the unit of the majority of the records the base unit. These go into the first record
+ * and every record is written relative to them. The decoders resolve each record to exactly the
+ * same name, time, unit and value as the records of \p pack resolve to. The base value is applied
+ * to the values instead of being written.
+ * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * @param[in] opts Encoding options, may be NULL.
+ * @return A valid pointer to the finished JSON document, or NULL on failure.
+ */
+char *senml_encode_json_ex(const senml_pack_t *pack, const senml_encode_opts_t *opts);
+
+
+/**
+ * Decodes a SenML pack in JSON format record by record without ever holding the whole pack.
+ * Every record is passed to \p callback with the base name, time, unit and value already
+ * applied, i.e. the name is the concatenation of the base name and the name. The record lives in
+ * storage that is reused for the next one, so memory use does not depend on the number of
+ * records. Records passed before an error is detected are not taken back.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if \p input is NUL terminated.
+ * @param[in] callback Called for every record in document order.
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory could not be allocated, or
+ * the value returned by the callback if it stopped decoding.
+ */
+int senml_decode_json_each(const char *input, size_t len, senml_record_cb_t callback, void *ctx);
+
+
 /**
  * Decodes a SenML pack in CBOR format and writes the results in \p pack. The memory necessary to 
  * store the decoded records will be allocated automatically.
@@ -161,16 +528,815 @@ char *senml_encode_json(const senml_pack_t *pack);
 senml_pack_t *senml_decode_cbor(const unsigned char *input, size_t len);
 
 
+/**
+ * Decodes a SenML pack in CBOR format in a single pass over \p input, without building an
+ * intermediate item tree. Definite and indefinite length containers and strings are accepted,
+ * numbers may be integers or half, single or double precision floats.
+ * @param[in] input The CBOR document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes.
+ * @param[in] opts Decoding options, may be NULL. See <code>senml_decode_json_ex</code>.
+ * @return A valid pointer to a <code>senml_pack_t</code> elements, or NULL on failure.
+ */
+senml_pack_t *senml_decode_cbor_ex(const unsigned char *input, size_t len,
+                                   const senml_decode_opts_t *opts);
+
+
+/**
+ * Decodes a SenML pack in CBOR format record by record. See <code>senml_decode_json_each</code>.
+ * @param[in] input The CBOR document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes.
+ * @param[in] callback Called for every record in document order.
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory could not be allocated, or
+ * the value returned by the callback if it stopped decoding.
+ */
+int senml_decode_cbor_each(const unsigned char *input, size_t len, senml_record_cb_t callback,
+                           void *ctx);
+
+
 /**
  * Creates a SenML document in CBOR format. The memory necessary to store the resulting CBOR
- * document will be allocated automatically.
+ * document will be allocated automatically and must be released with <code>senml_free</code>.
  * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * Containers have definite lengths and floats use the smallest width that represents them exactly.
  * @param[out] len The length of the resulting CBOR document.
- * @return A valid pointer to the finished JSON document, or NULL on failure.
+ * @return A valid pointer to the finished CBOR document, or NULL on failure.
  */
 unsigned char *senml_encode_cbor(const senml_pack_t *pack, size_t *len);
 
 
+/**
+ * Creates a SenML document in CBOR format like <code>senml_encode_cbor</code>, with options. See
+ * <code>senml_encode_json_ex</code>.
+ * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * @param[out] len The length of the resulting CBOR document.
+ * @param[in] opts Encoding options, may be NULL.
+ * @return A valid pointer to the finished CBOR document, or NULL on failure.
+ */
+unsigned char *senml_encode_cbor_ex(const senml_pack_t *pack, size_t *len,
+                                    const senml_encode_opts_t *opts);
+
+
+/**
+ * Creates a SenML document in CBOR format. The memory necessary to store the resulting CBOR
+ * document must be allocated in advance.
+ * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * @param[out] output The buffer that will contain the finished CBOR document.
+ * @param[in,out] len The size of \p output in bytes, on success the length of the document.
+ * The document is written directly into \p output, no memory is allocated.
+ * @return 0 on success, -1 if \p pack contains invalid data, or -2 if not enough memory was
+ * allocated.
+ */
+int senml_encode_cbor_s(const senml_pack_t *pack, unsigned char *output, size_t *len);
+
+
+/**
+ * Converts a SenML pack in JSON format to CBOR without building a pack or an item tree: every
+ * record is written as soon as it has been scanned, with the keys mapped to their CBOR labels.
+ * Strings are only copied if they contain escape sequences, and then into scratch memory that
+ * is reused for every record, so memory does not grow with the number of records. The first
+ * record keeps the base attributes, the output is otherwise the same as
+ * <code>senml_encode_cbor</code> would create for the decoded pack.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if it is NUL terminated.
+ * @param[out] out_len The length of the resulting CBOR document.
+ * @return The CBOR document, which must be released with <code>senml_free</code>, or NULL on
+ * failure.
+ */
+unsigned char *senml_transcode_json_to_cbor(const char *input, size_t len, size_t *out_len);
+
+
+/**
+ * Converts a SenML pack in JSON format to CBOR in memory allocated in advance, see
+ * <code>senml_transcode_json_to_cbor</code>. \p output only has to hold the document: since the
+ * number of records is only known at the end, the records are moved up once the array head is
+ * written if it takes more than one byte.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if it is NUL terminated.
+ * @param[out] output The buffer that will contain the CBOR document.
+ * @param[in,out] out_len The size of \p output in bytes, on success the length of the document.
+ * @return 0 on success, -1 if \p input is invalid, or -2 if \p output is too small or memory
+ * could not be allocated.
+ */
+int senml_transcode_json_to_cbor_s(const char *input, size_t len, unsigned char *output,
+                                   size_t *out_len);
+
+
+/**
+ * Converts a SenML pack in CBOR format to JSON without building a pack or an item tree, see
+ * <code>senml_transcode_json_to_cbor</code>.
+ * @param[in] input The CBOR document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes.
+ * @return The NUL terminated JSON document, which must be released with <code>senml_free</code>,
+ * or NULL on failure.
+ */
+char *senml_transcode_cbor_to_json(const unsigned char *input, size_t len);
+
+
+/**
+ * Converts a SenML pack in CBOR format to JSON in memory allocated in advance, see
+ * <code>senml_transcode_json_to_cbor</code>.
+ * @param[in] input The CBOR document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes.
+ * @param[out] output The buffer that will contain the NUL terminated JSON document.
+ * @param[in] out_len The size of \p output in bytes.
+ * @return 0 on success, -1 if \p input is invalid or contains numbers JSON cannot represent,
+ * or -2 if \p output is too small or memory could not be allocated.
+ */
+int senml_transcode_cbor_to_json_s(const unsigned char *input, size_t len, char *output,
+                                   size_t out_len);
+
+
+/**
+ * Creates a flat pack: a header, an array of records of fixed size and a table of NUL terminated
+ * strings in a single buffer, in the byte order of this host. Records refer to strings by offset,
+ * so the buffer can be written to a file as it is and read back with <code>senml_flat_map</code>
+ * or <code>senml_flat_open</code> without decoding it. Equal strings are only stored once.
+ * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * @param[out] len The length of the resulting flat pack.
+ * @return The flat pack, which must be released with <code>senml_free</code>, or NULL on failure.
+ */
+unsigned char *senml_encode_flat(const senml_pack_t *pack, size_t *len);
+
+
+/**
+ * Creates a flat pack in memory allocated in advance, see <code>senml_encode_flat</code>.
+ * @param[in] pack The <code>senml_pack_t</code> elements that contains the SenML records.
+ * @param[out] output The buffer that will contain the flat pack, aligned to 8 bytes if it is
+ * going to be opened in place.
+ * @param[in,out] len The size of \p output in bytes, on success the length of the flat pack.
+ * @return 0 on success, -1 if \p pack contains invalid data, or -2 if \p output is too small or
+ * memory could not be allocated.
+ */
+int senml_encode_flat_s(const senml_pack_t *pack, unsigned char *output, size_t *len);
+
+
+/**
+ * Opens a flat pack in memory. Only the header is checked, so this takes the same time for any
+ * number of records and nothing is copied; the accessors check each string as it is read, and
+ * a string that does not lie within the pack reads as not set. \p buf must stay valid while
+ * \p flat is used.
+ * @param[in] buf The flat pack, aligned to 8 bytes.
+ * @param[in] len The size of \p buf in bytes, may exceed the size of the flat pack.
+ * @param[out] flat
+ * @return 0 on success, -1 if \p buf is not a flat pack of this version and byte order.
+ */
+int senml_flat_open(const void *buf, size_t len, senml_flat_t *flat);
+
+
+/**
+ * Maps a file created from the output of <code>senml_encode_flat</code> and opens it, see
+ * <code>senml_flat_open</code>. The file is only read when records are.
+ * @param[in] path
+ * @param[out] flat Must be released with <code>senml_flat_close</code>.
+ * @return 0 on success, -1 if the file cannot be read or is not a flat pack.
+ */
+int senml_flat_map(const char *path, senml_flat_t *flat);
+
+
+/**
+ * Releases a flat pack opened by <code>senml_flat_map</code>. Flat packs opened by
+ * <code>senml_flat_open</code> need not be closed, the memory belongs to the caller.
+ * @param[in,out] flat
+ */
+void senml_flat_close(senml_flat_t *flat);
+
+
+/**
+ * Reads the base info of a flat pack. Strings are only set as views, and the base value if it is a
+ * string, all pointing into the flat pack.
+ * @param[in] flat
+ * @param[out] base_info
+ * @return true if the pack has base info, false otherwise.
+ */
+bool senml_flat_base_info(const senml_flat_t *flat, senml_base_info_t *base_info);
+
+
+/**
+ * Reads a record of a flat pack the way a zero-copy pack holds it: strings are only set as views
+ * pointing into the flat pack.
+ * @param[in] flat
+ * @param[in] i Index of the record, less than <code>flat->num</code>.
+ * @param[out] record
+ */
+void senml_flat_record(const senml_flat_t *flat, size_t i, senml_record_t *record);
+
+
+/*
+ * Read single attributes of record \p i of a flat pack, which must be less than
+ * <code>flat->num</code>. Strings point into the flat pack and are NUL terminated. A boolean
+ * value reads as 1 or 0 through <code>senml_flat_value_f</code>, a binary value through
+ * <code>senml_flat_value_s</code>, and a value of another type as 0, false or not set.
+ */
+senml_str_t senml_flat_name(const senml_flat_t *flat, size_t i);
+senml_str_t senml_flat_unit(const senml_flat_t *flat, size_t i);
+double senml_flat_time(const senml_flat_t *flat, size_t i);
+unsigned int senml_flat_update_time(const senml_flat_t *flat, size_t i);
+senml_value_type_t senml_flat_value_type(const senml_flat_t *flat, size_t i);
+double senml_flat_value_f(const senml_flat_t *flat, size_t i);
+bool senml_flat_value_b(const senml_flat_t *flat, size_t i);
+senml_str_t senml_flat_value_s(const senml_flat_t *flat, size_t i);
+
+
+/**
+ * Compiles a pack into a template for packs of the same shape: the same base info, the same
+ * number of records with the same names, units and value types. Encoding such a pack with
+ * <code>senml_template_encode</code> only writes the attributes in \p fields into an image of the
+ * JSON document prepared here, everything else is taken from \p pack. The attributes in \p fields
+ * are written for every record even if they are 0, which the decoders read the same as absent.
+ * @param[in] pack The pack that gives the shape.
+ * @param[in] fields The attributes that change, any of <code>SENML_FIELD_TIME</code>,
+ * <code>SENML_FIELD_UPDATE_TIME</code> and <code>SENML_FIELD_VALUE</code>, or 0 for time and
+ * value. Only float and boolean values change, string values are part of the template.
+ * @return The template, which must be released with <code>senml_template_free</code>, or NULL on
+ * failure.
+ */
+senml_template_t *senml_template_json(const senml_pack_t *pack, unsigned int fields);
+
+
+/**
+ * Compiles a pack into a template for CBOR documents, see <code>senml_template_json</code>. Times
+ * and float values always take 9 bytes and update times 5, so that each encode overwrites them in
+ * place.
+ * @param[in] pack The pack that gives the shape.
+ * @param[in] fields The attributes that change, or 0 for time and value.
+ * @return The template, which must be released with <code>senml_template_free</code>, or NULL on
+ * failure.
+ */
+senml_template_t *senml_template_cbor(const senml_pack_t *pack, unsigned int fields);
+
+
+/**
+ * Encodes a pack with a template, see <code>senml_template_json</code>. No memory is allocated.
+ * @param[in,out] tmpl
+ * @param[in] pack A pack of the shape of the template. Only the number of records and the value
+ * types are checked, the other attributes are not read.
+ * @param[out] len The length of the document.
+ * @return The document, NUL terminated if it is JSON, which belongs to the template and stays
+ * valid until the next encode with it, or NULL if \p pack does not fit the template or holds a
+ * number JSON cannot represent.
+ */
+const void *senml_template_encode(senml_template_t *tmpl, const senml_pack_t *pack, size_t *len);
+
+
+/**
+ * Releases a template.
+ * @param[in] tmpl The template to release, may be NULL.
+ */
+void senml_template_free(senml_template_t *tmpl);
+
+
+/**
+ * Creates an empty series for the samples of one sensor. Times are stored as the difference
+ * between consecutive intervals in microseconds and values as the XOR with the previous value, in
+ * as few bits as possible, so that samples taken at regular intervals of a slowly changing value
+ * take a few bits each. Nothing is lost: a time that is not a whole number of microseconds is
+ * stored in full.
+ * @param[in] name The resolved name of the sensor, NUL terminated. It is copied.
+ * @param[in] unit The unit of the values, may be NULL. It is copied.
+ * @return The series, which must be released with <code>senml_series_free</code>, or NULL if
+ * memory could not be allocated.
+ */
+senml_series_t *senml_series_new(const char *name, const char *unit);
+
+
+/**
+ * Collects the samples of one sensor from a pack: the records with a float value whose resolved
+ * name is \p name, with times and values resolved against the base info. The unit of the first
+ * of them is the unit of the series.
+ * @param[in] pack The pack, whose records of the sensor must be in the order of their time.
+ * @param[in] name The resolved name of the sensor, NUL terminated.
+ * @return The series, empty if no record matches, or NULL on failure. Must be released with
+ * <code>senml_series_free</code>.
+ */
+senml_series_t *senml_series_from_pack(const senml_pack_t *pack, const char *name);
+
+
+/**
+ * Converts a series to a pack whose base name and unit are those of the series and whose records
+ * only have a time and a float value.
+ * @param[in] series
+ * @return The pack, or NULL on failure. Must be released with <code>senml_pack_free</code>.
+ */
+senml_pack_t *senml_series_to_pack(const senml_series_t *series);
+
+
+/**
+ * Releases a series.
+ * @param[in] series The series, may be NULL.
+ */
+void senml_series_free(senml_series_t *series);
+
+
+/**
+ * Appends a sample to a series.
+ * @param[in,out] series
+ * @param[in] time The time, not before that of the previous sample.
+ * @param[in] value
+ * @return 0 on success, -1 if \p time is before the previous one or not a number, -2 if memory
+ * could not be allocated.
+ */
+int senml_series_append(senml_series_t *series, double time, double value);
+
+
+/**
+ * Returns the number of samples in a series.
+ * @param[in] series
+ */
+size_t senml_series_count(const senml_series_t *series);
+
+
+/**
+ * Returns the size of a series in bytes, the compressed samples and the index used for seeking.
+ * @param[in] series
+ */
+size_t senml_series_size(const senml_series_t *series);
+
+
+/**
+ * Decompresses consecutive samples of a series.
+ * @param[in] series
+ * @param[in] first Index of the first sample to decompress.
+ * @param[out] times The times, \p count entries.
+ * @param[out] values The values, \p count entries.
+ * @param[in] count The maximum number of samples to decompress.
+ * @return The number of samples decompressed, less than \p count at the end of the series.
+ */
+size_t senml_series_decode(const senml_series_t *series, size_t first, double *times,
+                           double *values, size_t count);
+
+
+/**
+ * Positions an iterator at the first sample of a series at or after a time. Samples are
+ * compressed in blocks of a few hundred, so only one block has to be decompressed to find it.
+ * The series must not be changed while the iterator is used.
+ * @param[in] series
+ * @param[in] time
+ * @param[out] iter
+ */
+void senml_series_seek(const senml_series_t *series, double time, senml_series_iter_t *iter);
+
+
+/**
+ * Returns the sample an iterator is positioned at and advances it.
+ * @param[in,out] iter
+ * @param[out] time
+ * @param[out] value
+ * @return true on success, false at the end of the series.
+ */
+bool senml_series_next(senml_series_iter_t *iter, double *time, double *value);
+
+
+/**
+ * Creates a store that keeps the recent samples of every sensor in memory for range scans and
+ * lookups of the latest value. Samples are kept per sensor in chunks of a few hundred, and the
+ * chunks are searched by time, so both take O(log n).
+ *
+ * One thread may add samples while any number of threads scan and look up, without a lock: readers
+ * never block the writer and only retry when the writer adds or drops a chunk they are reading.
+ * Samples are dropped a chunk at a time, the oldest first, either when they are older than
+ * <code>opts->max_age</code> behind the newest sample of any sensor or when the store is full.
+ * @param[in] opts The limits of the store, or NULL for none.
+ * @return The store, which must be released with <code>senml_store_free</code>, or NULL if memory
+ * could not be allocated.
+ */
+senml_store_t *senml_store_new(const senml_store_opts_t *opts);
+
+
+/**
+ * Releases a store. No thread may use it any longer.
+ * @param[in] store The store, may be NULL.
+ */
+void senml_store_free(senml_store_t *store);
+
+
+/**
+ * Adds the records of a pack with a float value to a store, each by its resolved name, time and
+ * value. Records with other values are skipped. Must not be called by two threads at once.
+ * @param[in,out] store
+ * @param[in] pack
+ * @return 0 on success, -1 if the time of a record is not a number or before the newest sample of
+ * its sensor, -2 if the store is full and does not evict or memory could not be allocated. The
+ * records in front of the one that failed have been added.
+ */
+int senml_store_add(senml_store_t *store, const senml_pack_t *pack);
+
+
+/**
+ * Drops the samples of every sensor that are older than a time, a chunk at a time, so that a few
+ * of them may stay. Must not be called while samples are being added.
+ * @param[in,out] store
+ * @param[in] time
+ */
+void senml_store_expire(senml_store_t *store, double time);
+
+
+/**
+ * Passes the samples of a sensor with a time in [t0, t1) to a callback, in the order of their
+ * times and in runs of up to a chunk. Samples added during the scan may or may not be passed.
+ * @param[in] store
+ * @param[in] name The resolved name of the sensor, NUL terminated.
+ * @param[in] t0 The first time of the range.
+ * @param[in] t1 The time after the range.
+ * @param[in] callback
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return 0 on success, also if the sensor is not known, -1 if the callback stopped the scan.
+ */
+int senml_store_range(const senml_store_t *store, const char *name, double t0, double t1,
+                      senml_sample_cb_t callback, void *ctx);
+
+
+/**
+ * Looks up the newest sample of a sensor.
+ * @param[in] store
+ * @param[in] name The resolved name of the sensor, NUL terminated.
+ * @param[out] time
+ * @param[out] value
+ * @return true on success, false if the sensor has no samples.
+ */
+bool senml_store_latest(const senml_store_t *store, const char *name, double *time,
+                        double *value);
+
+
+/**
+ * Returns the memory the samples of a store take in bytes, including chunks that were emptied
+ * and are kept for reuse.
+ * @param[in] store
+ */
+size_t senml_store_size(const senml_store_t *store);
+
+
+/**
+ * Sets up an arena in memory provided by the caller. The arena never grows and never calls
+ * malloc, so allocations fail once \p buf is used up. It can be attached to a pack for
+ * <code>senml_decode_json_s</code> and is released by releasing \p buf.
+ * @param[in] buf The memory to hand out.
+ * @param[in] size The size of \p buf in bytes.
+ * @return The arena (placed at the beginning of \p buf), or NULL if \p size is too small.
+ */
+senml_arena_t *senml_arena_init(void *buf, size_t size);
+
+
+/**
+ * Releases a pack returned by one of the decoders. Everything belonging to the pack lives in its
+ * arena, so this does not need to walk the records. Packs built by hand are left untouched.
+ * @param[in] pack The pack to release, may be NULL.
+ */
+void senml_pack_free(senml_pack_t *pack);
+
+
+/**
+ * Empties a pack returned by one of the decoders but keeps its memory, so that it can be passed
+ * as <code>senml_decode_opts_t.pack</code> to decode the next document without calling malloc.
+ * All records, base info and strings of the pack become invalid.
+ * @param[in,out] pack
+ */
+void senml_pack_reset(senml_pack_t *pack);
+
+
+/**
+ * Creates a parser for a SenML pack in JSON format that arrives in chunks, e.g. from a socket.
+ * Every record is passed to \p callback as soon as its closing brace has been fed, so the memory
+ * used by the parser is bounded by the largest record rather than the size of the pack.
+ * @param[in] callback Called for every record in document order.
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return The parser, or NULL if memory could not be allocated.
+ */
+senml_parser_t *senml_parser_new(senml_record_cb_t callback, void *ctx);
+
+
+/**
+ * Parses the next chunk of the document. Chunks may be split at any byte, including inside
+ * strings, numbers and multi-byte characters.
+ * @param[in,out] parser
+ * @param[in] chunk The next bytes of the document.
+ * @param[in] len The length of \p chunk in bytes.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory could not be allocated, or
+ * the value returned by the callback if it stopped the parser. Once it failed, the parser
+ * rejects all further input.
+ */
+int senml_parser_feed(senml_parser_t *parser, const char *chunk, size_t len);
+
+
+/**
+ * Checks that the document fed so far is complete and releases the parser.
+ * @param[in] parser
+ * @return 0 if a complete and valid pack has been parsed, -1 otherwise.
+ */
+int senml_parser_finish(senml_parser_t *parser);
+
+
+/**
+ * Starts a pool of worker threads for the batch functions. The threads sleep while no batch is
+ * being processed. Allocation hooks installed with <code>senml_set_allocator</code> are called
+ * from these threads and must be thread-safe.
+ * @param[in] threads Number of threads, or 0 for one per online CPU.
+ * @return The pool, or NULL if memory could not be allocated or a thread could not be started.
+ */
+senml_pool_t *senml_pool_new(unsigned int threads);
+
+
+/**
+ * Stops the threads of a pool and releases it. No batch may be running on the pool.
+ * @param[in] pool The pool, may be NULL.
+ */
+void senml_pool_free(senml_pool_t *pool);
+
+
+/**
+ * Decodes many independent JSON documents in parallel. The documents are split evenly across
+ * the threads of \p pool, and threads that run out of work steal from the others.
+ * Every pack is independent and must be released with <code>senml_pack_free</code>. Batches on
+ * the same pool are processed one after the other.
+ * @param[in] pool The pool to run on, or NULL to decode on the calling thread.
+ * @param[in] inputs The JSON documents.
+ * @param[in] lens The length of each document in bytes, 0 for NUL terminated documents. May be
+ * NULL if all of them are NUL terminated.
+ * @param[in] count The number of documents.
+ * @param[out] packs Receives the pack decoded from <code>inputs[i]</code> at index i, or NULL if
+ * that document could not be decoded.
+ * @return 0 if all documents were decoded, -1 otherwise. <code>senml_last_error</code> then
+ * describes the failure that was detected first.
+ */
+int senml_decode_json_batch(senml_pool_t *pool, const char *const *inputs, const size_t *lens,
+                            size_t count, senml_pack_t **packs);
+
+
+/**
+ * Encodes many independent packs to JSON in parallel, see <code>senml_decode_json_batch</code>.
+ * Each thread builds the documents in a buffer of its own that is reused across calls, so only
+ * the final documents are allocated.
+ * @param[in] pool The pool to run on, or NULL to encode on the calling thread.
+ * @param[in] packs The packs to encode.
+ * @param[in] count The number of packs.
+ * @param[out] outputs Receives the document encoded from <code>packs[i]</code> at index i, or
+ * NULL on failure. Each document must be released with <code>senml_free</code>.
+ * @return 0 if all packs were encoded, -1 otherwise, see <code>senml_decode_json_batch</code>.
+ */
+int senml_encode_json_batch(senml_pool_t *pool, const senml_pack_t *const *packs, size_t count,
+                            char **outputs);
+
+
+/**
+ * Decodes a file of SenML JSON in parallel. The file is mapped rather than read, so the records
+ * are decoded straight from the page cache and their strings point into it. It is cut into
+ * chunks of about a megabyte at record boundaries, or at line boundaries with
+ * <code>SENML_FILE_LINES</code>, which are decoded by the threads of \p pool.
+ * A file that holds a single pack reaches \p callback as one pack per chunk. Each of them has the
+ * base info of the file, but only the first one has the records that set it. Finding the record
+ * boundaries of a single pack takes a quick pass over the file before decoding starts, while the
+ * lines of a file of JSON lines are found by the threads themselves.
+ * With <code>SENML_FILE_LINES</code>, every line is a pack of its own and passed on its own, blank
+ * lines are skipped.
+ * @param[in] pool The pool to run on, or NULL to decode on the calling thread in file order.
+ * @param[in] path The file to decode.
+ * @param[in] flags Combination of SENML_FILE_* flags.
+ * @param[in] callback Called for every chunk or line.
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return 0 if the whole file was decoded, -1 otherwise. <code>senml_last_error</code> then
+ * describes the failure that was detected first, with its offset and line in the file. Decoding
+ * stops soon after a failure, but chunks that were being decoded at the time still reach the
+ * callback.
+ */
+int senml_decode_file(senml_pool_t *pool, const char *path, unsigned int flags,
+                      senml_pack_cb_t callback, void *ctx);
+
+
+/**
+ * Decodes a SenML pack in JSON format directly into columns, without building records first.
+ * Names and units are interned, so equal strings share one ID. The base info is kept as is
+ * and not applied to the records.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if \p input is NUL terminated.
+ * @return The columns, or NULL on failure. Must be released with <code>senml_columns_free</code>.
+ */
+senml_columns_t *senml_decode_json_columns(const char *input, size_t len);
+
+
+/**
+ * Decodes a SenML pack in CBOR format directly into columns, see
+ * <code>senml_decode_json_columns</code>.
+ * @param[in] input The CBOR document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes.
+ * @return The columns, or NULL on failure. Must be released with <code>senml_columns_free</code>.
+ */
+senml_columns_t *senml_decode_cbor_columns(const unsigned char *input, size_t len);
+
+
+/**
+ * Converts a pack to columns. The columns do not refer to the pack afterwards.
+ * @param[in] pack
+ * @return The columns, or NULL on failure. Must be released with <code>senml_columns_free</code>.
+ */
+senml_columns_t *senml_columns_from_pack(const senml_pack_t *pack);
+
+
+/**
+ * Converts columns to a pack. Records with the same name or unit share one copy of the string.
+ * The pack does not refer to the columns afterwards.
+ * @param[in] columns
+ * @return The pack, or NULL on failure. Must be released with <code>senml_pack_free</code>.
+ */
+senml_pack_t *senml_columns_to_pack(const senml_columns_t *columns);
+
+
+/**
+ * Releases columns returned by one of the functions above.
+ * @param[in] columns The columns, may be NULL.
+ */
+void senml_columns_free(senml_columns_t *columns);
+
+
+/**
+ * Aggregates the numeric values of all records. The base value is added to every value. Uses
+ * AVX2 or SSE2 if the CPU supports them.
+ * @param[in] columns
+ * @param[out] result
+ */
+void senml_aggregate(const senml_columns_t *columns, senml_aggregate_t *result);
+
+
+/**
+ * Aggregates the numeric values per name. As all records of a pack share the base name, this is
+ * the same as grouping by the resolved name.
+ * @param[in] columns
+ * @param[out] results One entry per string of \p columns, <code>columns->num_strings + 1</code> in
+ * total. The entry of a name is at its ID, records without a name are in the last entry.
+ */
+void senml_aggregate_by_name(const senml_columns_t *columns, senml_aggregate_t *results);
+
+
+/**
+ * Aggregates the numeric values in consecutive time windows. The time of a record is resolved
+ * against the base time first, records outside of all windows are ignored.
+ * @param[in] columns
+ * @param[in] start Resolved time at which the first window starts.
+ * @param[in] window Length of every window in seconds.
+ * @param[out] results One entry per window.
+ * @param[in] num_windows Number of windows.
+ * @return 0 on success, -1 if \p window is not positive.
+ */
+int senml_aggregate_windows(const senml_columns_t *columns, double start, double window,
+                            senml_aggregate_t *results, size_t num_windows);
+
+
+/**
+ * Resolves the time of every record against the base time.
+ * @param[in] columns
+ * @param[out] times The resolved times, <code>columns->num</code> entries.
+ */
+void senml_resolve_times(const senml_columns_t *columns, double *times);
+
+
+/**
+ * Creates an empty names table. Any number of threads may use it at the same time, lookups never
+ * block. Names and IDs stay valid until the table is released.
+ * @return The table, or NULL if memory could not be allocated.
+ */
+senml_names_t *senml_names_new(void);
+
+
+/**
+ * Releases a names table. Packs decoded with it must not be used afterwards, their names point
+ * into the table.
+ * @param[in] names The table, may be NULL.
+ */
+void senml_names_free(senml_names_t *names);
+
+
+/**
+ * Looks up a name and adds it if it is not in the table yet.
+ * @param[in] names
+ * @param[in] name The name, need not be NUL terminated.
+ * @param[in] len The length of \p name in bytes.
+ * @param[out] id The ID of the name, IDs are handed out in order starting at 0.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_names_intern(senml_names_t *names, const char *name, size_t len, uint32_t *id);
+
+
+/**
+ * Looks up a name without adding it.
+ * @param[in] names
+ * @param[in] name The name, need not be NUL terminated.
+ * @param[in] len The length of \p name in bytes.
+ * @param[out] id The ID of the name, or SENML_NO_ID if it is not in the table.
+ * @return 0 if the name was found, -1 otherwise.
+ */
+int senml_names_find(const senml_names_t *names, const char *name, size_t len, uint32_t *id);
+
+
+/**
+ * Returns the canonical copy of a name.
+ * @param[in] names
+ * @param[in] id
+ * @return The name, NUL terminated, or a view with <code>p</code> NULL if the ID is unknown.
+ */
+senml_str_t senml_names_get(const senml_names_t *names, uint32_t id);
+
+
+/**
+ * Returns the number of names in the table, which is also the next ID to be handed out.
+ * @param[in] names
+ */
+size_t senml_names_count(const senml_names_t *names);
+
+
+/**
+ * Creates a filter that keeps the records whose resolved name is one of \p names. Lookups take a
+ * single hash of the name, however many names there are.
+ * @param[in] names The names, NUL terminated. They are copied.
+ * @param[in] count The number of names.
+ * @return The filter, or NULL if memory could not be allocated.
+ */
+senml_filter_t *senml_filter_names(const char *const *names, size_t count);
+
+
+/**
+ * Creates a filter that keeps the records whose resolved name starts with \p prefix.
+ * @param[in] prefix The prefix, NUL terminated. It is copied.
+ * @return The filter, or NULL if memory could not be allocated.
+ */
+senml_filter_t *senml_filter_prefix(const char *prefix);
+
+
+/**
+ * Creates a filter that asks \p match about every record, e.g. to apply a pattern compiled in
+ * advance. The resolved name is only assembled if the pack has a base name.
+ * @param[in] match Called with the resolved name of every record, possibly from several threads.
+ * @param[in] ctx Passed to every call of \p match.
+ * @return The filter, or NULL if memory could not be allocated.
+ */
+senml_filter_t *senml_filter_match(senml_match_t match, void *ctx);
+
+
+/**
+ * Releases a filter. No decoder may be using it.
+ * @param[in] filter The filter, may be NULL.
+ */
+void senml_filter_free(senml_filter_t *filter);
+
+
+/**
+ * Returns the error of the most recent encode or decode call made on the calling thread. Every
+ * encode and decode function (including the parser and the batch functions) records its outcome
+ * here instead of printing anything; other functions only record running out of memory.
+ * @return The error, its code is SENML_OK if the call succeeded. Valid until the thread exits.
+ */
+const senml_error_t *senml_last_error(void);
+
+
+/**
+ * Describes a kind of error in a few words, e.g. for log messages.
+ * @param[in] code
+ * @return A static string.
+ */
+const char *senml_error_string(senml_error_code_t code);
+
+
+/**
+ * Turns statistics on or off for all threads. They are off by default, and while they are off
+ * the encoders and decoders only test a flag per call. With SENML_STATS_COUNTERS every call adds
+ * to a few counters of the calling thread. SENML_STATS_TIMING additionally reads the clock at the
+ * start and the end of every call and around every decoded record.
+ * @param[in] flags Combination of SENML_STATS_* flags, 0 to turn statistics off.
+ */
+void senml_stats_enable(unsigned int flags);
+
+
+/**
+ * Sums up the counters of all threads, including threads that have exited. Calls that are running
+ * at the same time may or may not be included.
+ *
+ * Times are CPU time stamp counter ticks on x86 and nanoseconds elsewhere. The parse phase of a
+ * decoder is the whole call minus the time spent converting records. Time spent in record
+ * callbacks is not counted at all.
+ * @param[out] stats
+ */
+void senml_stats_get(senml_stats_t *stats);
+
+
+/**
+ * Starts counting from zero again.
+ */
+void senml_stats_reset(void);
+
+
+/**
+ * Replaces the functions the library allocates memory with. This must be
+ * called before any other function of the library and is not thread-safe.
+ * @param[in] allocator The new allocation functions, or NULL to go back to malloc(3) and free(3).
+ */
+void senml_set_allocator(const senml_allocator_t *allocator);
+
+
+/**
+ * Releases a document returned by one of the encoders.
+ * @param[in] ptr
+ */
+void senml_free(void *ptr);
+
+
 /**
  * Pretty prints the base info.
  * @param[in] base_info
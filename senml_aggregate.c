@@ -0,0 +1,343 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SENML_AGGREGATE_X86
+#endif
+
+
+/**
+ * Adds the values of the numeric records among \p n records to \p acc, each increased by
+ * \p offset. While accumulating, min and max of an empty aggregate are infinite.
+ */
+typedef void (*senml_aggregate_kernel_t)(const double *values, const uint8_t *types, size_t n,
+                                         double offset, senml_aggregate_t *acc);
+
+
+static inline void senml_aggregate_start(senml_aggregate_t *acc)
+{
+	acc->count = 0;
+	acc->min   = INFINITY;
+	acc->max   = -INFINITY;
+	acc->sum   = 0;
+	acc->mean  = 0;
+}
+
+
+static inline void senml_aggregate_finish(senml_aggregate_t *acc)
+{
+	if (acc->count == 0) {
+		memset(acc, 0, sizeof(senml_aggregate_t));
+		return;
+	}
+	
+	acc->mean = acc->sum / (double)acc->count;
+}
+
+
+static void senml_aggregate_scalar(const double *values, const uint8_t *types, size_t n,
+                                   double offset, senml_aggregate_t *acc)
+{
+	for (size_t i = 0; i < n; i++) {
+		double v = values[i] + offset;
+		
+		if (types[i] != SENML_TYPE_FLOAT)
+			continue;
+		
+		// same operand order as minpd and maxpd, so all kernels agree on NaN
+		acc->min = v < acc->min ? v : acc->min;
+		acc->max = v > acc->max ? v : acc->max;
+		acc->sum += v;
+		acc->count++;
+	}
+}
+
+
+#ifdef SENML_AGGREGATE_X86
+
+__attribute__((target("sse2")))
+static void senml_aggregate_sse2(const double *values, const uint8_t *types, size_t n,
+                                 double offset, senml_aggregate_t *acc)
+{
+	const __m128d pinf = _mm_set1_pd(INFINITY);
+	const __m128d ninf = _mm_set1_pd(-INFINITY);
+	const __m128d off  = _mm_set1_pd(offset);
+	__m128d       min  = pinf;
+	__m128d       max  = ninf;
+	__m128d       sum  = _mm_setzero_pd();
+	size_t        i    = 0;
+	double        lanes[2];
+	
+	for (; i + 2 <= n; i += 2) {
+		__m128d mask = _mm_castsi128_pd(_mm_set_epi64x(-(int64_t)(types[i + 1] == SENML_TYPE_FLOAT),
+		                                               -(int64_t)(types[i] == SENML_TYPE_FLOAT)));
+		__m128d v    = _mm_add_pd(_mm_loadu_pd(values + i), off);
+		
+		// SSE2 has no blend, the other lanes are replaced with the neutral element by hand
+		min = _mm_min_pd(_mm_or_pd(_mm_and_pd(mask, v), _mm_andnot_pd(mask, pinf)), min);
+		max = _mm_max_pd(_mm_or_pd(_mm_and_pd(mask, v), _mm_andnot_pd(mask, ninf)), max);
+		sum = _mm_add_pd(_mm_and_pd(mask, v), sum);
+		acc->count += (size_t)__builtin_popcount((unsigned int)_mm_movemask_pd(mask));
+	}
+	
+	_mm_storeu_pd(lanes, min);
+	acc->min = lanes[0] < acc->min ? lanes[0] : acc->min;
+	acc->min = lanes[1] < acc->min ? lanes[1] : acc->min;
+	_mm_storeu_pd(lanes, max);
+	acc->max = lanes[0] > acc->max ? lanes[0] : acc->max;
+	acc->max = lanes[1] > acc->max ? lanes[1] : acc->max;
+	_mm_storeu_pd(lanes, sum);
+	acc->sum += lanes[0] + lanes[1];
+	
+	senml_aggregate_scalar(values + i, types + i, n - i, offset, acc);
+}
+
+
+__attribute__((target("avx2")))
+static void senml_aggregate_avx2(const double *values, const uint8_t *types, size_t n,
+                                 double offset, senml_aggregate_t *acc)
+{
+	const __m256d pinf    = _mm256_set1_pd(INFINITY);
+	const __m256d ninf    = _mm256_set1_pd(-INFINITY);
+	const __m256d off     = _mm256_set1_pd(offset);
+	const __m256i numeric = _mm256_set1_epi64x(SENML_TYPE_FLOAT);
+	__m256d       min     = pinf;
+	__m256d       max     = ninf;
+	__m256d       sum0    = _mm256_setzero_pd();
+	__m256d       sum1    = _mm256_setzero_pd();
+	size_t        i       = 0;
+	double        lanes[4];
+	
+	// two sums per iteration hide the latency of the additions
+	for (; i + 8 <= n; i += 8) {
+		__m128i t     = _mm_loadl_epi64((const __m128i *)(types + i));
+		__m256d mask0 = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_cvtepu8_epi64(t), numeric));
+		__m256d mask1 = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+			_mm256_cvtepu8_epi64(_mm_srli_si128(t, 4)), numeric));
+		__m256d v0    = _mm256_add_pd(_mm256_loadu_pd(values + i), off);
+		__m256d v1    = _mm256_add_pd(_mm256_loadu_pd(values + i + 4), off);
+		
+		min  = _mm256_min_pd(_mm256_blendv_pd(pinf, v0, mask0), min);
+		min  = _mm256_min_pd(_mm256_blendv_pd(pinf, v1, mask1), min);
+		max  = _mm256_max_pd(_mm256_blendv_pd(ninf, v0, mask0), max);
+		max  = _mm256_max_pd(_mm256_blendv_pd(ninf, v1, mask1), max);
+		sum0 = _mm256_add_pd(_mm256_and_pd(mask0, v0), sum0);
+		sum1 = _mm256_add_pd(_mm256_and_pd(mask1, v1), sum1);
+		acc->count += (size_t)__builtin_popcount((unsigned int)(_mm256_movemask_pd(mask0) |
+		                                                        _mm256_movemask_pd(mask1) << 4));
+	}
+	
+	_mm256_storeu_pd(lanes, min);
+	
+	for (int lane = 0; lane < 4; lane++)
+		acc->min = lanes[lane] < acc->min ? lanes[lane] : acc->min;
+	
+	_mm256_storeu_pd(lanes, max);
+	
+	for (int lane = 0; lane < 4; lane++)
+		acc->max = lanes[lane] > acc->max ? lanes[lane] : acc->max;
+	
+	_mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+	acc->sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	
+	senml_aggregate_sse2(values + i, types + i, n - i, offset, acc);
+}
+
+#endif
+
+
+static senml_aggregate_kernel_t senml_aggregate_selected;  //!< Kernel in use, NULL until chosen
+
+
+/**
+ * Picks the widest kernel the CPU supports, the choice is made once.
+ */
+static senml_aggregate_kernel_t senml_aggregate_kernel(void)
+{
+	senml_aggregate_kernel_t selected = __atomic_load_n(&senml_aggregate_selected,
+	                                                    __ATOMIC_RELAXED);
+	
+	if (selected)
+		return selected;
+	
+	selected = senml_aggregate_scalar;
+
+#ifdef SENML_AGGREGATE_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2"))
+		selected = senml_aggregate_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		selected = senml_aggregate_sse2;
+#endif
+
+	// every thread makes the same choice, so it does not matter which store wins
+	__atomic_store_n(&senml_aggregate_selected, selected, __ATOMIC_RELAXED);
+	
+	return selected;
+}
+
+
+int senml_aggregate_force(senml_kernel_t kernel)
+{
+	senml_aggregate_kernel_t selected = NULL;
+	
+#ifdef SENML_AGGREGATE_X86
+	__builtin_cpu_init();
+#endif
+
+	switch (kernel) {
+	case SENML_KERNEL_AUTO:
+		break;
+	
+	case SENML_KERNEL_SCALAR:
+		selected = senml_aggregate_scalar;
+		break;
+	
+#ifdef SENML_AGGREGATE_X86
+	case SENML_KERNEL_SSE2:
+		if (!__builtin_cpu_supports("sse2"))
+			return -1;
+		
+		selected = senml_aggregate_sse2;
+		break;
+	
+	case SENML_KERNEL_AVX2:
+		if (!__builtin_cpu_supports("avx2"))
+			return -1;
+		
+		selected = senml_aggregate_avx2;
+		break;
+#endif
+
+	default:
+		return -1;
+	}
+	
+	// AUTO clears the choice, so that the next call makes it again
+	__atomic_store_n(&senml_aggregate_selected, selected, __ATOMIC_RELAXED);
+	
+	return 0;
+}
+
+
+static inline double senml_aggregate_base_value(const senml_columns_t *columns)
+{
+	if (!columns->base_info || columns->base_info->base_value_type != SENML_TYPE_FLOAT)
+		return 0;
+	
+	return columns->base_info->base_value.base_value_f;
+}
+
+
+static inline double senml_aggregate_base_time(const senml_columns_t *columns)
+{
+	return columns->base_info ? columns->base_info->base_time : 0;
+}
+
+
+void senml_aggregate(const senml_columns_t *columns, senml_aggregate_t *result)
+{
+	senml_aggregate_start(result);
+	senml_aggregate_kernel()(columns->value_f, columns->value_type, columns->num,
+	                         senml_aggregate_base_value(columns), result);
+	senml_aggregate_finish(result);
+}
+
+
+void senml_aggregate_by_name(const senml_columns_t *columns, senml_aggregate_t *results)
+{
+	senml_aggregate_kernel_t kernel = senml_aggregate_kernel();
+	double                   offset = senml_aggregate_base_value(columns);
+	size_t                   i      = 0;
+	
+	for (size_t id = 0; id <= columns->num_strings; id++)
+		senml_aggregate_start(&results[id]);
+	
+	// records of one sensor tend to follow each other, each run goes to the kernel as a whole
+	while (i < columns->num) {
+		uint32_t id  = columns->name_id[i];
+		size_t   end = i + 1;
+		
+		while (end < columns->num && columns->name_id[end] == id)
+			end++;
+		
+		kernel(columns->value_f + i, columns->value_type + i, end - i, offset,
+		       &results[id == SENML_NO_ID ? columns->num_strings : id]);
+		i = end;
+	}
+	
+	for (size_t id = 0; id <= columns->num_strings; id++)
+		senml_aggregate_finish(&results[id]);
+}
+
+
+/**
+ * Finds the window a resolved time falls into.
+ * @return true if it falls into one of the windows.
+ */
+static inline bool senml_aggregate_window_of(double time, double start, double window,
+                                             size_t num_windows, size_t *index)
+{
+	double position = floor((time - start) / window);
+	
+	// also false for NaN
+	if (!(position >= 0 && position < (double)num_windows))
+		return false;
+	
+	*index = (size_t)position;
+	return true;
+}
+
+
+int senml_aggregate_windows(const senml_columns_t *columns, double start, double window,
+                            senml_aggregate_t *results, size_t num_windows)
+{
+	senml_aggregate_kernel_t kernel    = senml_aggregate_kernel();
+	double                   offset    = senml_aggregate_base_value(columns);
+	double                   base_time = senml_aggregate_base_time(columns);
+	size_t                   i         = 0;
+	
+	if (!(window > 0))
+		return -1;
+	
+	for (size_t w = 0; w < num_windows; w++)
+		senml_aggregate_start(&results[w]);
+	
+	// records are usually ordered by time, so every window is one run of records
+	while (i < columns->num) {
+		size_t index, next, end = i + 1;
+		
+		if (!senml_aggregate_window_of(columns->time[i] + base_time, start, window, num_windows,
+		                               &index)) {
+			i++;
+			continue;
+		}
+		
+		while (end < columns->num &&
+		       senml_aggregate_window_of(columns->time[end] + base_time, start, window, num_windows,
+		                                 &next) && next == index)
+			end++;
+		
+		kernel(columns->value_f + i, columns->value_type + i, end - i, offset, &results[index]);
+		i = end;
+	}
+	
+	for (size_t w = 0; w < num_windows; w++)
+		senml_aggregate_finish(&results[w]);
+	
+	return 0;
+}
+
+
+void senml_resolve_times(const senml_columns_t *columns, double *times)
+{
+	double base_time = senml_aggregate_base_time(columns);
+	
+	for (size_t i = 0; i < columns->num; i++)
+		times[i] = columns->time[i] + base_time;
+}
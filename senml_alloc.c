@@ -0,0 +1,307 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SENML_ARENA_MIN_CHUNK (1024)       //!< Smallest chunk worth a call to malloc
+#define SENML_ARENA_MAX_CHUNK (1 << 24)    //!< Chunks stop doubling at this size
+
+
+static void *senml_libc_malloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	return malloc(size);
+}
+
+
+static void *senml_libc_realloc(void *ptr, size_t size, void *ctx)
+{
+	(void)ctx;
+	return realloc(ptr, size);
+}
+
+
+static void senml_libc_free(void *ptr, void *ctx)
+{
+	(void)ctx;
+	free(ptr);
+}
+
+
+static senml_allocator_t senml_allocator = {
+	.malloc  = senml_libc_malloc,
+	.realloc = senml_libc_realloc,
+	.free    = senml_libc_free,
+	.ctx     = NULL
+};
+
+
+void *senml_malloc(size_t size)
+{
+	void *ptr = senml_allocator.malloc(size, senml_allocator.ctx);
+	
+	if (senml_stats_on(SENML_STATS_COUNTERS))
+		senml_stats_add_alloc(size);
+	
+	if (!ptr)
+		senml_error_set(SENML_ERROR_NO_MEMORY, 0, "could not allocate %zu bytes", size);
+	
+	return ptr;
+}
+
+
+void *senml_realloc(void *ptr, size_t size)
+{
+	void *moved = senml_allocator.realloc(ptr, size, senml_allocator.ctx);
+	
+	if (senml_stats_on(SENML_STATS_COUNTERS))
+		senml_stats_add_alloc(size);
+	
+	if (!moved)
+		senml_error_set(SENML_ERROR_NO_MEMORY, 0, "could not allocate %zu bytes", size);
+	
+	return moved;
+}
+
+
+void senml_free(void *ptr)
+{
+	senml_allocator.free(ptr, senml_allocator.ctx);
+}
+
+
+void senml_set_allocator(const senml_allocator_t *allocator)
+{
+	if (allocator) {
+		senml_allocator = *allocator;
+	} else {
+		senml_allocator.malloc  = senml_libc_malloc;
+		senml_allocator.realloc = senml_libc_realloc;
+		senml_allocator.free    = senml_libc_free;
+		senml_allocator.ctx     = NULL;
+	}
+}
+
+
+bool senml_writer_grow(senml_writer_t *w, size_t n)
+{
+	size_t  cap = w->cap ? w->cap : 256;
+	char   *buf;
+	
+	while (cap - w->len < n)
+		cap *= 2;
+	
+	if (!(buf = senml_realloc(w->buf, cap)))
+		return false;
+	
+	w->buf = buf;
+	w->cap = cap;
+	
+	return true;
+}
+
+
+static senml_arena_chunk_t *senml_arena_new_chunk(size_t size)
+{
+	senml_arena_chunk_t *chunk = senml_malloc(sizeof(senml_arena_chunk_t) + size);
+	
+	if (chunk) {
+		chunk->next = NULL;
+		chunk->size = size;
+		chunk->used = 0;
+	}
+	
+	return chunk;
+}
+
+
+senml_arena_t *senml_arena_new(size_t size)
+{
+	size_t header = SENML_ARENA_ALIGN(sizeof(senml_arena_t));
+	
+	if (size < SENML_ARENA_MIN_CHUNK)
+		size = SENML_ARENA_MIN_CHUNK;
+	
+	senml_arena_chunk_t *chunk = senml_arena_new_chunk(header + SENML_ARENA_ALIGN(size));
+	
+	if (!chunk)
+		return NULL;
+	
+	senml_arena_t *arena = (senml_arena_t *)chunk->data;
+	
+	arena->first   = chunk;
+	arena->current = chunk;
+	arena->mark    = header;
+	arena->last    = NULL;
+	arena->fixed   = false;
+	chunk->used    = header;
+	
+	return arena;
+}
+
+
+senml_arena_t *senml_arena_init(void *buf, size_t size)
+{
+	uintptr_t offset = SENML_ARENA_ALIGN((uintptr_t)buf) - (uintptr_t)buf;
+	size_t    header = sizeof(senml_arena_chunk_t) + SENML_ARENA_ALIGN(sizeof(senml_arena_t));
+	
+	if (size < offset + header)
+		return NULL;
+	
+	senml_arena_chunk_t *chunk = (senml_arena_chunk_t *)((unsigned char *)buf + offset);
+	senml_arena_t       *arena = (senml_arena_t *)chunk->data;
+	
+	chunk->next = NULL;
+	chunk->size = size - offset - sizeof(senml_arena_chunk_t);
+	chunk->used = SENML_ARENA_ALIGN(sizeof(senml_arena_t));
+	
+	arena->first   = chunk;
+	arena->current = chunk;
+	arena->mark    = chunk->used;
+	arena->last    = NULL;
+	arena->fixed   = true;
+	
+	return arena;
+}
+
+
+senml_pack_t *senml_arena_new_pack(size_t size)
+{
+	senml_arena_t *arena = senml_arena_new(SENML_ARENA_ALIGN(sizeof(senml_pack_t)) + size);
+	
+	if (!arena)
+		return NULL;
+	
+	senml_pack_t *pack = senml_arena_alloc(arena, sizeof(senml_pack_t));
+	
+	memset(pack, 0, sizeof(senml_pack_t));
+	pack->arena = arena;
+	arena->mark = arena->first->used;
+	arena->last = NULL;
+	
+	return pack;
+}
+
+
+/**
+ * Moves on to a chunk with at least \p size free bytes, reusing chunks kept by a reset first.
+ */
+static senml_arena_chunk_t *senml_arena_next_chunk(senml_arena_t *arena, size_t size)
+{
+	senml_arena_chunk_t *current = arena->current;
+	senml_arena_chunk_t *chunk   = current->next;
+	
+	if (chunk && chunk->size >= size) {
+		arena->current = chunk;
+		return chunk;
+	}
+	
+	if (arena->fixed) {
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "the arena is full");
+		return NULL;
+	}
+	
+	size_t chunk_size = current->size < SENML_ARENA_MAX_CHUNK / 2 ?
+	                    current->size * 2 : SENML_ARENA_MAX_CHUNK;
+	
+	if (chunk_size < size)
+		chunk_size = size;
+	
+	if (!(chunk = senml_arena_new_chunk(chunk_size)))
+		return NULL;
+	
+	// a kept chunk that was too small stays in the list and is used after this one
+	chunk->next    = current->next;
+	current->next  = chunk;
+	arena->current = chunk;
+	
+	return chunk;
+}
+
+
+void *senml_arena_alloc(senml_arena_t *arena, size_t size)
+{
+	senml_arena_chunk_t *chunk = arena->current;
+	void                *ptr;
+	
+	size = SENML_ARENA_ALIGN(size);
+	
+	if (chunk->size - chunk->used < size && !(chunk = senml_arena_next_chunk(arena, size)))
+		return NULL;
+	
+	ptr          = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->last  = ptr;
+	
+	return ptr;
+}
+
+
+void *senml_arena_grow(senml_arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	senml_arena_chunk_t *chunk = arena->current;
+	void                *copy;
+	
+	old_size = SENML_ARENA_ALIGN(old_size);
+	new_size = SENML_ARENA_ALIGN(new_size);
+	
+	if (ptr && ptr == arena->last && chunk->size - chunk->used + old_size >= new_size) {
+		chunk->used = chunk->used - old_size + new_size;
+		return ptr;
+	}
+	
+	if ((copy = senml_arena_alloc(arena, new_size)) && ptr)
+		memcpy(copy, ptr, old_size < new_size ? old_size : new_size);
+	
+	return copy;
+}
+
+
+void senml_arena_reset(senml_arena_t *arena)
+{
+	for (senml_arena_chunk_t *chunk = arena->first->next; chunk; chunk = chunk->next)
+		chunk->used = 0;
+	
+	arena->first->used = arena->mark;
+	arena->current     = arena->first;
+	arena->last        = NULL;
+}
+
+
+void senml_arena_free(senml_arena_t *arena)
+{
+	senml_arena_chunk_t *chunk = arena->first;
+	
+	if (arena->fixed)
+		return;
+	
+	// the arena lives in its first chunk, so it must not be touched after that one is gone
+	while (chunk) {
+		senml_arena_chunk_t *next = chunk->next;
+		
+		senml_free(chunk);
+		chunk = next;
+	}
+}
+
+
+void senml_pack_free(senml_pack_t *pack)
+{
+	if (pack && pack->arena)
+		senml_arena_free(pack->arena);
+}
+
+
+void senml_pack_reset(senml_pack_t *pack)
+{
+	if (!pack->arena)
+		return;
+	
+	senml_arena_reset(pack->arena);
+	
+	pack->base_info = NULL;
+	pack->records   = NULL;
+	pack->num       = 0;
+}
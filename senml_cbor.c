@@ -0,0 +1,1245 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+
+#define SENML_CBOR_MAX_DEPTH (2048)   //!< Nesting limit for values we skip
+
+#define CBOR_UINT        (0)   //!< Major type of unsigned integers
+#define CBOR_NEGINT      (1)   //!< Major type of negative integers
+#define CBOR_BYTES       (2)   //!< Major type of byte strings
+#define CBOR_TEXT        (3)   //!< Major type of text strings
+#define CBOR_ARRAY       (4)   //!< Major type of arrays
+#define CBOR_MAP         (5)   //!< Major type of maps
+#define CBOR_TAG         (6)   //!< Major type of tagged items
+#define CBOR_SIMPLE      (7)   //!< Major type of floats and simple values
+
+#define CBOR_FALSE       (20)  //!< Additional information of the simple value false
+#define CBOR_TRUE        (21)  //!< Additional information of the simple value true
+#define CBOR_HALF        (25)  //!< Additional information of half precision floats
+#define CBOR_ARG32       (26)  //!< Additional information of a 4 byte argument
+#define CBOR_SINGLE      (26)  //!< Additional information of single precision floats
+#define CBOR_DOUBLE      (27)  //!< Additional information of double precision floats
+#define CBOR_INDEFINITE  (31)  //!< Additional information of indefinite length items
+
+#define CBOR_BREAK       (0xff)  //!< Terminates indefinite length items
+
+
+/*! Read position inside a CBOR document */
+typedef struct {
+	const uint8_t *start;  //!< Beginning of the document, used to report error positions
+	const uint8_t *p;      //!< Next byte to be consumed
+	const uint8_t *end;    //!< One past the last byte of the document
+	unsigned int   depth;  //!< Current nesting depth while skipping unknown values
+} senml_cbor_cursor_t;
+
+
+/**
+ * Records an error at the cursor position. Malformed input or an invalid value at the end of the
+ * document counts as truncated.
+ */
+static void senml_cbor_error(const senml_cbor_cursor_t *c, senml_error_code_t code, size_t record,
+                             const char *msg)
+{
+	senml_error_t *error;
+	
+	if ((code == SENML_ERROR_SYNTAX || code == SENML_ERROR_RECORD) && c->p >= c->end)
+		code = SENML_ERROR_TRUNCATED;
+	
+	error         = senml_error_set(code, record, "%s", msg);
+	error->offset = (size_t)(c->p - c->start);
+}
+
+
+/*! Initial byte and argument of a data item */
+typedef struct {
+	uint8_t  major;       //!< Major type
+	uint8_t  info;        //!< Additional information
+	uint64_t arg;         //!< Value, length or count; 0 for indefinite items
+	bool     indefinite;  //!< Length is determined by a break
+} senml_cbor_head_t;
+
+
+static inline uint64_t senml_cbor_be(const uint8_t *p, size_t len)
+{
+	uint64_t value = 0;
+	
+	for (size_t i = 0; i < len; i++)
+		value = (value << 8) | p[i];
+	
+	return value;
+}
+
+
+/**
+ * Reads the head of the next data item.
+ * @return 0 on success, -1 if the input is truncated or malformed.
+ */
+static int senml_cbor_read_head(senml_cbor_cursor_t *c, senml_cbor_head_t *head)
+{
+	size_t len;
+	
+	if (c->p >= c->end)
+		return -1;
+	
+	head->major      = *c->p >> 5;
+	head->info       = *c->p & 0x1f;
+	head->indefinite = false;
+	c->p++;
+	
+	if (head->info < 24) {
+		head->arg = head->info;
+		return 0;
+	}
+	
+	switch (head->info) {
+	case 24: len = 1; break;
+	case 25: len = 2; break;
+	case 26: len = 4; break;
+	case 27: len = 8; break;
+	
+	case CBOR_INDEFINITE:
+		// only strings and containers have an indefinite form. A break is no item of its own, it is
+		// consumed by the container or string that expects it
+		if (head->major < CBOR_BYTES || head->major >= CBOR_TAG)
+			return -1;
+		
+		head->arg        = 0;
+		head->indefinite = true;
+		return 0;
+	
+	default:
+		return -1;
+	}
+	
+	if ((size_t)(c->end - c->p) < len)
+		return -1;
+	
+	head->arg = senml_cbor_be(c->p, len);
+	c->p     += len;
+	
+	return 0;
+}
+
+
+static inline bool senml_cbor_at_break(const senml_cbor_cursor_t *c)
+{
+	return c->p < c->end && *c->p == CBOR_BREAK;
+}
+
+
+static double senml_cbor_half(uint16_t half)
+{
+	int    exponent = (half >> 10) & 0x1f;
+	int    mantissa = half & 0x3ff;
+	double value;
+	
+	if (exponent == 0)
+		value = ldexp(mantissa, -24);
+	else if (exponent != 31)
+		value = ldexp(mantissa + 1024, exponent - 25);
+	else
+		value = mantissa == 0 ? INFINITY : NAN;
+	
+	return half & 0x8000 ? -value : value;
+}
+
+
+static double senml_cbor_single(uint32_t bits)
+{
+	float value;
+	
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+static double senml_cbor_double(uint64_t bits)
+{
+	double value;
+	
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+/**
+ * Skips (and validates) an arbitrary data item.
+ * @return 0 on success, -1 if the input is truncated or malformed.
+ */
+static int senml_cbor_skip(senml_cbor_cursor_t *c)
+{
+	senml_cbor_head_t head;
+	
+	// tags do not nest the item they tag, so any number of them is read in a loop
+	do {
+		if (senml_cbor_read_head(c, &head))
+			return -1;
+	} while (head.major == CBOR_TAG);
+	
+	switch (head.major) {
+	case CBOR_BYTES:
+	case CBOR_TEXT:
+		if (!head.indefinite) {
+			if ((uint64_t)(c->end - c->p) < head.arg)
+				return -1;
+			
+			c->p += head.arg;
+			return 0;
+		}
+		
+		// chunks must be definite strings of the same major type
+		while (!senml_cbor_at_break(c)) {
+			senml_cbor_head_t chunk;
+			
+			if (senml_cbor_read_head(c, &chunk) || chunk.major != head.major ||
+			    chunk.indefinite || (uint64_t)(c->end - c->p) < chunk.arg)
+				return -1;
+			
+			c->p += chunk.arg;
+		}
+		
+		c->p++;
+		return 0;
+	
+	case CBOR_ARRAY:
+	case CBOR_MAP: {
+		uint64_t items = head.major == CBOR_MAP ? 2 : 1;
+		
+		if (++c->depth > SENML_CBOR_MAX_DEPTH)
+			return -1;
+		
+		if (head.indefinite) {
+			while (!senml_cbor_at_break(c))
+				for (uint64_t i = 0; i < items; i++)
+					if (senml_cbor_skip(c))
+						return -1;
+			
+			c->p++;
+		} else {
+			for (uint64_t i = 0; i < head.arg; i++)
+				for (uint64_t j = 0; j < items; j++)
+					if (senml_cbor_skip(c))
+						return -1;
+		}
+		
+		c->depth--;
+		return 0;
+	}
+	
+	default:
+		return 0;
+	}
+}
+
+
+/**
+ * Reads a text string without copying it.
+ * @return 0 on success, -1 if the next item is not a well-formed text string.
+ */
+static int senml_cbor_read_text(senml_cbor_cursor_t *c, senml_token_t *token)
+{
+	const uint8_t     *start = c->p;
+	senml_cbor_head_t  head;
+	
+	if (senml_cbor_read_head(c, &head) || head.major != CBOR_TEXT)
+		return -1;
+	
+	if (!head.indefinite) {
+		if ((uint64_t)(c->end - c->p) < head.arg)
+			return -1;
+		
+		token->p    = (const char *)c->p;
+		token->len  = (size_t)head.arg;
+		token->kind = SENML_TOKEN_PLAIN;
+		c->p       += head.arg;
+		return 0;
+	}
+	
+	c->p = start;
+	
+	if (senml_cbor_skip(c))
+		return -1;
+	
+	// the token spans the chunks including their heads, senml_cbor_join_chunks strips them
+	token->p    = (const char *)start + 1;
+	token->len  = (size_t)(c->p - start) - 2;
+	token->kind = SENML_TOKEN_CBOR_CHUNKED;
+	return 0;
+}
+
+
+size_t senml_cbor_join_chunks(const senml_token_t *token, char *out)
+{
+	senml_cbor_cursor_t c = {
+		.p   = (const uint8_t *)token->p,
+		.end = (const uint8_t *)token->p + token->len
+	};
+	
+	senml_cbor_head_t chunk;
+	size_t            len = 0;
+	
+	// the chunks have been validated by senml_cbor_read_text
+	while (c.p < c.end && senml_cbor_read_head(&c, &chunk) == 0) {
+		memcpy(out + len, c.p, (size_t)chunk.arg);
+		len += (size_t)chunk.arg;
+		c.p += chunk.arg;
+	}
+	
+	return len;
+}
+
+
+/**
+ * Reads a number of any CBOR representation (integers, half, single and double floats).
+ * Tags, e.g. for epoch based date/time, are ignored.
+ * @return 0 on success, -1 if the next item is not a number.
+ */
+static int senml_cbor_read_number(senml_cbor_cursor_t *c, double *value)
+{
+	senml_cbor_head_t head;
+	
+	do {
+		if (senml_cbor_read_head(c, &head))
+			return -1;
+	} while (head.major == CBOR_TAG);
+	
+	switch (head.major) {
+	case CBOR_UINT:
+		*value = (double)head.arg;
+		return 0;
+	
+	case CBOR_NEGINT:
+		*value = -1.0 - (double)head.arg;
+		return 0;
+	
+	case CBOR_SIMPLE:
+		switch (head.info) {
+		case CBOR_HALF:   *value = senml_cbor_half((uint16_t)head.arg);     return 0;
+		case CBOR_SINGLE: *value = senml_cbor_single((uint32_t)head.arg);   return 0;
+		case CBOR_DOUBLE: *value = senml_cbor_double(head.arg);             return 0;
+		default:          return -1;
+		}
+	
+	default:
+		return -1;
+	}
+}
+
+
+/**
+ * Checks whether the next item is a number that <code>senml_cbor_read_number</code> accepts.
+ */
+static bool senml_cbor_at_number(const senml_cbor_cursor_t *c)
+{
+	const uint8_t *p = c->p;
+	
+	// skip the heads of tags, they are ignored by senml_cbor_read_number as well
+	while (p < c->end && *p >> 5 == CBOR_TAG) {
+		uint8_t info = *p & 0x1f;
+		
+		p += 1 + (info < 24 ? 0 : info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 8);
+	}
+	
+	if (p >= c->end)
+		return false;
+	
+	return *p >> 5 == CBOR_UINT || *p >> 5 == CBOR_NEGINT ||
+	       (*p >> 5 == CBOR_SIMPLE && (*p & 0x1f) >= CBOR_HALF && (*p & 0x1f) <= CBOR_DOUBLE);
+}
+
+
+/**
+ * Reads a map key. Keys that are not integers are reported as INT64_MIN.
+ * @return 0 on success, -1 if the input is malformed.
+ */
+static int senml_cbor_read_key(senml_cbor_cursor_t *c, int64_t *key)
+{
+	const uint8_t     *start = c->p;
+	senml_cbor_head_t  head;
+	
+	if (senml_cbor_read_head(c, &head))
+		return -1;
+	
+	if (head.major == CBOR_UINT && head.arg <= INT64_MAX) {
+		*key = (int64_t)head.arg;
+	} else if (head.major == CBOR_NEGINT && head.arg < INT64_MAX) {
+		*key = -1 - (int64_t)head.arg;
+	} else {
+		c->p = start;
+		*key = INT64_MIN;
+		return senml_cbor_skip(c);
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Scans one record map in a single pass. Base attributes are only honored if
+ * \p with_base_info is set, i.e. for the first record of a pack. Attributes and records
+ * \p select does not keep are skipped, see <code>senml_json_scan_record</code>.
+ */
+static int senml_cbor_scan_record(senml_cbor_cursor_t *c, senml_fields_t *fields,
+                                  bool with_base_info, const senml_select_t *select)
+{
+	senml_cbor_head_t head;
+	uint64_t          remaining;
+	
+	memset(fields, 0, sizeof(*fields));
+	
+	if (senml_cbor_read_head(c, &head) || head.major != CBOR_MAP)
+		return -1;
+	
+	remaining = head.arg;
+	
+	while (head.indefinite ? !senml_cbor_at_break(c) : remaining-- > 0) {
+		int64_t key;
+		int     rc;
+		
+		if (senml_cbor_read_key(c, &key))
+			return -1;
+		
+		// once a record has been rejected, the rest of it is only validated
+		switch (fields->rejected ? INT64_MAX : key) {
+		case SC_NAME:
+			if ((select->skip & SENML_FIELD_NAME) && !select->filter)
+				goto skip;
+			
+			rc = senml_cbor_read_text(c, &fields->name);
+			fields->has_name = true;
+			
+			// the first record may set the base name after the name, the decoder tests it then
+			if (rc == 0 && select->filter && !with_base_info)
+				senml_select_name(select, fields);
+			
+			break;
+		
+		case SC_UNIT:
+			if (select->skip & SENML_FIELD_UNIT)
+				goto skip;
+			
+			rc = senml_cbor_read_text(c, &fields->unit);
+			fields->has_unit = true;
+			break;
+		
+		case SC_TIME:
+			if (select->skip & SENML_FIELD_TIME)
+				goto skip;
+			
+			rc = senml_cbor_read_number(c, &fields->time);
+			fields->has_time = true;
+			break;
+		
+		case SC_UPDATE_TIME:
+			if (select->skip & SENML_FIELD_UPDATE_TIME)
+				goto skip;
+			
+			rc = senml_cbor_read_number(c, &fields->update_time);
+			fields->has_update_time = true;
+			break;
+		
+		case SC_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			rc = senml_cbor_read_number(c, &fields->value);
+			fields->has_value = true;
+			break;
+		
+		case SC_STRING_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			rc = senml_cbor_read_text(c, &fields->string_value);
+			fields->has_string_value = true;
+			break;
+		
+		case SC_BOOL_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			// an invalid vb is only an error if there is no v that takes precedence
+			fields->has_bool_value = true;
+			fields->bool_valid     = c->p < c->end &&
+			                         (*c->p == (CBOR_SIMPLE << 5 | CBOR_TRUE) ||
+			                          *c->p == (CBOR_SIMPLE << 5 | CBOR_FALSE));
+			fields->bool_value     = fields->bool_valid &&
+			                         *c->p == (CBOR_SIMPLE << 5 | CBOR_TRUE);
+			rc = senml_cbor_skip(c);
+			break;
+		
+		case SC_VERSION:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_cbor_read_number(c, &fields->version);
+			fields->has_version = fields->has_base_info = true;
+			break;
+		
+		case SC_BASE_NAME:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_cbor_read_text(c, &fields->base_name);
+			fields->has_base_name = fields->has_base_info = true;
+			break;
+		
+		case SC_BASE_TIME:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_cbor_read_number(c, &fields->base_time);
+			fields->has_base_time = fields->has_base_info = true;
+			break;
+		
+		case SC_BASE_UNIT:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_cbor_read_text(c, &fields->base_unit);
+			fields->has_base_unit = fields->has_base_info = true;
+			break;
+		
+		case SC_BASE_VALUE:
+			if (!with_base_info)
+				goto skip;
+			
+			fields->has_base_info = true;
+			
+			// FIXME how do we handle different data types here? only numbers are stored for now
+			if (senml_cbor_at_number(c)) {
+				rc = senml_cbor_read_number(c, &fields->base_value);
+				fields->has_base_value = true;
+				break;
+			}
+			
+			goto skip;
+		
+		default:
+		// TODO value sum and data values are not supported yet
+		skip:
+			rc = senml_cbor_skip(c);
+			break;
+		}
+		
+		if (rc) {
+			char msg[48];
+			
+			snprintf(msg, sizeof(msg), "invalid value for key %lld", (long long)key);
+			senml_cbor_error(c, SENML_ERROR_RECORD, 0, msg);
+			return -1;
+		}
+	}
+	
+	if (head.indefinite)
+		c->p++;
+	
+	return 0;
+}
+
+
+/**
+ * Decodes the array of records the cursor points to into <code>d->pack</code>.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory ran out.
+ */
+static int senml_cbor_decode_pack(senml_decoder_t *d, senml_cbor_cursor_t *c,
+                                  const senml_cbor_head_t *head)
+{
+	senml_fields_t fields;
+	uint64_t       remaining = head->arg;
+	int            rc;
+	
+	while (head->indefinite ? !senml_cbor_at_break(c) : remaining-- > 0) {
+		if (c->p >= c->end || *c->p >> 5 != CBOR_MAP) {
+			senml_cbor_error(c, SENML_ERROR_RECORD, d->count + 1, "record is not a map");
+			return -1;
+		}
+		
+		if (senml_cbor_scan_record(c, &fields, d->count == 0, &d->select)) {
+			// keep the more precise error of an invalid value
+			if (senml_error_current()->code == SENML_OK)
+				senml_cbor_error(c, SENML_ERROR_SYNTAX, 0, "record is not valid");
+			
+			senml_error_current()->record = d->count + 1;
+			return -1;
+		}
+		
+		if ((rc = senml_decoder_add(d, &fields)))
+			return rc;
+	}
+	
+	if (head->indefinite)
+		c->p++;
+	
+	if (c->p != c->end) {
+		senml_cbor_error(c, SENML_ERROR_TRAILING, 0, "trailing data after the pack");
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Fails a call whose input does not even start with an array.
+ */
+static void senml_cbor_not_array(const senml_cbor_cursor_t *c)
+{
+	senml_call_t call;
+	
+	senml_call_begin(&call);
+	senml_cbor_error(c, SENML_ERROR_NOT_ARRAY, 0, "not an array");
+	senml_call_decoded(&call, (size_t)(c->end - c->start), 0, 0, -1);
+}
+
+
+senml_pack_t *senml_decode_cbor(const unsigned char *input, size_t len)
+{
+	return senml_decode_cbor_ex(input, len, NULL);
+}
+
+
+senml_pack_t *senml_decode_cbor_ex(const unsigned char *input, size_t len,
+                                   const senml_decode_opts_t *opts)
+{
+	senml_decoder_t     d;
+	senml_cbor_head_t   head;
+	senml_cbor_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + len,
+		.depth = 0
+	};
+	
+	if (senml_cbor_read_head(&c, &head) || head.major != CBOR_ARRAY) {
+		senml_cbor_not_array(&c);
+		return NULL;
+	}
+	
+	// a definite array tells us how many records to expect, but every record needs a byte
+	if (senml_decoder_init(&d, opts, len * 3,
+	                       head.indefinite ? 8 : (size_t)(head.arg < len ? head.arg : len)))
+		return NULL;
+	
+	d.len = len;
+	
+	return senml_decoder_finish(&d, senml_cbor_decode_pack(&d, &c, &head));
+}
+
+
+int senml_decode_cbor_each(const unsigned char *input, size_t len, senml_record_cb_t callback,
+                           void *ctx)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	senml_cbor_head_t   head;
+	int                 rc;
+	senml_cbor_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + len,
+		.depth = 0
+	};
+	
+	if (senml_cbor_read_head(&c, &head) || head.major != CBOR_ARRAY) {
+		senml_cbor_not_array(&c);
+		return -1;
+	}
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, callback, ctx))
+		return -2;
+	
+	d.resolve = true;
+	rc        = senml_cbor_decode_pack(&d, &c, &head);
+	senml_call_decoded(&d.call, len, d.count, rc == 0 ? 1 : 0, rc);
+	senml_decoder_release(&d);
+	
+	return rc;
+}
+
+
+senml_columns_t *senml_decode_cbor_columns(const unsigned char *input, size_t len)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	senml_columns_t    *columns;
+	senml_cbor_head_t   head;
+	int                 rc;
+	senml_cbor_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + len,
+		.depth = 0
+	};
+	
+	if (senml_cbor_read_head(&c, &head) || head.major != CBOR_ARRAY) {
+		senml_cbor_not_array(&c);
+		return NULL;
+	}
+	
+	if (!(columns = senml_columns_new(head.indefinite ? 0 : (size_t)(head.arg < len ? head.arg : len))))
+		return NULL;
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, senml_columns_add_record, columns)) {
+		senml_columns_free(columns);
+		return NULL;
+	}
+	
+	// the strings are copied into the columns anyway, so the decoder does not need to copy them
+	d.borrow = true;
+	rc       = senml_cbor_decode_pack(&d, &c, &head);
+	senml_call_decoded(&d.call, len, d.count, rc == 0 ? 1 : 0, rc);
+	senml_decoder_release(&d);
+	
+	if (rc) {
+		senml_columns_free(columns);
+		return NULL;
+	}
+	
+	return columns;
+}
+
+
+/**
+ * Writes an initial byte followed by \p len bytes of \p arg in network byte order.
+ */
+static void senml_cbor_put_arg(senml_writer_t *w, uint8_t initial, uint64_t arg, size_t len)
+{
+	uint8_t buf[9];
+	
+	buf[0] = initial;
+	
+	for (size_t i = 0; i < len; i++)
+		buf[len - i] = (uint8_t)(arg >> (8 * i));
+	
+	senml_writer_put(w, buf, len + 1);
+}
+
+
+/**
+ * Writes the head of a data item with the shortest encoding of \p arg.
+ */
+static void senml_cbor_put_head(senml_writer_t *w, uint8_t major, uint64_t arg)
+{
+	if (arg < 24)
+		senml_cbor_put_arg(w, (uint8_t)(major << 5 | arg), 0, 0);
+	else if (arg <= UINT8_MAX)
+		senml_cbor_put_arg(w, (uint8_t)(major << 5 | 24), arg, 1);
+	else if (arg <= UINT16_MAX)
+		senml_cbor_put_arg(w, (uint8_t)(major << 5 | 25), arg, 2);
+	else if (arg <= UINT32_MAX)
+		senml_cbor_put_arg(w, (uint8_t)(major << 5 | 26), arg, 4);
+	else
+		senml_cbor_put_arg(w, (uint8_t)(major << 5 | 27), arg, 8);
+}
+
+
+static inline void senml_cbor_put_key(senml_writer_t *w, int key)
+{
+	if (key < 0)
+		senml_cbor_put_head(w, CBOR_NEGINT, (uint64_t)(-1 - key));
+	else
+		senml_cbor_put_head(w, CBOR_UINT, (uint64_t)key);
+}
+
+
+static inline void senml_cbor_put_text(senml_writer_t *w, senml_str_t str)
+{
+	senml_cbor_put_head(w, CBOR_TEXT, str.len);
+	senml_writer_put(w, str.p, str.len);
+}
+
+
+/**
+ * Finds the half precision encoding of \p value.
+ * @return true if \p value can be represented exactly, false otherwise.
+ */
+static bool senml_cbor_to_half(float value, uint16_t *half)
+{
+	uint32_t bits;
+	uint16_t sign;
+	int      exponent;
+	uint32_t mantissa;
+	
+	memcpy(&bits, &value, sizeof(bits));
+	
+	sign     = (uint16_t)(bits >> 16 & 0x8000);
+	exponent = (int)(bits >> 23 & 0xff) - 127;
+	mantissa = bits & 0x7fffff;
+	
+	if (exponent == 128) {
+		// NaN payloads are not preserved, all NaNs become the canonical one
+		*half = mantissa ? 0x7e00 : (uint16_t)(sign | 0x7c00);
+		return true;
+	}
+	
+	if (exponent == -127 && mantissa == 0) {
+		*half = sign;
+		return true;
+	}
+	
+	if (exponent >= -14 && exponent <= 15) {
+		*half = (uint16_t)(sign | (exponent + 15) << 10 | mantissa >> 13);
+		return (mantissa & 0x1fff) == 0;
+	}
+	
+	if (exponent >= -24 && exponent < -14) {
+		// subnormal, the implicit bit becomes part of the mantissa
+		mantissa |= 0x800000;
+		*half = (uint16_t)(sign | mantissa >> (-1 - exponent));
+		return (mantissa & ((1u << (-1 - exponent)) - 1)) == 0;
+	}
+	
+	return false;
+}
+
+
+/**
+ * Writes \p value as a half, single or double precision float, whichever is the smallest that
+ * represents it exactly.
+ */
+static void senml_cbor_put_double(senml_writer_t *w, double value)
+{
+	float    single = (float)value;
+	uint16_t half;
+	
+	if (value != value || (double)single == value) {
+		if (senml_cbor_to_half(single, &half)) {
+			senml_cbor_put_arg(w, CBOR_SIMPLE << 5 | CBOR_HALF, half, 2);
+		} else {
+			uint32_t bits;
+			
+			memcpy(&bits, &single, sizeof(bits));
+			senml_cbor_put_arg(w, CBOR_SIMPLE << 5 | CBOR_SINGLE, bits, 4);
+		}
+	} else {
+		uint64_t bits;
+		
+		memcpy(&bits, &value, sizeof(bits));
+		senml_cbor_put_arg(w, CBOR_SIMPLE << 5 | CBOR_DOUBLE, bits, 8);
+	}
+}
+
+
+static inline size_t senml_cbor_base_fields(const senml_base_info_t *base_info)
+{
+	return (base_info->version ? 1 : 0) +
+	       (senml_str_of(base_info->base_name, &base_info->base_name_view).p ? 1 : 0) +
+	       (base_info->base_time > 0 ? 1 : 0) +
+	       (senml_str_of(base_info->base_unit, &base_info->base_unit_view).p ? 1 : 0) +
+	       (base_info->base_value_type == SENML_TYPE_FLOAT ? 1 : 0);
+}
+
+
+static void senml_cbor_put_base_fields(senml_writer_t *w, const senml_base_info_t *base_info)
+{
+	senml_str_t base_name = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	senml_str_t base_unit = senml_str_of(base_info->base_unit, &base_info->base_unit_view);
+	
+	if (base_info->version) {
+		senml_cbor_put_key(w, SC_VERSION);
+		senml_cbor_put_head(w, CBOR_UINT, base_info->version);
+	}
+	
+	if (base_name.p) {
+		senml_cbor_put_key(w, SC_BASE_NAME);
+		senml_cbor_put_text(w, base_name);
+	}
+	
+	if (base_info->base_time > 0) {
+		senml_cbor_put_key(w, SC_BASE_TIME);
+		senml_cbor_put_double(w, base_info->base_time);
+	}
+	
+	if (base_unit.p) {
+		senml_cbor_put_key(w, SC_BASE_UNIT);
+		senml_cbor_put_text(w, base_unit);
+	}
+	
+	// only numeric base values are decoded, see senml_decoder_store_base_info
+	if (base_info->base_value_type == SENML_TYPE_FLOAT) {
+		senml_cbor_put_key(w, SC_BASE_VALUE);
+		senml_cbor_put_double(w, base_info->base_value.base_value_f);
+	}
+}
+
+
+static inline size_t senml_cbor_record_fields(const senml_record_t *record)
+{
+	return (senml_str_of(record->name, &record->name_view).p ? 1 : 0) +
+	       (senml_str_of(record->unit, &record->unit_view).p ? 1 : 0) +
+	       (record->time != 0 ? 1 : 0) +
+	       (record->update_time != 0 ? 1 : 0) +
+	       (record->value_type == SENML_TYPE_FLOAT ||
+	        record->value_type == SENML_TYPE_STRING ||
+	        record->value_type == SENML_TYPE_BOOL ? 1 : 0);
+}
+
+
+static int senml_cbor_put_record_fields(senml_writer_t *w, const senml_record_t *record)
+{
+	senml_str_t name = senml_str_of(record->name, &record->name_view);
+	senml_str_t unit = senml_str_of(record->unit, &record->unit_view);
+	senml_str_t str;
+	
+	if (name.p) {
+		senml_cbor_put_key(w, SC_NAME);
+		senml_cbor_put_text(w, name);
+	}
+	
+	if (unit.p) {
+		senml_cbor_put_key(w, SC_UNIT);
+		senml_cbor_put_text(w, unit);
+	}
+	
+	if (record->time != 0) {
+		senml_cbor_put_key(w, SC_TIME);
+		senml_cbor_put_double(w, record->time);
+	}
+	
+	if (record->update_time != 0) {
+		senml_cbor_put_key(w, SC_UPDATE_TIME);
+		senml_cbor_put_head(w, CBOR_UINT, record->update_time);
+	}
+	
+	if (record->value_type == SENML_TYPE_FLOAT) {
+		senml_cbor_put_key(w, SC_VALUE);
+		senml_cbor_put_double(w, record->value.value_f);
+	} else if (record->value_type == SENML_TYPE_STRING) {
+		if (!(str = senml_str_of(record->value.value_s, &record->value_view)).p) {
+			senml_error_set(SENML_ERROR_INVALID_PACK, 0, "string value is not set");
+			return -1;
+		}
+		
+		senml_cbor_put_key(w, SC_STRING_VALUE);
+		senml_cbor_put_text(w, str);
+	} else if (record->value_type == SENML_TYPE_BOOL) {
+		senml_cbor_put_key(w, SC_BOOL_VALUE);
+		senml_cbor_put_head(w, CBOR_SIMPLE, record->value.value_b ? CBOR_TRUE : CBOR_FALSE);
+	}
+	// FIXME handle binary value
+	
+	return 0;
+}
+
+
+int senml_cbor_put_record(senml_writer_t *w, const senml_base_info_t *base_info,
+                          const senml_record_t *record)
+{
+	if (base_info) {
+		senml_cbor_put_head(w, CBOR_MAP, senml_cbor_base_fields(base_info) +
+		                                 senml_cbor_record_fields(record));
+		senml_cbor_put_base_fields(w, base_info);
+	} else {
+		senml_cbor_put_head(w, CBOR_MAP, senml_cbor_record_fields(record));
+	}
+	
+	return senml_cbor_put_record_fields(w, record);
+}
+
+
+void senml_cbor_finish_array(senml_writer_t *w, size_t at, size_t reserved, size_t count)
+{
+	char           buf[SENML_CBOR_MAX_HEAD];
+	senml_writer_t head = { .buf = buf, .len = 0, .cap = sizeof(buf), .fixed = true };
+	size_t         items = w->len - at - reserved;
+	
+	senml_cbor_put_head(&head, CBOR_ARRAY, count);
+	
+	// a head longer than the space left for it moves the items up, which needs room at the end
+	if (head.len > reserved && !senml_writer_reserve(w, head.len - reserved))
+		return;
+	
+	memmove(w->buf + at + head.len, w->buf + at + reserved, items);
+	memcpy(w->buf + at, buf, head.len);
+	w->len = at + head.len + items;
+}
+
+
+/**
+ * Writes a whole pack with definite length containers. The attributes are the same that
+ * <code>senml_encode_json</code> emits.
+ * @param[in] compact Base fields to write the records relative to, or NULL to write the pack as is.
+ * @return 0 on success, -1 if the pack contains invalid data.
+ */
+static int senml_cbor_encode_pack(senml_writer_t *w, const senml_pack_t *pack,
+                                  const senml_compact_t *compact)
+{
+	bool separate_base = pack->base_info && !compact;
+	
+	senml_cbor_put_head(w, CBOR_ARRAY, pack->num + (separate_base ? 1 : 0));
+	
+	// a compact pack carries its base fields in the first record instead of a map of their own
+	if (separate_base) {
+		senml_cbor_put_head(w, CBOR_MAP, senml_cbor_base_fields(pack->base_info));
+		senml_cbor_put_base_fields(w, pack->base_info);
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		senml_record_t        relative;
+		
+		if (compact) {
+			senml_compact_record(compact, record, &relative);
+			record = &relative;
+		}
+		
+		if (senml_cbor_put_record(w, compact && i == 0 ? &compact->base_info : NULL, record)) {
+			senml_error_current()->record = i + 1;
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+
+unsigned char *senml_encode_cbor(const senml_pack_t *pack, size_t *len)
+{
+	return senml_encode_cbor_ex(pack, len, NULL);
+}
+
+
+unsigned char *senml_encode_cbor_ex(const senml_pack_t *pack, size_t *len,
+                                    const senml_encode_opts_t *opts)
+{
+	senml_writer_t  w = { 0 };
+	senml_compact_t compact;
+	senml_call_t    call;
+	bool            compacting = opts && (opts->flags & SENML_ENCODE_COMPACT);
+	int             rc;
+	
+	senml_call_begin(&call);
+	
+	if (compacting && senml_compact_init(&compact, pack)) {
+		senml_call_encoded(&call, 0, 0, -2);
+		return NULL;
+	}
+	
+	rc = senml_cbor_encode_pack(&w, pack, compacting ? &compact : NULL);
+	
+	if (compacting)
+		senml_compact_release(&compact);
+	
+	// the buffer only overflows if it could not grow
+	if (rc == 0 && w.overflow)
+		rc = -2;
+	
+	senml_call_encoded(&call, rc ? 0 : w.len, pack->num, rc);
+	
+	if (rc) {
+		senml_free(w.buf);
+		return NULL;
+	}
+	
+	*len = w.len;
+	
+	return (unsigned char *)w.buf;
+}
+
+
+int senml_encode_cbor_s(const senml_pack_t *pack, unsigned char *output, size_t *len)
+{
+	senml_writer_t w = {
+		.buf   = (char *)output,
+		.len   = 0,
+		.cap   = *len,
+		.fixed = true
+	};
+	
+	senml_call_t call;
+	int          rc;
+	
+	senml_call_begin(&call);
+	
+	if ((rc = senml_cbor_encode_pack(&w, pack, NULL)) == 0 && w.overflow) {
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "the document needs more than %zu bytes", *len);
+		rc = -2;
+	}
+	
+	senml_call_encoded(&call, rc ? 0 : w.len, pack->num, rc);
+	
+	if (rc == 0)
+		*len = w.len;
+	
+	return rc;
+}
+
+
+int senml_cbor_put_template(senml_writer_t *w, const senml_pack_t *pack, senml_slots_t *slots)
+{
+	senml_cbor_put_head(w, CBOR_ARRAY, pack->num + (pack->base_info ? 1 : 0));
+	
+	if (pack->base_info) {
+		senml_cbor_put_head(w, CBOR_MAP, senml_cbor_base_fields(pack->base_info));
+		senml_cbor_put_base_fields(w, pack->base_info);
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		senml_record_t        fixed  = *record;
+		size_t                count  = senml_slots_strip(slots, &fixed);
+		
+		senml_cbor_put_head(w, CBOR_MAP, senml_cbor_record_fields(&fixed) + count);
+		
+		if (senml_cbor_put_record_fields(w, &fixed)) {
+			senml_error_current()->record = i + 1;
+			return -1;
+		}
+		
+		// the placeholders have the widths the values are patched in with, whatever they are
+		if (slots->fields & SENML_FIELD_TIME) {
+			senml_cbor_put_key(w, SC_TIME);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_TIME);
+			senml_cbor_put_arg(w, CBOR_SIMPLE << 5 | CBOR_DOUBLE, 0, 8);
+		}
+		
+		if (slots->fields & SENML_FIELD_UPDATE_TIME) {
+			senml_cbor_put_key(w, SC_UPDATE_TIME);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_UPDATE_TIME);
+			senml_cbor_put_arg(w, CBOR_UINT << 5 | CBOR_ARG32, 0, 4);
+		}
+		
+		if ((slots->fields & SENML_FIELD_VALUE) && record->value_type == SENML_TYPE_FLOAT) {
+			senml_cbor_put_key(w, SC_VALUE);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_FLOAT);
+			senml_cbor_put_arg(w, CBOR_SIMPLE << 5 | CBOR_DOUBLE, 0, 8);
+		} else if ((slots->fields & SENML_FIELD_VALUE) && record->value_type == SENML_TYPE_BOOL) {
+			senml_cbor_put_key(w, SC_BOOL_VALUE);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_BOOL);
+			senml_cbor_put_head(w, CBOR_SIMPLE, CBOR_FALSE);
+		}
+	}
+	
+	return 0;
+}
+
+
+void senml_cbor_patch_slot(char *image, const senml_slot_t *slot, const senml_record_t *record)
+{
+	senml_writer_t w = { .buf = image + slot->offset, .len = 0, .cap = 9, .fixed = true };
+	uint64_t       bits;
+	
+	switch (slot->kind) {
+	case SENML_SLOT_TIME:
+		memcpy(&bits, &record->time, sizeof(bits));
+		senml_cbor_put_arg(&w, CBOR_SIMPLE << 5 | CBOR_DOUBLE, bits, 8);
+		break;
+	
+	case SENML_SLOT_UPDATE_TIME:
+		senml_cbor_put_arg(&w, CBOR_UINT << 5 | CBOR_ARG32, record->update_time, 4);
+		break;
+	
+	case SENML_SLOT_FLOAT:
+		memcpy(&bits, &record->value.value_f, sizeof(bits));
+		senml_cbor_put_arg(&w, CBOR_SIMPLE << 5 | CBOR_DOUBLE, bits, 8);
+		break;
+	
+	case SENML_SLOT_BOOL:
+		senml_cbor_put_head(&w, CBOR_SIMPLE, record->value.value_b ? CBOR_TRUE : CBOR_FALSE);
+		break;
+	}
+}
+
+
+static int senml_cbor_transcode_record(const senml_record_t *record,
+                                       const senml_base_info_t *base_info, void *ctx)
+{
+	senml_transcoder_t *t = ctx;
+	
+	if (t->count > 0)
+		senml_writer_putc(t->w, ',');
+	
+	// the base fields stay in the first record rather than getting an object of their own
+	if (senml_json_put_record(t->w, t->count == 0 ? base_info : NULL, record)) {
+		senml_error_current()->record = t->count + 1;
+		return -1;
+	}
+	
+	t->count++;
+	
+	return senml_transcoder_check(t);
+}
+
+
+/**
+ * Writes the records of a CBOR document as JSON while they are scanned, see
+ * <code>senml_json_transcode</code>. The output is terminated.
+ * @return 0 on success, -1 if the document is invalid, -2 if the output is full or memory ran out.
+ */
+static int senml_cbor_transcode(const unsigned char *input, size_t len, senml_writer_t *w)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	senml_transcoder_t  t = { .w = w, .count = 0 };
+	senml_cbor_head_t   head;
+	int                 rc;
+	senml_cbor_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + len,
+		.depth = 0
+	};
+	
+	if (senml_cbor_read_head(&c, &head) || head.major != CBOR_ARRAY) {
+		senml_cbor_not_array(&c);
+		return -1;
+	}
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, senml_cbor_transcode_record, &t))
+		return -2;
+	
+	d.borrow = true;
+	d.len    = len;
+	
+	senml_writer_putc(w, '[');
+	
+	if ((rc = senml_cbor_decode_pack(&d, &c, &head)) == 0) {
+		senml_writer_putc(w, ']');
+		senml_writer_putc(w, '\0');
+		rc = senml_transcoder_check(&t);
+	}
+	
+	senml_transcoder_finish(&d, rc ? 0 : w->len - 1, rc);
+	senml_decoder_release(&d);
+	
+	return rc;
+}
+
+
+char *senml_transcode_cbor_to_json(const unsigned char *input, size_t len)
+{
+	senml_writer_t w = { 0 };
+	
+	// JSON spells out the keys and numbers CBOR encodes in a byte or two. If this fails, so does
+	// the first write, which reports the error
+	senml_writer_grow(&w, len * 2);
+	
+	if (senml_cbor_transcode(input, len, &w)) {
+		senml_free(w.buf);
+		return NULL;
+	}
+	
+	return w.buf;
+}
+
+
+int senml_transcode_cbor_to_json_s(const unsigned char *input, size_t len, char *output,
+                                   size_t out_len)
+{
+	senml_writer_t w = {
+		.buf   = output,
+		.len   = 0,
+		.cap   = out_len,
+		.fixed = true
+	};
+	
+	return senml_cbor_transcode(input, len, &w);
+}
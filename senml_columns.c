@@ -0,0 +1,416 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <string.h>
+
+
+#define SENML_COLUMNS_MIN_CAPACITY (16)   //!< Records the columns make room for at first
+#define SENML_COLUMNS_MIN_INDEX    (64)   //!< Slots of the string index at first, a power of two
+
+
+/**
+ * Resizes one column, leaving it untouched on failure.
+ */
+static inline bool senml_columns_resize(void **column, size_t size)
+{
+	void *resized = senml_realloc(*column, size);
+	
+	if (resized)
+		*column = resized;
+	
+	return resized != NULL;
+}
+
+
+/**
+ * Makes room for at least \p capacity records in every column.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_columns_reserve(senml_columns_t *columns, size_t capacity)
+{
+	if (capacity < SENML_COLUMNS_MIN_CAPACITY)
+		capacity = SENML_COLUMNS_MIN_CAPACITY;
+	
+	if (capacity <= columns->capacity)
+		return 0;
+	
+	if (!senml_columns_resize((void **)&columns->time,        sizeof(double) * capacity) ||
+	    !senml_columns_resize((void **)&columns->value_f,     sizeof(double) * capacity) ||
+	    !senml_columns_resize((void **)&columns->value_type,  sizeof(uint8_t) * capacity) ||
+	    !senml_columns_resize((void **)&columns->update_time, sizeof(unsigned int) * capacity) ||
+	    !senml_columns_resize((void **)&columns->name_id,     sizeof(uint32_t) * capacity) ||
+	    !senml_columns_resize((void **)&columns->unit_id,     sizeof(uint32_t) * capacity) ||
+	    !senml_columns_resize((void **)&columns->value_s,     sizeof(senml_str_t) * capacity))
+		return -2;
+	
+	columns->capacity = capacity;
+	
+	return 0;
+}
+
+
+senml_columns_t *senml_columns_new(size_t capacity)
+{
+	senml_arena_t   *arena = senml_arena_new(0);
+	senml_columns_t *columns;
+	
+	if (!arena)
+		return NULL;
+	
+	if (!(columns = senml_arena_alloc(arena, sizeof(senml_columns_t)))) {
+		senml_arena_free(arena);
+		return NULL;
+	}
+	
+	memset(columns, 0, sizeof(senml_columns_t));
+	columns->arena = arena;
+	
+	if (senml_columns_reserve(columns, capacity)) {
+		senml_columns_free(columns);
+		return NULL;
+	}
+	
+	return columns;
+}
+
+
+void senml_columns_free(senml_columns_t *columns)
+{
+	if (!columns)
+		return;
+	
+	senml_free(columns->time);
+	senml_free(columns->value_f);
+	senml_free(columns->value_type);
+	senml_free(columns->update_time);
+	senml_free(columns->name_id);
+	senml_free(columns->unit_id);
+	senml_free(columns->value_s);
+	senml_free(columns->strings);
+	senml_free(columns->index);
+	
+	// the columns struct itself lives in the arena
+	senml_arena_free(columns->arena);
+}
+
+
+/**
+ * Doubles the string index and inserts all strings again. The strings array grows along, it
+ * always has room for as many strings as may be in the index, i.e. half the slots.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_columns_grow_index(senml_columns_t *columns)
+{
+	size_t    size = columns->index_size ? columns->index_size * 2 : SENML_COLUMNS_MIN_INDEX;
+	uint32_t *index;
+	
+	if (!senml_columns_resize((void **)&columns->strings, sizeof(senml_str_t) * (size / 2)) ||
+	    !(index = senml_malloc(sizeof(uint32_t) * size)))
+		return -2;
+	
+	memset(index, 0xff, sizeof(uint32_t) * size);
+	
+	for (uint32_t id = 0; id < columns->num_strings; id++) {
+		size_t slot = senml_hash(SENML_HASH_SEED, columns->strings[id].p, columns->strings[id].len) & (size - 1);
+		
+		while (index[slot] != SENML_NO_ID)
+			slot = (slot + 1) & (size - 1);
+		
+		index[slot] = id;
+	}
+	
+	senml_free(columns->index);
+	columns->index      = index;
+	columns->index_size = size;
+	
+	return 0;
+}
+
+
+/**
+ * Looks up a string and adds a copy of it if it is not known yet.
+ * @param[in,out] columns
+ * @param[in] str The string, if <code>str.p</code> is NULL the ID is SENML_NO_ID.
+ * @param[out] id Index of the string in <code>columns->strings</code>.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_columns_intern(senml_columns_t *columns, senml_str_t str, uint32_t *id)
+{
+	size_t slot;
+	char  *copy;
+	
+	if (!str.p) {
+		*id = SENML_NO_ID;
+		return 0;
+	}
+	
+	// keep the index at most half full
+	if ((columns->num_strings + 1) * 2 > columns->index_size && senml_columns_grow_index(columns))
+		return -2;
+	
+	slot = senml_hash(SENML_HASH_SEED, str.p, str.len) & (columns->index_size - 1);
+	
+	while (columns->index[slot] != SENML_NO_ID) {
+		senml_str_t *existing = &columns->strings[columns->index[slot]];
+		
+		if (existing->len == str.len && memcmp(existing->p, str.p, str.len) == 0) {
+			*id = columns->index[slot];
+			return 0;
+		}
+		
+		slot = (slot + 1) & (columns->index_size - 1);
+	}
+	
+	if (!(copy = senml_arena_strndup(columns->arena, str.p, str.len)))
+		return -2;
+	
+	*id = (uint32_t)columns->num_strings;
+	columns->strings[*id] = (senml_str_t){ .p = copy, .len = str.len };
+	columns->index[slot]  = *id;
+	columns->num_strings++;
+	
+	return 0;
+}
+
+
+/**
+ * Copies \p len bytes of binary data into \p arena.
+ * @return The copy, or NULL if memory could not be allocated.
+ */
+static uint8_t *senml_columns_memdup(senml_arena_t *arena, const void *p, size_t len)
+{
+	uint8_t *copy = senml_arena_alloc(arena, len ? len : 1);
+	
+	if (copy)
+		memcpy(copy, p, len);
+	
+	return copy;
+}
+
+
+/**
+ * Copies a base info including its strings and binary value into \p arena.
+ * @return The copy, or NULL if memory could not be allocated.
+ */
+static senml_base_info_t *senml_columns_copy_base_info(senml_arena_t *arena,
+                                                       const senml_base_info_t *base_info)
+{
+	senml_base_info_t *copy = senml_arena_alloc(arena, sizeof(senml_base_info_t));
+	senml_str_t        str;
+	
+	if (!copy)
+		return NULL;
+	
+	*copy = *base_info;
+	copy->base_name = NULL;
+	copy->base_unit = NULL;
+	
+	str = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	
+	if (str.p && !(copy->base_name = senml_arena_strndup(arena, str.p, str.len)))
+		return NULL;
+	
+	copy->base_name_view = (senml_str_t){ .p = copy->base_name, .len = str.len };
+	
+	str = senml_str_of(base_info->base_unit, &base_info->base_unit_view);
+	
+	if (str.p && !(copy->base_unit = senml_arena_strndup(arena, str.p, str.len)))
+		return NULL;
+	
+	copy->base_unit_view = (senml_str_t){ .p = copy->base_unit, .len = str.len };
+	
+	if (base_info->base_value_type == SENML_TYPE_STRING && base_info->base_value.base_value_s) {
+		const char *s = base_info->base_value.base_value_s;
+		
+		if (!(copy->base_value.base_value_s = senml_arena_strndup(arena, s, strlen(s))))
+			return NULL;
+	}
+	
+	if (base_info->base_value_type == SENML_TYPE_BINARY && base_info->base_value.base_value_bin.p) {
+		const senml_bin_data_t *bin = &base_info->base_value.base_value_bin;
+		
+		if (!(copy->base_value.base_value_bin.p = senml_columns_memdup(arena, bin->p, bin->len)))
+			return NULL;
+	}
+	
+	return copy;
+}
+
+
+/**
+ * Appends a record to the columns.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_columns_add(senml_columns_t *columns, const senml_record_t *record)
+{
+	size_t i = columns->num;
+	
+	if (i == columns->capacity && senml_columns_reserve(columns, columns->capacity * 2))
+		return -2;
+	
+	if (senml_columns_intern(columns, senml_str_of(record->name, &record->name_view),
+	                         &columns->name_id[i]) ||
+	    senml_columns_intern(columns, senml_str_of(record->unit, &record->unit_view),
+	                         &columns->unit_id[i]))
+		return -2;
+	
+	columns->time[i]        = record->time;
+	columns->update_time[i] = record->update_time;
+	columns->value_type[i]  = (uint8_t)record->value_type;
+	columns->value_f[i]     = 0;
+	columns->value_s[i]     = (senml_str_t){ .p = NULL, .len = 0 };
+	
+	switch (record->value_type) {
+	case SENML_TYPE_FLOAT:
+		columns->value_f[i] = record->value.value_f;
+		break;
+	
+	case SENML_TYPE_BOOL:
+		columns->value_f[i] = record->value.value_b ? 1 : 0;
+		break;
+	
+	case SENML_TYPE_STRING: {
+		senml_str_t  str  = senml_str_of(record->value.value_s, &record->value_view);
+		char        *copy = NULL;
+		
+		if (str.p && !(copy = senml_arena_strndup(columns->arena, str.p, str.len)))
+			return -2;
+		
+		columns->value_s[i] = (senml_str_t){ .p = copy, .len = str.len };
+		break;
+	}
+	
+	// binary values share the column of the strings, the type tells them apart
+	case SENML_TYPE_BINARY: {
+		const senml_bin_data_t *bin  = &record->value.value_bin;
+		uint8_t                *copy = NULL;
+		
+		if (bin->p && !(copy = senml_columns_memdup(columns->arena, bin->p, bin->len)))
+			return -2;
+		
+		columns->value_s[i] = (senml_str_t){ .p = (const char *)copy, .len = bin->len };
+		break;
+	}
+	
+	default:
+		break;
+	}
+	
+	columns->num++;
+	
+	return 0;
+}
+
+
+int senml_columns_add_record(const senml_record_t *record, const senml_base_info_t *base_info,
+                             void *ctx)
+{
+	senml_columns_t *columns = ctx;
+	
+	if (base_info && !columns->base_info &&
+	    !(columns->base_info = senml_columns_copy_base_info(columns->arena, base_info)))
+		return -2;
+	
+	return senml_columns_add(columns, record);
+}
+
+
+senml_columns_t *senml_columns_from_pack(const senml_pack_t *pack)
+{
+	senml_columns_t *columns = senml_columns_new(pack->num);
+	
+	if (!columns)
+		return NULL;
+	
+	if (pack->base_info &&
+	    !(columns->base_info = senml_columns_copy_base_info(columns->arena, pack->base_info)))
+		goto error;
+	
+	for (size_t i = 0; i < pack->num; i++)
+		if (senml_columns_add(columns, &pack->records[i]))
+			goto error;
+	
+	return columns;
+	
+	error:
+	senml_columns_free(columns);
+	return NULL;
+}
+
+
+senml_pack_t *senml_columns_to_pack(const senml_columns_t *columns)
+{
+	senml_pack_t  *pack;
+	char         **strings;
+	
+	if (!(pack = senml_arena_new_pack(sizeof(senml_record_t) * columns->num +
+	                                  sizeof(char *) * columns->num_strings)))
+		return NULL;
+	
+	if (columns->base_info &&
+	    !(pack->base_info = senml_columns_copy_base_info(pack->arena, columns->base_info)))
+		goto error;
+	
+	// every distinct string is copied once and shared by all records using it
+	if (!(strings = senml_arena_alloc(pack->arena, sizeof(char *) * columns->num_strings + 1)))
+		goto error;
+	
+	for (size_t id = 0; id < columns->num_strings; id++)
+		if (!(strings[id] = senml_arena_strndup(pack->arena, columns->strings[id].p,
+		                                        columns->strings[id].len)))
+			goto error;
+	
+	if (!(pack->records = senml_arena_alloc(pack->arena, sizeof(senml_record_t) * columns->num + 1)))
+		goto error;
+	
+	for (size_t i = 0; i < columns->num; i++) {
+		senml_record_t *record = &pack->records[i];
+		
+		memset(record, 0, sizeof(senml_record_t));
+		record->name_id = SENML_NO_ID;
+		
+		if (columns->name_id[i] != SENML_NO_ID) {
+			record->name      = strings[columns->name_id[i]];
+			record->name_view = (senml_str_t){ .p = record->name,
+			                                   .len = columns->strings[columns->name_id[i]].len };
+		}
+		
+		if (columns->unit_id[i] != SENML_NO_ID) {
+			record->unit      = strings[columns->unit_id[i]];
+			record->unit_view = (senml_str_t){ .p = record->unit,
+			                                   .len = columns->strings[columns->unit_id[i]].len };
+		}
+		
+		record->time        = columns->time[i];
+		record->update_time = columns->update_time[i];
+		record->value_type  = (senml_value_type_t)columns->value_type[i];
+		
+		if (record->value_type == SENML_TYPE_FLOAT) {
+			record->value.value_f = columns->value_f[i];
+		} else if (record->value_type == SENML_TYPE_BOOL) {
+			record->value.value_b = columns->value_f[i] != 0;
+		} else if (record->value_type == SENML_TYPE_STRING && columns->value_s[i].p) {
+			if (!(record->value.value_s = senml_arena_strndup(pack->arena, columns->value_s[i].p,
+			                                                  columns->value_s[i].len)))
+				goto error;
+			
+			record->value_view = (senml_str_t){ .p = record->value.value_s,
+			                                    .len = columns->value_s[i].len };
+		} else if (record->value_type == SENML_TYPE_BINARY && columns->value_s[i].p) {
+			const senml_str_t *bin = &columns->value_s[i];
+			
+			if (!(record->value.value_bin.p = senml_columns_memdup(pack->arena, bin->p, bin->len)))
+				goto error;
+			
+			record->value.value_bin.len = bin->len;
+		}
+		
+		pack->num++;
+	}
+	
+	return pack;
+	
+	error:
+	senml_pack_free(pack);
+	return NULL;
+}
@@ -0,0 +1,210 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <string.h>
+
+
+static inline bool senml_compact_str_equal(senml_str_t a, senml_str_t b)
+{
+	return a.len == b.len && (a.len == 0 || memcmp(a.p, b.p, a.len) == 0);
+}
+
+
+static inline senml_str_t senml_compact_resolved_unit(const senml_base_info_t *original,
+                                                      const senml_record_t *record)
+{
+	senml_str_t unit = senml_str_of(record->unit, &record->unit_view);
+	
+	if (!unit.p && original)
+		unit = senml_str_of(original->base_unit, &original->base_unit_view);
+	
+	return unit;
+}
+
+
+static inline double senml_compact_resolved_time(const senml_base_info_t *original,
+                                                 const senml_record_t *record)
+{
+	return original ? record->time + original->base_time : record->time;
+}
+
+
+/**
+ * Finds how many leading bytes all record names share. Since every resolved name starts with the
+ * original base name, this is what the base name can be extended by.
+ */
+static size_t senml_compact_name_prefix(const senml_pack_t *pack)
+{
+	senml_str_t first = senml_str_of(pack->records[0].name, &pack->records[0].name_view);
+	size_t      len   = first.p ? first.len : 0;
+	
+	for (size_t i = 1; i < pack->num && len > 0; i++) {
+		senml_str_t name = senml_str_of(pack->records[i].name, &pack->records[i].name_view);
+		size_t      n    = 0;
+		
+		if (!name.p)
+			return 0;
+		
+		while (n < len && n < name.len && name.p[n] == first.p[n])
+			n++;
+		
+		len = n;
+	}
+	
+	// never split a UTF-8 sequence between base name and name
+	while (len > 0 && len < first.len && ((uint8_t)first.p[len] & 0xc0) == 0x80)
+		len--;
+	
+	return len;
+}
+
+
+/**
+ * Picks a base time all resolved times can be written relative to without losing precision. A
+ * base time the pack already has is kept, resolving the times against another one would only add
+ * digits.
+ * @return The base time, or 0 if none is suitable.
+ */
+static double senml_compact_base_time(const senml_pack_t *pack)
+{
+	const senml_base_info_t *original  = pack->base_info;
+	double                   base_time = senml_compact_resolved_time(original, &pack->records[0]);
+	
+	if (original && original->base_time > 0)
+		return original->base_time;
+	
+	for (size_t i = 1; i < pack->num; i++) {
+		double time = senml_compact_resolved_time(original, &pack->records[i]);
+		
+		if (time < base_time)
+			base_time = time;
+	}
+	
+	// records without a time would pick up the base time
+	if (!(base_time > 0))
+		return 0;
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		double time = senml_compact_resolved_time(original, &pack->records[i]);
+		
+		if ((time - base_time) + base_time != time)
+			return 0;
+	}
+	
+	return base_time;
+}
+
+
+/**
+ * Picks the unit most of the records use, with a majority vote.
+ * @return The unit, or a view with <code>p</code> NULL if some record has none.
+ */
+static senml_str_t senml_compact_base_unit(const senml_pack_t *pack)
+{
+	senml_str_t none      = { .p = NULL, .len = 0 };
+	senml_str_t candidate = none;
+	size_t      votes     = 0;
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		senml_str_t unit = senml_compact_resolved_unit(pack->base_info, &pack->records[i]);
+		
+		// records without a unit would pick up the base unit
+		if (!unit.p)
+			return none;
+		
+		if (votes == 0) {
+			candidate = unit;
+			votes     = 1;
+		} else if (senml_compact_str_equal(unit, candidate)) {
+			votes++;
+		} else {
+			votes--;
+		}
+	}
+	
+	return candidate;
+}
+
+
+int senml_compact_init(senml_compact_t *compact, const senml_pack_t *pack)
+{
+	const senml_base_info_t *original  = pack->base_info;
+	senml_str_t              base_name = { .p = NULL, .len = 0 };
+	senml_str_t              first;
+	
+	memset(compact, 0, sizeof(senml_compact_t));
+	compact->original                  = original;
+	compact->base_info.base_value_type = SENML_TYPE_UNDEF;
+	
+	if (original) {
+		compact->base_info.version = original->version;
+		base_name                  = senml_str_of(original->base_name, &original->base_name_view);
+	}
+	
+	// without records there is nothing to carry the base fields
+	if (pack->num == 0)
+		return 0;
+	
+	first              = senml_str_of(pack->records[0].name, &pack->records[0].name_view);
+	compact->name_skip = senml_compact_name_prefix(pack);
+	
+	// the base name is a view unless both the old base name and a prefix of the names go into it
+	if (compact->name_skip > 0 && base_name.len > 0) {
+		if (!(compact->buf = senml_malloc(base_name.len + compact->name_skip)))
+			return -2;
+		
+		memcpy(compact->buf, base_name.p, base_name.len);
+		memcpy(compact->buf + base_name.len, first.p, compact->name_skip);
+		base_name = (senml_str_t){ .p = compact->buf, .len = base_name.len + compact->name_skip };
+	} else if (compact->name_skip > 0) {
+		base_name = (senml_str_t){ .p = first.p, .len = compact->name_skip };
+	}
+	
+	compact->base_info.base_name_view = base_name;
+	compact->base_info.base_time      = senml_compact_base_time(pack);
+	compact->base_info.base_unit_view = senml_compact_base_unit(pack);
+	
+	return 0;
+}
+
+
+void senml_compact_release(senml_compact_t *compact)
+{
+	senml_free(compact->buf);
+	compact->buf = NULL;
+}
+
+
+void senml_compact_record(const senml_compact_t *compact, const senml_record_t *record,
+                          senml_record_t *relative)
+{
+	const senml_base_info_t *original = compact->original;
+	senml_str_t              name     = senml_str_of(record->name, &record->name_view);
+	senml_str_t              unit     = senml_compact_resolved_unit(original, record);
+	
+	*relative      = *record;
+	relative->name = NULL;
+	relative->unit = NULL;
+	
+	// a name that is all base name is left out, the decoder resolves it to the base name again
+	if (name.p && name.len > compact->name_skip)
+		relative->name_view = (senml_str_t){ .p = name.p + compact->name_skip,
+		                                     .len = name.len - compact->name_skip };
+	else
+		relative->name_view = (senml_str_t){ .p = NULL, .len = 0 };
+	
+	if (unit.p && compact->base_info.base_unit_view.p &&
+	    senml_compact_str_equal(unit, compact->base_info.base_unit_view))
+		unit = (senml_str_t){ .p = NULL, .len = 0 };
+	
+	relative->unit_view = unit;
+	
+	if (!original || original->base_time != compact->base_info.base_time)
+		relative->time = senml_compact_resolved_time(original, record) -
+		                 compact->base_info.base_time;
+	
+	// the base value is not carried over, so it is applied to the values right away
+	if (record->value_type == SENML_TYPE_FLOAT && original &&
+	    original->base_value_type == SENML_TYPE_FLOAT)
+		relative->value.value_f = record->value.value_f + original->base_value.base_value_f;
+}
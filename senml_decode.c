@@ -0,0 +1,449 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <limits.h>
+#include <string.h>
+
+
+size_t senml_token_decode(const senml_token_t *token, char *out)
+{
+	switch (token->kind) {
+	case SENML_TOKEN_JSON_ESCAPED:
+		return senml_json_unescape(token, out);
+	
+	case SENML_TOKEN_CBOR_CHUNKED:
+		return senml_cbor_join_chunks(token, out);
+	
+	default:
+		memcpy(out, token->p, token->len);
+		return token->len;
+	}
+}
+
+
+int senml_decoder_init(senml_decoder_t *d, const senml_decode_opts_t *opts, size_t size,
+                       size_t capacity)
+{
+	memset(d, 0, sizeof(*d));
+	senml_call_begin(&d->call);
+	
+	d->borrow      = opts && (opts->flags & SENML_DECODE_ZERO_COPY);
+	d->names       = opts ? opts->names : NULL;
+	d->max_records = opts ? opts->max_records : 0;
+	
+	if (opts) {
+		d->select.skip   = opts->fields ? SENML_FIELD_ALL & ~opts->fields : 0;
+		d->select.filter = opts->filter;
+	}
+	
+	if (opts && opts->pack) {
+		d->pack   = opts->pack;
+		d->reused = true;
+		senml_pack_reset(d->pack);
+	} else if (!(d->pack = senml_arena_new_pack(size))) {
+		return -2;
+	}
+	
+	d->arena = d->pack->arena;
+	
+	if (capacity < 8)
+		capacity = 8;
+	
+	if (!(d->pack->records = senml_arena_alloc(d->arena, sizeof(senml_record_t) * capacity))) {
+		senml_decoder_finish(d, -2);
+		return -2;
+	}
+	
+	d->capacity = capacity;
+	
+	return 0;
+}
+
+
+senml_pack_t *senml_decoder_finish(senml_decoder_t *d, int rc)
+{
+	senml_call_decoded(&d->call, d->len, d->count - d->skipped, rc == 0 ? 1 : 0, rc);
+	
+	if (rc == 0)
+		return d->pack;
+	
+	if (d->reused)
+		senml_pack_reset(d->pack);
+	else
+		senml_pack_free(d->pack);
+	
+	return NULL;
+}
+
+
+/**
+ * Stores a string attribute. When borrowing, only the view is set and it points into the input
+ * unless the raw token has to be decoded first. Otherwise it is copied into \p arena.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_decoder_store_string(senml_decoder_t *d, senml_arena_t *arena,
+                                      const senml_token_t *token, char **s, senml_str_t *view)
+{
+	char *copy;
+	
+	if (d->borrow && token->kind == SENML_TOKEN_PLAIN) {
+		view->p   = token->p;
+		view->len = token->len;
+		return 0;
+	}
+	
+	if (!arena || !(copy = senml_arena_alloc(arena, token->len + 1)))
+		return -2;
+	
+	view->p   = copy;
+	view->len = senml_token_decode(token, copy);
+	copy[view->len] = '\0';
+	
+	if (!d->borrow)
+		*s = copy;
+	
+	return 0;
+}
+
+
+static int senml_decoder_store_base_info(senml_decoder_t *d, const senml_fields_t *fields)
+{
+	senml_base_info_t *base_info = d->base_info;
+	
+	if (!base_info && (!d->arena ||
+	                   !(base_info = senml_arena_alloc(d->arena, sizeof(senml_base_info_t)))))
+		return -2;
+	
+	memset(base_info, 0, sizeof(senml_base_info_t));
+	d->pack->base_info = base_info;
+	base_info->base_value_type = SENML_TYPE_UNDEF;
+	
+	if (fields->has_version)
+		base_info->version = (uint8_t)(int64_t)fields->version;
+	
+	if (fields->has_base_name &&
+	    senml_decoder_store_string(d, d->arena, &fields->base_name,
+	                               &base_info->base_name, &base_info->base_name_view))
+		return -2;
+	
+	if (fields->has_base_time)
+		base_info->base_time = fields->base_time;
+	
+	if (fields->has_base_unit &&
+	    senml_decoder_store_string(d, d->arena, &fields->base_unit,
+	                               &base_info->base_unit, &base_info->base_unit_view))
+		return -2;
+	
+	if (fields->has_base_value) {
+		base_info->base_value_type         = SENML_TYPE_FLOAT;
+		base_info->base_value.base_value_f = fields->base_value;
+	}
+	
+	// the scanners resolve the names of the following records against it
+	d->select.base_name = base_info->base_name_view;
+	
+	return 0;
+}
+
+
+/**
+ * Interns the resolved name of a record and lets its name point into the canonical copy, so that
+ * no copy is made per record. The copy is terminated and lives as long as the table, so unless
+ * the decoder borrows, <code>record->name</code> is set as well.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_decoder_intern_name(senml_decoder_t *d, senml_arena_t *arena,
+                                     const senml_fields_t *fields, senml_record_t *record)
+{
+	const senml_base_info_t *base_info = d->pack->base_info;
+	senml_str_t              base_name = { .p = "", .len = 0 };
+	senml_str_t              name      = { .p = "", .len = 0 };
+	const char              *canonical;
+	
+	if (base_info && (base_info->base_name || base_info->base_name_view.p))
+		base_name = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	
+	if (fields->has_name && fields->name.kind == SENML_TOKEN_PLAIN) {
+		name = (senml_str_t){ .p = fields->name.p, .len = fields->name.len };
+	} else if (fields->has_name) {
+		// escaped names have to be decoded somewhere before they can be looked up
+		char *decoded = arena ? senml_arena_alloc(arena, fields->name.len + 1) : NULL;
+		
+		if (!decoded)
+			return -2;
+		
+		name = (senml_str_t){ .p = decoded, .len = senml_token_decode(&fields->name, decoded) };
+	}
+	
+	// no base name and no name, so there is nothing to identify the record by
+	if (base_name.len == 0 && !fields->has_name)
+		return 0;
+	
+	if (senml_names_intern_parts(d->names, base_name, name, &record->name_id, &canonical))
+		return -2;
+	
+	if (fields->has_name) {
+		record->name_view = (senml_str_t){ .p = canonical + base_name.len, .len = name.len };
+		
+		if (!d->borrow)
+			record->name = (char *)canonical + base_name.len;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Applies the base name, time, unit and value to a record that was decoded for a callback.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_decoder_resolve(senml_decoder_t *d, senml_record_t *record)
+{
+	const senml_base_info_t *base_info = d->pack->base_info;
+	
+	senml_str_t base_name = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	senml_str_t name      = senml_str_of(record->name, &record->name_view);
+	
+	if (base_name.len > 0) {
+		size_t  len  = base_name.len + name.len;
+		char   *full = senml_arena_alloc(d->scratch, len + 1);
+		
+		if (!full)
+			return -2;
+		
+		memcpy(full, base_name.p, base_name.len);
+		
+		if (name.len > 0)
+			memcpy(full + base_name.len, name.p, name.len);
+		
+		full[len]         = '\0';
+		record->name      = full;
+		record->name_view = (senml_str_t){ .p = full, .len = len };
+	}
+	
+	if (!record->unit_view.p) {
+		record->unit      = base_info->base_unit;
+		record->unit_view = base_info->base_unit_view;
+	}
+	
+	record->time += base_info->base_time;
+	
+	if (record->value_type == SENML_TYPE_FLOAT && base_info->base_value_type == SENML_TYPE_FLOAT)
+		record->value.value_f += base_info->base_value.base_value_f;
+	
+	return 0;
+}
+
+
+void senml_transcoder_finish(const senml_decoder_t *d, size_t bytes, int rc)
+{
+	senml_call_t call = { 0 };
+	
+	senml_call_decoded(&d->call, d->len, d->count, rc == 0 ? 1 : 0, rc);
+	
+	if (rc || !senml_stats_on(SENML_STATS_COUNTERS))
+		return;
+	
+	// the records were written from the callback, so the time spent there is what encoding took
+	if (d->call.start)
+		call.start = senml_ticks() - d->call.external;
+	
+	senml_stats_add_call(&call, false, bytes, d->count, 1, 0);
+}
+
+
+int senml_decoder_init_callback(senml_decoder_t *d, senml_pack_t *pack, senml_record_t *record,
+                                senml_record_cb_t callback, void *ctx)
+{
+	memset(d, 0, sizeof(*d));
+	memset(pack, 0, sizeof(*pack));
+	senml_call_begin(&d->call);
+	
+	pack->records = record;
+	d->pack       = pack;
+	d->capacity   = 1;
+	d->fixed      = true;
+	d->callback   = callback;
+	d->ctx        = ctx;
+	
+	// the base info outlives the records, so it gets an arena of its own
+	if (!(d->arena = senml_arena_new(0)) || !(d->scratch = senml_arena_new(0))) {
+		senml_decoder_release(d);
+		return -2;
+	}
+	
+	return 0;
+}
+
+
+void senml_decoder_release(senml_decoder_t *d)
+{
+	if (d->arena)
+		senml_arena_free(d->arena);
+	
+	if (d->scratch)
+		senml_arena_free(d->scratch);
+	
+	d->arena   = NULL;
+	d->scratch = NULL;
+}
+
+
+/**
+ * Builds a record from the scanned attributes, see <code>senml_decoder_add</code>.
+ * @return 0 on success, 1 if the filter rejected the record, -1 if the attributes are invalid,
+ * -2 if memory ran out.
+ */
+static int senml_decoder_convert(senml_decoder_t *d, const senml_fields_t *fields)
+{
+	senml_pack_t   *pack  = d->pack;
+	senml_arena_t  *arena = d->callback ? d->scratch : d->arena;
+	senml_record_t *record;
+	bool            keep  = !fields->rejected;
+	
+	if (d->max_records && d->count == d->max_records) {
+		senml_error_set(SENML_ERROR_NO_SPACE, d->count + 1, "more than %zu records", d->count);
+		return -2;
+	}
+	
+	// the conversions below are undefined for values outside of the target types, and NaN
+	if (fields->has_version && !(fields->version >= 0 && fields->version <= UINT8_MAX)) {
+		senml_error_set(SENML_ERROR_RECORD, d->count + 1, "bver is out of range");
+		return -1;
+	}
+	
+	if (fields->has_update_time && !(fields->update_time >= 0 && fields->update_time <= UINT_MAX)) {
+		senml_error_set(SENML_ERROR_RECORD, d->count + 1, "ut is out of range");
+		return -1;
+	}
+	
+	// the base info applies to the records that follow, even if this one is not kept
+	if (fields->has_base_info && senml_decoder_store_base_info(d, fields))
+		return -2;
+	
+	if (d->select.filter && !fields->tested) {
+		int rc = senml_filter_test(d->select.filter, d->select.base_name,
+		                           fields->has_name ? &fields->name : NULL);
+		
+		if (rc < 0)
+			return -2;
+		
+		keep = rc == 1;
+	}
+	
+	if (!keep) {
+		d->count++;
+		d->skipped++;
+		return 1;
+	}
+	
+	// with a callback the previous record has been handed out already and is replaced
+	if (d->callback) {
+		senml_arena_reset(d->scratch);
+		pack->num = 0;
+	}
+	
+	if (pack->num == d->capacity) {
+		senml_record_t *records;
+		
+		if (d->fixed) {
+			senml_error_set(SENML_ERROR_NO_SPACE, d->count + 1,
+			                "more records than the pack can hold");
+			return -2;
+		}
+		
+		if (!(records = senml_arena_grow(d->arena, pack->records,
+		                                 sizeof(senml_record_t) * d->capacity,
+		                                 sizeof(senml_record_t) * d->capacity * 2)))
+			return -2;
+		
+		pack->records = records;
+		d->capacity  *= 2;
+	}
+	
+	record = &pack->records[pack->num];
+	memset(record, 0, sizeof(*record));
+	record->name_id = SENML_NO_ID;
+	
+	// the name may have been scanned for the filter only
+	if (!(d->select.skip & SENML_FIELD_NAME)) {
+		if (d->names) {
+			if (senml_decoder_intern_name(d, arena, fields, record))
+				return -2;
+		} else if (fields->has_name && senml_decoder_store_string(d, arena, &fields->name,
+		                                                          &record->name,
+		                                                          &record->name_view)) {
+			return -2;
+		}
+	}
+	
+	if (fields->has_unit &&
+	    senml_decoder_store_string(d, arena, &fields->unit, &record->unit, &record->unit_view))
+		return -2;
+	
+	if (fields->has_time)
+		record->time = fields->time;
+	
+	if (fields->has_update_time)
+		record->update_time = (unsigned int)(int64_t)fields->update_time;
+	
+	// same precedence as the jansson decoder: v, then vb, then vs
+	if (fields->has_value) {
+		record->value_type    = SENML_TYPE_FLOAT;
+		record->value.value_f = fields->value;
+	} else if (fields->has_bool_value) {
+		if (!fields->bool_valid) {
+			senml_error_set(SENML_ERROR_RECORD, d->count + 1, "vb is not boolean value");
+			return -1;
+		}
+		
+		record->value_type    = SENML_TYPE_BOOL;
+		record->value.value_b = fields->bool_value;
+	} else if (fields->has_string_value) {
+		if (senml_decoder_store_string(d, arena, &fields->string_value,
+		                               &record->value.value_s, &record->value_view))
+			return -2;
+		
+		record->value_type = SENML_TYPE_STRING;
+	}
+	
+	pack->num++;
+	d->count++;
+	
+	if (d->callback && d->resolve && pack->base_info && senml_decoder_resolve(d, record))
+		return -2;
+	
+	return 0;
+}
+
+
+int senml_decoder_add(senml_decoder_t *d, const senml_fields_t *fields)
+{
+	uint64_t start = d->call.start ? senml_ticks() : 0;
+	uint64_t converted = 0;
+	int      rc    = senml_decoder_convert(d, fields);
+	
+	if (start) {
+		converted        = senml_ticks();
+		d->call.convert += converted - start;
+	}
+	
+	// a record the filter rejected is not passed on
+	if (rc == 1)
+		return 0;
+	
+	if (rc || !d->callback)
+		return rc;
+	
+	rc = d->callback(&d->pack->records[0], d->pack->base_info, d->ctx);
+	
+	if (start)
+		d->call.external += senml_ticks() - converted;
+	
+	// the callback may have failed in the library, e.g. when columns run out of memory
+	if (rc && senml_error_current()->code == SENML_OK)
+		senml_error_set(SENML_ERROR_CALLBACK, d->count, "record #%zu was rejected by the callback",
+		                d->count);
+	
+	return rc;
+}
@@ -0,0 +1,70 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+
+static __thread senml_error_t senml_error_local;   //!< Error of the latest call on this thread
+
+
+static const char *senml_error_strings[SENML_ERROR_COUNT] = {
+	[SENML_OK]                 = "success",
+	[SENML_ERROR_SYNTAX]       = "syntax error",
+	[SENML_ERROR_TRUNCATED]    = "premature end of input",
+	[SENML_ERROR_DEPTH]        = "maximum nesting depth exceeded",
+	[SENML_ERROR_NOT_ARRAY]    = "not an array",
+	[SENML_ERROR_RECORD]       = "invalid record",
+	[SENML_ERROR_TRAILING]     = "trailing data after the pack",
+	[SENML_ERROR_INVALID_PACK] = "pack cannot be encoded",
+	[SENML_ERROR_NO_MEMORY]    = "out of memory",
+	[SENML_ERROR_NO_SPACE]     = "buffer too small",
+	[SENML_ERROR_CALLBACK]     = "stopped by the callback",
+	[SENML_ERROR_IO]           = "file cannot be read"
+};
+
+
+senml_error_t *senml_error_current(void)
+{
+	return &senml_error_local;
+}
+
+
+senml_error_t *senml_error_set(senml_error_code_t code, size_t record, const char *fmt, ...)
+{
+	senml_error_t *error = &senml_error_local;
+	va_list        args;
+	
+	error->code   = code;
+	error->record = record;
+	error->offset = 0;
+	error->line   = 0;
+	
+	va_start(args, fmt);
+	vsnprintf(error->message, sizeof(error->message), fmt, args);
+	va_end(args);
+	
+	return error;
+}
+
+
+void senml_error_default(senml_error_code_t code)
+{
+	if (senml_error_local.code == SENML_OK)
+		senml_error_set(code, 0, "%s", senml_error_strings[code]);
+}
+
+
+const senml_error_t *senml_last_error(void)
+{
+	return &senml_error_local;
+}
+
+
+const char *senml_error_string(senml_error_code_t code)
+{
+	if ((unsigned int)code >= SENML_ERROR_COUNT)
+		return "unknown error";
+	
+	return senml_error_strings[code];
+}
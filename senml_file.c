@@ -0,0 +1,413 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define SENML_FILE_CHUNK (1 << 20)   //!< Bytes of input per item of the pool
+
+
+/*! Records of a single pack that one item decodes */
+typedef struct {
+	size_t begin;  //!< Offset of the first record
+	size_t end;    //!< Offset of the comma or bracket after the last record
+	size_t first;  //!< Number of records in front of the chunk
+} senml_file_chunk_t;
+
+
+/*! Arguments of <code>senml_decode_file</code> */
+typedef struct {
+	const char          *base;       //!< The mapped file
+	size_t               size;       //!< Size of the file in bytes
+	senml_file_chunk_t  *chunks;     //!< Chunks of a single pack, NULL for JSON lines
+	senml_base_info_t   *base_info;  //!< Base info of a single pack, may be NULL
+	senml_pack_cb_t      callback;
+	void                *ctx;
+} senml_file_t;
+
+
+static inline bool senml_file_is_ws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+/**
+ * Finds the closing quote of a string without validating anything.
+ * @param[in] p First byte after the opening quote.
+ * @param[in] end
+ * @return The byte after the closing quote, or \p end if there is none.
+ */
+static const char *senml_file_skip_string(const char *p, const char *end)
+{
+	while ((p = memchr(p, '"', (size_t)(end - p)))) {
+		size_t backslashes = 0;
+		
+		// the opening quote stops this at the latest
+		while (p[-1 - (ptrdiff_t)backslashes] == '\\')
+			backslashes++;
+		
+		if (backslashes % 2 == 0)
+			return p + 1;
+		
+		p++;
+	}
+	
+	return end;
+}
+
+
+/**
+ * Cuts the single pack of a file into chunks at the commas between records. Only strings and
+ * nesting are tracked here, everything else is validated when the chunks are decoded.
+ * @param[in,out] file
+ * @param[out] count Number of chunks.
+ * @return 0 on success, -1 if the file is not an array or the array is not closed, -2 if memory
+ * ran out.
+ */
+static int senml_file_split(senml_file_t *file, size_t *count)
+{
+	senml_file_chunk_t  *chunk;
+	size_t               records = 0;
+	size_t               depth   = 0;
+	senml_json_cursor_t  c = {
+		.start = file->base,
+		.p     = file->base,
+		.end   = file->base + file->size,
+		.depth = 0
+	};
+	
+	*count = 0;
+	senml_json_skip_ws(&c);
+	
+	if (c.p >= c.end || *c.p != '[') {
+		senml_json_error(&c, SENML_ERROR_NOT_ARRAY, "not an array");
+		return -1;
+	}
+	
+	c.p++;
+	senml_json_skip_ws(&c);
+	
+	if (c.p < c.end && *c.p == ']') {
+		c.p++;
+		goto done;
+	}
+	
+	// every chunk but the last is at least SENML_FILE_CHUNK bytes long
+	if (!(file->chunks = senml_malloc(sizeof(senml_file_chunk_t) *
+	                                  (file->size / SENML_FILE_CHUNK + 1))))
+		return -2;
+	
+	chunk        = file->chunks;
+	chunk->begin = (size_t)(c.p - c.start);
+	chunk->first = 0;
+	
+	while (c.p < c.end) {
+		switch (*c.p) {
+		case '"':
+			c.p = senml_file_skip_string(c.p + 1, c.end);
+			continue;
+		
+		case '{':
+		case '[':
+			depth++;
+			break;
+		
+		case '}':
+			// unbalanced input is left to the decoder of the chunk
+			if (depth > 0)
+				depth--;
+			
+			break;
+		
+		case ']':
+			if (depth > 0) {
+				depth--;
+				break;
+			}
+			
+			chunk->end = (size_t)(c.p - c.start);
+			(*count)++;
+			c.p++;
+			goto done;
+		
+		case ',':
+			if (depth > 0)
+				break;
+			
+			records++;
+			
+			if ((size_t)(c.p - c.start) - chunk->begin >= SENML_FILE_CHUNK) {
+				chunk->end = (size_t)(c.p - c.start);
+				(*count)++;
+				
+				chunk++;
+				chunk->begin = (size_t)(c.p - c.start) + 1;
+				chunk->first = records;
+			}
+			
+			break;
+		}
+		
+		c.p++;
+	}
+	
+	senml_json_error(&c, SENML_ERROR_TRUNCATED, "']' expected");
+	return -1;
+	
+	done:
+	senml_json_skip_ws(&c);
+	
+	if (c.p != c.end) {
+		senml_json_error(&c, SENML_ERROR_TRAILING, "end of file expected");
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Decodes the base info of a single pack from its first record, so that every chunk can refer to
+ * it. The records of the chunk are decoded again with the chunk, and so are errors found.
+ * @param[in,out] file
+ * @param[out] head Pack that holds the base info, must be released by the caller.
+ * @return 0 on success, -2 if memory ran out.
+ */
+static int senml_file_base_info(senml_file_t *file, senml_pack_t **head)
+{
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_ZERO_COPY };
+	senml_decoder_t     d;
+	senml_fields_t      fields;
+	senml_json_cursor_t c = {
+		.start = file->base,
+		.p     = file->base + file->chunks[0].begin,
+		.end   = file->base + file->chunks[0].end,
+		.depth = 0
+	};
+	
+	*head = NULL;
+	
+	if (senml_json_scan_record(&c, &fields, true, NULL) || !fields.has_base_info)
+		return 0;
+	
+	if (senml_decoder_init(&d, &opts, 256, 1))
+		return -2;
+	
+	// the decoder is not finished, so the record does not show up in the statistics twice
+	*head = d.pack;
+	
+	if (senml_decoder_add(&d, &fields) == -2)
+		return -2;
+	
+	file->base_info = d.pack->base_info;
+	
+	return 0;
+}
+
+
+/**
+ * Hands a pack to the callback of the file.
+ * @return true to continue, false if the callback stopped decoding.
+ */
+static bool senml_file_deliver(senml_pool_job_t *job, const senml_pack_t *pack, size_t offset)
+{
+	senml_file_t *file = job->ctx;
+	
+	if (file->callback(pack, offset, file->ctx) == 0)
+		return true;
+	
+	if (senml_error_current()->code == SENML_OK)
+		senml_error_set(SENML_ERROR_CALLBACK, 0, "pack at offset %zu was rejected by the callback",
+		                offset);
+	
+	senml_pool_fail(job);
+	return false;
+}
+
+
+static void senml_file_decode_chunk(senml_pool_job_t *job, size_t index, senml_writer_t *scratch)
+{
+	senml_file_t             *file  = job->ctx;
+	const senml_file_chunk_t *chunk = &file->chunks[index];
+	senml_decode_opts_t       opts  = { .flags = SENML_DECODE_ZERO_COPY };
+	senml_decoder_t           d;
+	senml_pack_t             *pack;
+	int                       rc;
+	senml_json_cursor_t       c = {
+		.start = file->base,
+		.p     = file->base + chunk->begin,
+		.end   = file->base + chunk->end,
+		.depth = 0
+	};
+	
+	(void)scratch;
+	
+	if (senml_pool_failed(job))
+		return;
+	
+	if (senml_decoder_init(&d, &opts, (chunk->end - chunk->begin) * 2, 8)) {
+		senml_pool_fail(job);
+		return;
+	}
+	
+	d.len = chunk->end - chunk->begin;
+	
+	// the cursor starts at the beginning of the file, so only the record number is relative
+	if ((rc = senml_json_decode_slice(&d, &c, index == 0)) && senml_error_current()->record)
+		senml_error_current()->record += chunk->first;
+	
+	if (!(pack = senml_decoder_finish(&d, rc))) {
+		senml_pool_fail(job);
+		return;
+	}
+	
+	if (!pack->base_info)
+		pack->base_info = file->base_info;
+	
+	senml_file_deliver(job, pack, chunk->begin);
+	senml_pack_free(pack);
+}
+
+
+/**
+ * Finds the first line that starts at or after \p offset.
+ */
+static const char *senml_file_line(const senml_file_t *file, size_t offset)
+{
+	const char *newline;
+	
+	if (offset == 0)
+		return file->base;
+	
+	if (offset >= file->size)
+		return file->base + file->size;
+	
+	// a line that starts right at offset follows a newline just in front of it
+	newline = memchr(file->base + offset - 1, '\n', file->size - offset + 1);
+	
+	return newline ? newline + 1 : file->base + file->size;
+}
+
+
+/**
+ * Makes the position of an error relative to the file rather than the line it was found in.
+ */
+static void senml_file_locate(const senml_file_t *file, const char *line)
+{
+	senml_error_t *error = senml_error_current();
+	const char    *p     = file->base;
+	unsigned int   lines = 1;
+	
+	while ((p = memchr(p, '\n', (size_t)(line - p)))) {
+		lines++;
+		p++;
+	}
+	
+	error->offset += (size_t)(line - file->base);
+	error->line    = lines;
+}
+
+
+static void senml_file_decode_lines(senml_pool_job_t *job, size_t index, senml_writer_t *scratch)
+{
+	senml_file_t        *file = job->ctx;
+	const char          *end  = file->base + file->size;
+	const char          *p    = senml_file_line(file, index * SENML_FILE_CHUNK);
+	const char          *stop = senml_file_line(file, (index + 1) * SENML_FILE_CHUNK);
+	senml_decode_opts_t  opts = { .flags = SENML_DECODE_ZERO_COPY };
+	
+	(void)scratch;
+	
+	// a line belongs to the item its first byte falls into
+	while (p < stop && !senml_pool_failed(job)) {
+		const char   *eol  = memchr(p, '\n', (size_t)(end - p));
+		const char   *last = eol ? eol : end;
+		senml_pack_t *pack;
+		
+		while (p < last && senml_file_is_ws(*p))
+			p++;
+		
+		while (last > p && senml_file_is_ws(last[-1]))
+			last--;
+		
+		if (p < last) {
+			// every line reuses the pack of the previous one
+			if (!(pack = senml_decode_json_ex(p, (size_t)(last - p), &opts))) {
+				senml_file_locate(file, p);
+				senml_pool_fail(job);
+				break;
+			}
+			
+			opts.pack = pack;
+			
+			if (!senml_file_deliver(job, pack, (size_t)(p - file->base)))
+				break;
+		}
+		
+		if (!eol)
+			break;
+		
+		p = eol + 1;
+	}
+	
+	senml_pack_free(opts.pack);
+}
+
+
+int senml_decode_file(senml_pool_t *pool, const char *path, unsigned int flags,
+                      senml_pack_cb_t callback, void *ctx)
+{
+	senml_file_t     file = { .callback = callback, .ctx = ctx };
+	senml_pool_job_t job  = { .ctx = &file };
+	senml_pack_t    *head = NULL;
+	struct stat      st;
+	int              fd;
+	int              rc;
+	
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st)) {
+		senml_error_set(SENML_ERROR_IO, 0, "%s: %s", path, strerror(errno));
+		
+		if (fd >= 0)
+			close(fd);
+		
+		return -1;
+	}
+	
+	file.size = (size_t)st.st_size;
+	
+	// an empty file cannot be mapped, but it can be decoded from an empty string
+	if (file.size == 0) {
+		file.base = "";
+	} else if ((file.base = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		senml_error_set(SENML_ERROR_IO, 0, "%s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	
+	// the mapping keeps the file open
+	close(fd);
+	
+	if (flags & SENML_FILE_LINES) {
+		job.run   = senml_file_decode_lines;
+		job.count = file.size / SENML_FILE_CHUNK + 1;
+		rc        = senml_pool_run(pool, &job);
+	} else if ((rc = senml_file_split(&file, &job.count)) == 0 && job.count > 0 &&
+	           (rc = senml_file_base_info(&file, &head)) == 0) {
+		job.run = senml_file_decode_chunk;
+		rc      = senml_pool_run(pool, &job);
+	}
+	
+	senml_pack_free(head);
+	senml_free(file.chunks);
+	
+	if (file.size > 0)
+		munmap((void *)file.base, file.size);
+	
+	return rc ? -1 : 0;
+}
@@ -0,0 +1,265 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <string.h>
+
+
+#define SENML_FILTER_BUF (256)   //!< Longest name that is assembled on the stack
+
+
+/*! How a filter decides about a name */
+typedef enum {
+	SENML_FILTER_NAMES = 0,  //!< The name is one of a set
+	SENML_FILTER_PREFIX,     //!< The name starts with a prefix
+	SENML_FILTER_MATCH       //!< A function of the caller decides
+} senml_filter_kind_t;
+
+
+/*! A name of the set and what is needed to compare it quickly */
+typedef struct {
+	const char  *p;     //!< The name, NULL if the slot is empty
+	uint32_t     len;   //!< Length of the name in bytes
+	uint32_t     hash;  //!< Hash of the name
+} senml_filter_entry_t;
+
+
+/*
+ * A filter never changes after it has been created, so any number of decoders may use it at the
+ * same time without synchronization.
+ */
+struct senml_filter {
+	senml_filter_kind_t    kind;
+	senml_arena_t         *arena;   //!< Holds the filter and everything it refers to
+	senml_filter_entry_t  *slots;   //!< Open addressing hash table of the names
+	size_t                 size;    //!< Number of slots, a power of two
+	senml_str_t            prefix;  //!< Prefix of SENML_FILTER_PREFIX
+	senml_match_t          match;   //!< Function of SENML_FILTER_MATCH
+	void                  *ctx;     //!< Passed to every call of match
+};
+
+
+static senml_filter_t *senml_filter_new(senml_filter_kind_t kind, size_t size)
+{
+	senml_arena_t  *arena  = senml_arena_new(sizeof(senml_filter_t) + size);
+	senml_filter_t *filter = arena ? senml_arena_alloc(arena, sizeof(senml_filter_t)) : NULL;
+	
+	if (!filter) {
+		if (arena)
+			senml_arena_free(arena);
+		
+		return NULL;
+	}
+	
+	memset(filter, 0, sizeof(*filter));
+	filter->kind  = kind;
+	filter->arena = arena;
+	
+	return filter;
+}
+
+
+senml_filter_t *senml_filter_names(const char *const *names, size_t count)
+{
+	senml_filter_t *filter;
+	size_t          bytes = 0;
+	size_t          size  = 16;
+	
+	// at most half of the slots are used, so probe sequences stay short
+	while (size < count * 2)
+		size *= 2;
+	
+	for (size_t i = 0; i < count; i++)
+		bytes += SENML_ARENA_ALIGN(strlen(names[i]) + 1);
+	
+	filter = senml_filter_new(SENML_FILTER_NAMES, sizeof(senml_filter_entry_t) * size + bytes);
+	
+	if (!filter)
+		return NULL;
+	
+	if (!(filter->slots = senml_arena_alloc(filter->arena, sizeof(senml_filter_entry_t) * size))) {
+		senml_filter_free(filter);
+		return NULL;
+	}
+	
+	memset(filter->slots, 0, sizeof(senml_filter_entry_t) * size);
+	filter->size = size;
+	
+	for (size_t i = 0; i < count; i++) {
+		size_t    len  = strlen(names[i]);
+		uint32_t  hash = senml_hash(SENML_HASH_SEED, names[i], len);
+		size_t    slot = hash & (size - 1);
+		char     *copy;
+		
+		while (filter->slots[slot].p &&
+		       (filter->slots[slot].len != len || memcmp(filter->slots[slot].p, names[i], len) != 0))
+			slot = (slot + 1) & (size - 1);
+		
+		// duplicates are only stored once
+		if (filter->slots[slot].p)
+			continue;
+		
+		if (!(copy = senml_arena_strndup(filter->arena, names[i], len))) {
+			senml_filter_free(filter);
+			return NULL;
+		}
+		
+		filter->slots[slot] = (senml_filter_entry_t){
+			.p    = copy,
+			.len  = (uint32_t)len,
+			.hash = hash
+		};
+	}
+	
+	return filter;
+}
+
+
+senml_filter_t *senml_filter_prefix(const char *prefix)
+{
+	size_t          len    = strlen(prefix);
+	senml_filter_t *filter = senml_filter_new(SENML_FILTER_PREFIX, len + 1);
+	char           *copy;
+	
+	if (!filter)
+		return NULL;
+	
+	if (!(copy = senml_arena_strndup(filter->arena, prefix, len))) {
+		senml_filter_free(filter);
+		return NULL;
+	}
+	
+	filter->prefix = (senml_str_t){ .p = copy, .len = len };
+	
+	return filter;
+}
+
+
+senml_filter_t *senml_filter_match(senml_match_t match, void *ctx)
+{
+	senml_filter_t *filter = senml_filter_new(SENML_FILTER_MATCH, 0);
+	
+	if (filter) {
+		filter->match = match;
+		filter->ctx   = ctx;
+	}
+	
+	return filter;
+}
+
+
+void senml_filter_free(senml_filter_t *filter)
+{
+	if (filter)
+		senml_arena_free(filter->arena);
+}
+
+
+/**
+ * Looks up the concatenation of \p base_name and \p name without building it.
+ */
+static bool senml_filter_find(const senml_filter_t *filter, senml_str_t base_name,
+                              senml_str_t name)
+{
+	uint32_t hash = senml_hash(senml_hash(SENML_HASH_SEED, base_name.p, base_name.len),
+	                           name.p, name.len);
+	size_t   len  = base_name.len + name.len;
+	size_t   slot = hash & (filter->size - 1);
+	
+	for (const senml_filter_entry_t *entry; (entry = &filter->slots[slot])->p;
+	     slot = (slot + 1) & (filter->size - 1)) {
+		if (entry->hash == hash && entry->len == len &&
+		    memcmp(entry->p, base_name.p, base_name.len) == 0 &&
+		    memcmp(entry->p + base_name.len, name.p, name.len) == 0)
+			return true;
+	}
+	
+	return false;
+}
+
+
+/**
+ * Checks whether the concatenation of \p base_name and \p name starts with the prefix.
+ */
+static bool senml_filter_has_prefix(const senml_filter_t *filter, senml_str_t base_name,
+                                    senml_str_t name)
+{
+	senml_str_t prefix = filter->prefix;
+	size_t      head   = prefix.len < base_name.len ? prefix.len : base_name.len;
+	
+	if (base_name.len + name.len < prefix.len || memcmp(base_name.p, prefix.p, head) != 0)
+		return false;
+	
+	return memcmp(name.p, prefix.p + head, prefix.len - head) == 0;
+}
+
+
+/**
+ * Passes the resolved name to the function of the caller, assembling it first if necessary.
+ * @return 1 if the record is kept, 0 if not, -2 if memory could not be allocated.
+ */
+static int senml_filter_call(const senml_filter_t *filter, senml_str_t base_name, senml_str_t name)
+{
+	char    buf[SENML_FILTER_BUF];
+	char   *full = buf;
+	size_t  len  = base_name.len + name.len;
+	bool    keep;
+	
+	if (base_name.len == 0)
+		return filter->match(name.p, name.len, filter->ctx) ? 1 : 0;
+	
+	if (len > sizeof(buf) && !(full = senml_malloc(len)))
+		return -2;
+	
+	memcpy(full, base_name.p, base_name.len);
+	memcpy(full + base_name.len, name.p, name.len);
+	keep = filter->match(full, len, filter->ctx);
+	
+	if (full != buf)
+		senml_free(full);
+	
+	return keep ? 1 : 0;
+}
+
+
+int senml_filter_test(const senml_filter_t *filter, senml_str_t base_name,
+                      const senml_token_t *name)
+{
+	char         buf[SENML_FILTER_BUF];
+	char        *decoded = NULL;
+	senml_str_t  plain   = { .p = "", .len = 0 };
+	int          rc      = 0;
+	
+	if (!base_name.p)
+		base_name = (senml_str_t){ .p = "", .len = 0 };
+	
+	if (name && name->kind == SENML_TOKEN_PLAIN) {
+		plain = (senml_str_t){ .p = name->p, .len = name->len };
+	} else if (name) {
+		// names with escape sequences are rare, they are decoded before they are compared
+		decoded = name->len <= sizeof(buf) ? buf : senml_malloc(name->len + 1);
+		
+		if (!decoded)
+			return -2;
+		
+		plain = (senml_str_t){ .p = decoded, .len = senml_token_decode(name, decoded) };
+	}
+	
+	switch (filter->kind) {
+	case SENML_FILTER_NAMES:
+		rc = senml_filter_find(filter, base_name, plain) ? 1 : 0;
+		break;
+	
+	case SENML_FILTER_PREFIX:
+		rc = senml_filter_has_prefix(filter, base_name, plain) ? 1 : 0;
+		break;
+	
+	case SENML_FILTER_MATCH:
+		rc = senml_filter_call(filter, base_name, plain);
+		break;
+	}
+	
+	if (decoded && decoded != buf)
+		senml_free(decoded);
+	
+	return rc;
+}
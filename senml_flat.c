@@ -0,0 +1,651 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * A flat pack is a header, an array of records of fixed size and a table of strings, in this
+ * order and in the byte order of the host that wrote it. Records refer to their strings by offset
+ * into the table, so the buffer can be moved, written to a file and mapped back as it is. Every
+ * string is followed by a NUL, and equal strings are only stored once.
+ */
+
+
+#define SENML_FLAT_MAGIC     "SMLF"        //!< First bytes of every flat pack
+#define SENML_FLAT_ORDER     (0x0102)      //!< Reads as 0x0201 on a host of the other byte order
+#define SENML_FLAT_BASE_INFO (1 << 0)      //!< Header flag, set if the pack has base info
+#define SENML_FLAT_NONE      (UINT32_MAX)  //!< Offset of a string that is not set
+#define SENML_FLAT_MIN_INDEX (64)          //!< Slots of the first string index, a power of two
+
+
+/*! Reference to a string in the string table */
+typedef struct {
+	uint32_t  offset;  //!< Offset of the first byte in the table, SENML_FLAT_NONE if not set
+	uint32_t  len;     //!< Length in bytes, without the NUL that follows
+} senml_flat_str_t;
+
+
+/*! Beginning of every flat pack */
+typedef struct {
+	char              magic[4];          //!< SENML_FLAT_MAGIC, not terminated
+	uint16_t          version;           //!< SENML_FLAT_VERSION
+	uint16_t          order;             //!< SENML_FLAT_ORDER in the byte order of the writer
+	uint32_t          flags;             //!< SENML_FLAT_BASE_INFO if the pack has base info
+	uint32_t          record_size;       //!< Size of a record in bytes
+	uint64_t          num;               //!< Number of records
+	uint64_t          strings;           //!< Offset of the string table, follows the records
+	uint64_t          size;              //!< Size of the whole flat pack in bytes
+	double            base_time;
+	double            base_value;        //!< Float base value, or 1 and 0 for a boolean one
+	senml_flat_str_t  base_name;
+	senml_flat_str_t  base_unit;
+	senml_flat_str_t  base_value_s;      //!< String or binary base value
+	uint8_t           base_version;
+	uint8_t           base_value_type;   //!< A <code>senml_value_type_t</code>
+	uint8_t           reserved[6];
+} senml_flat_header_t;
+
+
+/*! A record, the records follow the header */
+typedef struct {
+	double            time;
+	double            value;        //!< Float value, or 1 and 0 for a boolean one
+	senml_flat_str_t  name;
+	senml_flat_str_t  unit;
+	senml_flat_str_t  value_s;      //!< String or binary value
+	uint32_t          update_time;
+	uint8_t           value_type;   //!< A <code>senml_value_type_t</code>
+	uint8_t           reserved[3];
+} senml_flat_record_t;
+
+
+/*! A string in the table and what is needed to compare it quickly */
+typedef struct {
+	uint32_t  offset;  //!< Offset in the table, SENML_FLAT_NONE if the slot is empty
+	uint32_t  len;
+	uint32_t  hash;
+} senml_flat_entry_t;
+
+
+/*! State of the encoder */
+typedef struct {
+	senml_writer_t      *w;
+	size_t               strings;  //!< Offset of the string table in the output
+	senml_flat_entry_t  *index;    //!< Open addressing hash table of the strings written so far
+	size_t               size;     //!< Number of slots, a power of two
+	size_t               used;     //!< Number of slots in use
+} senml_flat_encoder_t;
+
+
+/**
+ * Doubles the size of the string index.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_flat_grow(senml_flat_encoder_t *enc)
+{
+	size_t              size  = enc->size ? enc->size * 2 : SENML_FLAT_MIN_INDEX;
+	senml_flat_entry_t *index = senml_malloc(sizeof(senml_flat_entry_t) * size);
+	
+	if (!index)
+		return -2;
+	
+	memset(index, 0xff, sizeof(senml_flat_entry_t) * size);
+	
+	for (size_t i = 0; i < enc->size; i++) {
+		size_t slot;
+		
+		if (enc->index[i].offset == SENML_FLAT_NONE)
+			continue;
+		
+		for (slot = enc->index[i].hash & (size - 1); index[slot].offset != SENML_FLAT_NONE;
+		     slot = (slot + 1) & (size - 1))
+			;
+		
+		index[slot] = enc->index[i];
+	}
+	
+	senml_free(enc->index);
+	enc->index = index;
+	enc->size  = size;
+	
+	return 0;
+}
+
+
+/**
+ * Adds a string to the table unless it is there already.
+ * @param[in] p The string, NULL if it is not set.
+ * @param[out] ref Where the string ended up.
+ * @return 0 on success, -1 if the table would exceed 4 GiB, -2 if memory ran out.
+ */
+static int senml_flat_put_string(senml_flat_encoder_t *enc, const char *p, size_t len,
+                                 senml_flat_str_t *ref)
+{
+	senml_writer_t *w = enc->w;
+	uint32_t        hash;
+	size_t          slot;
+	
+	ref->offset = SENML_FLAT_NONE;
+	ref->len    = 0;
+	
+	// the output is discarded anyway
+	if (!p || w->overflow)
+		return 0;
+	
+	if (len >= SENML_FLAT_NONE - (w->len - enc->strings)) {
+		senml_error_set(SENML_ERROR_INVALID_PACK, 0, "strings exceed the 4 GiB of a flat pack");
+		return -1;
+	}
+	
+	if (enc->used * 2 >= enc->size && senml_flat_grow(enc))
+		return -2;
+	
+	hash = senml_hash(SENML_HASH_SEED, p, len);
+	
+	for (slot = hash & (enc->size - 1); enc->index[slot].offset != SENML_FLAT_NONE;
+	     slot = (slot + 1) & (enc->size - 1)) {
+		const senml_flat_entry_t *entry = &enc->index[slot];
+		
+		if (entry->hash == hash && entry->len == len &&
+		    memcmp(w->buf + enc->strings + entry->offset, p, len) == 0) {
+			ref->offset = entry->offset;
+			ref->len    = entry->len;
+			return 0;
+		}
+	}
+	
+	ref->offset = (uint32_t)(w->len - enc->strings);
+	ref->len    = (uint32_t)len;
+	
+	senml_writer_put(w, p, len);
+	senml_writer_putc(w, '\0');
+	
+	if (!w->overflow) {
+		enc->index[slot] = (senml_flat_entry_t){ .offset = ref->offset, .len = ref->len, .hash = hash };
+		enc->used++;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Stores a value that may be a number or a string as a number and a string reference. \p f and
+ * \p b point into the union of the value and are only read if it holds that type.
+ * @return 0 on success, -1 if a string value is not set or too large, -2 if memory ran out.
+ */
+static int senml_flat_put_value(senml_flat_encoder_t *enc, senml_value_type_t type,
+                                const double *f, const bool *b, senml_str_t s,
+                                senml_bin_data_t bin, double *value, senml_flat_str_t *ref)
+{
+	*value = 0;
+	
+	switch (type) {
+	case SENML_TYPE_FLOAT:
+		*value = *f;
+		break;
+	
+	case SENML_TYPE_BOOL:
+		*value = *b ? 1 : 0;
+		break;
+	
+	case SENML_TYPE_STRING:
+		if (!s.p) {
+			senml_error_set(SENML_ERROR_INVALID_PACK, 0, "string value is not set");
+			return -1;
+		}
+		
+		return senml_flat_put_string(enc, s.p, s.len, ref);
+	
+	case SENML_TYPE_BINARY:
+		return senml_flat_put_string(enc, bin.p ? (const char *)bin.p : "", bin.len, ref);
+	
+	default:
+		break;
+	}
+	
+	ref->offset = SENML_FLAT_NONE;
+	ref->len    = 0;
+	
+	return 0;
+}
+
+
+static int senml_flat_put_base_info(senml_flat_encoder_t *enc, const senml_base_info_t *base_info,
+                                    senml_flat_header_t *header)
+{
+	senml_str_t name  = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	senml_str_t unit  = senml_str_of(base_info->base_unit, &base_info->base_unit_view);
+	senml_str_t value = { .p = base_info->base_value.base_value_s, .len = 0 };
+	int         rc;
+	
+	if (base_info->base_value_type == SENML_TYPE_STRING && value.p)
+		value.len = strlen(value.p);
+	
+	header->flags          |= SENML_FLAT_BASE_INFO;
+	header->base_version    = base_info->version;
+	header->base_time       = base_info->base_time;
+	header->base_value_type = (uint8_t)base_info->base_value_type;
+	
+	if ((rc = senml_flat_put_string(enc, name.p, name.len, &header->base_name)) ||
+	    (rc = senml_flat_put_string(enc, unit.p, unit.len, &header->base_unit)))
+		return rc;
+	
+	return senml_flat_put_value(enc, base_info->base_value_type,
+	                            &base_info->base_value.base_value_f,
+	                            &base_info->base_value.base_value_b, value,
+	                            base_info->base_value.base_value_bin, &header->base_value,
+	                            &header->base_value_s);
+}
+
+
+/**
+ * Writes a whole flat pack. The header and the records are written in place once their strings
+ * have been added to the table behind them.
+ * @return 0 on success, -1 if the pack contains invalid data, -2 if memory ran out.
+ */
+static int senml_flat_encode(senml_writer_t *w, const senml_pack_t *pack)
+{
+	senml_flat_header_t  header  = { .version = SENML_FLAT_VERSION };
+	senml_flat_encoder_t enc     = { .w = w };
+	size_t               records = sizeof(senml_flat_header_t);
+	int                  rc      = 0;
+	
+	enc.strings = records + sizeof(senml_flat_record_t) * pack->num;
+	
+	if (!senml_writer_reserve(w, enc.strings))
+		return w->fixed ? 0 : -2;
+	
+	w->len = enc.strings;
+	
+	if (pack->base_info && (rc = senml_flat_put_base_info(&enc, pack->base_info, &header)))
+		goto done;
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		senml_str_t           name   = senml_str_of(record->name, &record->name_view);
+		senml_str_t           unit   = senml_str_of(record->unit, &record->unit_view);
+		senml_str_t           value  = { .p = NULL, .len = 0 };
+		senml_flat_record_t   flat   = {
+			.time        = record->time,
+			.update_time = record->update_time,
+			.value_type  = (uint8_t)record->value_type
+		};
+		
+		// the union only holds a string pointer if the value is a string
+		if (record->value_type == SENML_TYPE_STRING)
+			value = senml_str_of(record->value.value_s, &record->value_view);
+		
+		if ((rc = senml_flat_put_string(&enc, name.p, name.len, &flat.name)) ||
+		    (rc = senml_flat_put_string(&enc, unit.p, unit.len, &flat.unit)) ||
+		    (rc = senml_flat_put_value(&enc, record->value_type, &record->value.value_f,
+		                               &record->value.value_b, value, record->value.value_bin,
+		                               &flat.value, &flat.value_s))) {
+			senml_error_current()->record = i + 1;
+			goto done;
+		}
+		
+		if (!w->overflow)
+			memcpy(w->buf + records + sizeof(senml_flat_record_t) * i, &flat, sizeof(flat));
+	}
+	
+	memcpy(header.magic, SENML_FLAT_MAGIC, sizeof(header.magic));
+	header.order       = SENML_FLAT_ORDER;
+	header.record_size = sizeof(senml_flat_record_t);
+	header.num         = pack->num;
+	header.strings     = enc.strings;
+	header.size        = w->len;
+	
+	if (!w->overflow)
+		memcpy(w->buf, &header, sizeof(header));
+	
+	done:
+	senml_free(enc.index);
+	return rc;
+}
+
+
+unsigned char *senml_encode_flat(const senml_pack_t *pack, size_t *len)
+{
+	senml_writer_t w = { 0 };
+	senml_call_t   call;
+	int            rc;
+	
+	senml_call_begin(&call);
+	
+	// the buffer only overflows if it could not grow
+	if ((rc = senml_flat_encode(&w, pack)) == 0 && w.overflow)
+		rc = -2;
+	
+	senml_call_encoded(&call, rc ? 0 : w.len, pack->num, rc);
+	
+	if (rc) {
+		senml_free(w.buf);
+		return NULL;
+	}
+	
+	*len = w.len;
+	
+	return (unsigned char *)w.buf;
+}
+
+
+int senml_encode_flat_s(const senml_pack_t *pack, unsigned char *output, size_t *len)
+{
+	senml_writer_t w = {
+		.buf   = (char *)output,
+		.len   = 0,
+		.cap   = *len,
+		.fixed = true
+	};
+	
+	senml_call_t call;
+	int          rc;
+	
+	senml_call_begin(&call);
+	
+	if ((rc = senml_flat_encode(&w, pack)) == 0 && w.overflow) {
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "the flat pack needs more than %zu bytes", *len);
+		rc = -2;
+	}
+	
+	senml_call_encoded(&call, rc ? 0 : w.len, pack->num, rc);
+	
+	if (rc == 0)
+		*len = w.len;
+	
+	return rc;
+}
+
+
+/**
+ * Checks the header, which is all that has to be done before the records can be read.
+ * @return 0 on success, -1 if \p buf is not a flat pack this library can read.
+ */
+static int senml_flat_check(const void *buf, size_t len)
+{
+	const senml_flat_header_t *header = buf;
+	
+	if ((uintptr_t)buf % 8 != 0) {
+		senml_error_set(SENML_ERROR_SYNTAX, 0, "flat pack is not aligned to 8 bytes");
+		return -1;
+	}
+	
+	if (len < sizeof(*header)) {
+		senml_error_set(SENML_ERROR_TRUNCATED, 0, "flat pack is shorter than its header");
+		return -1;
+	}
+	
+	if (memcmp(header->magic, SENML_FLAT_MAGIC, sizeof(header->magic)) != 0) {
+		senml_error_set(SENML_ERROR_SYNTAX, 0, "not a flat pack");
+		return -1;
+	}
+	
+	if (header->order != SENML_FLAT_ORDER) {
+		senml_error_set(SENML_ERROR_SYNTAX, 0, "flat pack was written with the other byte order");
+		return -1;
+	}
+	
+	if (header->version != SENML_FLAT_VERSION) {
+		senml_error_set(SENML_ERROR_SYNTAX, 0, "flat pack version %u is not supported",
+		                header->version);
+		return -1;
+	}
+	
+	if (header->size > len) {
+		senml_error_set(SENML_ERROR_TRUNCATED, 0, "flat pack needs %llu bytes but has %zu",
+		                (unsigned long long)header->size, len);
+		return -1;
+	}
+	
+	// the records must fit in front of the string table, which must fit in the pack
+	if (header->record_size != sizeof(senml_flat_record_t) || header->strings > header->size ||
+	    header->num > (header->size - sizeof(*header)) / sizeof(senml_flat_record_t) ||
+	    header->strings != sizeof(*header) + header->num * sizeof(senml_flat_record_t)) {
+		senml_error_set(SENML_ERROR_SYNTAX, 0, "flat pack is corrupt");
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+int senml_flat_open(const void *buf, size_t len, senml_flat_t *flat)
+{
+	const senml_flat_header_t *header = buf;
+	senml_call_t               call;
+	int                        rc;
+	
+	senml_call_begin(&call);
+	memset(flat, 0, sizeof(*flat));
+	
+	if ((rc = senml_flat_check(buf, len)) == 0) {
+		flat->buf         = buf;
+		flat->size        = header->size;
+		flat->num         = header->num;
+		flat->records     = (const char *)buf + sizeof(*header);
+		flat->strings     = (const char *)buf + header->strings;
+		flat->strings_len = header->size - header->strings;
+	}
+	
+	senml_call_decoded(&call, flat->size, flat->num, rc == 0 ? 1 : 0, rc);
+	
+	return rc;
+}
+
+
+int senml_flat_map(const char *path, senml_flat_t *flat)
+{
+	struct stat  st;
+	void        *base;
+	int          fd;
+	
+	memset(flat, 0, sizeof(*flat));
+	
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st)) {
+		senml_error_set(SENML_ERROR_IO, 0, "%s: %s", path, strerror(errno));
+		
+		if (fd >= 0)
+			close(fd);
+		
+		return -1;
+	}
+	
+	// an empty file cannot be mapped, and it is too short to be a flat pack anyway
+	if (st.st_size == 0) {
+		senml_error_set(SENML_ERROR_TRUNCATED, 0, "%s: file is empty", path);
+		close(fd);
+		return -1;
+	}
+	
+	if ((base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		senml_error_set(SENML_ERROR_IO, 0, "%s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	
+	// the mapping keeps the file open
+	close(fd);
+	
+	if (senml_flat_open(base, (size_t)st.st_size, flat)) {
+		munmap(base, (size_t)st.st_size);
+		return -1;
+	}
+	
+	flat->mapped = (size_t)st.st_size;
+	
+	return 0;
+}
+
+
+void senml_flat_close(senml_flat_t *flat)
+{
+	if (flat->mapped)
+		munmap((void *)flat->buf, flat->mapped);
+	
+	memset(flat, 0, sizeof(*flat));
+}
+
+
+static inline const senml_flat_record_t *senml_flat_at(const senml_flat_t *flat, size_t i)
+{
+	return &((const senml_flat_record_t *)flat->records)[i];
+}
+
+
+/**
+ * Resolves a string reference. Only the header is checked when a pack is opened, so every
+ * reference is checked here: one that does not end in the table reads as a string that is not set.
+ */
+static inline senml_str_t senml_flat_string(const senml_flat_t *flat, senml_flat_str_t ref)
+{
+	if (ref.offset >= flat->strings_len || ref.len >= flat->strings_len - ref.offset ||
+	    flat->strings[ref.offset + ref.len] != '\0')
+		return (senml_str_t){ .p = NULL, .len = 0 };
+	
+	return (senml_str_t){ .p = flat->strings + ref.offset, .len = ref.len };
+}
+
+
+static inline senml_value_type_t senml_flat_type(uint8_t type)
+{
+	return type <= SENML_TYPE_BINARY ? (senml_value_type_t)type : SENML_TYPE_UNDEF;
+}
+
+
+bool senml_flat_base_info(const senml_flat_t *flat, senml_base_info_t *base_info)
+{
+	const senml_flat_header_t *header = flat->buf;
+	senml_str_t                value;
+	
+	memset(base_info, 0, sizeof(*base_info));
+	
+	if (!(header->flags & SENML_FLAT_BASE_INFO))
+		return false;
+	
+	base_info->version         = header->base_version;
+	base_info->base_time       = header->base_time;
+	base_info->base_name_view  = senml_flat_string(flat, header->base_name);
+	base_info->base_unit_view  = senml_flat_string(flat, header->base_unit);
+	base_info->base_value_type = senml_flat_type(header->base_value_type);
+	
+	switch (base_info->base_value_type) {
+	case SENML_TYPE_FLOAT:
+		base_info->base_value.base_value_f = header->base_value;
+		break;
+	
+	case SENML_TYPE_BOOL:
+		base_info->base_value.base_value_b = header->base_value != 0;
+		break;
+	
+	case SENML_TYPE_STRING:
+		// the only string of the base info without a view, it points into the table as well
+		value = senml_flat_string(flat, header->base_value_s);
+		base_info->base_value.base_value_s = (char *)value.p;
+		break;
+	
+	case SENML_TYPE_BINARY:
+		value = senml_flat_string(flat, header->base_value_s);
+		base_info->base_value.base_value_bin = (senml_bin_data_t){
+			.p   = (uint8_t *)value.p,
+			.len = value.len
+		};
+		break;
+	
+	default:
+		break;
+	}
+	
+	return true;
+}
+
+
+void senml_flat_record(const senml_flat_t *flat, size_t i, senml_record_t *record)
+{
+	const senml_flat_record_t *flat_record = senml_flat_at(flat, i);
+	senml_str_t                value;
+	
+	memset(record, 0, sizeof(*record));
+	record->name_view   = senml_flat_string(flat, flat_record->name);
+	record->unit_view   = senml_flat_string(flat, flat_record->unit);
+	record->time        = flat_record->time;
+	record->update_time = flat_record->update_time;
+	record->value_type  = senml_flat_type(flat_record->value_type);
+	record->name_id     = SENML_NO_ID;
+	
+	switch (record->value_type) {
+	case SENML_TYPE_FLOAT:
+		record->value.value_f = flat_record->value;
+		break;
+	
+	case SENML_TYPE_BOOL:
+		record->value.value_b = flat_record->value != 0;
+		break;
+	
+	case SENML_TYPE_STRING:
+		record->value_view = senml_flat_string(flat, flat_record->value_s);
+		break;
+	
+	case SENML_TYPE_BINARY:
+		value = senml_flat_string(flat, flat_record->value_s);
+		record->value.value_bin = (senml_bin_data_t){ .p = (uint8_t *)value.p, .len = value.len };
+		break;
+	
+	default:
+		break;
+	}
+}
+
+
+senml_str_t senml_flat_name(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_string(flat, senml_flat_at(flat, i)->name);
+}
+
+
+senml_str_t senml_flat_unit(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_string(flat, senml_flat_at(flat, i)->unit);
+}
+
+
+double senml_flat_time(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_at(flat, i)->time;
+}
+
+
+unsigned int senml_flat_update_time(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_at(flat, i)->update_time;
+}
+
+
+senml_value_type_t senml_flat_value_type(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_type(senml_flat_at(flat, i)->value_type);
+}
+
+
+double senml_flat_value_f(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_at(flat, i)->value;
+}
+
+
+bool senml_flat_value_b(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_at(flat, i)->value != 0;
+}
+
+
+senml_str_t senml_flat_value_s(const senml_flat_t *flat, size_t i)
+{
+	return senml_flat_string(flat, senml_flat_at(flat, i)->value_s);
+}
@@ -0,0 +1,282 @@
+#include "senml.h"
+#include "senml_private.h"
+#include "senml_jansson.h"
+
+#include <limits.h>
+#include <string.h>
+#include <stdbool.h>
+#include <jansson.h>
+
+
+static inline bool senml_check_string(json_t *object, const char *key)
+{
+	if (json_is_string(object))
+		return true;
+	
+	senml_error_set(SENML_ERROR_RECORD, 0, "%s is not a string value", key);
+	return false;
+}
+
+
+static inline bool senml_check_number(json_t *object, const char *key)
+{
+	if (json_is_number(object))
+		return true;
+	
+	senml_error_set(SENML_ERROR_RECORD, 0, "%s is not a number", key);
+	return false;
+}
+
+
+static inline bool senml_check_range(json_t *object, const char *key, double max)
+{
+	double value = json_number_value(object);
+	
+	if (value >= 0 && value <= max)
+		return true;
+	
+	senml_error_set(SENML_ERROR_RECORD, 0, "%s is out of range", key);
+	return false;
+}
+
+
+static inline bool senml_is_base_info(json_t *record)
+{
+	if (json_object_get(record, SJ_VERSION)   ||
+	    json_object_get(record, SJ_BASE_NAME) ||
+	    json_object_get(record, SJ_BASE_TIME) ||
+	    json_object_get(record, SJ_BASE_UNIT) ||
+	    json_object_get(record, SJ_BASE_VALUE))
+		return true;
+	else
+		return false;
+}
+
+
+senml_pack_t *senml_decode_json_jansson(const char *input, size_t len)
+{
+	json_error_t json_error;
+	senml_call_t call;
+	uint64_t     converting;
+	
+	json_t *json_root = NULL;
+	
+	senml_call_begin(&call);
+	
+	if (len == 0)
+		len = strlen(input);
+	
+	json_root  = json_loadb(input, len, 0, &json_error);
+	converting = call.start ? senml_ticks() : 0;
+	
+	if (!json_root) {
+		senml_error_t *error = senml_error_set(SENML_ERROR_SYNTAX, 0, "%s", json_error.text);
+		
+		error->offset = (size_t)json_error.position;
+		error->line   = (unsigned int)json_error.line;
+		senml_call_decoded(&call, len, 0, 0, -1);
+		return NULL;
+	}
+	
+	if (!json_is_array(json_root)) {
+		senml_error_set(SENML_ERROR_NOT_ARRAY, 0, "not an array");
+		senml_call_decoded(&call, len, 0, 0, -1);
+		json_decref(json_root);
+		return NULL;
+	}
+	
+	senml_pack_t *pack = senml_arena_new_pack(sizeof(senml_record_t) * json_array_size(json_root));
+	
+	if (!pack) {
+		senml_call_decoded(&call, len, 0, 0, -2);
+		json_decref(json_root);
+		return NULL;
+	}
+	
+	pack->records = senml_arena_alloc(pack->arena,
+	                                  sizeof(senml_record_t) * json_array_size(json_root));
+	pack->num     = json_array_size(json_root);
+	
+	unsigned int i = 0;
+	
+	if (!pack->records)
+		goto error;
+	
+	memset(pack->records, 0, sizeof(senml_record_t) * pack->num);
+	
+	json_t *json_record = json_array_get(json_root, i);
+	json_t *object      = NULL;
+	
+	if (senml_is_base_info(json_record)) {
+		pack->base_info = senml_arena_alloc(pack->arena, sizeof(senml_base_info_t));
+		memset(pack->base_info, 0, sizeof(senml_base_info_t));
+		pack->base_info->base_value_type = SENML_TYPE_UNDEF;
+		
+		object = json_object_get(json_record, SJ_VERSION);
+		
+		if (object) {
+			if (!senml_check_number(object, SJ_VERSION) ||
+			    !senml_check_range(object, SJ_VERSION, UINT8_MAX))
+				goto error;
+			
+			pack->base_info->version = (uint8_t)json_number_value(object);
+		}
+		
+		object = json_object_get(json_record, SJ_BASE_NAME);
+		
+		if (object) {
+			if (!senml_check_string(object, SJ_BASE_NAME))
+				goto error;
+			
+			pack->base_info->base_name = senml_arena_strndup(pack->arena, json_string_value(object),
+			                                                 json_string_length(object));
+			pack->base_info->base_name_view.p   = pack->base_info->base_name;
+			pack->base_info->base_name_view.len = json_string_length(object);
+		}
+		
+		object = json_object_get(json_record, SJ_BASE_TIME);
+		
+		if (object) {
+			if (!senml_check_number(object, SJ_BASE_TIME))
+				goto error;
+			
+			pack->base_info->base_time = json_number_value(object);
+		}
+		
+		object = json_object_get(json_record, SJ_BASE_UNIT);
+		
+		if (object) {
+			if (!senml_check_string(object, SJ_BASE_UNIT))
+				goto error;
+			
+			pack->base_info->base_unit = senml_arena_strndup(pack->arena, json_string_value(object),
+			                                                 json_string_length(object));
+			pack->base_info->base_unit_view.p   = pack->base_info->base_unit;
+			pack->base_info->base_unit_view.len = json_string_length(object);
+		}
+		
+		object = json_object_get(json_record, SJ_BASE_VALUE);
+		
+		if (object) {
+			// FIXME how do we handle different data types here?
+		}
+	}
+	
+	for (unsigned int index = 0; i < json_array_size(json_root); i++, index++) {
+		json_record = json_array_get(json_root, i);
+		pack->records[index].name_id = SENML_NO_ID;
+		
+		if (!json_is_object(json_record)) {
+			senml_error_set(SENML_ERROR_RECORD, i + 1, "record #%u is not valid", i + 1);
+			goto error;
+		}
+		
+		object = json_object_get(json_record, SJ_NAME);
+		
+		if (object) {
+			if (!senml_check_string(object, SJ_NAME))
+				goto error;
+			
+			pack->records[index].name = senml_arena_strndup(pack->arena, json_string_value(object),
+			                                                json_string_length(object));
+			pack->records[index].name_view.p   = pack->records[index].name;
+			pack->records[index].name_view.len = json_string_length(object);
+		}
+		
+		object = json_object_get(json_record, SJ_UNIT);
+		
+		if (object) {
+			if (!senml_check_string(object, SJ_UNIT))
+				goto error;
+			
+			pack->records[index].unit = senml_arena_strndup(pack->arena, json_string_value(object),
+			                                                json_string_length(object));
+			pack->records[index].unit_view.p   = pack->records[index].unit;
+			pack->records[index].unit_view.len = json_string_length(object);
+		}
+		
+		object = json_object_get(json_record, SJ_TIME);
+		
+		if (object) {
+			if (!senml_check_number(object, SJ_TIME))
+				goto error;
+			
+			pack->records[index].time = json_number_value(object);
+		}
+		
+		object = json_object_get(json_record, SJ_UPDATE_TIME);
+		
+		if (object) {
+			if (!senml_check_number(object, SJ_UPDATE_TIME) ||
+			    !senml_check_range(object, SJ_UPDATE_TIME, UINT_MAX))
+				goto error;
+			
+			pack->records[index].update_time = (unsigned int)(json_int_t)json_number_value(object);
+		}
+		
+		// TODO insert check for value sum here, not sure how yet
+		
+		object = json_object_get(json_record, SJ_VALUE);
+		
+		if (object) {
+			if (!senml_check_number(object, SJ_VALUE))
+				goto error;
+			
+			pack->records[index].value_type    = SENML_TYPE_FLOAT;
+			pack->records[index].value.value_f = json_number_value(object);
+			continue;
+		}
+		
+		object = json_object_get(json_record, SJ_BOOL_VALUE);
+		
+		if (object) {
+			pack->records[index].value_type = SENML_TYPE_BOOL;
+			
+			if (json_is_true(object)) {
+				pack->records[index].value.value_b = true;
+			} else if (json_is_false(object)) {
+				pack->records[index].value.value_b = false;
+			} else {
+				senml_error_set(SENML_ERROR_RECORD, i + 1, "vb is not boolean value");
+				goto error;
+			}
+			
+			continue;
+		}
+		
+		object = json_object_get(json_record, SJ_STRING_VALUE);
+		
+		if (object) {
+			if (!senml_check_string(object, SJ_STRING_VALUE))
+				goto error;
+			
+			pack->records[index].value_type    = SENML_TYPE_STRING;
+			pack->records[index].value.value_s = senml_arena_strndup(pack->arena, json_string_value(object),
+			                                                         json_string_length(object));
+			pack->records[index].value_view.p   = pack->records[index].value.value_s;
+			pack->records[index].value_view.len = json_string_length(object);
+			continue;
+		}
+		
+		// TODO what about binary values?
+	}
+	
+	json_decref(json_root);
+	
+	if (converting)
+		call.convert = senml_ticks() - converting;
+	
+	senml_call_decoded(&call, len, pack->num, 1, 0);
+	
+	return pack;
+	
+	error:
+	// errors of attributes do not know their record yet
+	if (senml_error_current()->code == SENML_ERROR_RECORD && senml_error_current()->record == 0)
+		senml_error_current()->record = i + 1;
+	
+	senml_call_decoded(&call, len, 0, 0, -1);
+	json_decref(json_root);
+	senml_pack_free(pack);
+	return NULL;
+}
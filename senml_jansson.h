@@ -0,0 +1,26 @@
+#ifndef SENML_JANSSON_H
+#define SENML_JANSSON_H
+
+#include "senml.h"
+
+#include <stddef.h>
+
+
+/**
+ * Reference implementation of <code>senml_decode_json</code> that builds a jansson tree first.
+ * It is not part of the library and only linked into the tests and the benchmark, to cross-check
+ * and compare against the native decoder. That decodes every document the same way except for a
+ * few: jansson rejects integers that do not fit json_int_t and numbers that overflow even in
+ * attributes the native decoder skips, reads -0 as 0, and reports every syntax error, an empty
+ * document and a document that is a single string or number as SENML_ERROR_SYNTAX. It also
+ * reports a syntax error after an invalid record, which the native decoder only finds first with
+ * <code>SENML_DECODE_PRESIZE</code>. The jansson tree is allocated with whatever was passed to
+ * json_set_alloc_funcs, not with the functions passed to <code>senml_set_allocator</code>.
+ * @param[in] input The JSON document containing the SenML pack.
+ * @param[in] len The length of \p input in bytes, or 0 if \p input is NUL terminated.
+ * @return A valid pointer to a <code>senml_pack_t</code> elements, or NULL on failure.
+ */
+senml_pack_t *senml_decode_json_jansson(const char *input, size_t len);
+
+
+#endif  // SENML_JANSSON_H
@@ -0,0 +1,1749 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+
+/*! The attributes the decoder knows about */
+typedef enum {
+	SJ_KEY_UNKNOWN = 0,
+	SJ_KEY_VERSION,
+	SJ_KEY_BASE_NAME,
+	SJ_KEY_BASE_TIME,
+	SJ_KEY_BASE_UNIT,
+	SJ_KEY_BASE_VALUE,
+	SJ_KEY_NAME,
+	SJ_KEY_UNIT,
+	SJ_KEY_VALUE,
+	SJ_KEY_STRING_VALUE,
+	SJ_KEY_BOOL_VALUE,
+	SJ_KEY_VALUE_SUM,
+	SJ_KEY_TIME,
+	SJ_KEY_UPDATE_TIME,
+	SJ_KEY_DATA_VALUE
+} senml_json_key_t;
+
+
+#define SJ_KEY_ENTRY(key, id) { key, sizeof(key) - 1, id }
+
+static const struct {
+	const char       *key;
+	size_t            len;
+	senml_json_key_t  id;
+} senml_json_keys[] = {
+	SJ_KEY_ENTRY(SJ_NAME,         SJ_KEY_NAME),
+	SJ_KEY_ENTRY(SJ_VALUE,        SJ_KEY_VALUE),
+	SJ_KEY_ENTRY(SJ_TIME,         SJ_KEY_TIME),
+	SJ_KEY_ENTRY(SJ_UNIT,         SJ_KEY_UNIT),
+	SJ_KEY_ENTRY(SJ_STRING_VALUE, SJ_KEY_STRING_VALUE),
+	SJ_KEY_ENTRY(SJ_BOOL_VALUE,   SJ_KEY_BOOL_VALUE),
+	SJ_KEY_ENTRY(SJ_UPDATE_TIME,  SJ_KEY_UPDATE_TIME),
+	SJ_KEY_ENTRY(SJ_VALUE_SUM,    SJ_KEY_VALUE_SUM),
+	SJ_KEY_ENTRY(SJ_DATA_VALUE,   SJ_KEY_DATA_VALUE),
+	SJ_KEY_ENTRY(SJ_BASE_NAME,    SJ_KEY_BASE_NAME),
+	SJ_KEY_ENTRY(SJ_BASE_TIME,    SJ_KEY_BASE_TIME),
+	SJ_KEY_ENTRY(SJ_BASE_UNIT,    SJ_KEY_BASE_UNIT),
+	SJ_KEY_ENTRY(SJ_BASE_VALUE,   SJ_KEY_BASE_VALUE),
+	SJ_KEY_ENTRY(SJ_VERSION,      SJ_KEY_VERSION)
+};
+
+#define SJ_KEY_MAX_LEN (4)   //!< Length of the longest key in senml_json_keys
+
+
+void senml_json_error(const senml_json_cursor_t *c, senml_error_code_t code, const char *msg)
+{
+	senml_error_t *error;
+	unsigned int   line = 1;
+	
+	for (const char *p = c->start; p < c->p && p < c->end; p++)
+		if (*p == '\n')
+			line++;
+	
+	// whatever was expected, the real problem is that the document stops
+	if (code == SENML_ERROR_SYNTAX && c->p >= c->end)
+		code = SENML_ERROR_TRUNCATED;
+	
+	error         = senml_error_set(code, 0, "%s", msg);
+	error->offset = (size_t)(c->p - c->start);
+	error->line   = line;
+}
+
+
+static inline int senml_json_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+
+static inline int32_t senml_json_hex4(const char *p)
+{
+	int32_t value = 0;
+	
+	for (int i = 0; i < 4; i++) {
+		int digit = senml_json_hex(p[i]);
+		
+		if (digit < 0)
+			return -1;
+		
+		value = (value << 4) | digit;
+	}
+	
+	return value;
+}
+
+
+/**
+ * Validates one UTF-8 encoded code point.
+ * @return The length of the sequence, or 0 if it is invalid.
+ */
+static inline size_t senml_json_utf8_len(const unsigned char *p, const unsigned char *end)
+{
+	size_t   len;
+	uint32_t cp;
+	
+	if (p[0] < 0x80)
+		return 1;
+	else if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+		len = 2;
+		cp  = p[0] & 0x1f;
+	} else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+		len = 3;
+		cp  = p[0] & 0x0f;
+	} else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+		len = 4;
+		cp  = p[0] & 0x07;
+	} else
+		return 0;
+	
+	if ((size_t)(end - p) < len)
+		return 0;
+	
+	for (size_t i = 1; i < len; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+		
+		cp = (cp << 6) | (p[i] & 0x3f);
+	}
+	
+	// reject overlong encodings, surrogates and code points beyond U+10FFFF
+	if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+	    (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	
+	return len;
+}
+
+
+/**
+ * Checks 8 bytes of a string at once for anything but printable ASCII other than quotes and
+ * backslashes. A byte may be reported because of a borrow from a lower one that is special, so
+ * only the absence of special bytes is exact.
+ */
+static inline bool senml_json_special8(const char *p)
+{
+	const uint64_t ones = 0x0101010101010101u;
+	const uint64_t high = 0x8080808080808080u;
+	uint64_t       v;
+	
+	memcpy(&v, p, sizeof(v));
+	
+	return ((((v - ones * 0x20) | ((v ^ (ones * '"')) - ones) | ((v ^ (ones * '\\')) - ones)) & ~v) |
+	        v) & high;
+}
+
+
+int senml_json_scan_string(senml_json_cursor_t *c, senml_token_t *str)
+{
+	c->p++;
+	
+	str->p    = c->p;
+	str->kind = SENML_TOKEN_PLAIN;
+	
+	while (c->p < c->end) {
+		unsigned char ch;
+		
+		// names and units are mostly plain ASCII, which needs no closer look
+		while (c->end - c->p >= 8 && !senml_json_special8(c->p))
+			c->p += 8;
+		
+		if (c->p >= c->end)
+			break;
+		
+		ch = (unsigned char)*c->p;
+		
+		if (ch == '"') {
+			str->len = (size_t)(c->p - str->p);
+			c->p++;
+			return 0;
+		} else if (ch == '\\') {
+			str->kind = SENML_TOKEN_JSON_ESCAPED;
+			
+			if (c->end - c->p < 2)
+				break;
+			
+			switch (c->p[1]) {
+			case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+				c->p += 2;
+				break;
+			
+			case 'u': {
+				int32_t cp;
+				
+				if (c->end - c->p < 6 || (cp = senml_json_hex4(c->p + 2)) < 0) {
+					senml_json_error(c, SENML_ERROR_SYNTAX, "invalid escape");
+					return -1;
+				}
+				
+				if (cp == 0) {
+					senml_json_error(c, SENML_ERROR_SYNTAX, "\\u0000 is not allowed");
+					return -1;
+				}
+				
+				c->p += 6;
+				
+				if (cp >= 0xdc00 && cp <= 0xdfff) {
+					senml_json_error(c, SENML_ERROR_SYNTAX, "invalid Unicode escape");
+					return -1;
+				}
+				
+				if (cp >= 0xd800 && cp <= 0xdbff) {
+					int32_t low;
+					
+					if (c->end - c->p < 6 || c->p[0] != '\\' || c->p[1] != 'u' ||
+					    (low = senml_json_hex4(c->p + 2)) < 0xdc00 || low > 0xdfff) {
+						senml_json_error(c, SENML_ERROR_SYNTAX, "invalid Unicode surrogate pair");
+						return -1;
+					}
+					
+					c->p += 6;
+				}
+				
+				break;
+			}
+			
+			default:
+				senml_json_error(c, SENML_ERROR_SYNTAX, "invalid escape");
+				return -1;
+			}
+		} else if (ch < 0x20) {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "control character in string");
+			return -1;
+		} else if (ch < 0x80) {
+			c->p++;
+		} else {
+			size_t len = senml_json_utf8_len((const unsigned char *)c->p,
+			                                 (const unsigned char *)c->end);
+			
+			if (!len) {
+				senml_json_error(c, SENML_ERROR_SYNTAX, "invalid UTF-8");
+				return -1;
+			}
+			
+			c->p += len;
+		}
+	}
+	
+	senml_json_error(c, SENML_ERROR_TRUNCATED, "premature end of input");
+	return -1;
+}
+
+
+size_t senml_json_unescape(const senml_token_t *str, char *out)
+{
+	const char *p   = str->p;
+	const char *end = str->p + str->len;
+	char       *o   = out;
+	
+	if (str->kind != SENML_TOKEN_JSON_ESCAPED) {
+		memcpy(out, str->p, str->len);
+		return str->len;
+	}
+	
+	while (p < end) {
+		if (*p != '\\') {
+			*o++ = *p++;
+			continue;
+		}
+		
+		switch (p[1]) {
+		case 'b': *o++ = '\b'; break;
+		case 'f': *o++ = '\f'; break;
+		case 'n': *o++ = '\n'; break;
+		case 'r': *o++ = '\r'; break;
+		case 't': *o++ = '\t'; break;
+		case 'u': {
+			uint32_t cp = (uint32_t)senml_json_hex4(p + 2);
+			
+			if (cp >= 0xd800 && cp <= 0xdbff) {
+				cp = 0x10000 + ((cp - 0xd800) << 10) + ((uint32_t)senml_json_hex4(p + 8) - 0xdc00);
+				p += 6;
+			}
+			
+			if (cp < 0x80) {
+				*o++ = (char)cp;
+			} else if (cp < 0x800) {
+				*o++ = (char)(0xc0 | (cp >> 6));
+				*o++ = (char)(0x80 | (cp & 0x3f));
+			} else if (cp < 0x10000) {
+				*o++ = (char)(0xe0 | (cp >> 12));
+				*o++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+				*o++ = (char)(0x80 | (cp & 0x3f));
+			} else {
+				*o++ = (char)(0xf0 | (cp >> 18));
+				*o++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+				*o++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+				*o++ = (char)(0x80 | (cp & 0x3f));
+			}
+			
+			p += 4;
+			break;
+		}
+		default:   *o++ = p[1]; break;
+		}
+		
+		p += 2;
+	}
+	
+	return (size_t)(o - out);
+}
+
+
+/**
+ * Finds the end of a number token, validating it against the JSON grammar.
+ * @return One past the last character of the token, or NULL on a syntax error.
+ */
+static const char *senml_json_number_end(senml_json_cursor_t *c)
+{
+	const char *p = c->p;
+	
+	if (p < c->end && *p == '-')
+		p++;
+	
+	if (p < c->end && *p == '0') {
+		p++;
+	} else if (p < c->end && *p >= '1' && *p <= '9') {
+		while (p < c->end && *p >= '0' && *p <= '9')
+			p++;
+	} else {
+		senml_json_error(c, SENML_ERROR_SYNTAX, "invalid number");
+		return NULL;
+	}
+	
+	if (p < c->end && *p == '.') {
+		p++;
+		
+		if (p >= c->end || *p < '0' || *p > '9') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "invalid number");
+			return NULL;
+		}
+		
+		while (p < c->end && *p >= '0' && *p <= '9')
+			p++;
+	}
+	
+	if (p < c->end && (*p == 'e' || *p == 'E')) {
+		p++;
+		
+		if (p < c->end && (*p == '+' || *p == '-'))
+			p++;
+		
+		if (p >= c->end || *p < '0' || *p > '9') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "invalid number");
+			return NULL;
+		}
+		
+		while (p < c->end && *p >= '0' && *p <= '9')
+			p++;
+	}
+	
+	return p;
+}
+
+
+int senml_json_scan_number(senml_json_cursor_t *c, double *value)
+{
+	const char *begin = c->p;
+	const char *p     = senml_json_number_end(c);
+	
+	if (!p)
+		return -1;
+	
+	senml_double_parse(begin, p, value);
+	
+	// a number too large for a double is an error, as in jansson, rather than infinity
+	if (isinf(*value)) {
+		senml_json_error(c, SENML_ERROR_SYNTAX, "real number overflow");
+		return -1;
+	}
+	
+	c->p = p;
+	return 0;
+}
+
+
+static inline int senml_json_expect_literal(senml_json_cursor_t *c, const char *literal, size_t len)
+{
+	if ((size_t)(c->end - c->p) < len || memcmp(c->p, literal, len) != 0) {
+		senml_json_error(c, SENML_ERROR_SYNTAX, "invalid token");
+		return -1;
+	}
+	
+	c->p += len;
+	return 0;
+}
+
+
+int senml_json_skip_value(senml_json_cursor_t *c)
+{
+	senml_token_t  str;
+	const char    *end;
+	
+	senml_json_skip_ws(c);
+	
+	if (c->p >= c->end) {
+		senml_json_error(c, SENML_ERROR_TRUNCATED, "premature end of input");
+		return -1;
+	}
+	
+	switch (*c->p) {
+	case '"':
+		return senml_json_scan_string(c, &str);
+	
+	case 't':
+		return senml_json_expect_literal(c, "true", 4);
+	
+	case 'f':
+		return senml_json_expect_literal(c, "false", 5);
+	
+	case 'n':
+		return senml_json_expect_literal(c, "null", 4);
+	
+	case '[':
+	case '{': {
+		char close  = *c->p == '[' ? ']' : '}';
+		bool object = close == '}';
+		
+		if (++c->depth > SENML_JSON_MAX_DEPTH) {
+			senml_json_error(c, SENML_ERROR_DEPTH, "maximum parsing depth reached");
+			return -1;
+		}
+		
+		c->p++;
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == close) {
+			c->p++;
+			c->depth--;
+			return 0;
+		}
+		
+		while (true) {
+			if (object) {
+				senml_json_skip_ws(c);
+				
+				if (c->p >= c->end || *c->p != '"') {
+					senml_json_error(c, SENML_ERROR_SYNTAX, "string or '}' expected");
+					return -1;
+				}
+				
+				if (senml_json_scan_string(c, &str))
+					return -1;
+				
+				senml_json_skip_ws(c);
+				
+				if (c->p >= c->end || *c->p != ':') {
+					senml_json_error(c, SENML_ERROR_SYNTAX, "':' expected");
+					return -1;
+				}
+				
+				c->p++;
+			}
+			
+			if (senml_json_skip_value(c))
+				return -1;
+			
+			senml_json_skip_ws(c);
+			
+			if (c->p < c->end && *c->p == ',') {
+				c->p++;
+			} else if (c->p < c->end && *c->p == close) {
+				c->p++;
+				c->depth--;
+				return 0;
+			} else {
+				senml_json_error(c, SENML_ERROR_SYNTAX, object ? "'}' expected" : "']' expected");
+				return -1;
+			}
+		}
+	}
+	
+	default:
+		// a number that is skipped only has to be well-formed, it is not converted
+		if (!(end = senml_json_number_end(c)))
+			return -1;
+		
+		c->p = end;
+		return 0;
+	}
+}
+
+
+static senml_json_key_t senml_json_lookup_key(const senml_token_t *key)
+{
+	char        buf[SJ_KEY_MAX_LEN];
+	const char *k   = key->p;
+	size_t      len = key->len;
+	
+	// an escaped key can only be one of ours if it is short enough after unescaping
+	if (key->kind == SENML_TOKEN_JSON_ESCAPED) {
+		if (len > 6 * SJ_KEY_MAX_LEN)
+			return SJ_KEY_UNKNOWN;
+		
+		char tmp[6 * SJ_KEY_MAX_LEN];
+		
+		len = senml_json_unescape(key, tmp);
+		
+		if (len > SJ_KEY_MAX_LEN)
+			return SJ_KEY_UNKNOWN;
+		
+		memcpy(buf, tmp, len);
+		k = buf;
+	}
+	
+	if (len == 0 || len > SJ_KEY_MAX_LEN)
+		return SJ_KEY_UNKNOWN;
+	
+	for (size_t i = 0; i < sizeof(senml_json_keys) / sizeof(senml_json_keys[0]); i++) {
+		if (senml_json_keys[i].len == len && senml_json_keys[i].key[0] == k[0] &&
+		    memcmp(senml_json_keys[i].key, k, len) == 0)
+			return senml_json_keys[i].id;
+	}
+	
+	return SJ_KEY_UNKNOWN;
+}
+
+
+/**
+ * Reports a value of the wrong type for an attribute. A value that is not even well-formed JSON
+ * is a syntax error, like jansson reports it.
+ * @return -1.
+ */
+static int senml_json_wrong_type(senml_json_cursor_t *c, const char *key, const char *type)
+{
+	senml_json_cursor_t value = *c;
+	
+	if (senml_json_skip_value(&value) == 0)
+		senml_error_set(SENML_ERROR_RECORD, 0, "%s is not %s", key, type);
+	
+	return -1;
+}
+
+
+static inline int senml_json_read_string(senml_json_cursor_t *c, senml_token_t *str,
+                                         const char *key)
+{
+	if (c->p >= c->end || *c->p != '"')
+		return senml_json_wrong_type(c, key, "a string value");
+	
+	return senml_json_scan_string(c, str);
+}
+
+
+static inline int senml_json_read_number(senml_json_cursor_t *c, double *value, const char *key)
+{
+	if (c->p >= c->end || (*c->p != '-' && (*c->p < '0' || *c->p > '9')))
+		return senml_json_wrong_type(c, key, "a number");
+	
+	return senml_json_scan_number(c, value);
+}
+
+
+int senml_json_scan_record(senml_json_cursor_t *c, senml_fields_t *fields, bool with_base_info,
+                           const senml_select_t *select)
+{
+	static const senml_select_t all = { 0 };
+	
+	senml_token_t key;
+	
+	memset(fields, 0, sizeof(*fields));
+	
+	if (!select)
+		select = &all;
+	
+	senml_json_skip_ws(c);
+	
+	if (c->p >= c->end || *c->p != '{')
+		return -1;
+	
+	// the record counts towards the nesting depth of the values it contains
+	c->p++;
+	c->depth++;
+	senml_json_skip_ws(c);
+	
+	if (c->p < c->end && *c->p == '}') {
+		c->p++;
+		c->depth--;
+		return 0;
+	}
+	
+	while (true) {
+		int rc = 0;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p >= c->end || *c->p != '"') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "string or '}' expected");
+			return -1;
+		}
+		
+		if (senml_json_scan_string(c, &key))
+			return -1;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p >= c->end || *c->p != ':') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "':' expected");
+			return -1;
+		}
+		
+		c->p++;
+		senml_json_skip_ws(c);
+		
+		// once a record has been rejected, the rest of it is only validated
+		switch (fields->rejected ? SJ_KEY_UNKNOWN : senml_json_lookup_key(&key)) {
+		case SJ_KEY_NAME:
+			if ((select->skip & SENML_FIELD_NAME) && !select->filter)
+				goto skip;
+			
+			rc = senml_json_read_string(c, &fields->name, SJ_NAME);
+			fields->has_name = true;
+			
+			// the first record may set the base name after the name, the decoder tests it then
+			if (rc == 0 && select->filter && !with_base_info)
+				senml_select_name(select, fields);
+			
+			break;
+		
+		case SJ_KEY_UNIT:
+			if (select->skip & SENML_FIELD_UNIT)
+				goto skip;
+			
+			rc = senml_json_read_string(c, &fields->unit, SJ_UNIT);
+			fields->has_unit = true;
+			break;
+		
+		case SJ_KEY_TIME:
+			if (select->skip & SENML_FIELD_TIME)
+				goto skip;
+			
+			rc = senml_json_read_number(c, &fields->time, SJ_TIME);
+			fields->has_time = true;
+			break;
+		
+		case SJ_KEY_UPDATE_TIME:
+			if (select->skip & SENML_FIELD_UPDATE_TIME)
+				goto skip;
+			
+			rc = senml_json_read_number(c, &fields->update_time, SJ_UPDATE_TIME);
+			fields->has_update_time = true;
+			break;
+		
+		case SJ_KEY_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			rc = senml_json_read_number(c, &fields->value, SJ_VALUE);
+			fields->has_value = true;
+			break;
+		
+		case SJ_KEY_STRING_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			rc = senml_json_read_string(c, &fields->string_value, SJ_STRING_VALUE);
+			fields->has_string_value = true;
+			break;
+		
+		case SJ_KEY_BOOL_VALUE:
+			if (select->skip & SENML_FIELD_VALUE)
+				goto skip;
+			
+			// an invalid vb is only an error if there is no v that takes precedence
+			fields->has_bool_value = true;
+			fields->bool_valid     = true;
+			
+			if (c->end - c->p >= 4 && memcmp(c->p, "true", 4) == 0) {
+				fields->bool_value = true;
+				c->p += 4;
+			} else if (c->end - c->p >= 5 && memcmp(c->p, "false", 5) == 0) {
+				fields->bool_value = false;
+				c->p += 5;
+			} else {
+				fields->bool_valid = false;
+				rc = senml_json_skip_value(c);
+			}
+			
+			break;
+		
+		case SJ_KEY_VERSION:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_json_read_number(c, &fields->version, SJ_VERSION);
+			fields->has_version = fields->has_base_info = true;
+			break;
+		
+		case SJ_KEY_BASE_NAME:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_json_read_string(c, &fields->base_name, SJ_BASE_NAME);
+			fields->has_base_name = fields->has_base_info = true;
+			break;
+		
+		case SJ_KEY_BASE_TIME:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_json_read_number(c, &fields->base_time, SJ_BASE_TIME);
+			fields->has_base_time = fields->has_base_info = true;
+			break;
+		
+		case SJ_KEY_BASE_UNIT:
+			if (!with_base_info)
+				goto skip;
+			
+			rc = senml_json_read_string(c, &fields->base_unit, SJ_BASE_UNIT);
+			fields->has_base_unit = fields->has_base_info = true;
+			break;
+		
+		case SJ_KEY_BASE_VALUE:
+			if (!with_base_info)
+				goto skip;
+			
+			fields->has_base_info = true;
+			
+			// FIXME how do we handle different data types here? only numbers are stored for now
+			if (c->p < c->end && (*c->p == '-' || (*c->p >= '0' && *c->p <= '9'))) {
+				rc = senml_json_read_number(c, &fields->base_value, SJ_BASE_VALUE);
+				fields->has_base_value = true;
+				break;
+			}
+			
+			goto skip;
+		
+		default:
+		// TODO value sum and data values are not supported yet
+		skip:
+			rc = senml_json_skip_value(c);
+			break;
+		}
+		
+		if (rc)
+			return -1;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == ',') {
+			c->p++;
+		} else if (c->p < c->end && *c->p == '}') {
+			c->p++;
+			c->depth--;
+			return 0;
+		} else {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "'}' expected");
+			return -1;
+		}
+	}
+}
+
+
+/**
+ * Decodes records separated by commas up to a closing bracket, or up to the end of the input if
+ * \p bracket is not set.
+ * @param[in] with_base_info Whether the first record may carry base attributes.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory ran out.
+ */
+static int senml_json_decode_records(senml_decoder_t *d, senml_json_cursor_t *c,
+                                     bool with_base_info, bool bracket)
+{
+	senml_fields_t fields;
+	int            rc;
+	
+	while (true) {
+		senml_json_skip_ws(c);
+		
+		if (c->p >= c->end || *c->p != '{') {
+			// still validate the document so we report the same error as jansson would
+			if (senml_json_skip_value(c) == 0)
+				senml_error_set(SENML_ERROR_RECORD, d->count + 1, "record #%zu is not valid",
+				                d->count + 1);
+			
+			return -1;
+		}
+		
+		if (senml_json_scan_record(c, &fields, with_base_info && d->count == 0, &d->select)) {
+			senml_error_current()->record = d->count + 1;
+			return -1;
+		}
+		
+		if ((rc = senml_decoder_add(d, &fields)))
+			return rc;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == ',') {
+			c->p++;
+		} else if (bracket && c->p < c->end && *c->p == ']') {
+			c->p++;
+			return 0;
+		} else if (!bracket && c->p == c->end) {
+			return 0;
+		} else {
+			senml_json_error(c, SENML_ERROR_SYNTAX, bracket ? "']' expected" : "',' expected");
+			return -1;
+		}
+	}
+}
+
+
+/**
+ * Decodes the array of records the cursor points to into <code>d->pack</code>.
+ * @return 0 on success, -1 if the document is invalid, -2 if memory ran out.
+ */
+static int senml_json_decode_pack(senml_decoder_t *d, senml_json_cursor_t *c)
+{
+	int rc;
+	
+	senml_json_skip_ws(c);
+	
+	if (c->p >= c->end || *c->p != '[') {
+		senml_json_error(c, SENML_ERROR_NOT_ARRAY, "not an array");
+		return -1;
+	}
+	
+	// like jansson, the limit applies to the whole document including the array of records
+	c->p++;
+	c->depth++;
+	senml_json_skip_ws(c);
+	
+	if (c->p < c->end && *c->p == ']')
+		c->p++;
+	else if ((rc = senml_json_decode_records(d, c, true, true)))
+		return rc;
+	
+	c->depth--;
+	senml_json_skip_ws(c);
+	
+	if (c->p != c->end) {
+		senml_json_error(c, SENML_ERROR_TRAILING, "end of file expected");
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+int senml_json_decode_slice(senml_decoder_t *d, senml_json_cursor_t *c, bool with_base_info)
+{
+	return senml_json_decode_records(d, c, with_base_info, false);
+}
+
+
+/**
+ * Validates the members of a record and counts the strings among their values. Keys are only
+ * compared if they could be base attributes.
+ * @return 0 on success, -1 if the object is not well-formed.
+ */
+static int senml_json_index_record(senml_json_cursor_t *c, senml_json_info_t *info)
+{
+	senml_token_t str;
+	bool          base = false;
+	
+	// the depth is counted like the decoder does, so that both fail on the same values
+	c->p++;
+	c->depth++;
+	senml_json_skip_ws(c);
+	
+	if (c->p < c->end && *c->p == '}') {
+		c->p++;
+		c->depth--;
+		return 0;
+	}
+	
+	while (true) {
+		senml_json_key_t key;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p >= c->end || *c->p != '"') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "string or '}' expected");
+			return -1;
+		}
+		
+		if (senml_json_scan_string(c, &str))
+			return -1;
+		
+		if (str.len > 0 && (str.p[0] == 'b' || str.kind != SENML_TOKEN_PLAIN) &&
+		    (key = senml_json_lookup_key(&str)) >= SJ_KEY_BASE_NAME && key <= SJ_KEY_BASE_VALUE)
+			base = true;
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p >= c->end || *c->p != ':') {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "':' expected");
+			return -1;
+		}
+		
+		c->p++;
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == '"') {
+			if (senml_json_scan_string(c, &str))
+				return -1;
+			
+			info->strings++;
+			info->string_bytes += str.len;
+		} else if (senml_json_skip_value(c)) {
+			return -1;
+		}
+		
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == ',') {
+			c->p++;
+		} else if (c->p < c->end && *c->p == '}') {
+			c->p++;
+			break;
+		} else {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "'}' expected");
+			return -1;
+		}
+	}
+	
+	if (base)
+		info->base_records++;
+	
+	c->depth--;
+	
+	return 0;
+}
+
+
+/**
+ * Validates a whole document and counts what decoding it needs memory for, without converting
+ * anything. The attributes of the records are not looked at, those errors are left to the
+ * decoder.
+ * @param[in] max_records Records the document may have, 0 for no limit.
+ * @return 0 on success, -1 if the document is not a well-formed JSON array, -2 if it has more
+ * than \p max_records records.
+ */
+static int senml_json_index(senml_json_cursor_t *c, senml_json_info_t *info, size_t max_records)
+{
+	memset(info, 0, sizeof(*info));
+	senml_json_skip_ws(c);
+	
+	if (c->p >= c->end || *c->p != '[') {
+		senml_json_error(c, SENML_ERROR_NOT_ARRAY, "not an array");
+		return -1;
+	}
+	
+	c->p++;
+	c->depth++;
+	senml_json_skip_ws(c);
+	
+	if (c->p < c->end && *c->p == ']') {
+		c->p++;
+		goto done;
+	}
+	
+	while (true) {
+		senml_json_skip_ws(c);
+		
+		// the limit is checked before the record is scanned, so a huge document stops early
+		if (max_records && info->records == max_records) {
+			senml_error_set(SENML_ERROR_NO_SPACE, info->records + 1, "more than %zu records",
+			                info->records);
+			return -2;
+		}
+		
+		if (c->p < c->end && *c->p == '{' ? senml_json_index_record(c, info) :
+		    senml_json_skip_value(c))
+			return -1;
+		
+		info->records++;
+		senml_json_skip_ws(c);
+		
+		if (c->p < c->end && *c->p == ',') {
+			c->p++;
+		} else if (c->p < c->end && *c->p == ']') {
+			c->p++;
+			break;
+		} else {
+			senml_json_error(c, SENML_ERROR_SYNTAX, "']' expected");
+			return -1;
+		}
+	}
+	
+	done:
+	c->depth--;
+	senml_json_skip_ws(c);
+	
+	if (c->p != c->end) {
+		senml_json_error(c, SENML_ERROR_TRAILING, "end of file expected");
+		return -1;
+	}
+	
+	return 0;
+}
+
+
+/**
+ * Computes how much memory the pack of an indexed document needs at most: the records, the base
+ * info, and a copy of every string value with its terminator and padding.
+ */
+static inline size_t senml_json_pack_size(const senml_json_info_t *info)
+{
+	return SENML_ARENA_ALIGN(sizeof(senml_record_t) * (info->records > 8 ? info->records : 8)) +
+	       (info->base_records ? SENML_ARENA_ALIGN(sizeof(senml_base_info_t)) : 0) +
+	       info->string_bytes + info->strings * 8;
+}
+
+
+int senml_validate_json(const char *input, size_t len, senml_json_info_t *info)
+{
+	senml_json_info_t   scratch;
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + (len > 0 ? len : strlen(input)),
+		.depth = 0
+	};
+	
+	senml_error_clear();
+	
+	return senml_json_index(&c, info ? info : &scratch, 0);
+}
+
+
+/**
+ * Decodes a document after a first pass has validated it and counted what the pack needs, see
+ * <code>SENML_DECODE_PRESIZE</code>. The limits of \p opts are enforced by that pass, before
+ * anything is allocated.
+ * @return The pack, or NULL on failure.
+ */
+static senml_pack_t *senml_json_decode_presized(senml_json_cursor_t *c,
+                                                const senml_decode_opts_t *opts)
+{
+	senml_decoder_t     d;
+	senml_json_cursor_t scan = *c;
+	senml_json_info_t   info;
+	senml_call_t        call;
+	size_t              size;
+	int                 rc;
+	
+	senml_call_begin(&call);
+	
+	if ((rc = senml_json_index(&scan, &info, opts->max_records)) == 0 &&
+	    opts->max_bytes && (size = senml_json_pack_size(&info)) > opts->max_bytes) {
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "the pack needs %zu bytes, more than %zu", size,
+		                opts->max_bytes);
+		rc = -2;
+	}
+	
+	if (rc) {
+		senml_call_decoded(&call, (size_t)(c->end - c->start), 0, 0, rc);
+		return NULL;
+	}
+	
+	if (senml_decoder_init(&d, opts, senml_json_pack_size(&info), info.records))
+		return NULL;
+	
+	// the scan counts as parsing
+	d.call = call;
+	d.len  = (size_t)(c->end - c->start);
+	
+	return senml_decoder_finish(&d, senml_json_decode_pack(&d, c));
+}
+
+
+senml_pack_t *senml_decode_json(const char *input, size_t len)
+{
+	return senml_decode_json_ex(input, len, NULL);
+}
+
+
+senml_pack_t *senml_decode_json_ex(const char *input, size_t len, const senml_decode_opts_t *opts)
+{
+	senml_decoder_t     d;
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + (len > 0 ? len : strlen(input)),
+		.depth = 0
+	};
+	
+	if (opts && (opts->flags & SENML_DECODE_PRESIZE))
+		return senml_json_decode_presized(&c, opts);
+	
+	if (senml_decoder_init(&d, opts, (size_t)(c.end - c.start) * 2, 8))
+		return NULL;
+	
+	d.len = (size_t)(c.end - c.start);
+	
+	return senml_decoder_finish(&d, senml_json_decode_pack(&d, &c));
+}
+
+
+int senml_decode_json_each(const char *input, size_t len, senml_record_cb_t callback, void *ctx)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	int                 rc;
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + (len > 0 ? len : strlen(input)),
+		.depth = 0
+	};
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, callback, ctx))
+		return -2;
+	
+	d.resolve = true;
+	rc        = senml_json_decode_pack(&d, &c);
+	senml_call_decoded(&d.call, (size_t)(c.end - c.start), d.count, rc == 0 ? 1 : 0, rc);
+	senml_decoder_release(&d);
+	
+	return rc;
+}
+
+
+senml_columns_t *senml_decode_json_columns(const char *input, size_t len)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	senml_columns_t    *columns;
+	int                 rc;
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + (len > 0 ? len : strlen(input)),
+		.depth = 0
+	};
+	
+	// records take a few dozen bytes each, the columns grow if this guess is too small
+	if (!(columns = senml_columns_new((size_t)(c.end - c.start) / 64)))
+		return NULL;
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, senml_columns_add_record, columns)) {
+		senml_columns_free(columns);
+		return NULL;
+	}
+	
+	// the strings are copied into the columns anyway, so the decoder does not need to copy them
+	d.borrow = true;
+	rc       = senml_json_decode_pack(&d, &c);
+	senml_call_decoded(&d.call, (size_t)(c.end - c.start), d.count, rc == 0 ? 1 : 0, rc);
+	senml_decoder_release(&d);
+	
+	if (rc) {
+		senml_columns_free(columns);
+		return NULL;
+	}
+	
+	return columns;
+}
+
+
+int senml_decode_json_s(const char *input, senml_pack_t *pack)
+{
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + strlen(input),
+		.depth = 0
+	};
+	
+	senml_decoder_t d = {
+		.pack      = pack,
+		.arena     = pack->arena,
+		.base_info = pack->base_info,
+		.capacity  = pack->num,
+		.borrow    = true,
+		.fixed     = true
+	};
+	
+	int rc;
+	
+	senml_call_begin(&d.call);
+	pack->base_info = NULL;
+	pack->num       = 0;
+	
+	rc = senml_json_decode_pack(&d, &c);
+	senml_call_decoded(&d.call, (size_t)(c.end - c.start), d.count, rc == 0 ? 1 : 0, rc);
+	
+	return rc;
+}
+
+
+int senml_json_put_string(senml_writer_t *w, senml_str_t str)
+{
+	static const char hex[] = "0123456789abcdef";
+	
+	const unsigned char *p   = (const unsigned char *)str.p;
+	const unsigned char *end = p + str.len;
+	
+	senml_writer_putc(w, '"');
+	
+	while (p < end) {
+		const unsigned char *run = p;
+		
+		// copy everything that needs no escaping in one go
+		while (p < end && *p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\')
+			p++;
+		
+		senml_writer_put(w, run, (size_t)(p - run));
+		
+		if (p == end)
+			break;
+		
+		uint32_t cp  = *p;
+		size_t   len = senml_json_utf8_len(p, end);
+		char     esc[12];
+		
+		if (!len) {
+			senml_error_set(SENML_ERROR_INVALID_PACK, 0, "string is not valid UTF-8");
+			return -1;
+		}
+		
+		switch (cp) {
+		case '"':  senml_writer_put(w, "\\\"", 2); break;
+		case '\\': senml_writer_put(w, "\\\\", 2); break;
+		case '\b': senml_writer_put(w, "\\b", 2);  break;
+		case '\f': senml_writer_put(w, "\\f", 2);  break;
+		case '\n': senml_writer_put(w, "\\n", 2);  break;
+		case '\r': senml_writer_put(w, "\\r", 2);  break;
+		case '\t': senml_writer_put(w, "\\t", 2);  break;
+		default:
+			if (len > 1) {
+				cp &= 0x3f >> (len - 1);
+				
+				for (size_t i = 1; i < len; i++)
+					cp = (cp << 6) | (p[i] & 0x3f);
+			}
+			
+			if (cp >= 0x10000) {
+				uint32_t high = 0xd800 + ((cp - 0x10000) >> 10);
+				uint32_t low  = 0xdc00 + ((cp - 0x10000) & 0x3ff);
+				
+				memcpy(esc, "\\ud800\\udc00", 12);
+				esc[2]  = hex[(high >> 12) & 0xf];
+				esc[3]  = hex[(high >> 8) & 0xf];
+				esc[4]  = hex[(high >> 4) & 0xf];
+				esc[5]  = hex[high & 0xf];
+				esc[8]  = hex[(low >> 12) & 0xf];
+				esc[9]  = hex[(low >> 8) & 0xf];
+				esc[10] = hex[(low >> 4) & 0xf];
+				esc[11] = hex[low & 0xf];
+				senml_writer_put(w, esc, 12);
+			} else {
+				memcpy(esc, "\\u0000", 6);
+				esc[2] = hex[(cp >> 12) & 0xf];
+				esc[3] = hex[(cp >> 8) & 0xf];
+				esc[4] = hex[(cp >> 4) & 0xf];
+				esc[5] = hex[cp & 0xf];
+				senml_writer_put(w, esc, 6);
+			}
+			
+			break;
+		}
+		
+		p += len;
+	}
+	
+	senml_writer_putc(w, '"');
+	
+	return 0;
+}
+
+
+int senml_json_put_double(senml_writer_t *w, double value)
+{
+	char buf[SENML_DOUBLE_MAX_LEN];
+	
+	if (!isfinite(value)) {
+		senml_error_set(SENML_ERROR_INVALID_PACK, 0, "number is not finite");
+		return -1;
+	}
+	
+	// a buffer of the caller only needs room for the digits that are written, so near its end the
+	// number is formatted on the stack first
+	if ((!w->fixed || w->cap - w->len >= SENML_DOUBLE_MAX_LEN) &&
+	    senml_writer_reserve(w, SENML_DOUBLE_MAX_LEN))
+		w->len += senml_double_format(value, w->buf + w->len);
+	else
+		senml_writer_put(w, buf, senml_double_format(value, buf));
+	
+	return 0;
+}
+
+
+static inline void senml_json_put_key(senml_writer_t *w, const char *key, size_t len, bool *first)
+{
+	if (!*first)
+		senml_writer_putc(w, ',');
+	
+	*first = false;
+	
+	senml_writer_putc(w, '"');
+	senml_writer_put(w, key, len);
+	senml_writer_put(w, "\":", 2);
+}
+
+#define SENML_JSON_PUT_KEY(w, key, first) senml_json_put_key(w, key, sizeof(key) - 1, first)
+
+
+static int senml_json_put_base_fields(senml_writer_t *w, const senml_base_info_t *base_info,
+                                      bool *first)
+{
+	senml_str_t str;
+	
+	if (base_info->version) {
+		SENML_JSON_PUT_KEY(w, SJ_VERSION, first);
+		senml_json_put_uint(w, base_info->version);
+	}
+	
+	str = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	
+	if (str.p) {
+		SENML_JSON_PUT_KEY(w, SJ_BASE_NAME, first);
+		
+		if (senml_json_put_string(w, str))
+			return -1;
+	}
+	
+	if (base_info->base_time > 0) {
+		SENML_JSON_PUT_KEY(w, SJ_BASE_TIME, first);
+		
+		if (senml_json_put_double(w, base_info->base_time))
+			return -1;
+	}
+	
+	str = senml_str_of(base_info->base_unit, &base_info->base_unit_view);
+	
+	if (str.p) {
+		SENML_JSON_PUT_KEY(w, SJ_BASE_UNIT, first);
+		
+		if (senml_json_put_string(w, str))
+			return -1;
+	}
+	
+	// only numeric base values are decoded, see senml_decoder_store_base_info
+	if (base_info->base_value_type == SENML_TYPE_FLOAT) {
+		SENML_JSON_PUT_KEY(w, SJ_BASE_VALUE, first);
+		
+		if (senml_json_put_double(w, base_info->base_value.base_value_f))
+			return -1;
+	}
+	
+	return 0;
+}
+
+
+static int senml_json_put_record_fields(senml_writer_t *w, const senml_record_t *record,
+                                        bool *first)
+{
+	senml_str_t str = senml_str_of(record->name, &record->name_view);
+	
+	if (str.p) {
+		SENML_JSON_PUT_KEY(w, SJ_NAME, first);
+		
+		if (senml_json_put_string(w, str))
+			return -1;
+	}
+	
+	str = senml_str_of(record->unit, &record->unit_view);
+	
+	if (str.p) {
+		SENML_JSON_PUT_KEY(w, SJ_UNIT, first);
+		
+		if (senml_json_put_string(w, str))
+			return -1;
+	}
+	
+	if (record->time != 0) {
+		SENML_JSON_PUT_KEY(w, SJ_TIME, first);
+		
+		if (senml_json_put_double(w, record->time))
+			return -1;
+	}
+	
+	if (record->update_time != 0) {
+		SENML_JSON_PUT_KEY(w, SJ_UPDATE_TIME, first);
+		senml_json_put_uint(w, record->update_time);
+	}
+	
+	if (record->value_type == SENML_TYPE_FLOAT) {
+		SENML_JSON_PUT_KEY(w, SJ_VALUE, first);
+		
+		if (senml_json_put_double(w, record->value.value_f))
+			return -1;
+	} else if (record->value_type == SENML_TYPE_STRING) {
+		str = senml_str_of(record->value.value_s, &record->value_view);
+		
+		if (!str.p)
+			return -1;
+		
+		SENML_JSON_PUT_KEY(w, SJ_STRING_VALUE, first);
+		
+		if (senml_json_put_string(w, str))
+			return -1;
+	} else if (record->value_type == SENML_TYPE_BOOL) {
+		SENML_JSON_PUT_KEY(w, SJ_BOOL_VALUE, first);
+		
+		if (record->value.value_b)
+			senml_writer_put(w, "true", 4);
+		else
+			senml_writer_put(w, "false", 5);
+	}
+	// FIXME handle binary value
+	
+	return 0;
+}
+
+
+int senml_json_put_record(senml_writer_t *w, const senml_base_info_t *base_info,
+                          const senml_record_t *record)
+{
+	bool first = true;
+	
+	senml_writer_putc(w, '{');
+	
+	if (base_info && senml_json_put_base_fields(w, base_info, &first))
+		return -1;
+	
+	if (senml_json_put_record_fields(w, record, &first))
+		return -1;
+	
+	senml_writer_putc(w, '}');
+	
+	return 0;
+}
+
+
+int senml_json_encode_pack(senml_writer_t *w, const senml_pack_t *pack,
+                           const senml_compact_t *compact)
+{
+	bool first_record = true;
+	
+	senml_writer_putc(w, '[');
+	
+	// a compact pack carries its base fields in the first record instead of an object of their own
+	if (pack->base_info && !compact) {
+		bool first = true;
+		
+		senml_writer_putc(w, '{');
+		
+		if (senml_json_put_base_fields(w, pack->base_info, &first))
+			return -1;
+		
+		senml_writer_putc(w, '}');
+		first_record = false;
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t    *record    = &pack->records[i];
+		const senml_base_info_t *base_info = NULL;
+		senml_record_t           relative;
+		
+		if (!first_record)
+			senml_writer_putc(w, ',');
+		
+		if (compact) {
+			base_info = first_record ? &compact->base_info : NULL;
+			senml_compact_record(compact, record, &relative);
+			record = &relative;
+		}
+		
+		if (senml_json_put_record(w, base_info, record)) {
+			senml_error_current()->record = i + 1;
+			return -1;
+		}
+		
+		first_record = false;
+	}
+	
+	senml_writer_putc(w, ']');
+	
+	return 0;
+}
+
+
+char *senml_encode_json(const senml_pack_t *pack)
+{
+	return senml_encode_json_ex(pack, NULL);
+}
+
+
+char *senml_encode_json_ex(const senml_pack_t *pack, const senml_encode_opts_t *opts)
+{
+	senml_writer_t  w = { 0 };
+	senml_compact_t compact;
+	senml_call_t    call;
+	bool            compacting = opts && (opts->flags & SENML_ENCODE_COMPACT);
+	int             rc;
+	
+	senml_call_begin(&call);
+	
+	if (compacting && senml_compact_init(&compact, pack)) {
+		senml_call_encoded(&call, 0, 0, -2);
+		return NULL;
+	}
+	
+	rc = senml_json_encode_pack(&w, pack, compacting ? &compact : NULL);
+	senml_writer_putc(&w, '\0');
+	
+	if (compacting)
+		senml_compact_release(&compact);
+	
+	// the buffer only overflows if it could not grow
+	if (rc == 0 && w.overflow)
+		rc = -2;
+	
+	senml_call_encoded(&call, rc ? 0 : w.len - 1, pack->num, rc);
+	
+	if (rc) {
+		senml_free(w.buf);
+		return NULL;
+	}
+	
+	return w.buf;
+}
+
+
+int senml_encode_json_s(const senml_pack_t *pack, char *output, size_t len)
+{
+	senml_writer_t w = {
+		.buf   = output,
+		.len   = 0,
+		.cap   = len,
+		.fixed = true
+	};
+	
+	senml_call_t call;
+	int          rc;
+	
+	senml_call_begin(&call);
+	
+	if ((rc = senml_json_encode_pack(&w, pack, NULL)) == 0) {
+		senml_writer_putc(&w, '\0');
+		
+		if (w.overflow) {
+			senml_error_set(SENML_ERROR_NO_SPACE, 0, "the document needs more than %zu bytes", len);
+			rc = -2;
+		}
+	}
+	
+	senml_call_encoded(&call, rc ? 0 : w.len - 1, pack->num, rc);
+	
+	return rc;
+}
+
+
+int senml_json_put_template(senml_writer_t *w, const senml_pack_t *pack, senml_slots_t *slots)
+{
+	senml_writer_putc(w, '[');
+	
+	if (pack->base_info) {
+		bool first = true;
+		
+		senml_writer_putc(w, '{');
+		
+		if (senml_json_put_base_fields(w, pack->base_info, &first))
+			return -1;
+		
+		senml_writer_putc(w, '}');
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		senml_record_t        fixed  = *record;
+		bool                  first  = true;
+		
+		senml_slots_strip(slots, &fixed);
+		
+		if (i > 0 || pack->base_info)
+			senml_writer_putc(w, ',');
+		
+		senml_writer_putc(w, '{');
+		
+		if (senml_json_put_record_fields(w, &fixed, &first)) {
+			senml_error_current()->record = i + 1;
+			return -1;
+		}
+		
+		if (slots->fields & SENML_FIELD_TIME) {
+			SENML_JSON_PUT_KEY(w, SJ_TIME, &first);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_TIME);
+		}
+		
+		if (slots->fields & SENML_FIELD_UPDATE_TIME) {
+			SENML_JSON_PUT_KEY(w, SJ_UPDATE_TIME, &first);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_UPDATE_TIME);
+		}
+		
+		if ((slots->fields & SENML_FIELD_VALUE) && record->value_type == SENML_TYPE_FLOAT) {
+			SENML_JSON_PUT_KEY(w, SJ_VALUE, &first);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_FLOAT);
+		} else if ((slots->fields & SENML_FIELD_VALUE) && record->value_type == SENML_TYPE_BOOL) {
+			SENML_JSON_PUT_KEY(w, SJ_BOOL_VALUE, &first);
+			senml_slots_add(slots, w->len, i, SENML_SLOT_BOOL);
+		}
+		
+		senml_writer_putc(w, '}');
+	}
+	
+	senml_writer_putc(w, ']');
+	
+	return 0;
+}
+
+
+int senml_json_put_slot(senml_writer_t *w, const senml_slot_t *slot, const senml_record_t *record)
+{
+	switch (slot->kind) {
+	case SENML_SLOT_TIME:
+		return senml_json_put_double(w, record->time);
+	
+	case SENML_SLOT_UPDATE_TIME:
+		senml_json_put_uint(w, record->update_time);
+		break;
+	
+	case SENML_SLOT_FLOAT:
+		return senml_json_put_double(w, record->value.value_f);
+	
+	case SENML_SLOT_BOOL:
+		if (record->value.value_b)
+			senml_writer_put(w, "true", 4);
+		else
+			senml_writer_put(w, "false", 5);
+		
+		break;
+	}
+	
+	return 0;
+}
+
+
+static int senml_json_transcode_record(const senml_record_t *record,
+                                       const senml_base_info_t *base_info, void *ctx)
+{
+	senml_transcoder_t *t = ctx;
+	
+	// the base fields stay in the first record rather than getting a map of their own
+	if (senml_cbor_put_record(t->w, t->count == 0 ? base_info : NULL, record)) {
+		senml_error_current()->record = t->count + 1;
+		return -1;
+	}
+	
+	t->count++;
+	
+	return senml_transcoder_check(t);
+}
+
+
+/**
+ * Writes the records of a JSON document as CBOR while they are scanned. Strings are only copied
+ * if they contain escape sequences, and then into scratch memory that is reused for every record.
+ * @return 0 on success, -1 if the document is invalid, -2 if the output is full or memory ran out.
+ */
+static int senml_json_transcode(const char *input, size_t len, senml_writer_t *w)
+{
+	senml_decoder_t     d;
+	senml_pack_t        pack;
+	senml_record_t      record;
+	senml_transcoder_t  t = { .w = w, .count = 0 };
+	size_t              head;
+	size_t              reserved;
+	int                 rc;
+	senml_json_cursor_t c = {
+		.start = input,
+		.p     = input,
+		.end   = input + (len > 0 ? len : strlen(input)),
+		.depth = 0
+	};
+	
+	if (senml_decoder_init_callback(&d, &pack, &record, senml_json_transcode_record, &t))
+		return -2;
+	
+	d.borrow = true;
+	d.len    = (size_t)(c.end - c.start);
+	
+	// the number of records is only known at the end. A growing writer leaves room for the longest
+	// head, a buffer of the caller only for the shortest, so that any document that fits is written
+	head     = w->len;
+	reserved = w->fixed ? 1 : SENML_CBOR_MAX_HEAD;
+	
+	if (senml_writer_reserve(w, reserved))
+		w->len += reserved;
+	
+	if ((rc = senml_json_decode_pack(&d, &c)) == 0 && (rc = senml_transcoder_check(&t)) == 0) {
+		senml_cbor_finish_array(w, head, reserved, t.count);
+		rc = senml_transcoder_check(&t);
+	}
+	
+	senml_transcoder_finish(&d, rc ? 0 : w->len - head, rc);
+	senml_decoder_release(&d);
+	
+	return rc;
+}
+
+
+unsigned char *senml_transcode_json_to_cbor(const char *input, size_t len, size_t *out_len)
+{
+	senml_writer_t w = { 0 };
+	
+	// CBOR is more compact than JSON, so the output rarely has to grow. If this fails, so does the
+	// first write, which reports the error
+	senml_writer_grow(&w, len > 0 ? len : strlen(input));
+	
+	if (senml_json_transcode(input, len, &w)) {
+		senml_free(w.buf);
+		return NULL;
+	}
+	
+	*out_len = w.len;
+	
+	return (unsigned char *)w.buf;
+}
+
+
+int senml_transcode_json_to_cbor_s(const char *input, size_t len, unsigned char *output,
+                                   size_t *out_len)
+{
+	senml_writer_t w = {
+		.buf   = (char *)output,
+		.len   = 0,
+		.cap   = *out_len,
+		.fixed = true
+	};
+	
+	int rc = senml_json_transcode(input, len, &w);
+	
+	if (rc == 0)
+		*out_len = w.len;
+	
+	return rc;
+}
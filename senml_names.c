@@ -0,0 +1,283 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <pthread.h>
+#include <string.h>
+
+
+#define SENML_NAMES_FIRST_BLOCK (64)  //!< Entries of the first block, every further block doubles
+#define SENML_NAMES_BLOCKS      (27)  //!< Enough blocks for UINT32_MAX entries
+#define SENML_NAMES_MIN_INDEX   (256) //!< Slots of the first index, a power of two
+
+
+/*! A name and what is needed to compare it quickly */
+typedef struct {
+	const char  *p;     //!< The name, NUL terminated, never moves
+	uint32_t     len;   //!< Length of the name in bytes
+	uint32_t     hash;  //!< Hash of the name
+} senml_names_entry_t;
+
+
+/*! Open addressing hash table from names to IDs */
+typedef struct senml_names_index {
+	struct senml_names_index *retired;  //!< The index this one replaced, readers may still use it
+	size_t                    size;     //!< Number of slots, a power of two
+	uint32_t                  slots[];  //!< ID + 1 of the name in each slot, 0 if the slot is empty
+} senml_names_index_t;
+
+
+/*
+ * Readers never take the lock. Entries are written before the slot that points to them, and
+ * neither entries nor strings move once they have been published. A full index is replaced by
+ * a larger one and kept until the table is released, so readers that still hold it stay safe.
+ */
+struct senml_names {
+	pthread_mutex_t       lock;                         //!< Serializes writers
+	senml_names_index_t  *index;                        //!< Current index
+	uint32_t              count;                        //!< Number of published entries
+	senml_names_entry_t  *blocks[SENML_NAMES_BLOCKS];   //!< Entries by ID, see senml_names_entry
+	senml_arena_t        *arena;                        //!< Memory of the names
+};
+
+
+/**
+ * Finds the entry of an ID. Block k holds the 64 << k IDs that follow the ones of the blocks
+ * before it.
+ */
+static inline senml_names_entry_t *senml_names_entry(const senml_names_t *names, uint32_t id)
+{
+	uint64_t position = (uint64_t)id / SENML_NAMES_FIRST_BLOCK + 1;
+	int      block    = 63 - __builtin_clzll(position);
+	uint64_t first    = (uint64_t)SENML_NAMES_FIRST_BLOCK * (((uint64_t)1 << block) - 1);
+	
+	return &__atomic_load_n(&names->blocks[block], __ATOMIC_ACQUIRE)[id - first];
+}
+
+
+static inline bool senml_names_equal(const senml_names_entry_t *entry, uint32_t hash,
+                                     senml_str_t prefix, senml_str_t name)
+{
+	return entry->hash == hash && entry->len == prefix.len + name.len &&
+	       memcmp(entry->p, prefix.p, prefix.len) == 0 &&
+	       memcmp(entry->p + prefix.len, name.p, name.len) == 0;
+}
+
+
+/**
+ * Looks up the concatenation of \p prefix and \p name without taking the lock.
+ * @return true if the name was found.
+ */
+static bool senml_names_lookup(const senml_names_t *names, senml_str_t prefix, senml_str_t name,
+                               uint32_t hash, uint32_t *id)
+{
+	const senml_names_index_t *index = __atomic_load_n(&names->index, __ATOMIC_ACQUIRE);
+	size_t                     slot;
+	uint32_t                   value;
+	
+	if (!index)
+		return false;
+	
+	slot = hash & (index->size - 1);
+	
+	while ((value = __atomic_load_n(&index->slots[slot], __ATOMIC_ACQUIRE)) != 0) {
+		if (senml_names_equal(senml_names_entry(names, value - 1), hash, prefix, name)) {
+			*id = value - 1;
+			return true;
+		}
+		
+		slot = (slot + 1) & (index->size - 1);
+	}
+	
+	return false;
+}
+
+
+static inline void senml_names_insert(senml_names_index_t *index, uint32_t hash, uint32_t id)
+{
+	size_t slot = hash & (index->size - 1);
+	
+	while (index->slots[slot] != 0)
+		slot = (slot + 1) & (index->size - 1);
+	
+	__atomic_store_n(&index->slots[slot], id + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Replaces the index with one of twice the size. Must be called with the lock held.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_names_grow(senml_names_t *names)
+{
+	senml_names_index_t *index;
+	size_t               size = names->index ? names->index->size * 2 : SENML_NAMES_MIN_INDEX;
+	
+	if (!(index = senml_malloc(sizeof(senml_names_index_t) + sizeof(uint32_t) * size)))
+		return -2;
+	
+	memset(index->slots, 0, sizeof(uint32_t) * size);
+	index->size    = size;
+	index->retired = names->index;
+	
+	for (uint32_t id = 0; id < names->count; id++)
+		senml_names_insert(index, senml_names_entry(names, id)->hash, id);
+	
+	__atomic_store_n(&names->index, index, __ATOMIC_RELEASE);
+	
+	return 0;
+}
+
+
+/**
+ * Adds a name that is known to be missing. Must be called with the lock held.
+ * @return 0 on success, -2 if memory could not be allocated or there are too many names.
+ */
+static int senml_names_add(senml_names_t *names, senml_str_t prefix, senml_str_t name,
+                           uint32_t hash, uint32_t *id)
+{
+	uint64_t             position = (uint64_t)names->count / SENML_NAMES_FIRST_BLOCK + 1;
+	int                  block    = 63 - __builtin_clzll(position);
+	size_t               len      = prefix.len + name.len;
+	senml_names_entry_t *entry;
+	char                *copy;
+	
+	if (names->count == UINT32_MAX - 1 || len > UINT32_MAX)
+		return -2;
+	
+	// keep the index at most half full
+	if ((size_t)(names->count + 1) * 2 > (names->index ? names->index->size : 0) &&
+	    senml_names_grow(names))
+		return -2;
+	
+	if (!names->blocks[block]) {
+		senml_names_entry_t *entries = senml_malloc(sizeof(senml_names_entry_t) *
+		                                            ((size_t)SENML_NAMES_FIRST_BLOCK << block));
+		
+		if (!entries)
+			return -2;
+		
+		__atomic_store_n(&names->blocks[block], entries, __ATOMIC_RELEASE);
+	}
+	
+	if (!(copy = senml_arena_alloc(names->arena, len + 1)))
+		return -2;
+	
+	memcpy(copy, prefix.p, prefix.len);
+	memcpy(copy + prefix.len, name.p, name.len);
+	copy[len] = '\0';
+	
+	*id         = names->count;
+	entry       = senml_names_entry(names, *id);
+	entry->p    = copy;
+	entry->len  = (uint32_t)len;
+	entry->hash = hash;
+	
+	// the entry must be complete before a reader can find it
+	__atomic_store_n(&names->count, *id + 1, __ATOMIC_RELEASE);
+	senml_names_insert(names->index, hash, *id);
+	
+	return 0;
+}
+
+
+int senml_names_intern_parts(senml_names_t *names, senml_str_t prefix, senml_str_t name,
+                             uint32_t *id, const char **canonical)
+{
+	uint32_t hash = senml_hash(senml_hash(SENML_HASH_SEED, prefix.p, prefix.len), name.p, name.len);
+	int      rc   = 0;
+	
+	if (!senml_names_lookup(names, prefix, name, hash, id)) {
+		pthread_mutex_lock(&names->lock);
+		
+		// another writer may have added it in the meantime
+		if (!senml_names_lookup(names, prefix, name, hash, id))
+			rc = senml_names_add(names, prefix, name, hash, id);
+		
+		pthread_mutex_unlock(&names->lock);
+	}
+	
+	if (rc == 0 && canonical)
+		*canonical = senml_names_entry(names, *id)->p;
+	
+	return rc;
+}
+
+
+senml_names_t *senml_names_new(void)
+{
+	senml_names_t *names = senml_malloc(sizeof(senml_names_t));
+	
+	if (!names)
+		return NULL;
+	
+	memset(names, 0, sizeof(senml_names_t));
+	
+	if (!(names->arena = senml_arena_new(0))) {
+		senml_free(names);
+		return NULL;
+	}
+	
+	pthread_mutex_init(&names->lock, NULL);
+	
+	return names;
+}
+
+
+void senml_names_free(senml_names_t *names)
+{
+	senml_names_index_t *index;
+	
+	if (!names)
+		return;
+	
+	while ((index = names->index)) {
+		names->index = index->retired;
+		senml_free(index);
+	}
+	
+	for (int block = 0; block < SENML_NAMES_BLOCKS; block++)
+		senml_free(names->blocks[block]);
+	
+	senml_arena_free(names->arena);
+	pthread_mutex_destroy(&names->lock);
+	senml_free(names);
+}
+
+
+int senml_names_intern(senml_names_t *names, const char *name, size_t len, uint32_t *id)
+{
+	return senml_names_intern_parts(names, (senml_str_t){ .p = "", .len = 0 },
+	                                (senml_str_t){ .p = name, .len = len }, id, NULL);
+}
+
+
+int senml_names_find(const senml_names_t *names, const char *name, size_t len, uint32_t *id)
+{
+	senml_str_t prefix = { .p = "", .len = 0 };
+	senml_str_t str    = { .p = name, .len = len };
+	
+	if (senml_names_lookup(names, prefix, str, senml_hash(SENML_HASH_SEED, name, len), id))
+		return 0;
+	
+	*id = SENML_NO_ID;
+	return -1;
+}
+
+
+senml_str_t senml_names_get(const senml_names_t *names, uint32_t id)
+{
+	const senml_names_entry_t *entry;
+	
+	if (id >= __atomic_load_n(&names->count, __ATOMIC_ACQUIRE))
+		return (senml_str_t){ .p = NULL, .len = 0 };
+	
+	entry = senml_names_entry(names, id);
+	
+	return (senml_str_t){ .p = entry->p, .len = entry->len };
+}
+
+
+size_t senml_names_count(const senml_names_t *names)
+{
+	return __atomic_load_n(&names->count, __ATOMIC_ACQUIRE);
+}
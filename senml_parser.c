@@ -0,0 +1,250 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <string.h>
+
+
+/*! Position of the parser in the top level array */
+typedef enum {
+	SENML_PARSER_START = 0,  //!< Before the opening bracket
+	SENML_PARSER_FIRST,      //!< After the opening bracket, a record or the closing bracket follows
+	SENML_PARSER_NEXT,       //!< After a comma, a record follows
+	SENML_PARSER_RECORD,     //!< Inside a record, bytes are collected until it is closed
+	SENML_PARSER_AFTER,      //!< After a record, a comma or the closing bracket follows
+	SENML_PARSER_DONE,       //!< After the closing bracket, only whitespace may follow
+	SENML_PARSER_FAILED      //!< The document is invalid or the callback stopped the parser
+} senml_parser_state_t;
+
+
+struct senml_parser {
+	senml_parser_state_t  state;      //!< Where in the document the parser is
+	int                   rc;         //!< Result of the call that made the parser fail
+	senml_writer_t        buf;        //!< Raw bytes of the record being collected
+	unsigned int          depth;      //!< Nesting depth inside the record being collected
+	bool                  in_string;  //!< The last byte collected is inside a string
+	bool                  escape;     //!< The last byte collected is a backslash inside a string
+	senml_decoder_t       decoder;    //!< Builds the records and passes them to the callback
+	senml_pack_t          pack;       //!< Holds the base info and the current record
+	senml_record_t        record;     //!< Storage for the current record
+};
+
+
+static inline bool senml_parser_is_ws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+senml_parser_t *senml_parser_new(senml_record_cb_t callback, void *ctx)
+{
+	senml_parser_t *parser = senml_malloc(sizeof(senml_parser_t));
+	
+	if (!parser)
+		return NULL;
+	
+	memset(parser, 0, sizeof(senml_parser_t));
+	parser->state = SENML_PARSER_START;
+	
+	if (senml_decoder_init_callback(&parser->decoder, &parser->pack, &parser->record,
+	                                callback, ctx)) {
+		senml_free(parser);
+		return NULL;
+	}
+	
+	return parser;
+}
+
+
+/**
+ * Decodes the record collected in the buffer and passes it to the callback.
+ * @return 0 on success, -1 if the record is invalid, -2 if memory ran out, or the result of the
+ * callback.
+ */
+static int senml_parser_emit(senml_parser_t *parser)
+{
+	senml_fields_t      fields;
+	senml_json_cursor_t c = {
+		.start = parser->buf.buf,
+		.p     = parser->buf.buf,
+		.end   = parser->buf.buf + parser->buf.len,
+		.depth = 0
+	};
+	
+	if (senml_json_scan_record(&c, &fields, parser->decoder.count == 0, NULL))
+		return -1;
+	
+	if (c.p != c.end) {
+		senml_json_error(&c, SENML_ERROR_SYNTAX, "'}' expected");
+		return -1;
+	}
+	
+	return senml_decoder_add(&parser->decoder, &fields);
+}
+
+
+/**
+ * Collects the bytes of the current record until its closing brace.
+ * @return The number of bytes consumed, the record is complete if <code>parser->depth</code> is 0.
+ */
+static size_t senml_parser_collect(senml_parser_t *parser, const char *chunk, size_t len)
+{
+	size_t i;
+	
+	for (i = 0; i < len && parser->depth > 0; i++) {
+		char c = chunk[i];
+		
+		if (parser->in_string) {
+			if (parser->escape)
+				parser->escape = false;
+			else if (c == '\\')
+				parser->escape = true;
+			else if (c == '"')
+				parser->in_string = false;
+		} else if (c == '"') {
+			parser->in_string = true;
+		} else if (c == '{' || c == '[') {
+			parser->depth++;
+		} else if (c == '}' || c == ']') {
+			parser->depth--;
+		}
+	}
+	
+	senml_writer_put(&parser->buf, chunk, i);
+	
+	return i;
+}
+
+
+int senml_parser_feed(senml_parser_t *parser, const char *chunk, size_t len)
+{
+	const char *p     = chunk;
+	const char *end   = chunk + len;
+	size_t      count = parser->decoder.count;
+	int         rc;
+	
+	// the decoder times the records, so every chunk is a call of its own
+	senml_call_begin(&parser->decoder.call);
+	
+	while (p < end && parser->state != SENML_PARSER_FAILED) {
+		rc = -1;
+		
+		if (parser->state == SENML_PARSER_RECORD) {
+			p += senml_parser_collect(parser, p, (size_t)(end - p));
+			
+			if (parser->buf.overflow) {
+				rc = -2;
+				goto error;
+			}
+			
+			if (parser->depth > SENML_JSON_MAX_DEPTH) {
+				senml_error_set(SENML_ERROR_DEPTH, parser->decoder.count + 1,
+				                "maximum parsing depth reached");
+				goto error;
+			}
+			
+			if (parser->depth > 0)
+				continue;
+			
+			if ((rc = senml_parser_emit(parser))) {
+				// the positions of the scanner are relative to the record
+				if (rc == -1) {
+					senml_error_current()->record = parser->decoder.count + 1;
+					senml_error_current()->offset = 0;
+					senml_error_current()->line   = 0;
+				}
+				
+				goto error;
+			}
+			
+			parser->state = SENML_PARSER_AFTER;
+			continue;
+		}
+		
+		if (senml_parser_is_ws(*p)) {
+			p++;
+			continue;
+		}
+		
+		switch (parser->state) {
+		case SENML_PARSER_START:
+			if (*p != '[') {
+				senml_error_set(SENML_ERROR_NOT_ARRAY, 0, "not an array");
+				goto error;
+			}
+			
+			parser->state = SENML_PARSER_FIRST;
+			break;
+		
+		case SENML_PARSER_FIRST:
+		case SENML_PARSER_NEXT:
+			if (*p == ']' && parser->state == SENML_PARSER_FIRST) {
+				parser->state = SENML_PARSER_DONE;
+				break;
+			}
+			
+			if (*p != '{') {
+				senml_error_set(SENML_ERROR_RECORD, parser->decoder.count + 1,
+				                "record #%zu is not valid", parser->decoder.count + 1);
+				goto error;
+			}
+			
+			parser->state   = SENML_PARSER_RECORD;
+			parser->buf.len = 0;
+			parser->depth   = 1;
+			senml_writer_putc(&parser->buf, '{');
+			break;
+		
+		case SENML_PARSER_AFTER:
+			if (*p == ',') {
+				parser->state = SENML_PARSER_NEXT;
+			} else if (*p == ']') {
+				parser->state = SENML_PARSER_DONE;
+			} else {
+				senml_error_set(SENML_ERROR_SYNTAX, 0, "']' expected");
+				goto error;
+			}
+			break;
+		
+		default:
+			senml_error_set(SENML_ERROR_TRAILING, 0, "end of file expected");
+			goto error;
+		}
+		
+		p++;
+	}
+	
+	rc = parser->state == SENML_PARSER_FAILED ? parser->rc : 0;
+	senml_call_decoded(&parser->decoder.call, len, parser->decoder.count - count, 0, rc);
+	
+	return rc;
+	
+	error:
+	parser->state = SENML_PARSER_FAILED;
+	parser->rc    = rc;
+	senml_call_decoded(&parser->decoder.call, (size_t)(p - chunk), parser->decoder.count - count,
+	                   0, rc);
+	return rc;
+}
+
+
+int senml_parser_finish(senml_parser_t *parser)
+{
+	senml_call_t call;
+	int          rc = parser->state == SENML_PARSER_DONE ? 0 : -1;
+	
+	// a parser that failed has reported and counted its error already
+	if (parser->state != SENML_PARSER_FAILED) {
+		senml_call_begin(&call);
+		
+		if (rc)
+			senml_error_set(SENML_ERROR_TRUNCATED, 0, "premature end of input");
+		
+		// the bytes and records have been counted by the calls that fed them
+		senml_call_decoded(&call, 0, 0, rc == 0 ? 1 : 0, rc);
+	}
+	senml_decoder_release(&parser->decoder);
+	senml_free(parser->buf.buf);
+	senml_free(parser);
+	
+	return rc;
+}
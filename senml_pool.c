@@ -0,0 +1,354 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*! State of one worker thread */
+typedef struct {
+	uint64_t             range;    //!< Items left to this worker, begin and end in the upper and lower half
+	senml_writer_t       scratch;  //!< Buffer the worker reuses across items and batches
+	pthread_t            thread;   //!< The thread itself
+	struct senml_pool   *pool;     //!< Pool the worker belongs to
+} senml_pool_worker_t;
+
+
+struct senml_pool {
+	pthread_mutex_t      lock;        //!< Protects everything below but the worker ranges
+	pthread_cond_t       wake;        //!< Signalled when a job is posted or the pool shuts down
+	pthread_cond_t       idle;        //!< Signalled when the last worker has finished a job
+	senml_pool_job_t    *job;         //!< Job currently being processed, NULL if none
+	unsigned long        generation;  //!< Incremented for every job, so workers never run one twice
+	unsigned int         busy;        //!< Number of workers still working on the job
+	bool                 quit;        //!< Workers exit once they see this
+	unsigned int         num;         //!< Number of worker threads
+	senml_pool_worker_t  workers[];   //!< The workers
+};
+
+
+static inline uint64_t senml_pool_range(uint32_t begin, uint32_t end)
+{
+	return (uint64_t)begin << 32 | end;
+}
+
+
+/**
+ * Takes the next item from the front of the worker's own range.
+ * @return true if an item was taken, false if the range is empty.
+ */
+static bool senml_pool_pop(senml_pool_worker_t *worker, size_t *index)
+{
+	uint64_t range = __atomic_load_n(&worker->range, __ATOMIC_ACQUIRE);
+	
+	while (true) {
+		uint32_t begin = (uint32_t)(range >> 32);
+		uint32_t end   = (uint32_t)range;
+		
+		if (begin >= end)
+			return false;
+		
+		if (__atomic_compare_exchange_n(&worker->range, &range, senml_pool_range(begin + 1, end),
+		                                true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*index = begin;
+			return true;
+		}
+	}
+}
+
+
+/**
+ * Moves the back half of another worker's range to \p thief, whose own range must be empty.
+ * @return true if something was stolen, false if all other ranges are empty.
+ */
+static bool senml_pool_steal(senml_pool_t *pool, senml_pool_worker_t *thief)
+{
+	for (unsigned int i = 0; i < pool->num; i++) {
+		senml_pool_worker_t *victim = &pool->workers[i];
+		uint64_t             range  = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+		
+		while (victim != thief) {
+			uint32_t begin = (uint32_t)(range >> 32);
+			uint32_t end   = (uint32_t)range;
+			uint32_t mid   = begin + (end - begin) / 2;
+			
+			if (begin >= end)
+				break;
+			
+			// the owner and other thieves change the same word, so only one of them wins
+			if (__atomic_compare_exchange_n(&victim->range, &range, senml_pool_range(begin, mid),
+			                                true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__atomic_store_n(&thief->range, senml_pool_range(mid, end), __ATOMIC_RELEASE);
+				return true;
+			}
+		}
+	}
+	
+	return false;
+}
+
+
+/**
+ * Processes items of the current job until no worker has any left.
+ */
+static void senml_pool_work(senml_pool_t *pool, senml_pool_worker_t *worker, senml_pool_job_t *job)
+{
+	size_t index;
+	
+	do {
+		while (senml_pool_pop(worker, &index))
+			job->run(job, index, &worker->scratch);
+	} while (senml_pool_steal(pool, worker));
+}
+
+
+static void *senml_pool_main(void *arg)
+{
+	senml_pool_worker_t *worker = arg;
+	senml_pool_t        *pool   = worker->pool;
+	unsigned long        seen   = 0;
+	
+	pthread_mutex_lock(&pool->lock);
+	
+	while (true) {
+		while (!pool->quit && pool->generation == seen)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		
+		if (pool->quit)
+			break;
+		
+		senml_pool_job_t *job = pool->job;
+		
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		
+		senml_pool_work(pool, worker, job);
+		
+		pthread_mutex_lock(&pool->lock);
+		
+		if (--pool->busy == 0)
+			pthread_cond_broadcast(&pool->idle);
+	}
+	
+	pthread_mutex_unlock(&pool->lock);
+	
+	return NULL;
+}
+
+
+senml_pool_t *senml_pool_new(unsigned int threads)
+{
+	senml_pool_t *pool;
+	
+	if (threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		
+		threads = online > 0 ? (unsigned int)online : 1;
+	}
+	
+	if (!(pool = senml_malloc(sizeof(senml_pool_t) + sizeof(senml_pool_worker_t) * threads)))
+		return NULL;
+	
+	memset(pool, 0, sizeof(senml_pool_t) + sizeof(senml_pool_worker_t) * threads);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	
+	for (unsigned int i = 0; i < threads; i++) {
+		pool->workers[i].pool = pool;
+		
+		if (pthread_create(&pool->workers[i].thread, NULL, senml_pool_main, &pool->workers[i])) {
+			senml_pool_free(pool);
+			return NULL;
+		}
+		
+		pool->num++;
+	}
+	
+	return pool;
+}
+
+
+void senml_pool_free(senml_pool_t *pool)
+{
+	if (!pool)
+		return;
+	
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	
+	for (unsigned int i = 0; i < pool->num; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+		senml_free(pool->workers[i].scratch.buf);
+	}
+	
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	senml_free(pool);
+}
+
+
+/**
+ * Hands the outcome of a job to the calling thread. The items ran on other threads or left the
+ * error of the last item behind, so the error of the first failure is put in place.
+ * @return 0 if every item succeeded, -1 otherwise.
+ */
+static int senml_pool_result(senml_pool_job_t *job)
+{
+	// waiting for the workers has ordered their writes before this
+	if (!job->failed) {
+		senml_error_clear();
+		return 0;
+	}
+	
+	*senml_error_current() = job->error;
+	return -1;
+}
+
+
+int senml_pool_run(senml_pool_t *pool, senml_pool_job_t *job)
+{
+	if (job->count > UINT32_MAX) {
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "more than %u items in a batch", UINT32_MAX);
+		return -1;
+	}
+	
+	if (!pool || pool->num == 0) {
+		senml_writer_t scratch = { 0 };
+		
+		for (size_t i = 0; i < job->count; i++)
+			job->run(job, i, &scratch);
+		
+		senml_free(scratch.buf);
+		return senml_pool_result(job);
+	}
+	
+	pthread_mutex_lock(&pool->lock);
+	
+	while (pool->job)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	
+	// hand every worker an equal share up front, stealing evens out the rest
+	for (unsigned int i = 0; i < pool->num; i++) {
+		uint32_t begin = (uint32_t)(job->count * i / pool->num);
+		uint32_t end   = (uint32_t)(job->count * (i + 1) / pool->num);
+		
+		__atomic_store_n(&pool->workers[i].range, senml_pool_range(begin, end), __ATOMIC_RELEASE);
+	}
+	
+	pool->job  = job;
+	pool->busy = pool->num;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	
+	while (pool->busy > 0)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	
+	pool->job = NULL;
+	pthread_cond_broadcast(&pool->idle);
+	pthread_mutex_unlock(&pool->lock);
+	
+	return senml_pool_result(job);
+}
+
+
+/*! Arguments of <code>senml_decode_json_batch</code> */
+typedef struct {
+	const char *const  *inputs;
+	const size_t       *lens;
+	senml_pack_t      **packs;
+} senml_decode_batch_t;
+
+
+/*! Arguments of <code>senml_encode_json_batch</code> */
+typedef struct {
+	const senml_pack_t *const  *packs;
+	char                      **outputs;
+} senml_encode_batch_t;
+
+
+static void senml_decode_json_item(senml_pool_job_t *job, size_t index, senml_writer_t *scratch)
+{
+	senml_decode_batch_t *batch = job->ctx;
+	
+	(void)scratch;
+	
+	// every pack gets an arena of its own so that it can be released independently
+	batch->packs[index] = senml_decode_json(batch->inputs[index],
+	                                        batch->lens ? batch->lens[index] : 0);
+	
+	if (!batch->packs[index])
+		senml_pool_fail(job);
+}
+
+
+static void senml_encode_json_item(senml_pool_job_t *job, size_t index, senml_writer_t *scratch)
+{
+	senml_encode_batch_t *batch = job->ctx;
+	
+	const senml_pack_t   *pack  = batch->packs[index];
+	senml_call_t          call;
+	
+	// the document is built in the worker's buffer and copied out with its exact size
+	scratch->len      = 0;
+	scratch->overflow = false;
+	
+	batch->outputs[index] = NULL;
+	senml_call_begin(&call);
+	
+	if (!pack) {
+		senml_error_set(SENML_ERROR_INVALID_PACK, 0, "pack #%zu is missing", index + 1);
+	} else if (senml_json_encode_pack(scratch, pack, NULL) == 0) {
+		senml_writer_putc(scratch, '\0');
+		
+		if (!scratch->overflow && (batch->outputs[index] = senml_malloc(scratch->len)))
+			memcpy(batch->outputs[index], scratch->buf, scratch->len);
+	}
+	
+	senml_call_encoded(&call, batch->outputs[index] ? scratch->len - 1 : 0, pack ? pack->num : 0,
+	                   batch->outputs[index] ? 0 : -1);
+	
+	if (!batch->outputs[index])
+		senml_pool_fail(job);
+}
+
+
+int senml_decode_json_batch(senml_pool_t *pool, const char *const *inputs, const size_t *lens,
+                            size_t count, senml_pack_t **packs)
+{
+	senml_decode_batch_t batch = {
+		.inputs = inputs,
+		.lens   = lens,
+		.packs  = packs
+	};
+	
+	senml_pool_job_t job = {
+		.run   = senml_decode_json_item,
+		.ctx   = &batch,
+		.count = count
+	};
+	
+	return senml_pool_run(pool, &job);
+}
+
+
+int senml_encode_json_batch(senml_pool_t *pool, const senml_pack_t *const *packs, size_t count,
+                            char **outputs)
+{
+	senml_encode_batch_t batch = {
+		.packs   = packs,
+		.outputs = outputs
+	};
+	
+	senml_pool_job_t job = {
+		.run   = senml_encode_json_item,
+		.ctx   = &batch,
+		.count = count
+	};
+	
+	return senml_pool_run(pool, &job);
+}
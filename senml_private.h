@@ -0,0 +1,933 @@
+#ifndef SENML_PRIVATE_H
+#define SENML_PRIVATE_H
+
+#include "senml.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+
+#define SENML_JSON_MAX_DEPTH (2048)   //!< Nesting limit for values we skip, same as jansson's
+
+#define SENML_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)   //!< Rounds up to the arena alignment
+
+
+/*! Block of memory the arena hands out allocations from */
+typedef struct senml_arena_chunk {
+	struct senml_arena_chunk *next;  //!< Next chunk in allocation order
+	size_t                    size;  //!< Usable bytes in data
+	size_t                    used;  //!< Bytes already handed out
+	unsigned char             data[] __attribute__((aligned(8)));
+} senml_arena_chunk_t;
+
+
+/*! Bump allocator, lives at the beginning of its first chunk */
+struct senml_arena {
+	senml_arena_chunk_t *first;    //!< Chunk holding this struct
+	senml_arena_chunk_t *current;  //!< Chunk allocations are currently taken from
+	size_t               mark;     //!< Bytes of the first chunk that survive a reset
+	void                *last;     //!< Most recent allocation, the only one that can grow in place
+	bool                 fixed;    //!< Lives in caller memory, must neither grow nor be freed
+};
+
+
+/*! Read position inside a JSON document that is not necessarily NUL terminated */
+typedef struct {
+	const char   *start;  //!< Beginning of the document, used to report error positions
+	const char   *p;      //!< Next character to be consumed
+	const char   *end;    //!< One past the last character of the document
+	unsigned int  depth;  //!< Current nesting depth while skipping unknown values
+} senml_json_cursor_t;
+
+
+/*! How the bytes of a string token are encoded in the input */
+typedef enum {
+	SENML_TOKEN_PLAIN = 0,     //!< The raw bytes are the string itself
+	SENML_TOKEN_JSON_ESCAPED,  //!< Contents of a JSON string that contain escape sequences
+	SENML_TOKEN_CBOR_CHUNKED   //!< Chunks of an indefinite length CBOR text string up to the break
+} senml_token_kind_t;
+
+
+/*! A string as it appears in the input, before anything is copied or decoded */
+typedef struct {
+	const char         *p;     //!< First raw byte
+	size_t              len;   //!< Number of raw bytes, the decoded string is never longer
+	senml_token_kind_t  kind;  //!< How the raw bytes have to be decoded
+} senml_token_t;
+
+
+/*! Attributes of a single record as found by a scanner, before anything is copied */
+typedef struct {
+	senml_token_t name;
+	senml_token_t unit;
+	senml_token_t string_value;
+	senml_token_t base_name;
+	senml_token_t base_unit;
+	double        time;
+	double        value;
+	double        base_time;
+	double        update_time;
+	double        version;
+	double        base_value;
+	bool          has_name;
+	bool          has_unit;
+	bool          has_time;
+	bool          has_update_time;
+	bool          has_value;
+	bool          has_bool_value;
+	bool          bool_value;
+	bool          bool_valid;
+	bool          has_string_value;
+	bool          has_base_info;
+	bool          has_version;
+	bool          has_base_name;
+	bool          has_base_time;
+	bool          has_base_unit;
+	bool          has_base_value;
+	bool          tested;     //!< The name has already been tested against the filter
+	bool          rejected;   //!< The filter rejected the record, the rest of it was skipped
+} senml_fields_t;
+
+
+/*! The part of the records a decoder keeps, see <code>senml_decode_opts_t</code> */
+typedef struct {
+	unsigned int          skip;       //!< SENML_FIELD_* attributes that are not decoded
+	const senml_filter_t *filter;     //!< Records to keep by resolved name, NULL for all
+	senml_str_t           base_name;  //!< Base name of the pack, which the names are resolved with
+} senml_select_t;
+
+
+/*! Time and outcome of one call of a public encode or decode function */
+typedef struct {
+	uint64_t  start;     //!< Ticks when the call started, 0 if timing is off
+	uint64_t  convert;   //!< Ticks spent converting records
+	uint64_t  external;  //!< Ticks spent in callbacks, which belong to the caller
+} senml_call_t;
+
+
+/*! State shared by the decoders while they fill a pack */
+typedef struct {
+	senml_pack_t        *pack;        //!< Pack the records are stored in
+	senml_arena_t       *arena;       //!< Where copies are allocated, may be NULL for caller memory
+	senml_base_info_t   *base_info;   //!< Caller provided storage for the base info, may be NULL
+	size_t               capacity;    //!< Number of records <code>pack->records</code> can hold
+	size_t               count;       //!< Number of records decoded so far, including skipped ones
+	size_t               skipped;     //!< Number of records the filter rejected
+	size_t               max_records; //!< Records the document may have, 0 for no limit
+	bool                 borrow;      //!< Let strings point into the input
+	bool                 fixed;       //!< The records array belongs to the caller and cannot grow
+	bool                 reused;      //!< The pack was passed in through the options
+	bool                 resolve;     //!< Apply the base info to records passed to the callback
+	senml_record_cb_t    callback;    //!< Receives every record instead of the pack, may be NULL
+	void                *ctx;         //!< Passed to the callback
+	senml_arena_t       *scratch;     //!< Strings of the current record if there is a callback
+	senml_names_t       *names;       //!< Table the resolved names are interned in, may be NULL
+	senml_call_t         call;        //!< The public call the decoder works for, started by init
+	size_t               len;         //!< Bytes of input, for the statistics
+	senml_select_t       select;      //!< Attributes and records to keep
+} senml_decoder_t;
+
+
+/*! Output of the encoders, either caller memory of fixed size or a buffer that grows */
+typedef struct {
+	char   *buf;       //!< Start of the output
+	size_t  len;       //!< Bytes written so far
+	size_t  cap;       //!< Size of buf in bytes
+	bool    fixed;     //!< buf belongs to the caller and cannot grow
+	bool    overflow;  //!< Some output was dropped because buf was too small
+} senml_writer_t;
+
+
+/**
+ * Makes room for \p n more bytes in a growing writer.
+ * @return true on success, false if memory could not be allocated.
+ */
+bool senml_writer_grow(senml_writer_t *w, size_t n);
+
+
+/**
+ * Ensures that \p n more bytes fit, growing the buffer if allowed.
+ * @return true if they fit, false (and the overflow flag is set) otherwise.
+ */
+static inline bool senml_writer_reserve(senml_writer_t *w, size_t n)
+{
+	if (w->cap - w->len >= n)
+		return true;
+	
+	if (w->fixed || w->overflow || !senml_writer_grow(w, n)) {
+		w->overflow = true;
+		return false;
+	}
+	
+	return true;
+}
+
+
+static inline void senml_writer_put(senml_writer_t *w, const void *data, size_t n)
+{
+	if (senml_writer_reserve(w, n)) {
+		memcpy(w->buf + w->len, data, n);
+		w->len += n;
+	}
+}
+
+
+static inline void senml_writer_putc(senml_writer_t *w, char c)
+{
+	if (senml_writer_reserve(w, 1))
+		w->buf[w->len++] = c;
+}
+
+
+/**
+ * Writes a JSON string token including the quotes, escaping everything outside of ASCII.
+ * @return 0 on success, -1 if \p str is not valid UTF-8.
+ */
+int senml_json_put_string(senml_writer_t *w, senml_str_t str);
+
+
+/**
+ * Writes a JSON number token for a floating point value.
+ * @return 0 on success, -1 if \p value is not finite.
+ */
+int senml_json_put_double(senml_writer_t *w, double value);
+
+
+/**
+ * Writes a JSON number token for an unsigned integer.
+ */
+static inline void senml_json_put_uint(senml_writer_t *w, uint64_t value)
+{
+	char  buf[20];
+	char *p = buf + sizeof(buf);
+	
+	do {
+		*--p  = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	
+	senml_writer_put(w, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+
+/*! Base fields chosen for a pack by the compact encoders, the records are written relative to them */
+typedef struct {
+	senml_base_info_t        base_info;  //!< Base fields that go into the first record
+	const senml_base_info_t *original;   //!< Base info the records of the pack refer to, may be NULL
+	size_t                   name_skip;  //!< Leading bytes of every name that moved to the base name
+	char                    *buf;        //!< Base name if it had to be assembled, NULL otherwise
+} senml_compact_t;
+
+
+/**
+ * Chooses the longest common name prefix, the smallest time and the unit of the majority as the
+ * base fields of a pack. Each is only used if the decoders resolve every record exactly as before.
+ * Must be released with <code>senml_compact_release</code>.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_compact_init(senml_compact_t *compact, const senml_pack_t *pack);
+
+
+/**
+ * Releases what <code>senml_compact_init</code> allocated.
+ */
+void senml_compact_release(senml_compact_t *compact);
+
+
+/**
+ * Builds the record to write in place of \p record. Its strings point into \p record.
+ */
+void senml_compact_record(const senml_compact_t *compact, const senml_record_t *record,
+                          senml_record_t *relative);
+
+
+/**
+ * Writes a whole pack as JSON, without a terminator. Reals are written so that they round-trip,
+ * see <code>senml_double_format</code>.
+ * @param[in] compact Base fields to write the records relative to, or NULL to write the pack as is.
+ * @return 0 on success, -1 if the pack contains invalid data.
+ */
+int senml_json_encode_pack(senml_writer_t *w, const senml_pack_t *pack,
+                           const senml_compact_t *compact);
+
+
+/**
+ * Writes a record as a JSON object.
+ * @param[in] base_info Base fields to write in front of the record's own, may be NULL.
+ * @return 0 on success, -1 if the record contains invalid data.
+ */
+int senml_json_put_record(senml_writer_t *w, const senml_base_info_t *base_info,
+                          const senml_record_t *record);
+
+
+#define SENML_CBOR_MAX_HEAD (9)   //!< Longest head of a CBOR data item
+
+
+/**
+ * Writes a record as a CBOR map with a definite length, see <code>senml_json_put_record</code>.
+ * @return 0 on success, -1 if the record contains invalid data.
+ */
+int senml_cbor_put_record(senml_writer_t *w, const senml_base_info_t *base_info,
+                          const senml_record_t *record);
+
+
+/**
+ * Writes the head of an array whose items have already been written after \p reserved bytes left
+ * free for it at \p at. The items are moved down if the head is shorter and up if it is longer,
+ * which sets the overflow flag of a fixed writer that has no room for them.
+ * @param[in,out] w
+ * @param[in] at Offset of the space left for the head.
+ * @param[in] reserved Bytes left for the head, 1 to <code>SENML_CBOR_MAX_HEAD</code>.
+ * @param[in] count Number of items in the array.
+ */
+void senml_cbor_finish_array(senml_writer_t *w, size_t at, size_t reserved, size_t count);
+
+
+/*! What a slot of a template holds */
+typedef enum {
+	SENML_SLOT_TIME = 0,     //!< Time of a record, a float
+	SENML_SLOT_UPDATE_TIME,  //!< Update time of a record, an unsigned integer
+	SENML_SLOT_FLOAT,        //!< Float value of a record
+	SENML_SLOT_BOOL          //!< Boolean value of a record
+} senml_slot_kind_t;
+
+
+/*! Place in the image of a template that is written on every encode */
+typedef struct {
+	size_t             offset;  //!< Where the value goes in the image
+	size_t             record;  //!< Index of the record the value comes from
+	senml_slot_kind_t  kind;
+} senml_slot_t;
+
+
+/*! Slots of a template, filled in while its image is written */
+typedef struct {
+	senml_slot_t  *slots;  //!< Room for three slots per record
+	size_t         count;  //!< Number of slots in use
+	unsigned int   fields; //!< Attributes that get slots, SENML_FIELD_TIME, _UPDATE_TIME and _VALUE
+} senml_slots_t;
+
+
+/**
+ * Takes the attributes that get slots out of a copy of a record, so that the encoders leave them
+ * to the template.
+ * @return The number of slots of the record.
+ */
+static inline size_t senml_slots_strip(const senml_slots_t *slots, senml_record_t *record)
+{
+	size_t count = 0;
+	
+	if (slots->fields & SENML_FIELD_TIME) {
+		record->time = 0;
+		count++;
+	}
+	
+	if (slots->fields & SENML_FIELD_UPDATE_TIME) {
+		record->update_time = 0;
+		count++;
+	}
+	
+	// string values stay part of the image
+	if ((slots->fields & SENML_FIELD_VALUE) &&
+	    (record->value_type == SENML_TYPE_FLOAT || record->value_type == SENML_TYPE_BOOL)) {
+		record->value_type = SENML_TYPE_UNDEF;
+		count++;
+	}
+	
+	return count;
+}
+
+
+static inline void senml_slots_add(senml_slots_t *slots, size_t offset, size_t record,
+                                   senml_slot_kind_t kind)
+{
+	slots->slots[slots->count++] = (senml_slot_t){
+		.offset = offset,
+		.record = record,
+		.kind   = kind
+	};
+}
+
+
+/**
+ * Writes the image of a JSON template: the pack with the slots left out, so that the values are
+ * inserted at the offset of their slot. The keys of the slots are part of the image.
+ * @return 0 on success, -1 if the pack contains invalid data.
+ */
+int senml_json_put_template(senml_writer_t *w, const senml_pack_t *pack, senml_slots_t *slots);
+
+
+/**
+ * Writes the value of a slot of a JSON template, taken from \p record whose type has been checked.
+ * @return 0 on success, -1 if the value is not finite.
+ */
+int senml_json_put_slot(senml_writer_t *w, const senml_slot_t *slot, const senml_record_t *record);
+
+
+/**
+ * Writes the image of a CBOR template: the pack with a placeholder of fixed width in each slot,
+ * a double for times and float values, a 4 byte integer for update times and a simple value for
+ * booleans. The offset of a slot is that of the head of its item.
+ * @return 0 on success, -1 if the pack contains invalid data.
+ */
+int senml_cbor_put_template(senml_writer_t *w, const senml_pack_t *pack, senml_slots_t *slots);
+
+
+/**
+ * Overwrites the placeholder of a slot in the image of a CBOR template with the value taken from
+ * \p record, whose type has been checked.
+ */
+void senml_cbor_patch_slot(char *image, const senml_slot_t *slot, const senml_record_t *record);
+
+
+#define SENML_DOUBLE_MAX_LEN (32)   //!< Buffer size <code>senml_double_format</code> needs
+
+
+/**
+ * Formats a finite double so that it round-trips: parsing the output gives back exactly the same
+ * value. The digits are the shortest for most values but not for all, 1e23 for instance is
+ * written as 9.999999999999999e22. The output is a valid JSON number that always contains a '.'
+ * or an exponent, like jansson's reals.
+ * @param[in] value
+ * @param[out] buf Buffer of at least <code>SENML_DOUBLE_MAX_LEN</code> bytes, no terminator is
+ * written.
+ * @return The number of bytes written.
+ */
+size_t senml_double_format(double value, char *buf);
+
+
+/**
+ * Converts a number token that has already been validated against the JSON grammar, rounding
+ * correctly and independently of the locale. Only the characters up to \p end are read, so the
+ * token does not have to be terminated. Tokens too large for a double give infinity.
+ * @param[in] p First character of the token.
+ * @param[in] end One past the last character of the token.
+ * @param[out] value
+ */
+void senml_double_parse(const char *p, const char *end, double *value);
+
+
+/**
+ * Allocates memory through the hooks installed with <code>senml_set_allocator</code>.
+ */
+void *senml_malloc(size_t size);
+
+
+/**
+ * Resizes memory through the hooks installed with <code>senml_set_allocator</code>.
+ */
+void *senml_realloc(void *ptr, size_t size);
+
+
+/**
+ * Creates an arena whose first chunk has room for at least \p size bytes.
+ * @return The arena, or NULL if memory could not be allocated.
+ */
+senml_arena_t *senml_arena_new(size_t size);
+
+
+/**
+ * Creates an arena and allocates an empty pack at its beginning that survives resets.
+ * @param[in] size Expected number of bytes needed for the records and strings.
+ * @return The pack, or NULL if memory could not be allocated.
+ */
+senml_pack_t *senml_arena_new_pack(size_t size);
+
+
+/**
+ * Allocates \p size bytes aligned to 8 bytes.
+ * @return A pointer to the memory, or NULL if memory could not be allocated.
+ */
+void *senml_arena_alloc(senml_arena_t *arena, size_t size);
+
+
+/**
+ * Resizes an allocation, in place if it is the most recent one and the chunk has room.
+ * @return A pointer to the (possibly moved) memory, or NULL if memory could not be allocated.
+ */
+void *senml_arena_grow(senml_arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+
+
+/**
+ * Rewinds the arena to the state it had after creation while keeping all of its chunks.
+ */
+void senml_arena_reset(senml_arena_t *arena);
+
+
+/**
+ * Releases all chunks of the arena, including the one the arena itself lives in.
+ */
+void senml_arena_free(senml_arena_t *arena);
+
+
+/**
+ * Copies \p len bytes into the arena and terminates them.
+ * @return The copy, or NULL if memory could not be allocated.
+ */
+static inline char *senml_arena_strndup(senml_arena_t *arena, const char *s, size_t len)
+{
+	char *copy = senml_arena_alloc(arena, len + 1);
+	
+	if (copy) {
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+	}
+	
+	return copy;
+}
+
+
+/**
+ * Returns the error slot of the calling thread, which <code>senml_last_error</code> hands out.
+ */
+senml_error_t *senml_error_current(void);
+
+
+/**
+ * Records an error of the current call on the calling thread.
+ * @param[in] code
+ * @param[in] record Number of the affected record starting at 1, or 0.
+ * @param[in] fmt printf format of the message.
+ * @return The error slot, so that callers can fill in the position.
+ */
+senml_error_t *senml_error_set(senml_error_code_t code, size_t record, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+
+/**
+ * Marks the current call as successful so far.
+ */
+static inline void senml_error_clear(void)
+{
+	senml_error_t *error = senml_error_current();
+	
+	error->code       = SENML_OK;
+	error->record     = 0;
+	error->offset     = 0;
+	error->line       = 0;
+	error->message[0] = '\0';
+}
+
+
+/**
+ * Records \p code for a call that failed without saying why, e.g. because a callback returned an
+ * error of its own. An error that has already been recorded is kept.
+ */
+void senml_error_default(senml_error_code_t code);
+
+
+extern unsigned int senml_stats_flags;   //!< SENML_STATS_* flags, see senml_stats_enable
+
+
+/**
+ * Reads the clock <code>senml_stats_t.ticks</code> is measured with.
+ */
+static inline uint64_t senml_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+
+static inline bool senml_stats_on(unsigned int flags)
+{
+	return __builtin_expect((__atomic_load_n(&senml_stats_flags, __ATOMIC_RELAXED) & flags) != 0, 0);
+}
+
+
+/**
+ * Starts a call of a public encode or decode function.
+ */
+static inline void senml_call_begin(senml_call_t *call)
+{
+	senml_error_clear();
+	
+	call->start    = senml_stats_on(SENML_STATS_TIMING) ? senml_ticks() : 0;
+	call->convert  = 0;
+	call->external = 0;
+}
+
+
+/**
+ * Adds a finished call to the counters of the calling thread, see <code>senml_call_decoded</code>.
+ */
+void senml_stats_add_call(const senml_call_t *call, bool decoding, size_t bytes, size_t records,
+                          size_t packs, int rc);
+
+
+/**
+ * Ends a call of a decoder started with <code>senml_call_begin</code>.
+ * @param[in] call
+ * @param[in] bytes Bytes of input consumed.
+ * @param[in] records Records decoded.
+ * @param[in] packs Documents completed, usually 1 on success and 0 on failure.
+ * @param[in] rc Result of the call, anything but 0 counts as an error.
+ */
+static inline void senml_call_decoded(const senml_call_t *call, size_t bytes, size_t records,
+                                      size_t packs, int rc)
+{
+	if (rc)
+		senml_error_default(rc == -2 ? SENML_ERROR_NO_MEMORY : SENML_ERROR_SYNTAX);
+	
+	if (senml_stats_on(SENML_STATS_COUNTERS))
+		senml_stats_add_call(call, true, bytes, records, packs, rc);
+}
+
+
+/**
+ * Ends a call of an encoder started with <code>senml_call_begin</code>.
+ * @param[in] call
+ * @param[in] bytes Bytes of output written.
+ * @param[in] records Records encoded.
+ * @param[in] rc Result of the call, anything but 0 counts as an error.
+ */
+static inline void senml_call_encoded(const senml_call_t *call, size_t bytes, size_t records, int rc)
+{
+	if (rc)
+		senml_error_default(rc == -2 ? SENML_ERROR_NO_SPACE : SENML_ERROR_INVALID_PACK);
+	
+	if (senml_stats_on(SENML_STATS_COUNTERS))
+		senml_stats_add_call(call, false, bytes, records, rc ? 0 : 1, rc);
+}
+
+
+/**
+ * Counts a call of the allocator.
+ */
+void senml_stats_add_alloc(size_t size);
+
+
+/**
+ * Prepares a decoder for a new document, either with a fresh pack or the one in \p opts.
+ * @param[out] d
+ * @param[in] opts The options passed to the public decode function, may be NULL.
+ * @param[in] size Size of the input, used to size the arena.
+ * @param[in] capacity Number of records to make room for initially.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_decoder_init(senml_decoder_t *d, const senml_decode_opts_t *opts, size_t size,
+                       size_t capacity);
+
+
+/**
+ * Ends a decode call started with <code>senml_decoder_init</code> and counts it.
+ * @param[in] d
+ * @param[in] rc Result of decoding, anything but 0 releases (or empties) the pack.
+ * @return The pack on success, NULL otherwise.
+ */
+senml_pack_t *senml_decoder_finish(senml_decoder_t *d, int rc);
+
+
+/**
+ * Prepares a decoder that passes every record to \p callback instead of collecting them. Only
+ * one record is kept at a time, in \p pack, so memory does not grow with the number of records.
+ * @param[out] d
+ * @param[out] pack Holds the base info and the current record while decoding.
+ * @param[in] record Storage for the current record.
+ * @param[in] callback
+ * @param[in] ctx Passed to every call of \p callback.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_decoder_init_callback(senml_decoder_t *d, senml_pack_t *pack, senml_record_t *record,
+                                senml_record_cb_t callback, void *ctx);
+
+
+/**
+ * Releases the memory of a decoder set up with <code>senml_decoder_init_callback</code>.
+ */
+void senml_decoder_release(senml_decoder_t *d);
+
+
+/**
+ * Appends a record built from the scanned attributes to the pack. The base attributes are
+ * stored in the base info if <code>fields->has_base_info</code> is set. If the decoder has a
+ * callback, the record replaces the previous one and is passed to the callback.
+ * @return 0 on success, -1 if the attributes are invalid, -2 if memory ran out, or the result of
+ * the callback.
+ */
+int senml_decoder_add(senml_decoder_t *d, const senml_fields_t *fields);
+
+
+/*! Output of a transcoder, the context of the callback that writes the decoded records */
+typedef struct {
+	senml_writer_t *w;      //!< Where the records go
+	size_t          count;  //!< Records written so far
+} senml_transcoder_t;
+
+
+/**
+ * Stops a transcoder once its output is full, so the rest of a document that does not fit is not
+ * scanned for nothing.
+ * @return 0 to continue, -2 if the output is full.
+ */
+static inline int senml_transcoder_check(const senml_transcoder_t *t)
+{
+	if (!t->w->overflow)
+		return 0;
+	
+	// a writer that may grow only overflows if memory ran out, which has been recorded already
+	if (t->w->fixed && senml_error_current()->code == SENML_OK)
+		senml_error_set(SENML_ERROR_NO_SPACE, 0, "the document needs more than %zu bytes",
+		                t->w->cap);
+	
+	return -2;
+}
+
+
+/**
+ * Ends a transcoder call: the input counts as decoded and, on success, the records written from
+ * the callback as encoded.
+ * @param[in] d The decoder that drove the callback.
+ * @param[in] bytes Bytes of output written.
+ * @param[in] rc Result of decoding.
+ */
+void senml_transcoder_finish(const senml_decoder_t *d, size_t bytes, int rc);
+
+
+/**
+ * Creates empty columns with room for \p capacity records.
+ * @return The columns, or NULL if memory could not be allocated.
+ */
+senml_columns_t *senml_columns_new(size_t capacity);
+
+
+/**
+ * Appends a record to the columns passed as \p ctx, a <code>senml_record_cb_t</code> for the
+ * decoders. The base info is copied the first time it is passed.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_columns_add_record(const senml_record_t *record, const senml_base_info_t *base_info,
+                             void *ctx);
+
+
+/*! Implementations of the aggregation functions */
+typedef enum {
+	SENML_KERNEL_AUTO = 0,  //!< The widest one the CPU supports
+	SENML_KERNEL_SCALAR,
+	SENML_KERNEL_SSE2,
+	SENML_KERNEL_AVX2
+} senml_kernel_t;
+
+
+/**
+ * Makes the aggregation functions use \p kernel from now on, so that the tests can compare the
+ * kernels with each other. Not thread-safe.
+ * @return 0 on success, -1 if the kernel is not built for or not supported by this CPU.
+ */
+int senml_aggregate_force(senml_kernel_t kernel);
+
+
+/**
+ * Interns the concatenation of \p prefix and \p name without building it first.
+ * @param[out] id The ID of the name.
+ * @param[out] canonical The copy of the name in the table, may be NULL.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+int senml_names_intern_parts(senml_names_t *names, senml_str_t prefix, senml_str_t name,
+                             uint32_t *id, const char **canonical);
+
+
+/**
+ * Tests the resolved name of a record, \p base_name followed by the name, against a filter.
+ * @param[in] name The name as scanned, NULL if the record has none.
+ * @return 1 if the record is kept, 0 if not, -2 if memory ran out while decoding the name.
+ */
+int senml_filter_test(const senml_filter_t *filter, senml_str_t base_name,
+                      const senml_token_t *name);
+
+
+/**
+ * Tests a name a scanner has just read, so that the rest of a record that is not wanted can be
+ * skipped without converting anything. Running out of memory is left to the decoder to report.
+ */
+static inline void senml_select_name(const senml_select_t *select, senml_fields_t *fields)
+{
+	int rc = senml_filter_test(select->filter, select->base_name, &fields->name);
+	
+	if (rc >= 0) {
+		fields->tested   = true;
+		fields->rejected = rc == 0;
+	}
+}
+
+
+/**
+ * Decodes a string token into \p out, which must have room for <code>token->len</code> bytes.
+ * @return The length of the decoded string, no terminator is written.
+ */
+size_t senml_token_decode(const senml_token_t *token, char *out);
+
+
+/**
+ * Joins the chunks of an indefinite length CBOR text string.
+ * @return The number of bytes written to \p out.
+ */
+size_t senml_cbor_join_chunks(const senml_token_t *token, char *out);
+
+
+#define SENML_HASH_SEED (2166136261u)  //!< Hash of the empty string
+
+
+/**
+ * Continues a FNV-1a hash over \p len more bytes, so that the parts of a string can be hashed
+ * one after another.
+ */
+static inline uint32_t senml_hash(uint32_t hash, const char *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ (uint8_t)p[i]) * 16777619u;
+	
+	return hash;
+}
+
+
+/**
+ * Returns a string attribute as a view. The NUL terminated member takes precedence since packs
+ * built by hand usually only set that one.
+ * @param[in] s The <code>char *</code> member.
+ * @param[in] view The matching <code>*_view</code> member.
+ */
+static inline senml_str_t senml_str_of(const char *s, const senml_str_t *view)
+{
+	if (s)
+		return (senml_str_t){ .p = s, .len = strlen(s) };
+	
+	return *view;
+}
+
+
+/**
+ * Skips whitespace as defined by RFC 7159.
+ * @param[in,out] c
+ */
+static inline void senml_json_skip_ws(senml_json_cursor_t *c)
+{
+	while (c->p < c->end &&
+	       (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+		c->p++;
+}
+
+
+/**
+ * Records an error at the cursor position, with its line and offset.
+ * @param[in] c
+ * @param[in] code Kind of the error, a syntax error at the end of the input counts as truncation.
+ * @param[in] msg Description of the error.
+ */
+void senml_json_error(const senml_json_cursor_t *c, senml_error_code_t code, const char *msg);
+
+
+/**
+ * Scans a string token, validating its escape sequences and UTF-8 encoding.
+ * @param[in,out] c Must point to the opening quote, will point past the closing quote.
+ * @param[out] str The raw token.
+ * @return 0 on success, -1 on a syntax error.
+ */
+int senml_json_scan_string(senml_json_cursor_t *c, senml_token_t *str);
+
+
+/**
+ * Writes the unescaped contents of a string token scanned by <code>senml_json_scan_string</code>.
+ * The result is never longer than the raw token.
+ * @param[in] str
+ * @param[out] out Buffer of at least <code>str->len</code> bytes, no terminator is written.
+ * @return The number of bytes written.
+ */
+size_t senml_json_unescape(const senml_token_t *str, char *out);
+
+
+/**
+ * Scans a number token and converts it.
+ * @param[in,out] c
+ * @param[out] value
+ * @return 0 on success, -1 on a syntax error.
+ */
+int senml_json_scan_number(senml_json_cursor_t *c, double *value);
+
+
+/**
+ * Skips (and validates) an arbitrary JSON value.
+ * @param[in,out] c
+ * @return 0 on success, -1 on a syntax error.
+ */
+int senml_json_skip_value(senml_json_cursor_t *c);
+
+
+/**
+ * Scans one record object in a single pass without copying anything.
+ * @param[in,out] c Must point to the opening brace, will point past the closing brace.
+ * @param[out] fields The attributes found, strings point into the document.
+ * @param[in] with_base_info Whether base attributes are honored, i.e. for the first record.
+ * @param[in] select Attributes and records to skip, NULL to scan everything.
+ * @return 0 on success, -1 on a syntax error.
+ */
+int senml_json_scan_record(senml_json_cursor_t *c, senml_fields_t *fields, bool with_base_info,
+                           const senml_select_t *select);
+
+
+
+/**
+ * Decodes a slice of the records of a JSON array: records separated by commas, without the
+ * brackets, up to <code>c->end</code>. Errors are reported relative to <code>c->start</code>, so
+ * it may point to the beginning of the whole array.
+ * @param[in,out] d
+ * @param[in,out] c Must point to the first record (or whitespace in front of it).
+ * @param[in] with_base_info Whether the first record of the slice is the first of the array.
+ * @return 0 on success, -1 if the slice is invalid, -2 if memory ran out.
+ */
+int senml_json_decode_slice(senml_decoder_t *d, senml_json_cursor_t *c, bool with_base_info);
+
+
+/*! Work shared by all threads of a pool for the duration of one batch call */
+typedef struct senml_pool_job {
+	//! Processes one item, \p scratch belongs to the calling thread
+	void   (*run)(struct senml_pool_job *job, size_t index, senml_writer_t *scratch);
+	void    *ctx;     //!< Arguments of the batch call
+	size_t         count;   //!< Number of items
+	int            failed;  //!< Set by run if an item could not be processed
+	senml_error_t  error;   //!< Error of the first item that failed
+} senml_pool_job_t;
+
+
+/**
+ * Processes all items of \p job, on the pool if there is one and on the calling thread otherwise.
+ * Only one job can run on a pool at a time, concurrent calls wait for each other.
+ * @return 0 if every item succeeded, -1 otherwise.
+ */
+int senml_pool_run(senml_pool_t *pool, senml_pool_job_t *job);
+
+
+/**
+ * Marks the job as failed. The first item to fail leaves its error behind for the caller.
+ */
+static inline void senml_pool_fail(senml_pool_job_t *job)
+{
+	int expected = 0;
+	
+	if (__atomic_compare_exchange_n(&job->failed, &expected, 1, false, __ATOMIC_ACQ_REL,
+	                                __ATOMIC_ACQUIRE))
+		job->error = *senml_error_current();
+}
+
+
+/**
+ * Tells items that have not started yet that they can be skipped.
+ */
+static inline bool senml_pool_failed(const senml_pool_job_t *job)
+{
+	return __atomic_load_n(&job->failed, __ATOMIC_ACQUIRE) != 0;
+}
+
+
+#endif  // SENML_PRIVATE_H
@@ -0,0 +1,627 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <math.h>
+#include <string.h>
+
+
+/*
+ * Samples are compressed like in Facebook's Gorilla. Times are converted to whole microseconds
+ * and stored as the difference between consecutive deltas, which is 0 for samples taken at regular
+ * intervals. Values are stored as the XOR with the previous value, of which only the bits between
+ * the leading and trailing zeros are written, and often not even their position.
+ *
+ * Every SENML_SERIES_BLOCK samples a block starts with the time and value written in full, so that
+ * decoding can start there. A time that is not a whole number of microseconds is written in full
+ * wherever it appears.
+ */
+
+
+#define SENML_SERIES_BLOCK    (512)             //!< Samples per block, a power of two
+#define SENML_SERIES_TICKS    (1e6)             //!< Time units per second
+#define SENML_SERIES_MAX_TIME (9007199254.0)    //!< Times beyond 2^53 ticks are written in full
+#define SENML_SERIES_NO_WINDOW (64)             //!< Leading zeros before the first window is set
+#define SENML_SERIES_SLACK    (8)               //!< Zero bytes after the data for 64 bit reads
+
+
+/*! Where a block starts */
+typedef struct {
+	double  time;  //!< Time of the first sample
+	size_t  bit;   //!< Offset of the first bit
+} senml_series_block_t;
+
+
+/*! State shared by the encoder and the decoder */
+typedef struct {
+	int64_t   ticks;     //!< Time of the previous sample
+	int64_t   delta;     //!< Difference between the previous two times
+	uint64_t  value;     //!< Bits of the previous value
+	unsigned  leading;   //!< Leading zeros of the current window
+	unsigned  trailing;  //!< Trailing zeros of the current window
+} senml_series_state_t;
+
+
+struct senml_series {
+	char                  *name;
+	char                  *unit;        //!< NULL if not set
+	uint8_t               *data;        //!< The compressed samples, zero after the last bit
+	size_t                 bits;        //!< Bits written
+	size_t                 cap;         //!< Size of data in bytes
+	senml_series_block_t  *blocks;
+	size_t                 num_blocks;
+	size_t                 cap_blocks;
+	size_t                 count;       //!< Number of samples
+	double                 last_time;   //!< Time of the last sample
+	senml_series_state_t   state;       //!< State after the last sample
+};
+
+
+/**
+ * Converts a time to ticks.
+ * @return true if the ticks convert back to the same time, false otherwise.
+ */
+static inline bool senml_series_ticks(double time, int64_t *ticks)
+{
+	// also false for NaN
+	if (!(fabs(time) < SENML_SERIES_MAX_TIME)) {
+		*ticks = 0;
+		return false;
+	}
+	
+	*ticks = llround(time * SENML_SERIES_TICKS);
+	
+	return (double)*ticks / SENML_SERIES_TICKS == time;
+}
+
+
+static inline uint64_t senml_series_load(const uint8_t *p)
+{
+	uint64_t word;
+	
+	memcpy(&word, p, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+
+/**
+ * Reads \p n bits, 1 to 56 of them.
+ */
+static inline uint64_t senml_series_read(const uint8_t *data, size_t *bit, unsigned n)
+{
+	uint64_t word = senml_series_load(data + *bit / 8) << (*bit % 8);
+	
+	*bit += n;
+	
+	return word >> (64 - n);
+}
+
+
+static inline uint64_t senml_series_read64(const uint8_t *data, size_t *bit)
+{
+	uint64_t high = senml_series_read(data, bit, 32);
+	
+	return high << 32 | senml_series_read(data, bit, 32);
+}
+
+
+static inline int64_t senml_series_signed(uint64_t bits, unsigned n)
+{
+	return (int64_t)(bits << (64 - n)) >> (64 - n);
+}
+
+
+/**
+ * Makes room for \p n more bits and the slack behind them.
+ * @return 0 on success, -2 if memory could not be allocated.
+ */
+static int senml_series_reserve(senml_series_t *series, size_t n)
+{
+	size_t   need = (series->bits + n + 7) / 8 + SENML_SERIES_SLACK;
+	size_t   cap  = series->cap ? series->cap : 256;
+	uint8_t *data;
+	
+	if (need <= series->cap)
+		return 0;
+	
+	while (cap < need)
+		cap *= 2;
+	
+	if (!(data = senml_realloc(series->data, cap)))
+		return -2;
+	
+	memset(data + series->cap, 0, cap - series->cap);
+	series->data = data;
+	series->cap  = cap;
+	
+	return 0;
+}
+
+
+/**
+ * Appends the lowest \p n bits of \p value, at most 64. Room must have been reserved.
+ */
+static void senml_series_write(senml_series_t *series, uint64_t value, unsigned n)
+{
+	while (n > 0) {
+		unsigned free = 8 - series->bits % 8;
+		unsigned take = n < free ? n : free;
+		uint8_t  bits = (uint8_t)(value >> (n - take) & ((1u << take) - 1));
+		
+		series->data[series->bits / 8] |= (uint8_t)(bits << (free - take));
+		series->bits += take;
+		n            -= take;
+	}
+}
+
+
+static void senml_series_write_time(senml_series_t *series, double time, bool first)
+{
+	senml_series_state_t *state = &series->state;
+	int64_t               ticks;
+	uint64_t              bits;
+	
+	if (senml_series_ticks(time, &ticks) && !first) {
+		int64_t delta = ticks - state->ticks;
+		int64_t dod   = delta - state->delta;
+		
+		// a prefix of ones tells how many bits follow
+		if (dod == 0) {
+			senml_series_write(series, 0, 1);
+		} else if (dod >= -64 && dod < 64) {
+			senml_series_write(series, 0x2, 2);
+			senml_series_write(series, (uint64_t)dod, 7);
+		} else if (dod >= -256 && dod < 256) {
+			senml_series_write(series, 0x6, 3);
+			senml_series_write(series, (uint64_t)dod, 9);
+		} else if (dod >= -2048 && dod < 2048) {
+			senml_series_write(series, 0xe, 4);
+			senml_series_write(series, (uint64_t)dod, 12);
+		} else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+			senml_series_write(series, 0x1e, 5);
+			senml_series_write(series, (uint64_t)dod, 32);
+		} else {
+			senml_series_write(series, 0x3e, 6);
+			senml_series_write(series, (uint64_t)dod, 64);
+		}
+		
+		state->delta = delta;
+		state->ticks = ticks;
+		return;
+	}
+	
+	// the first time of a block has no prefix
+	if (!first)
+		senml_series_write(series, 0x3f, 6);
+	
+	memcpy(&bits, &time, sizeof(bits));
+	senml_series_write(series, bits, 64);
+	
+	state->delta = first ? 0 : ticks - state->ticks;
+	state->ticks = ticks;
+}
+
+
+static void senml_series_write_value(senml_series_t *series, double value, bool first)
+{
+	senml_series_state_t *state = &series->state;
+	uint64_t              bits;
+	uint64_t              xor;
+	unsigned              leading, trailing;
+	
+	memcpy(&bits, &value, sizeof(bits));
+	xor          = bits ^ state->value;
+	state->value = bits;
+	
+	if (first) {
+		senml_series_write(series, bits, 64);
+		state->leading  = SENML_SERIES_NO_WINDOW;
+		state->trailing = 0;
+		return;
+	}
+	
+	if (xor == 0) {
+		senml_series_write(series, 0, 1);
+		return;
+	}
+	
+	// the count of leading zeros has 5 bits
+	leading  = (unsigned)__builtin_clzll(xor);
+	trailing = (unsigned)__builtin_ctzll(xor);
+	
+	if (leading > 31)
+		leading = 31;
+	
+	if (state->leading != SENML_SERIES_NO_WINDOW && leading >= state->leading &&
+	    trailing >= state->trailing) {
+		senml_series_write(series, 0x2, 2);
+		senml_series_write(series, xor >> state->trailing, 64 - state->leading - state->trailing);
+		return;
+	}
+	
+	// the length is 1 to 64 and written less one
+	senml_series_write(series, 0x3, 2);
+	senml_series_write(series, leading, 5);
+	senml_series_write(series, 63 - leading - trailing, 6);
+	senml_series_write(series, xor >> trailing, 64 - leading - trailing);
+	
+	state->leading  = leading;
+	state->trailing = trailing;
+}
+
+
+/**
+ * Creates a series that holds copies of \p name and \p unit in the same allocation.
+ */
+static senml_series_t *senml_series_create(senml_str_t name, senml_str_t unit)
+{
+	senml_series_t *series = senml_malloc(sizeof(senml_series_t) + name.len + unit.len + 2);
+	
+	if (!series)
+		return NULL;
+	
+	memset(series, 0, sizeof(*series));
+	series->name = (char *)(series + 1);
+	memcpy(series->name, name.p, name.len);
+	series->name[name.len] = '\0';
+	
+	if (unit.p) {
+		series->unit = series->name + name.len + 1;
+		memcpy(series->unit, unit.p, unit.len);
+		series->unit[unit.len] = '\0';
+	}
+	
+	return series;
+}
+
+
+senml_series_t *senml_series_new(const char *name, const char *unit)
+{
+	return senml_series_create((senml_str_t){ .p = name, .len = strlen(name) },
+	                           (senml_str_t){ .p = unit, .len = unit ? strlen(unit) : 0 });
+}
+
+
+void senml_series_free(senml_series_t *series)
+{
+	if (!series)
+		return;
+	
+	senml_free(series->data);
+	senml_free(series->blocks);
+	senml_free(series);
+}
+
+
+int senml_series_append(senml_series_t *series, double time, double value)
+{
+	bool first = series->count % SENML_SERIES_BLOCK == 0;
+	
+	if (time != time) {
+		senml_error_set(SENML_ERROR_RECORD, 0, "time is not a number");
+		return -1;
+	}
+	
+	if (series->count > 0 && time < series->last_time) {
+		senml_error_set(SENML_ERROR_RECORD, 0, "time %.17g is before the previous one", time);
+		return -1;
+	}
+	
+	// the longest sample takes 6 + 64 bits for the time and 2 + 5 + 6 + 64 for the value
+	if (senml_series_reserve(series, 147))
+		return -2;
+	
+	if (first) {
+		if (series->num_blocks == series->cap_blocks) {
+			size_t                cap    = series->cap_blocks ? series->cap_blocks * 2 : 16;
+			senml_series_block_t *blocks = senml_realloc(series->blocks,
+			                                             sizeof(senml_series_block_t) * cap);
+			
+			if (!blocks)
+				return -2;
+			
+			series->blocks     = blocks;
+			series->cap_blocks = cap;
+		}
+		
+		series->blocks[series->num_blocks++] = (senml_series_block_t){
+			.time = time,
+			.bit  = series->bits
+		};
+	}
+	
+	senml_series_write_time(series, time, first);
+	senml_series_write_value(series, value, first);
+	series->last_time = time;
+	series->count++;
+	
+	return 0;
+}
+
+
+size_t senml_series_count(const senml_series_t *series)
+{
+	return series->count;
+}
+
+
+size_t senml_series_size(const senml_series_t *series)
+{
+	return (series->bits + 7) / 8 + sizeof(senml_series_block_t) * series->num_blocks;
+}
+
+
+/**
+ * Checks whether a record has a float value and resolves to \p name. The base name has been
+ * compared already.
+ * @param[in] skip Length of the base name.
+ */
+static inline bool senml_series_matches(const senml_record_t *record, senml_str_t name,
+                                        size_t skip)
+{
+	senml_str_t part = senml_str_of(record->name, &record->name_view);
+	
+	return record->value_type == SENML_TYPE_FLOAT && part.len == name.len - skip &&
+	       (part.len == 0 || memcmp(part.p, name.p + skip, part.len) == 0);
+}
+
+
+/**
+ * Positions an iterator at the beginning of a block.
+ */
+static void senml_series_start(const senml_series_t *series, size_t block,
+                               senml_series_iter_t *iter)
+{
+	memset(iter, 0, sizeof(*iter));
+	iter->series = series;
+	iter->index  = block * SENML_SERIES_BLOCK;
+	
+	if (block < series->num_blocks)
+		iter->bit = series->blocks[block].bit;
+}
+
+
+static double senml_series_read_time(senml_series_iter_t *iter, const uint8_t *data, bool first)
+{
+	static const unsigned widths[] = { 0, 7, 9, 12, 32, 64 };
+	
+	unsigned ones;
+	uint64_t bits;
+	int64_t  ticks;
+	double   time;
+	
+	if (!first) {
+		// the prefix is up to five ones and a zero, or six ones
+		ones = (unsigned)__builtin_clzll(~(senml_series_read(data, &iter->bit, 6) << 58));
+		
+		if (ones < 6) {
+			iter->bit -= 5 - ones;
+			
+			if (ones > 0) {
+				uint64_t dod = widths[ones] == 64 ? senml_series_read64(data, &iter->bit) :
+				               senml_series_read(data, &iter->bit, widths[ones]);
+				
+				iter->delta += senml_series_signed(dod, widths[ones]);
+			}
+			
+			iter->ticks += iter->delta;
+			
+			return (double)iter->ticks / SENML_SERIES_TICKS;
+		}
+	}
+	
+	bits = senml_series_read64(data, &iter->bit);
+	memcpy(&time, &bits, sizeof(time));
+	
+	senml_series_ticks(time, &ticks);
+	iter->delta = first ? 0 : ticks - iter->ticks;
+	iter->ticks = ticks;
+	
+	return time;
+}
+
+
+static double senml_series_read_value(senml_series_iter_t *iter, const uint8_t *data, bool first)
+{
+	double   value;
+	uint64_t xor;
+	unsigned len;
+	
+	if (first) {
+		iter->value = senml_series_read64(data, &iter->bit);
+	} else if (senml_series_read(data, &iter->bit, 1)) {
+		if (senml_series_read(data, &iter->bit, 1)) {
+			iter->leading  = (unsigned)senml_series_read(data, &iter->bit, 5);
+			iter->trailing = 63 - iter->leading - (unsigned)senml_series_read(data, &iter->bit, 6);
+		}
+		
+		len = 64 - iter->leading - iter->trailing;
+		
+		if (len > 56) {
+			xor        = senml_series_read64(data, &iter->bit) >> (64 - len);
+			iter->bit -= 64 - len;
+		} else {
+			xor = senml_series_read(data, &iter->bit, len);
+		}
+		
+		iter->value ^= xor << iter->trailing;
+	}
+	
+	memcpy(&value, &iter->value, sizeof(value));
+	
+	return value;
+}
+
+
+bool senml_series_next(senml_series_iter_t *iter, double *time, double *value)
+{
+	const senml_series_t *series = iter->series;
+	bool                  first  = iter->index % SENML_SERIES_BLOCK == 0;
+	
+	if (iter->index >= series->count)
+		return false;
+	
+	*time  = senml_series_read_time(iter, series->data, first);
+	*value = senml_series_read_value(iter, series->data, first);
+	iter->index++;
+	
+	return true;
+}
+
+
+void senml_series_seek(const senml_series_t *series, double time, senml_series_iter_t *iter)
+{
+	size_t lo = 0;
+	size_t hi = series->num_blocks;
+	double t, v;
+	
+	// the first block that starts at or after time, the sample may be at the end of the one before
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (series->blocks[mid].time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	senml_series_start(series, lo > 0 ? lo - 1 : 0, iter);
+	
+	for (senml_series_iter_t next = *iter; senml_series_next(&next, &t, &v) && t < time; )
+		*iter = next;
+}
+
+
+size_t senml_series_decode(const senml_series_t *series, size_t first, double *times,
+                           double *values, size_t count)
+{
+	senml_series_iter_t iter;
+	double              t, v;
+	size_t              n = 0;
+	
+	if (first >= series->count)
+		return 0;
+	
+	senml_series_start(series, first / SENML_SERIES_BLOCK, &iter);
+	
+	while (iter.index < first)
+		senml_series_next(&iter, &t, &v);
+	
+	while (n < count && senml_series_next(&iter, &times[n], &values[n]))
+		n++;
+	
+	return n;
+}
+
+
+senml_series_t *senml_series_from_pack(const senml_pack_t *pack, const char *name)
+{
+	const senml_base_info_t *base_info = pack->base_info;
+	senml_str_t              base_name = { .p = "", .len = 0 };
+	senml_str_t              base_unit = { .p = NULL, .len = 0 };
+	senml_str_t              full      = { .p = name, .len = strlen(name) };
+	senml_str_t              unit      = { .p = NULL, .len = 0 };
+	double                   base_time = 0, base_value = -0.0;
+	senml_series_t          *series    = NULL;
+	size_t                   first     = pack->num;
+	
+	if (base_info) {
+		if (base_info->base_name || base_info->base_name_view.p)
+			base_name = senml_str_of(base_info->base_name, &base_info->base_name_view);
+		
+		base_unit = senml_str_of(base_info->base_unit, &base_info->base_unit_view);
+		base_time = base_info->base_time;
+		
+		if (base_info->base_value_type == SENML_TYPE_FLOAT)
+			base_value = base_info->base_value.base_value_f;
+	}
+	
+	// only the resolved name has to match, so it is compared in two parts rather than assembled
+	if (base_name.len <= full.len && memcmp(full.p, base_name.p, base_name.len) == 0) {
+		for (first = 0; first < pack->num; first++)
+			if (senml_series_matches(&pack->records[first], full, base_name.len))
+				break;
+	}
+	
+	// the unit of the first sample is the unit of the series
+	if (first < pack->num) {
+		unit = senml_str_of(pack->records[first].unit, &pack->records[first].unit_view);
+		
+		if (!unit.p)
+			unit = base_unit;
+	}
+	
+	if (!(series = senml_series_create(full, unit)))
+		return NULL;
+	
+	// without a base value the value is -0 + v, which keeps the sign of a value of -0
+	for (size_t i = first; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		int                   rc;
+		
+		if (!senml_series_matches(record, full, base_name.len))
+			continue;
+		
+		if ((rc = senml_series_append(series, base_time + record->time,
+		                              base_value + record->value.value_f))) {
+			senml_error_current()->record = i + 1;
+			senml_series_free(series);
+			return NULL;
+		}
+	}
+	
+	return series;
+}
+
+
+senml_pack_t *senml_series_to_pack(const senml_series_t *series)
+{
+	senml_series_iter_t iter;
+	senml_pack_t       *pack;
+	senml_base_info_t  *base_info;
+	size_t              name_len = strlen(series->name);
+	size_t              unit_len = series->unit ? strlen(series->unit) : 0;
+	
+	if (!(pack = senml_arena_new_pack(sizeof(senml_base_info_t) + name_len + unit_len + 2 +
+	                                  sizeof(senml_record_t) * series->count)))
+		return NULL;
+	
+	// the resolved name becomes the base name, so the records need no name of their own
+	if (!(base_info = senml_arena_alloc(pack->arena, sizeof(senml_base_info_t))) ||
+	    !(pack->records = senml_arena_alloc(pack->arena, sizeof(senml_record_t) * series->count + 1)))
+		goto error;
+	
+	memset(base_info, 0, sizeof(senml_base_info_t));
+	pack->base_info = base_info;
+	
+	if (!(base_info->base_name = senml_arena_strndup(pack->arena, series->name, name_len)) ||
+	    (series->unit &&
+	     !(base_info->base_unit = senml_arena_strndup(pack->arena, series->unit, unit_len))))
+		goto error;
+	
+	base_info->base_value_type = SENML_TYPE_UNDEF;
+	base_info->base_name_view  = (senml_str_t){ .p = base_info->base_name, .len = name_len };
+	base_info->base_unit_view  = (senml_str_t){ .p = base_info->base_unit, .len = unit_len };
+	
+	senml_series_start(series, 0, &iter);
+	
+	for (size_t i = 0; i < series->count; i++) {
+		senml_record_t *record = &pack->records[i];
+		
+		memset(record, 0, sizeof(senml_record_t));
+		record->name_id    = SENML_NO_ID;
+		record->value_type = SENML_TYPE_FLOAT;
+		senml_series_next(&iter, &record->time, &record->value.value_f);
+		pack->num++;
+	}
+	
+	return pack;
+	
+	error:
+	senml_pack_free(pack);
+	return NULL;
+}
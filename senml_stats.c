@@ -0,0 +1,200 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <pthread.h>
+#include <string.h>
+
+
+/*
+ * Every thread counts into a block of its own, so the hot paths never share a cache line or take
+ * a lock. Only the owner writes a block, with plain relaxed stores, and readers load the counters
+ * one by one. A block lives in thread-local storage and is linked into the list of live blocks the
+ * first time its thread counts something. When the thread exits, its counts move to the retired
+ * totals and the block is unlinked.
+ */
+
+
+#define SENML_STATS_FIELDS (sizeof(senml_stats_t) / sizeof(uint64_t))   //!< Counters in a block
+
+
+/*! Counters of one thread */
+typedef struct senml_stats_block {
+	struct senml_stats_block *next;        //!< Next live block
+	senml_stats_t             stats;       //!< Written by the owner only
+	bool                      registered;  //!< Whether the block is in the list
+} senml_stats_block_t;
+
+
+unsigned int senml_stats_flags;
+
+
+static __thread senml_stats_block_t senml_stats_local;
+static pthread_mutex_t               senml_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static senml_stats_block_t          *senml_stats_blocks;     //!< Blocks of the live threads
+static senml_stats_t                 senml_stats_retired;    //!< Counts of the threads that exited
+static senml_stats_t                 senml_stats_baseline;   //!< Totals at the last reset
+static pthread_key_t                 senml_stats_key;        //!< Runs senml_stats_retire at exit
+static pthread_once_t                senml_stats_once = PTHREAD_ONCE_INIT;
+
+
+static inline uint64_t *senml_stats_fields(senml_stats_t *stats)
+{
+	return (uint64_t *)stats;
+}
+
+
+/**
+ * Adds the counters of \p block to \p totals. Must be called with the lock held.
+ */
+static void senml_stats_sum(senml_stats_t *totals, senml_stats_block_t *block)
+{
+	uint64_t *sum    = senml_stats_fields(totals);
+	uint64_t *fields = senml_stats_fields(&block->stats);
+	
+	for (size_t i = 0; i < SENML_STATS_FIELDS; i++)
+		sum[i] += __atomic_load_n(&fields[i], __ATOMIC_RELAXED);
+}
+
+
+static void senml_stats_retire(void *arg)
+{
+	senml_stats_block_t  *block = arg;
+	senml_stats_block_t **link;
+	
+	pthread_mutex_lock(&senml_stats_lock);
+	senml_stats_sum(&senml_stats_retired, block);
+	
+	for (link = &senml_stats_blocks; *link; link = &(*link)->next) {
+		if (*link == block) {
+			*link = block->next;
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&senml_stats_lock);
+}
+
+
+static void senml_stats_init(void)
+{
+	pthread_key_create(&senml_stats_key, senml_stats_retire);
+}
+
+
+/**
+ * Returns the block of the calling thread, linking it into the list on first use.
+ */
+static senml_stats_t *senml_stats_thread(void)
+{
+	senml_stats_block_t *block = &senml_stats_local;
+	
+	if (__builtin_expect(!block->registered, 0)) {
+		pthread_once(&senml_stats_once, senml_stats_init);
+		pthread_mutex_lock(&senml_stats_lock);
+		block->next        = senml_stats_blocks;
+		senml_stats_blocks = block;
+		pthread_mutex_unlock(&senml_stats_lock);
+		
+		// the key only serves to get a destructor called when the thread exits
+		pthread_setspecific(senml_stats_key, block);
+		block->registered = true;
+	}
+	
+	return &block->stats;
+}
+
+
+/**
+ * Adds to a counter of the calling thread. Nobody else writes it, so no read-modify-write is
+ * needed, the store only has to be atomic for readers.
+ */
+static inline void senml_stats_bump(uint64_t *counter, uint64_t n)
+{
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+
+void senml_stats_add_call(const senml_call_t *call, bool decoding, size_t bytes, size_t records,
+                          size_t packs, int rc)
+{
+	senml_stats_t *stats = senml_stats_thread();
+	
+	if (decoding) {
+		senml_stats_bump(&stats->bytes_in, bytes);
+		senml_stats_bump(&stats->records_decoded, records);
+		senml_stats_bump(&stats->packs_decoded, packs);
+	} else {
+		senml_stats_bump(&stats->bytes_out, bytes);
+		senml_stats_bump(&stats->records_encoded, records);
+		senml_stats_bump(&stats->packs_encoded, packs);
+	}
+	
+	if (rc)
+		senml_stats_bump(&stats->errors[senml_error_current()->code], 1);
+	
+	if (call->start) {
+		uint64_t total = senml_ticks() - call->start - call->external;
+		
+		if (decoding) {
+			senml_stats_bump(&stats->ticks[SENML_PHASE_PARSE], total - call->convert);
+			senml_stats_bump(&stats->ticks[SENML_PHASE_CONVERT], call->convert);
+		} else {
+			senml_stats_bump(&stats->ticks[SENML_PHASE_SERIALIZE], total);
+		}
+	}
+}
+
+
+void senml_stats_add_alloc(size_t size)
+{
+	senml_stats_t *stats = senml_stats_thread();
+	
+	senml_stats_bump(&stats->allocs, 1);
+	senml_stats_bump(&stats->alloc_bytes, size);
+}
+
+
+void senml_stats_enable(unsigned int flags)
+{
+	// timing only makes sense together with the rest of the counters
+	if (flags & SENML_STATS_TIMING)
+		flags |= SENML_STATS_COUNTERS;
+	
+	__atomic_store_n(&senml_stats_flags, flags, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Sums up everything counted since the library was loaded. Must be called with the lock held.
+ */
+static void senml_stats_total(senml_stats_t *totals)
+{
+	*totals = senml_stats_retired;
+	
+	for (senml_stats_block_t *block = senml_stats_blocks; block; block = block->next)
+		senml_stats_sum(totals, block);
+}
+
+
+void senml_stats_get(senml_stats_t *stats)
+{
+	uint64_t *fields   = senml_stats_fields(stats);
+	uint64_t *baseline = senml_stats_fields(&senml_stats_baseline);
+	
+	pthread_mutex_lock(&senml_stats_lock);
+	senml_stats_total(stats);
+	
+	for (size_t i = 0; i < SENML_STATS_FIELDS; i++)
+		fields[i] -= baseline[i];
+	
+	pthread_mutex_unlock(&senml_stats_lock);
+}
+
+
+void senml_stats_reset(void)
+{
+	// the blocks belong to their threads, so the totals are remembered rather than cleared
+	pthread_mutex_lock(&senml_stats_lock);
+	senml_stats_total(&senml_stats_baseline);
+	pthread_mutex_unlock(&senml_stats_lock);
+}
@@ -0,0 +1,651 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+
+
+#define SENML_STORE_CHUNK       (256)  //!< Samples per chunk
+#define SENML_STORE_FIRST_BLOCK (64)   //!< Sensors of the first block, every further block doubles
+#define SENML_STORE_BLOCKS      (27)   //!< Enough blocks for every ID of a names table
+#define SENML_STORE_MIN_RING    (4)    //!< Slots of the first ring of a sensor, a power of two
+
+
+/*! Samples of a sensor in the order of their times */
+typedef struct senml_store_chunk {
+	double                     times[SENML_STORE_CHUNK];
+	double                     values[SENML_STORE_CHUNK];
+	struct senml_store_chunk  *free_next;  //!< Next chunk of the free list
+} senml_store_chunk_t;
+
+
+/*! Chunks of a sensor by their number, chunk n is in slot n % size */
+typedef struct senml_store_ring {
+	struct senml_store_ring  *retired;   //!< The ring this one replaced, readers may still use it
+	size_t                    size;      //!< Number of slots, a power of two
+	senml_store_chunk_t      *chunks[];
+} senml_store_ring_t;
+
+
+/*
+ * Readers never wait for the writer. Appending to the newest chunk only publishes the new fill,
+ * everything else the writer changes, adding and dropping chunks, happens between two increments
+ * of seq. A reader copies what it needs and starts over if seq was odd or has changed meanwhile.
+ * That is rare, once per chunk at most. Chunks that are dropped are reused rather than released,
+ * so a reader that races with the writer reads stale samples, which it discards, but never freed
+ * memory.
+ */
+typedef struct {
+	uint32_t             seq;        //!< Odd while the writer changes the chunks
+	senml_store_ring_t  *ring;       //!< NULL until the first sample
+	uint64_t             first;      //!< Number of the oldest chunk
+	uint64_t             next;       //!< Number of the chunk after the newest one
+	uint32_t             fill;       //!< Samples in the newest chunk
+	double               last_time;  //!< Time of the newest sample, only used by the writer
+} senml_store_sensor_t;
+
+
+struct senml_store {
+	senml_store_opts_t     opts;
+	senml_names_t         *names;                        //!< IDs of the sensors by resolved name
+	senml_store_sensor_t  *blocks[SENML_STORE_BLOCKS];   //!< Sensors by ID, like the names
+	senml_store_chunk_t   *free;                         //!< Chunks that were dropped
+	size_t                 bytes;                        //!< Memory of all chunks
+	double                 newest;                       //!< Time of the newest sample
+	double                 expires;                      //!< At most the end of any oldest chunk
+	bool                   empty;                        //!< No sample has been added yet
+};
+
+
+/**
+ * Finds the sensor of an ID. Block k holds the 64 << k IDs that follow the ones of the blocks
+ * before it.
+ * @return The sensor, or NULL if its block has not been allocated yet.
+ */
+static inline senml_store_sensor_t *senml_store_sensor(const senml_store_t *store, uint32_t id)
+{
+	uint64_t              position = (uint64_t)id / SENML_STORE_FIRST_BLOCK + 1;
+	int                   block    = 63 - __builtin_clzll(position);
+	uint64_t              first    = (uint64_t)SENML_STORE_FIRST_BLOCK *
+	                                 (((uint64_t)1 << block) - 1);
+	senml_store_sensor_t *sensors  = __atomic_load_n(&store->blocks[block], __ATOMIC_ACQUIRE);
+	
+	return sensors ? &sensors[id - first] : NULL;
+}
+
+
+/**
+ * Finds a sensor by its resolved name without changing the store.
+ */
+static const senml_store_sensor_t *senml_store_find(const senml_store_t *store, const char *name)
+{
+	uint32_t id;
+	
+	if (senml_names_find(store->names, name, strlen(name), &id))
+		return NULL;
+	
+	return senml_store_sensor(store, id);
+}
+
+
+static inline void senml_store_begin_write(senml_store_sensor_t *sensor)
+{
+	__atomic_store_n(&sensor->seq, sensor->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static inline void senml_store_end_write(senml_store_sensor_t *sensor)
+{
+	__atomic_store_n(&sensor->seq, sensor->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Waits until the writer is not changing the chunks of a sensor.
+ * @return The sequence number to pass to <code>senml_store_end_read</code>.
+ */
+static inline uint32_t senml_store_begin_read(const senml_store_sensor_t *sensor)
+{
+	uint32_t seq;
+	
+	while ((seq = __atomic_load_n(&sensor->seq, __ATOMIC_ACQUIRE)) % 2)
+		sched_yield();
+	
+	return seq;
+}
+
+
+/**
+ * @return true if what was read since <code>senml_store_begin_read</code> is consistent.
+ */
+static inline bool senml_store_end_read(const senml_store_sensor_t *sensor, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	
+	return __atomic_load_n(&sensor->seq, __ATOMIC_RELAXED) == seq;
+}
+
+
+static inline senml_store_chunk_t *senml_store_chunk(const senml_store_ring_t *ring, uint64_t n)
+{
+	return ring->chunks[n & (ring->size - 1)];
+}
+
+
+/*! The chunks of a sensor as a reader saw them, all loaded under the same sequence number */
+typedef struct {
+	const senml_store_ring_t *ring;   //!< NULL if the sensor has never had a sample
+	uint64_t                  first;  //!< Number of the oldest chunk
+	uint64_t                  next;   //!< Number of the chunk after the newest one
+	uint32_t                  fill;   //!< Samples in the newest chunk
+	uint32_t                  seq;    //!< Pass to <code>senml_store_end_read</code> once done
+} senml_store_view_t;
+
+
+/**
+ * Loads the chunks of a sensor and retries until they are consistent, so that the ring holds
+ * every chunk from first to next. The chunks are never released, so they can be followed after
+ * this, but the writer may reuse them: whatever is read from them only counts if
+ * <code>senml_store_end_read</code> succeeds afterwards.
+ */
+static inline void senml_store_view(const senml_store_sensor_t *sensor, senml_store_view_t *view)
+{
+	do {
+		view->seq   = senml_store_begin_read(sensor);
+		view->ring  = __atomic_load_n(&sensor->ring, __ATOMIC_RELAXED);
+		view->first = __atomic_load_n(&sensor->first, __ATOMIC_RELAXED);
+		view->next  = __atomic_load_n(&sensor->next, __ATOMIC_RELAXED);
+		view->fill  = __atomic_load_n(&sensor->fill, __ATOMIC_ACQUIRE);
+	} while (!senml_store_end_read(sensor, view->seq) ||
+	         (!view->ring && view->next != view->first));
+}
+
+
+senml_store_t *senml_store_new(const senml_store_opts_t *opts)
+{
+	senml_store_t *store = senml_malloc(sizeof(senml_store_t));
+	
+	if (!store)
+		return NULL;
+	
+	memset(store, 0, sizeof(senml_store_t));
+	store->empty   = true;
+	store->expires = INFINITY;
+	
+	if (opts)
+		store->opts = *opts;
+	
+	if (!(store->names = senml_names_new())) {
+		senml_free(store);
+		return NULL;
+	}
+	
+	return store;
+}
+
+
+void senml_store_free(senml_store_t *store)
+{
+	senml_store_chunk_t *chunk;
+	
+	if (!store)
+		return;
+	
+	for (uint32_t id = 0; id < senml_names_count(store->names); id++) {
+		senml_store_sensor_t *sensor = senml_store_sensor(store, id);
+		senml_store_ring_t   *ring;
+		
+		if (!sensor)
+			break;
+		
+		for (uint64_t n = sensor->first; n < sensor->next; n++)
+			senml_free(senml_store_chunk(sensor->ring, n));
+		
+		while ((ring = sensor->ring)) {
+			sensor->ring = ring->retired;
+			senml_free(ring);
+		}
+	}
+	
+	while ((chunk = store->free)) {
+		store->free = chunk->free_next;
+		senml_free(chunk);
+	}
+	
+	for (int block = 0; block < SENML_STORE_BLOCKS; block++)
+		senml_free(store->blocks[block]);
+	
+	senml_names_free(store->names);
+	senml_free(store);
+}
+
+
+size_t senml_store_size(const senml_store_t *store)
+{
+	return __atomic_load_n(&store->bytes, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Moves the oldest chunk of a sensor to the free list.
+ */
+static void senml_store_drop(senml_store_t *store, senml_store_sensor_t *sensor)
+{
+	senml_store_chunk_t *chunk = senml_store_chunk(sensor->ring, sensor->first);
+	
+	senml_store_begin_write(sensor);
+	__atomic_store_n(&sensor->first, sensor->first + 1, __ATOMIC_RELAXED);
+	senml_store_end_write(sensor);
+	
+	chunk->free_next = store->free;
+	store->free      = chunk;
+}
+
+
+/**
+ * Drops the chunks of a sensor whose samples are all before \p time.
+ * @return The time of the last sample of the oldest chunk that is kept, or INFINITY if none is.
+ */
+static double senml_store_expire_sensor(senml_store_t *store, senml_store_sensor_t *sensor,
+                                        double time)
+{
+	while (sensor->first < sensor->next) {
+		senml_store_chunk_t *chunk = senml_store_chunk(sensor->ring, sensor->first);
+		size_t               last  = sensor->first + 1 == sensor->next ? sensor->fill - 1 :
+		                             SENML_STORE_CHUNK - 1;
+		
+		if (!(chunk->times[last] < time))
+			return chunk->times[last];
+		
+		senml_store_drop(store, sensor);
+	}
+	
+	return INFINITY;
+}
+
+
+void senml_store_expire(senml_store_t *store, double time)
+{
+	double expires = INFINITY;
+	
+	for (uint32_t id = 0; id < senml_names_count(store->names); id++) {
+		senml_store_sensor_t *sensor = senml_store_sensor(store, id);
+		double                end;
+		
+		if (!sensor)
+			break;
+		
+		if ((end = senml_store_expire_sensor(store, sensor, time)) < expires)
+			expires = end;
+	}
+	
+	store->expires = expires;
+}
+
+
+/**
+ * Finds the sensor whose oldest chunk starts first. Every sensor is looked at, which only happens
+ * when the store is full and a chunk is needed, once per chunk at most.
+ * @return The sensor, or NULL if no sensor has a chunk.
+ */
+static senml_store_sensor_t *senml_store_oldest(senml_store_t *store)
+{
+	senml_store_sensor_t *oldest = NULL;
+	double                time   = 0;
+	
+	for (uint32_t id = 0; id < senml_names_count(store->names); id++) {
+		senml_store_sensor_t *sensor = senml_store_sensor(store, id);
+		
+		if (!sensor)
+			break;
+		
+		if (sensor->first == sensor->next)
+			continue;
+		
+		if (!oldest || senml_store_chunk(sensor->ring, sensor->first)->times[0] < time) {
+			oldest = sensor;
+			time   = senml_store_chunk(sensor->ring, sensor->first)->times[0];
+		}
+	}
+	
+	return oldest;
+}
+
+
+/**
+ * Takes a chunk from the free list, allocates one, or drops one according to the policy of the
+ * store when it is full.
+ * @return The chunk, or NULL if the store is full or memory could not be allocated.
+ */
+static senml_store_chunk_t *senml_store_take(senml_store_t *store, senml_store_sensor_t *sensor)
+{
+	senml_store_chunk_t  *chunk;
+	senml_store_sensor_t *victim = NULL;
+	
+	if (!store->free && store->opts.max_bytes &&
+	    store->bytes + sizeof(senml_store_chunk_t) > store->opts.max_bytes) {
+		if (store->opts.evict == SENML_STORE_EVICT_OLDEST)
+			victim = senml_store_oldest(store);
+		else if (store->opts.evict == SENML_STORE_EVICT_SENSOR && sensor->first < sensor->next)
+			victim = sensor;
+		
+		if (!victim) {
+			senml_error_set(SENML_ERROR_NO_SPACE, 0, "the store is full");
+			return NULL;
+		}
+		
+		senml_store_drop(store, victim);
+	}
+	
+	if ((chunk = store->free)) {
+		store->free = chunk->free_next;
+		return chunk;
+	}
+	
+	if ((chunk = senml_malloc(sizeof(senml_store_chunk_t))))
+		__atomic_store_n(&store->bytes, store->bytes + sizeof(senml_store_chunk_t),
+		                 __ATOMIC_RELAXED);
+	
+	return chunk;
+}
+
+
+/**
+ * Starts a new chunk with a sample.
+ * @return 0 on success, -2 if the store is full or memory could not be allocated.
+ */
+static int senml_store_add_chunk(senml_store_t *store, senml_store_sensor_t *sensor, double time,
+                                 double value)
+{
+	senml_store_ring_t  *ring = sensor->ring;
+	senml_store_chunk_t *chunk;
+	
+	if (!(chunk = senml_store_take(store, sensor)))
+		return -2;
+	
+	chunk->times[0]  = time;
+	chunk->values[0] = value;
+	
+	// a full ring is replaced by a larger one, which readers only see after the chunk is added
+	if (!ring || sensor->next - sensor->first == ring->size) {
+		size_t size = ring ? ring->size * 2 : SENML_STORE_MIN_RING;
+		
+		if (!(ring = senml_malloc(sizeof(senml_store_ring_t) +
+		                          sizeof(senml_store_chunk_t *) * size))) {
+			chunk->free_next = store->free;
+			store->free      = chunk;
+			return -2;
+		}
+		
+		// readers with a stale view may look at any slot, which must not hold garbage
+		memset(ring->chunks, 0, sizeof(senml_store_chunk_t *) * size);
+		ring->size    = size;
+		ring->retired = sensor->ring;
+		
+		for (uint64_t n = sensor->first; n < sensor->next; n++)
+			ring->chunks[n & (size - 1)] = senml_store_chunk(sensor->ring, n);
+	}
+	
+	// the oldest chunk of a sensor only ends later as it fills, unless the sensor had none
+	if (sensor->first == sensor->next && time < store->expires)
+		store->expires = time;
+	
+	senml_store_begin_write(sensor);
+	ring->chunks[sensor->next & (ring->size - 1)] = chunk;
+	__atomic_store_n(&sensor->ring, ring, __ATOMIC_RELAXED);
+	__atomic_store_n(&sensor->next, sensor->next + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&sensor->fill, 1, __ATOMIC_RELAXED);
+	senml_store_end_write(sensor);
+	
+	return 0;
+}
+
+
+/**
+ * Appends a sample to a sensor.
+ * @return 0 on success, -1 if the time is not a number or before the newest sample of the
+ * sensor, -2 if the store is full or memory could not be allocated.
+ */
+static int senml_store_append(senml_store_t *store, senml_store_sensor_t *sensor, double time,
+                              double value)
+{
+	senml_store_chunk_t *chunk;
+	
+	if (time != time) {
+		senml_error_set(SENML_ERROR_RECORD, 0, "time is not a number");
+		return -1;
+	}
+	
+	if (sensor->first < sensor->next && time < sensor->last_time) {
+		senml_error_set(SENML_ERROR_RECORD, 0, "time %.17g is before the newest sample", time);
+		return -1;
+	}
+	
+	if (store->empty || time > store->newest)
+		store->newest = time;
+	
+	store->empty      = false;
+	sensor->last_time = time;
+	
+	// samples of every sensor age with the newest one, but the sensors are only walked once the
+	// oldest chunk of one of them may have expired
+	if (store->opts.max_age > 0 && store->expires < store->newest - store->opts.max_age)
+		senml_store_expire(store, store->newest - store->opts.max_age);
+	
+	if (sensor->first == sensor->next || sensor->fill == SENML_STORE_CHUNK)
+		return senml_store_add_chunk(store, sensor, time, value);
+	
+	// the sample is written before the fill that lets readers see it
+	chunk                       = senml_store_chunk(sensor->ring, sensor->next - 1);
+	chunk->times[sensor->fill]  = time;
+	chunk->values[sensor->fill] = value;
+	__atomic_store_n(&sensor->fill, sensor->fill + 1, __ATOMIC_RELEASE);
+	
+	return 0;
+}
+
+
+/**
+ * Finds the sensor of a resolved name and adds it if it is not known yet.
+ * @return The sensor, or NULL if memory could not be allocated.
+ */
+static senml_store_sensor_t *senml_store_intern(senml_store_t *store, senml_str_t base_name,
+                                                senml_str_t name)
+{
+	uint32_t              id;
+	uint64_t              position;
+	int                   block;
+	senml_store_sensor_t *sensors;
+	
+	if (senml_names_intern_parts(store->names, base_name, name, &id, NULL))
+		return NULL;
+	
+	position = (uint64_t)id / SENML_STORE_FIRST_BLOCK + 1;
+	block    = 63 - __builtin_clzll(position);
+	
+	if (!store->blocks[block]) {
+		size_t size = sizeof(senml_store_sensor_t) * ((size_t)SENML_STORE_FIRST_BLOCK << block);
+		
+		if (!(sensors = senml_malloc(size)))
+			return NULL;
+		
+		memset(sensors, 0, size);
+		__atomic_store_n(&store->blocks[block], sensors, __ATOMIC_RELEASE);
+	}
+	
+	return senml_store_sensor(store, id);
+}
+
+
+int senml_store_add(senml_store_t *store, const senml_pack_t *pack)
+{
+	const senml_base_info_t *base_info = pack->base_info;
+	senml_str_t              base_name = { .p = "", .len = 0 };
+	double                   base_time = 0, base_value = 0;
+	
+	if (base_info) {
+		if (base_info->base_name || base_info->base_name_view.p)
+			base_name = senml_str_of(base_info->base_name, &base_info->base_name_view);
+		
+		base_time = base_info->base_time;
+		
+		if (base_info->base_value_type == SENML_TYPE_FLOAT)
+			base_value = base_info->base_value.base_value_f;
+	}
+	
+	for (size_t i = 0; i < pack->num; i++) {
+		const senml_record_t *record = &pack->records[i];
+		senml_str_t           name   = { .p = "", .len = 0 };
+		senml_store_sensor_t *sensor;
+		int                   rc;
+		
+		if (record->value_type != SENML_TYPE_FLOAT)
+			continue;
+		
+		if (record->name || record->name_view.p)
+			name = senml_str_of(record->name, &record->name_view);
+		
+		if (!(sensor = senml_store_intern(store, base_name, name)))
+			rc = -2;
+		else
+			rc = senml_store_append(store, sensor, base_time + record->time,
+			                        base_value + record->value.value_f);
+		
+		if (rc) {
+			senml_error_current()->record = i + 1;
+			return rc;
+		}
+	}
+	
+	return 0;
+}
+
+
+bool senml_store_latest(const senml_store_t *store, const char *name, double *time,
+                        double *value)
+{
+	const senml_store_sensor_t *sensor = senml_store_find(store, name);
+	const senml_store_chunk_t  *chunk;
+	senml_store_view_t          view;
+	bool                        found;
+	
+	if (!sensor)
+		return false;
+	
+	do {
+		senml_store_view(sensor, &view);
+		found = view.next != view.first;
+		
+		if (found && (chunk = senml_store_chunk(view.ring, view.next - 1))) {
+			*time  = chunk->times[view.fill - 1];
+			*value = chunk->values[view.fill - 1];
+		}
+	} while (!senml_store_end_read(sensor, view.seq));
+	
+	return found;
+}
+
+
+/**
+ * Finds the first index in \p times, sorted and \p count long, whose time is not before \p time.
+ */
+static inline size_t senml_store_lower_bound(const double *times, size_t count, double time)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		
+		if (times[mid] < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+
+/**
+ * Finds the chunk the first sample at or after \p time may be in: the last one that starts before
+ * it, or the oldest one.
+ * @return The number of the chunk, or <code>sensor->next</code> if the sensor has none.
+ */
+static uint64_t senml_store_seek(const senml_store_sensor_t *sensor, double time)
+{
+	const senml_store_chunk_t *chunk;
+	senml_store_view_t         view;
+	uint64_t                   lo, hi;
+	
+	do {
+		senml_store_view(sensor, &view);
+		lo = view.first;
+		hi = view.next;
+		
+		while (lo < hi && (chunk = senml_store_chunk(view.ring, lo + (hi - lo) / 2))) {
+			if (chunk->times[0] < time)
+				lo = lo + (hi - lo) / 2 + 1;
+			else
+				hi = lo + (hi - lo) / 2;
+		}
+		
+		if (lo > view.first)
+			lo--;
+	} while (!senml_store_end_read(sensor, view.seq));
+	
+	return lo;
+}
+
+
+int senml_store_range(const senml_store_t *store, const char *name, double t0, double t1,
+                      senml_sample_cb_t callback, void *ctx)
+{
+	const senml_store_sensor_t *sensor = senml_store_find(store, name);
+	const senml_store_chunk_t  *chunk;
+	senml_store_view_t          view;
+	double                      times[SENML_STORE_CHUNK];
+	double                      values[SENML_STORE_CHUNK];
+	size_t                      count, begin, end;
+	
+	senml_error_clear();
+	
+	if (!sensor || !(t0 < t1))
+		return 0;
+	
+	for (uint64_t n = senml_store_seek(sensor, t0); ; n++) {
+		// the chunk is copied, so the callback runs without holding up the writer
+		do {
+			senml_store_view(sensor, &view);
+			
+			// chunks dropped meanwhile are skipped
+			if (n < view.first)
+				n = view.first;
+			
+			count = n >= view.next ? 0 : n + 1 == view.next ? view.fill : SENML_STORE_CHUNK;
+			
+			if (count > 0 && (chunk = senml_store_chunk(view.ring, n))) {
+				memcpy(times, chunk->times, sizeof(double) * count);
+				memcpy(values, chunk->values, sizeof(double) * count);
+			}
+		} while (!senml_store_end_read(sensor, view.seq));
+		
+		if (count == 0)
+			return 0;
+		
+		begin = senml_store_lower_bound(times, count, t0);
+		end   = senml_store_lower_bound(times, count, t1);
+		
+		if (end > begin && callback(times + begin, values + begin, end - begin, ctx)) {
+			if (senml_error_current()->code == SENML_OK)
+				senml_error_set(SENML_ERROR_CALLBACK, 0, "the callback stopped the range scan");
+			
+			return -1;
+		}
+		
+		if (end < count)
+			return 0;
+	}
+}
@@ -0,0 +1,174 @@
+#include "senml.h"
+#include "senml_private.h"
+
+#include <string.h>
+
+
+/*
+ * A template is a pack encoded once with the values that change cut out. JSON numbers have no
+ * fixed width, so a JSON image is kept without them and every encode copies the runs between the
+ * slots to the output, formatting the values in between. A CBOR image is a complete document with
+ * placeholders of fixed width, which every encode overwrites in place.
+ */
+struct senml_template {
+	bool           cbor;   //!< The image is CBOR rather than JSON
+	size_t         num;    //!< Number of records of the pack the template was made from
+	senml_slots_t  slots;  //!< In the order of their offsets
+	char          *image;
+	size_t         len;    //!< Length of the image, for JSON without the values
+	char          *out;    //!< Output of a JSON template, NULL for CBOR
+	size_t         cap;    //!< Size of out, enough for every value at its longest
+};
+
+
+static senml_template_t *senml_template_new(const senml_pack_t *pack, unsigned int fields,
+                                            bool cbor)
+{
+	senml_template_t *tmpl;
+	senml_writer_t    w = { 0 };
+	senml_call_t      call;
+	int               rc;
+	
+	senml_call_begin(&call);
+	
+	if (!(tmpl = senml_malloc(sizeof(senml_template_t)))) {
+		senml_call_encoded(&call, 0, 0, -2);
+		return NULL;
+	}
+	
+	memset(tmpl, 0, sizeof(*tmpl));
+	tmpl->cbor         = cbor;
+	tmpl->num          = pack->num;
+	tmpl->slots.fields = (fields ? fields : SENML_FIELD_TIME | SENML_FIELD_VALUE) &
+	                     (SENML_FIELD_TIME | SENML_FIELD_UPDATE_TIME | SENML_FIELD_VALUE);
+	
+	// a record has at most one slot per attribute that can change
+	if (pack->num > 0 &&
+	    !(tmpl->slots.slots = senml_malloc(sizeof(senml_slot_t) * 3 * pack->num))) {
+		rc = -2;
+		goto done;
+	}
+	
+	if (cbor)
+		rc = senml_cbor_put_template(&w, pack, &tmpl->slots);
+	else
+		rc = senml_json_put_template(&w, pack, &tmpl->slots);
+	
+	// the buffer only overflows if it could not grow
+	if (rc == 0 && w.overflow)
+		rc = -2;
+	
+	if (rc)
+		goto done;
+	
+	tmpl->image = w.buf;
+	tmpl->len   = w.len;
+	w.buf       = NULL;
+	
+	// the writers reserve room for a whole number before they format it
+	if (!cbor) {
+		tmpl->cap = tmpl->len + tmpl->slots.count * SENML_DOUBLE_MAX_LEN + 1;
+		
+		if (!(tmpl->out = senml_malloc(tmpl->cap)))
+			rc = -2;
+	}
+	
+	done:
+	senml_call_encoded(&call, rc ? 0 : tmpl->len, pack->num, rc);
+	
+	if (rc) {
+		senml_free(w.buf);
+		senml_template_free(tmpl);
+		return NULL;
+	}
+	
+	return tmpl;
+}
+
+
+senml_template_t *senml_template_json(const senml_pack_t *pack, unsigned int fields)
+{
+	return senml_template_new(pack, fields, false);
+}
+
+
+senml_template_t *senml_template_cbor(const senml_pack_t *pack, unsigned int fields)
+{
+	return senml_template_new(pack, fields, true);
+}
+
+
+const void *senml_template_encode(senml_template_t *tmpl, const senml_pack_t *pack, size_t *len)
+{
+	senml_writer_t w = {
+		.buf   = tmpl->out,
+		.len   = 0,
+		.cap   = tmpl->cap,
+		.fixed = true
+	};
+	
+	senml_call_t call;
+	size_t       at = 0;
+	int          rc = 0;
+	
+	senml_call_begin(&call);
+	
+	if (pack->num != tmpl->num) {
+		senml_error_set(SENML_ERROR_INVALID_PACK, 0, "the pack has %zu records, the template %zu",
+		                pack->num, tmpl->num);
+		rc = -1;
+	}
+	
+	for (size_t i = 0; rc == 0 && i < tmpl->slots.count; i++) {
+		const senml_slot_t   *slot   = &tmpl->slots.slots[i];
+		const senml_record_t *record = &pack->records[slot->record];
+		
+		if ((slot->kind == SENML_SLOT_FLOAT && record->value_type != SENML_TYPE_FLOAT) ||
+		    (slot->kind == SENML_SLOT_BOOL && record->value_type != SENML_TYPE_BOOL)) {
+			senml_error_set(SENML_ERROR_INVALID_PACK, slot->record + 1,
+			                "value type differs from the template");
+			rc = -1;
+		} else if (tmpl->cbor) {
+			senml_cbor_patch_slot(tmpl->image, slot, record);
+		} else {
+			senml_writer_put(&w, tmpl->image + at, slot->offset - at);
+			at = slot->offset;
+			
+			if (senml_json_put_slot(&w, slot, record)) {
+				senml_error_current()->record = slot->record + 1;
+				rc = -1;
+			}
+		}
+	}
+	
+	if (rc == 0 && !tmpl->cbor) {
+		senml_writer_put(&w, tmpl->image + at, tmpl->len - at);
+		senml_writer_putc(&w, '\0');
+	}
+	
+	senml_call_encoded(&call, rc ? 0 : tmpl->cbor ? tmpl->len : w.len - 1, pack->num, rc);
+	
+	if (rc)
+		return NULL;
+	
+	if (tmpl->cbor) {
+		*len = tmpl->len;
+		return tmpl->image;
+	}
+	
+	*len = w.len - 1;
+	
+	return w.buf;
+}
+
+
+void senml_template_free(senml_template_t *tmpl)
+{
+	if (!tmpl)
+		return;
+	
+	senml_free(tmpl->slots.slots);
+	senml_free(tmpl->image);
+	senml_free(tmpl->out);
+	senml_free(tmpl);
+}
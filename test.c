@@ -0,0 +1,2542 @@
+/*
+ * Tests of the library.
+ *
+ * Every case checks one property and reports each failed check with its line, the process exits
+ * with a non-zero status if any check failed.
+ *
+ * Usage: senml_test [--filter=SUBSTRING]
+ */
+
+#include "senml.h"
+#include "senml_private.h"
+#include "senml_jansson.h"
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*! One test case */
+typedef struct {
+	const char  *name;
+	void       (*run)(void);
+} test_case_t;
+
+
+/*! A document both decoders handle differently, on purpose or because of jansson */
+typedef struct {
+	const char          *json;
+	senml_error_code_t   native;   //!< Error of the native decoder, SENML_OK if it decodes
+	senml_error_code_t   jansson;  //!< Error of the jansson decoder, SENML_OK if it decodes
+} test_divergence_t;
+
+
+static unsigned int test_checks;    //!< Checks made by the current case
+static unsigned int test_failures;  //!< Checks of the current case that failed
+static size_t       test_allocs;    //!< Calls of malloc and realloc made by the library
+static size_t       test_blocks;    //!< Blocks the library allocated and has not freed yet
+
+
+#define TEST_CHECK(cond, ...)                                                                     \
+	do {                                                                                          \
+		test_checks++;                                                                            \
+		                                                                                          \
+		if (!(cond)) {                                                                            \
+			test_failures++;                                                                      \
+			printf("  line %d: %s: ", __LINE__, #cond);                                           \
+			printf(__VA_ARGS__);                                                                  \
+			printf("\n");                                                                         \
+		}                                                                                         \
+	} while (0)
+
+
+static void *test_malloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	void *ptr = malloc(size);
+	
+	__atomic_add_fetch(&test_allocs, 1, __ATOMIC_RELAXED);
+	
+	if (ptr)
+		__atomic_add_fetch(&test_blocks, 1, __ATOMIC_RELAXED);
+	
+	return ptr;
+}
+
+
+static void *test_realloc(void *ptr, size_t size, void *ctx)
+{
+	(void)ctx;
+	void *moved = realloc(ptr, size);
+	
+	__atomic_add_fetch(&test_allocs, 1, __ATOMIC_RELAXED);
+	
+	if (!ptr && moved)
+		__atomic_add_fetch(&test_blocks, 1, __ATOMIC_RELAXED);
+	
+	return moved;
+}
+
+
+static void test_free(void *ptr, void *ctx)
+{
+	(void)ctx;
+	
+	if (ptr)
+		__atomic_sub_fetch(&test_blocks, 1, __ATOMIC_RELAXED);
+	
+	free(ptr);
+}
+
+
+/*
+ * Documents the native decoder has to decode exactly like the jansson decoder. Syntax errors are
+ * all reported as SENML_ERROR_SYNTAX by jansson, without the record they occur in, while the
+ * native decoder tells some of them apart.
+ */
+static const char *const test_json_corpus[] = {
+	"[]",
+	" [ ] ",
+	"[{}]",
+	"[{\"n\":\"a\",\"v\":1}]",
+	" [ { \"n\" : \"a\" , \"v\" : 1 } ] \n",
+	"[{\"n\":\"a\",\"u\":\"Cel\",\"t\":1.5,\"ut\":10,\"v\":3}]",
+	"[{\"n\":\"a\",\"vb\":false},{\"n\":\"b\",\"vb\":true},{\"n\":\"c\",\"vs\":\"hi\"}]",
+	"[{\"bn\":\"dev/\",\"bt\":100,\"bu\":\"V\",\"bver\":5},{\"n\":\"x\",\"v\":1}]",
+	"[{\"bn\":\"dev/\",\"n\":\"x\",\"v\":1},{\"n\":\"y\",\"vb\":true}]",
+	"[{\"n\":\"a\",\"n\":\"b\",\"v\":1}]",
+	"[{\"n\":\"a\",\"v\":1,\"vs\":\"s\"}]",
+	"[{\"n\":\"a\",\"vs\":\"s\",\"v\":1}]",
+	"[{\"n\":\"a\",\"x\":[1,{\"y\":null},\"z\"],\"v\":1}]",
+	
+	// escapes and UTF-8
+	"[{\"n\":\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\",\"v\":1}]",
+	"[{\"n\":\"\\u0041\\u00e9\\u20ac\",\"vs\":\"\\u007f\"}]",
+	"[{\"n\":\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\",\"v\":1}]",
+	"[{\"n\":\"\\ud83d\\ude00\",\"vs\":\"x\\uD834\\uDD1Ey\"}]",
+	"[{\"n\":\"\\ud83d\",\"v\":1}]",
+	"[{\"n\":\"\\ude00\",\"v\":1}]",
+	"[{\"n\":\"\\ud83d\\u0041\",\"v\":1}]",
+	"[{\"n\":\"\\u0000x\",\"v\":1}]",
+	"[{\"n\":\"a\\x\",\"v\":1}]",
+	"[{\"n\":\"a\\u12\",\"v\":1}]",
+	"[{\"n\":\"a\tb\",\"v\":1}]",
+	"[{\"n\":\"\xff\",\"v\":1}]",
+	"[{\"n\":\"\xc3\",\"v\":1}]",
+	"[{\"n\":\"\xed\xa0\x80\",\"v\":1}]",
+	"[{\"n\":\"\xc0\xaf\",\"v\":1}]",
+	
+	// numbers
+	"[{\"v\":0},{\"v\":-0.0},{\"v\":0e0},{\"v\":1E+2},{\"v\":1e-2},{\"v\":-12.5e-3}]",
+	"[{\"v\":1e308},{\"v\":1.7976931348623157e308},{\"v\":1.7976931348623158e308}]",
+	"[{\"v\":4.9e-324},{\"v\":2.4703282292062328e-324},{\"v\":1e-400}]",
+	"[{\"v\":2.2250738585072011e-308},{\"v\":2.2250738585072014e-308}]",
+	"[{\"v\":9007199254740993},{\"v\":-9223372036854775808},{\"v\":9223372036854775807}]",
+	"[{\"v\":0.1000000000000000055511151231257827},{\"v\":1e23},{\"v\":8.41e21}]",
+	"[{\"v\":1e400}]",
+	"[{\"v\":-1e400}]",
+	"[{\"v\":1.7976931348623159e308}]",
+	"[{\"v\":01}]",
+	"[{\"v\":1.}]",
+	"[{\"v\":.5}]",
+	"[{\"v\":+1}]",
+	"[{\"v\":1e}]",
+	"[{\"v\":1e+}]",
+	"[{\"v\":-}]",
+	"[{\"v\":NaN}]",
+	"[{\"v\":Infinity}]",
+	
+	// records of the wrong shape
+	"[{\"n\":\"a\",\"vb\":1}]",
+	"[{\"n\":\"a\",\"v\":\"1\"}]",
+	"[{\"n\":1,\"v\":1}]",
+	"[{\"n\":\"a\",\"u\":1}]",
+	"[{\"n\":\"a\",\"t\":\"x\"}]",
+	"[{\"bver\":255,\"n\":\"a\",\"ut\":4294967295.5},{\"n\":\"b\",\"ut\":0}]",
+	"[{\"bver\":300,\"n\":\"a\"}]",
+	"[{\"bver\":-1,\"n\":\"a\"}]",
+	"[{\"n\":\"a\",\"ut\":-5}]",
+	"[{\"n\":\"a\",\"ut\":4294967296}]",
+	"[{\"n\":\"a\",\"ut\":1e30}]",
+	"[{\"bn\":1},{\"n\":\"a\"}]",
+	"[{\"n\":\"a\",\"v\":1},2]",
+	"[{\"n\":\"a\",\"v\":1},[]]",
+	"{\"n\":\"a\"}",
+	
+	// malformed documents
+	"[",
+	"[{\"n\":\"a\",\"v\":1}",
+	"[{\"n\":\"a\",\"v\":1},",
+	"[{\"n\":\"a\",\"v\":1}]]",
+	"[{\"n\":\"a\",\"v\":1}] x",
+	"[{\"n\":\"a\" \"v\":1}]",
+	"[{\"n\":\"a\",}]",
+	"[{\"n\":\"a\",\"v\":1,}]",
+	"[{\"n\":\"a\",\"v\":tru}]",
+	"[{\"n\" 1}]",
+	"[{\"n\":\"a",
+};
+
+
+/*! Where the decoders differ, kept here so that a change of either is noticed */
+static const test_divergence_t test_json_divergences[] = {
+	// integers outside of json_int_t are too big for jansson, the native decoder converts them
+	{ "[{\"v\":12345678901234567890123}]", SENML_OK, SENML_ERROR_SYNTAX },
+	
+	// jansson only decodes arrays and objects without JSON_DECODE_ANY
+	{ "\"x\"", SENML_ERROR_NOT_ARRAY, SENML_ERROR_SYNTAX },
+	{ "", SENML_ERROR_NOT_ARRAY, SENML_ERROR_SYNTAX },
+	
+	// numbers of attributes the native decoder skips are not converted, so they cannot overflow
+	{ "[{\"n\":\"a\",\"x\":1e400,\"v\":1}]", SENML_OK, SENML_ERROR_SYNTAX },
+	
+	// jansson parses the whole document first, the native decoder stops at the first invalid record
+	{ "[{\"n\":1,\"v\":1}", SENML_ERROR_RECORD, SENML_ERROR_SYNTAX },
+};
+
+
+/**
+ * Compares two strings that may be set in either form, see <code>senml_str_of</code>.
+ */
+static bool test_same_str(const char *a, const senml_str_t *a_view, const char *b,
+                          const senml_str_t *b_view)
+{
+	senml_str_t x = senml_str_of(a, a_view);
+	senml_str_t y = senml_str_of(b, b_view);
+	
+	if (!x.p || !y.p)
+		return !x.p && !y.p;
+	
+	return x.len == y.len && memcmp(x.p, y.p, x.len) == 0;
+}
+
+
+/**
+ * Compares two decoded packs, numbers bit by bit.
+ * @return NULL if they are the same, otherwise the first attribute that differs.
+ */
+static const char *test_same_pack(const senml_pack_t *a, const senml_pack_t *b)
+{
+	if (a->num != b->num)
+		return "number of records";
+	
+	if (!a->base_info != !b->base_info)
+		return "base info";
+	
+	if (a->base_info) {
+		const senml_base_info_t *x = a->base_info;
+		const senml_base_info_t *y = b->base_info;
+		
+		if (x->version != y->version)
+			return "bver";
+		
+		if (memcmp(&x->base_time, &y->base_time, sizeof(double)) != 0)
+			return "bt";
+		
+		if (!test_same_str(x->base_name, &x->base_name_view, y->base_name, &y->base_name_view))
+			return "bn";
+		
+		if (!test_same_str(x->base_unit, &x->base_unit_view, y->base_unit, &y->base_unit_view))
+			return "bu";
+	}
+	
+	for (size_t i = 0; i < a->num; i++) {
+		const senml_record_t *x = &a->records[i];
+		const senml_record_t *y = &b->records[i];
+		
+		if (!test_same_str(x->name, &x->name_view, y->name, &y->name_view))
+			return "n";
+		
+		if (!test_same_str(x->unit, &x->unit_view, y->unit, &y->unit_view))
+			return "u";
+		
+		if (memcmp(&x->time, &y->time, sizeof(double)) != 0)
+			return "t";
+		
+		if (x->update_time != y->update_time)
+			return "ut";
+		
+		if (x->value_type != y->value_type)
+			return "value type";
+		
+		if (x->value_type == SENML_TYPE_FLOAT &&
+		    memcmp(&x->value.value_f, &y->value.value_f, sizeof(double)) != 0)
+			return "v";
+		
+		if (x->value_type == SENML_TYPE_BOOL && x->value.value_b != y->value.value_b)
+			return "vb";
+		
+		if (x->value_type == SENML_TYPE_STRING &&
+		    !test_same_str(x->value.value_s, &x->value_view, y->value.value_s, &y->value_view))
+			return "vs";
+	}
+	
+	return NULL;
+}
+
+
+/**
+ * Maps the errors only the native decoder tells apart to the code jansson reports for them.
+ */
+static senml_error_code_t test_jansson_code(senml_error_code_t code)
+{
+	if (code == SENML_ERROR_TRUNCATED || code == SENML_ERROR_TRAILING || code == SENML_ERROR_DEPTH)
+		return SENML_ERROR_SYNTAX;
+	
+	return code;
+}
+
+
+static void test_json_differential(void)
+{
+	for (size_t i = 0; i < sizeof(test_json_corpus) / sizeof(test_json_corpus[0]); i++) {
+		const char   *json = test_json_corpus[i];
+		size_t        len  = strlen(json);
+		senml_pack_t *native;
+		senml_pack_t *jansson;
+		senml_error_t native_error;
+		senml_error_t jansson_error;
+		
+		native        = senml_decode_json(json, len);
+		native_error  = *senml_last_error();
+		jansson       = senml_decode_json_jansson(json, len);
+		jansson_error = *senml_last_error();
+		
+		TEST_CHECK(!native == !jansson, "%s: native %s, jansson %s", json,
+		           native ? "decodes" : native_error.message,
+		           jansson ? "decodes" : jansson_error.message);
+		
+		if (native && jansson) {
+			const char *diff = test_same_pack(native, jansson);
+			
+			TEST_CHECK(!diff, "%s: %s differs", json, diff);
+		} else if (!native && !jansson) {
+			TEST_CHECK(test_jansson_code(native_error.code) == jansson_error.code,
+			           "%s: native %s, jansson %s", json, senml_error_string(native_error.code),
+			           senml_error_string(jansson_error.code));
+			TEST_CHECK(jansson_error.code != SENML_ERROR_RECORD ||
+			           native_error.record == jansson_error.record,
+			           "%s: native record %zu, jansson record %zu", json, native_error.record,
+			           jansson_error.record);
+		}
+		
+		senml_pack_free(native);
+		senml_pack_free(jansson);
+	}
+}
+
+
+static void test_json_divergence(void)
+{
+	for (size_t i = 0; i < sizeof(test_json_divergences) / sizeof(test_json_divergences[0]); i++) {
+		const test_divergence_t *test = &test_json_divergences[i];
+		senml_pack_t            *pack;
+		
+		pack = senml_decode_json(test->json, 0);
+		TEST_CHECK(senml_last_error()->code == test->native, "%s: native %s", test->json,
+		           senml_error_string(senml_last_error()->code));
+		senml_pack_free(pack);
+		
+		pack = senml_decode_json_jansson(test->json, 0);
+		TEST_CHECK(senml_last_error()->code == test->jansson, "%s: jansson %s", test->json,
+		           senml_error_string(senml_last_error()->code));
+		senml_pack_free(pack);
+	}
+	
+	// jansson reads -0 as the integer 0, the native decoder keeps the sign
+	senml_pack_t *native  = senml_decode_json("[{\"v\":-0}]", 0);
+	senml_pack_t *jansson = senml_decode_json_jansson("[{\"v\":-0}]", 0);
+	
+	TEST_CHECK(native && signbit(native->records[0].value.value_f), "native -0 is not negative");
+	TEST_CHECK(jansson && !signbit(jansson->records[0].value.value_f), "jansson -0 is negative");
+	senml_pack_free(native);
+	senml_pack_free(jansson);
+	
+	// numbers that overflow are rejected by both, the native decoder does not return infinity
+	native = senml_decode_json("[{\"v\":1e400}]", 0);
+	TEST_CHECK(!native && senml_last_error()->code == SENML_ERROR_SYNTAX, "1e400 decodes");
+	senml_pack_free(native);
+}
+
+
+/**
+ * Nests arrays in an attribute of a record, the limit of jansson covers the whole document.
+ */
+static char *test_json_nested(size_t depth)
+{
+	static const char head[] = "[{\"n\":\"a\",\"x\":";
+	static const char tail[] = ",\"v\":1}]";
+	
+	char *json = malloc(sizeof(head) + sizeof(tail) + depth * 2);
+	char *p    = json;
+	
+	if (!json)
+		return NULL;
+	
+	memcpy(p, head, sizeof(head) - 1);
+	p += sizeof(head) - 1;
+	memset(p, '[', depth);
+	memset(p + depth, ']', depth);
+	p += depth * 2;
+	memcpy(p, tail, sizeof(tail));
+	
+	return json;
+}
+
+
+static void test_json_depth(void)
+{
+	// the array and the record are two of the levels
+	for (size_t depth = SENML_JSON_MAX_DEPTH - 3; depth <= SENML_JSON_MAX_DEPTH - 1; depth++) {
+		char         *json = test_json_nested(depth);
+		senml_pack_t *native;
+		senml_pack_t *jansson;
+		
+		if (!json)
+			continue;
+		
+		native  = senml_decode_json(json, 0);
+		jansson = senml_decode_json_jansson(json, 0);
+		
+		TEST_CHECK(!native == !jansson, "depth %zu: native %s, jansson %s", depth,
+		           native ? "decodes" : "fails", jansson ? "decodes" : "fails");
+		TEST_CHECK(!native == (depth + 2 > SENML_JSON_MAX_DEPTH), "depth %zu", depth);
+		TEST_CHECK(!native == (senml_validate_json(json, 0, NULL) != 0),
+		           "depth %zu: the validator disagrees", depth);
+		
+		senml_pack_free(native);
+		senml_pack_free(jansson);
+		free(json);
+	}
+}
+
+
+static void test_json_presize(void)
+{
+	static const char json[] = "[{\"n\":\"a\",\"v\":1},{\"n\":\"b\",\"v\":2},{\"n\":\"c\",\"v\":3}]";
+	
+	senml_decode_opts_t opts = { .flags = SENML_DECODE_PRESIZE };
+	senml_pack_t       *plain, *presized;
+	size_t              allocs;
+	
+	// the first pass changes neither the pack nor the error of a document
+	for (size_t i = 0; i < sizeof(test_json_corpus) / sizeof(test_json_corpus[0]); i++) {
+		const char *input = test_json_corpus[i];
+		senml_error_t error;
+		
+		plain    = senml_decode_json(input, 0);
+		error    = *senml_last_error();
+		presized = senml_decode_json_ex(input, 0, &opts);
+		
+		TEST_CHECK(!plain == !presized, "%s: plain %s, presized %s", input,
+		           plain ? "decodes" : "fails", presized ? "decodes" : "fails");
+		TEST_CHECK(plain || presized || error.code == senml_last_error()->code,
+		           "%s: plain error %d, presized %d", input, error.code,
+		           senml_last_error()->code);
+		
+		if (plain && presized) {
+			const char *diff = test_same_pack(plain, presized);
+			
+			TEST_CHECK(!diff, "%s: %s", input, diff);
+		}
+		
+		senml_pack_free(plain);
+		senml_pack_free(presized);
+	}
+	
+	// the first pass finds a syntax error after an invalid record, as jansson does
+	presized = senml_decode_json_ex("[{\"n\":1,\"v\":1}", 0, &opts);
+	TEST_CHECK(!presized && senml_last_error()->code == SENML_ERROR_TRUNCATED, "%s",
+	           senml_last_error()->message);
+	
+	// limits fail a presized document before anything is allocated
+	opts.max_records = 2;
+	allocs           = test_allocs;
+	presized         = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(!presized && senml_last_error()->code == SENML_ERROR_NO_SPACE &&
+	           senml_last_error()->record == 3, "%s", senml_last_error()->message);
+	TEST_CHECK(test_allocs == allocs, "%zu allocations", test_allocs - allocs);
+	
+	opts.flags = 0;
+	plain      = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(!plain && senml_last_error()->code == SENML_ERROR_NO_SPACE &&
+	           senml_last_error()->record == 3, "%s", senml_last_error()->message);
+	
+	opts.max_records = 3;
+	plain            = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(plain && plain->num == 3, "%s", senml_last_error()->message);
+	senml_pack_free(plain);
+	
+	opts.flags     = SENML_DECODE_PRESIZE;
+	opts.max_bytes = 64;
+	allocs         = test_allocs;
+	presized       = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(!presized && senml_last_error()->code == SENML_ERROR_NO_SPACE, "%s",
+	           senml_last_error()->message);
+	TEST_CHECK(test_allocs == allocs, "%zu allocations", test_allocs - allocs);
+}
+
+
+/**
+ * Runs the functions that promise not to allocate, on success and on failure.
+ * @return The number of allocations they made.
+ */
+static size_t test_heap_free_calls(void)
+{
+	static const char json[] = "[{\"bn\":\"dev\\/\",\"bt\":1.5,\"bu\":\"Cel\"},"
+	                           "{\"n\":\"a\\u00e9\",\"v\":21.25},{\"n\":\"b\",\"vb\":true},"
+	                           "{\"n\":\"c\",\"vs\":\"x\\ty\"}]";
+	
+	char               arena[1024];
+	senml_record_t     records[8];
+	senml_base_info_t  base_info;
+	char               json_out[512];
+	unsigned char      cbor_out[512];
+	size_t             cbor_len = sizeof(cbor_out);
+	size_t             allocs   = test_allocs;
+	senml_pack_t       pack     = {
+		.base_info = &base_info,
+		.records   = records,
+		.num       = 8,
+		.arena     = senml_arena_init(arena, sizeof(arena))
+	};
+	
+	// the escaped strings are unescaped into the arena
+	TEST_CHECK(senml_decode_json_s(json, &pack) == 0, "%s", senml_last_error()->message);
+	TEST_CHECK(pack.num == 4, "%zu records", pack.num);
+	TEST_CHECK(senml_encode_json_s(&pack, json_out, sizeof(json_out)) == 0, "%s",
+	           senml_last_error()->message);
+	TEST_CHECK(senml_encode_cbor_s(&pack, cbor_out, &cbor_len) == 0, "%s",
+	           senml_last_error()->message);
+	
+	// running out of space is reported without falling back to the heap
+	TEST_CHECK(senml_encode_json_s(&pack, json_out, 16) == -2, "small JSON buffer");
+	cbor_len = 16;
+	TEST_CHECK(senml_encode_cbor_s(&pack, cbor_out, &cbor_len) == -2, "small CBOR buffer");
+	pack.num = 2;
+	TEST_CHECK(senml_decode_json_s(json, &pack) == -2, "too many records");
+	pack.num = 8;
+	TEST_CHECK(senml_decode_json_s("[{\"n\":\"a\",", &pack) == -1, "truncated document");
+	
+	return test_allocs - allocs;
+}
+
+
+static void test_heap_free(void)
+{
+	size_t allocs = test_heap_free_calls();
+	
+	TEST_CHECK(allocs == 0, "%zu allocations", allocs);
+	
+	senml_stats_enable(SENML_STATS_COUNTERS | SENML_STATS_TIMING);
+	allocs = test_heap_free_calls();
+	senml_stats_enable(0);
+	
+	TEST_CHECK(allocs == 0, "%zu allocations with statistics", allocs);
+}
+
+
+/**
+ * Formats \p value and parses it back with both parsers.
+ * @return true if both give back exactly the same bits.
+ */
+static bool test_double_round_trip(double value)
+{
+	char    buf[SENML_DOUBLE_MAX_LEN + 1];
+	size_t  len = senml_double_format(value, buf);
+	double  parsed;
+	char   *stop;
+	
+	buf[len] = '\0';
+	
+	TEST_CHECK(strpbrk(buf, ".e") != NULL, "%s is not a real", buf);
+	
+	senml_double_parse(buf, buf + len, &parsed);
+	
+	if (memcmp(&parsed, &value, sizeof(double)) != 0) {
+		printf("  %a formats as %s, which parses as %a\n", value, buf, parsed);
+		return false;
+	}
+	
+	parsed = strtod(buf, &stop);
+	
+	if (stop != buf + len || memcmp(&parsed, &value, sizeof(double)) != 0) {
+		printf("  %a formats as %s, which strtod parses as %a\n", value, buf, parsed);
+		return false;
+	}
+	
+	return true;
+}
+
+
+static void test_double_edges(void)
+{
+	static const double values[] = {
+		0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0 / 3.0, 123.0, 1e21, 1e22, 1e23, 5e-324, 1e-323,
+		2.2250738585072009e-308, 2.2250738585072014e-308, 1.7976931348623157e308, -DBL_MAX,
+		DBL_MIN, DBL_EPSILON, 9007199254740992.0, 9007199254740994.0, 4503599627370497.5,
+		18446744073709551616.0, 8.41e21, 5e-310, 1.5e300, 299792458.0, 1e-7, 123456.789
+	};
+	
+	char buf[SENML_DOUBLE_MAX_LEN];
+	
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		TEST_CHECK(test_double_round_trip(values[i]), "%a", values[i]);
+	
+	// every power of two and ten, and their neighbours
+	for (int e = -1074; e <= 1023; e++) {
+		double value = ldexp(1.0, e);
+		
+		TEST_CHECK(test_double_round_trip(value), "2^%d", e);
+		TEST_CHECK(test_double_round_trip(nextafter(value, 0.0)), "2^%d - 1 ulp", e);
+		TEST_CHECK(test_double_round_trip(nextafter(value, INFINITY)), "2^%d + 1 ulp", e);
+	}
+	
+	for (int e = -323; e <= 308; e++)
+		TEST_CHECK(test_double_round_trip(strtod((snprintf(buf, sizeof(buf), "1e%d", e), buf),
+		                                         NULL)), "1e%d", e);
+	
+	// not the shortest digits, but they round-trip
+	TEST_CHECK(senml_double_format(1e23, buf) == 20 && memcmp(buf, "9.999999999999999e22", 20) == 0,
+	           "1e23 is %.*s", (int)senml_double_format(1e23, buf), buf);
+}
+
+
+static void test_double_random(void)
+{
+	uint64_t state = 0x9e3779b97f4a7c15u;
+	
+	for (unsigned int i = 0; i < 200000; i++) {
+		double   value;
+		uint64_t bits;
+		
+		// xorshift64*, every bit pattern that is a finite double
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		bits   = state * 2685821657736338717u;
+		
+		// every eighth value is a subnormal
+		if (i % 8 == 0)
+			bits &= 0x800fffffffffffffu;
+		
+		memcpy(&value, &bits, sizeof(double));
+		
+		if (isfinite(value))
+			TEST_CHECK(test_double_round_trip(value), "%a", value);
+	}
+}
+
+
+static void test_double_parse(void)
+{
+	// decimal inputs that are not doubles have to be rounded like strtod does
+	static const char *const inputs[] = {
+		"9007199254740993", "9007199254740995", "1e23", "8.41e21", "2.2250738585072011e-308",
+		"4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+		"1.7976931348623158e308", "0.1000000000000000055511151231257827", "7.3177701707893310e15",
+		"123456789012345678901234567890", "1.00000000000000011102230246251565404236316680908203125",
+		"1.00000000000000011102230246251565404236316680908203124"
+	};
+	
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+		double expected = strtod(inputs[i], NULL);
+		double parsed;
+		
+		senml_double_parse(inputs[i], inputs[i] + strlen(inputs[i]), &parsed);
+		
+		TEST_CHECK(memcmp(&parsed, &expected, sizeof(double)) == 0, "%s parses as %a, not %a",
+		           inputs[i], parsed, expected);
+	}
+}
+
+
+/**
+ * Compares the parser with strtod on \p text, once with \p text followed by more digits that
+ * are past the end of the token.
+ */
+static void test_double_parse_text(const char *text)
+{
+	char   buf[1100];
+	size_t len      = strlen(text);
+	double expected = strtod(text, NULL);
+	double parsed;
+	
+	snprintf(buf, sizeof(buf), "%s987654321", text);
+	senml_double_parse(buf, buf + len, &parsed);
+	
+	TEST_CHECK(memcmp(&parsed, &expected, sizeof(double)) == 0, "%.60s... parses as %a, not %a",
+	           text, parsed, expected);
+}
+
+
+static void test_double_parse_long(void)
+{
+	char     text[1100];
+	char     digits[800];
+	int      count = 1;
+	uint64_t state = 0x2545f4914f6cdd1du;
+	double   parsed;
+	
+	// 2^-1075 = 5^1075 * 10^-1075 is halfway between 0 and the smallest subnormal
+	digits[0] = 1;
+	
+	for (int i = 0; i < 1075; i++) {
+		int carry = 0;
+		
+		for (int j = 0; j < count; j++) {
+			carry     += digits[j] * 5;
+			digits[j]  = (char)(carry % 10);
+			carry     /= 10;
+		}
+		
+		if (carry)
+			digits[count++] = (char)carry;
+	}
+	
+	for (int j = 0; j < count; j++)
+		text[j] = (char)('0' + digits[count - 1 - j]);
+	
+	// exactly halfway rounds to the even 0, anything above it to the smallest subnormal
+	snprintf(text + count, 16, "e-1075");
+	test_double_parse_text(text);
+	senml_double_parse(text, text + strlen(text), &parsed);
+	TEST_CHECK(parsed == 0, "2^-1075 parses as %a", parsed);
+	
+	memset(text + count, '0', 100);
+	snprintf(text + count + 100, 16, "e-1175");
+	test_double_parse_text(text);
+	
+	snprintf(text + count + 100, 16, "1e-1176");
+	test_double_parse_text(text);
+	senml_double_parse(text, text + strlen(text), &parsed);
+	TEST_CHECK(parsed == 0x1p-1074, "just above 2^-1075 parses as %a", parsed);
+	
+	test_double_parse_text("0.000000000000000000000000000000000000000000001e-280");
+	test_double_parse_text("-17976931348623157081452742373170435679807056752584499659891747680315"
+	                       "72607800285387605895586327668781715404589535143824642343213268894641"
+	                       "82768467546703537516986049910576551282076245490090389328944075868508"
+	                       "45513394230458323690322294816580855933212334827479782620414472316873"
+	                       "8177180919299881250404026184124858368");
+	test_double_parse_text("1797693134862315807937289714053034150799341327710e259");
+	test_double_parse_text("123456789012345678901234567890e99999999999");
+	
+	// random tokens with 20 to 40 significant digits over the whole exponent range
+	for (unsigned int i = 0; i < 100000; i++) {
+		int len = 0;
+		
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		
+		if (i % 2)
+			text[len++] = '-';
+		
+		text[len++] = (char)('1' + state % 9);
+		text[len++] = '.';
+		
+		for (unsigned int j = 0; j < 19 + (state >> 8) % 21; j++)
+			text[len++] = (char)('0' + (state >> (j % 48)) % 10);
+		
+		snprintf(text + len, 16, "e%d", (int)((state >> 32) % 650) - 340);
+		test_double_parse_text(text);
+	}
+}
+
+
+static void test_encode_json_exact(void)
+{
+	senml_record_t records[] = {
+		{ .name = "abc", .value_type = SENML_TYPE_FLOAT, .value.value_f = 1.5 },
+		{ .name = "b",   .value_type = SENML_TYPE_FLOAT, .value.value_f = 2.0 }
+	};
+	
+	static const char expected[] = "[{\"n\":\"abc\",\"v\":1.5},{\"n\":\"b\",\"v\":2.0}]";
+	
+	senml_pack_t pack = { .records = records, .num = 2 };
+	char         buf[sizeof(expected)];
+	
+	// a buffer that holds the document and its terminator is enough
+	TEST_CHECK(senml_encode_json_s(&pack, buf, sizeof(buf)) == 0, "%s",
+	           senml_last_error()->message);
+	TEST_CHECK(strcmp(buf, expected) == 0, "%s", buf);
+	TEST_CHECK(senml_encode_json_s(&pack, buf, sizeof(buf) - 1) == -2, "no room for the NUL");
+}
+
+
+static void test_names_decode(void)
+{
+	static const char json[] = "[{\"bn\":\"dev/\",\"n\":\"temp\",\"v\":1},"
+	                           "{\"n\":\"h\\u0075m\",\"v\":2},{\"n\":\"temp\",\"v\":3}]";
+	
+	senml_names_t      *names = senml_names_new();
+	senml_decode_opts_t opts  = { .names = names };
+	senml_pack_t       *pack;
+	senml_str_t         canonical;
+	
+	TEST_CHECK(names != NULL, "no names table");
+	
+	if (!names)
+		return;
+	
+	// the names point into the table, with and without borrowing from the input
+	for (int zero_copy = 0; zero_copy <= 1; zero_copy++) {
+		opts.flags = zero_copy ? SENML_DECODE_ZERO_COPY : 0;
+		pack       = senml_decode_json_ex(json, 0, &opts);
+		
+		TEST_CHECK(pack && pack->num == 3, "%s", senml_last_error()->message);
+		
+		if (!pack)
+			continue;
+		
+		for (size_t i = 0; i < pack->num; i++) {
+			const senml_record_t *record = &pack->records[i];
+			
+			canonical = senml_names_get(names, record->name_id);
+			TEST_CHECK(canonical.p && record->name_view.p == canonical.p + 4 &&
+			           record->name_view.len == canonical.len - 4, "record %zu: view", i);
+			TEST_CHECK(zero_copy ? !record->name : record->name == record->name_view.p,
+			           "record %zu: name %s", i, record->name);
+		}
+		
+		canonical = senml_names_get(names, pack->records[1].name_id);
+		TEST_CHECK(canonical.len == 7 && memcmp(canonical.p, "dev/hum", 7) == 0, "%.*s",
+		           (int)canonical.len, canonical.p);
+		TEST_CHECK(pack->records[0].name_id == pack->records[2].name_id &&
+		           pack->records[0].name_id != pack->records[1].name_id, "IDs %u %u %u",
+		           pack->records[0].name_id, pack->records[1].name_id, pack->records[2].name_id);
+		TEST_CHECK(zero_copy || strcmp(pack->records[0].name, "temp") == 0, "name %s",
+		           pack->records[0].name);
+		
+		senml_pack_free(pack);
+	}
+	
+	TEST_CHECK(senml_names_count(names) == 2, "%zu names", senml_names_count(names));
+	senml_names_free(names);
+}
+
+
+/*! A CBOR document and what decoding it has to give */
+typedef struct {
+	const char         *cbor;
+	size_t              len;
+	senml_error_code_t  code;   //!< SENML_OK if the document decodes
+	const char         *name;   //!< Name of the first record
+	double              value;  //!< Value of the first record
+} test_cbor_case_t;
+
+
+#define TEST_CBOR(bytes, code, name, value) { bytes, sizeof(bytes) - 1, code, name, value }
+
+
+static const test_cbor_case_t test_cbor_cases[] = {
+	// definite and indefinite arrays and maps
+	TEST_CBOR("\x81\xa2\x00\x61" "a" "\x02\x01", SENML_OK, "a", 1),
+	TEST_CBOR("\x9f\xa2\x00\x61" "a" "\x02\x01\xff", SENML_OK, "a", 1),
+	TEST_CBOR("\x81\xbf\x00\x61" "a" "\x02\x01\xff", SENML_OK, "a", 1),
+	TEST_CBOR("\x9f\xbf\x00\x7f\x61" "a" "\x61" "b" "\xff\x02\x01\xff\xff", SENML_OK, "ab", 1),
+	TEST_CBOR("\x82\xa1\x02\x01\xbf\xff", SENML_OK, NULL, 1),
+	TEST_CBOR("\x80", SENML_OK, NULL, 0),
+	TEST_CBOR("\x9f\xff", SENML_OK, NULL, 0),
+	
+	// integers and half, single and double floats
+	TEST_CBOR("\x81\xa1\x02\x21", SENML_OK, NULL, -2),
+	TEST_CBOR("\x81\xa1\x02\x19\x01\x00", SENML_OK, NULL, 256),
+	TEST_CBOR("\x81\xa1\x02\xf9\x3e\x00", SENML_OK, NULL, 1.5),
+	TEST_CBOR("\x81\xa1\x02\xf9\x00\x01", SENML_OK, NULL, 5.9604644775390625e-8),
+	TEST_CBOR("\x81\xa1\x02\xf9\xfc\x00", SENML_OK, NULL, -INFINITY),
+	TEST_CBOR("\x81\xa1\x02\xfa\x3f\xc0\x00\x00", SENML_OK, NULL, 1.5),
+	TEST_CBOR("\x81\xa1\x02\xfb\x3f\xf8\x00\x00\x00\x00\x00\x00", SENML_OK, NULL, 1.5),
+	TEST_CBOR("\x82\xa1\x02\xf5\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x20\x19\x01\x2c\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x07\xf9\x7e\x00\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x07\x24\xa0", SENML_ERROR_RECORD, NULL, 0),
+	
+	// nested tags in front of a value and of an attribute that is skipped
+	TEST_CBOR("\x81\xa1\x02\xc1\xc0\x18\x2a", SENML_OK, NULL, 42),
+	TEST_CBOR("\x81\xa2\x18\x63\xc0\xd8\x64\x82\xc1\x01\x02\x02\x01", SENML_OK, NULL, 1),
+	TEST_CBOR("\x81\xa1\x02\xc1", SENML_ERROR_TRUNCATED, NULL, 0),
+	
+	// break bytes where no indefinite item is open, or missing where one is. An invalid value at
+	// the end of the document counts as truncated, so a record follows
+	TEST_CBOR("\x82\xa1\x18\x63\xff\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x18\x63\xc0\xff\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x02\xff\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x81\xa1\xff\x01", SENML_ERROR_SYNTAX, NULL, 0),
+	TEST_CBOR("\x81\xff", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x82\xa1\x18\x63\x82\x01\xff\xa0", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x9f\xa1\x02\x01", SENML_ERROR_TRUNCATED, NULL, 0),
+	TEST_CBOR("\x81\xa1\x00\x7f\x41" "a" "\xff", SENML_ERROR_RECORD, NULL, 0),
+	TEST_CBOR("\x80\xff", SENML_ERROR_TRAILING, NULL, 0),
+	TEST_CBOR("\xff", SENML_ERROR_NOT_ARRAY, NULL, 0),
+};
+
+
+static void test_cbor_decode(void)
+{
+	for (size_t i = 0; i < sizeof(test_cbor_cases) / sizeof(test_cbor_cases[0]); i++) {
+		const test_cbor_case_t *test = &test_cbor_cases[i];
+		senml_pack_t           *pack = senml_decode_cbor((const unsigned char *)test->cbor,
+		                                                 test->len);
+		
+		TEST_CHECK(senml_last_error()->code == test->code, "case %zu: %s: %s", i,
+		           senml_error_string(senml_last_error()->code), senml_last_error()->message);
+		
+		if (pack && pack->num > 0) {
+			const senml_record_t *record = &pack->records[0];
+			
+			TEST_CHECK(test->name ? record->name && strcmp(record->name, test->name) == 0 :
+			           !record->name, "case %zu: name %s", i, record->name);
+			TEST_CHECK(test->value == 0 || (record->value_type == SENML_TYPE_FLOAT &&
+			                                record->value.value_f == test->value),
+			           "case %zu: value %g", i, record->value.value_f);
+		}
+		
+		senml_pack_free(pack);
+	}
+}
+
+
+#define TEST_CBOR_TAGS (1000000)   //!< Tags in front of one value, far more than the stack holds
+
+
+static void test_cbor_tags(void)
+{
+	// [{99: <tags> 1, 2: <tags> 1}]
+	size_t         len  = 4 + TEST_CBOR_TAGS + 1 + 1 + TEST_CBOR_TAGS + 1;
+	unsigned char *cbor = malloc(len);
+	unsigned char *p    = cbor;
+	senml_pack_t  *pack;
+	
+	if (!cbor)
+		return;
+	
+	memcpy(p, "\x81\xa2\x18\x63", 4);
+	p += 4;
+	memset(p, 0xc0, TEST_CBOR_TAGS);
+	p   += TEST_CBOR_TAGS;
+	*p++ = 0x01;
+	*p++ = 0x02;
+	memset(p, 0xc1, TEST_CBOR_TAGS);
+	p   += TEST_CBOR_TAGS;
+	*p++ = 0x01;
+	
+	pack = senml_decode_cbor(cbor, len);
+	TEST_CHECK(pack && pack->num == 1 && pack->records[0].value.value_f == 1, "%s",
+	           senml_last_error()->message);
+	senml_pack_free(pack);
+	free(cbor);
+}
+
+
+#define TEST_TRANSCODE_MAX (300)   //!< Most records transcoded, enough for a 3 byte array head
+
+
+static void test_transcode_exact(void)
+{
+	static const size_t counts[] = { 2, 23, 24, 255, 256, TEST_TRANSCODE_MAX };
+	
+	static char          json[TEST_TRANSCODE_MAX * 24];
+	static unsigned char buf[TEST_TRANSCODE_MAX * 24];
+	
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		unsigned char *expected;
+		size_t         len  = 0;
+		size_t         size = 0;
+		
+		json[len++] = '[';
+		
+		for (size_t j = 0; j < counts[i]; j++)
+			len += (size_t)sprintf(json + len, "%s{\"n\":\"s%zu\",\"v\":%zu}", j ? "," : "",
+			                       j, j);
+		
+		json[len++] = ']';
+		
+		expected = senml_transcode_json_to_cbor(json, len, &size);
+		TEST_CHECK(expected != NULL, "%zu records: %s", counts[i], senml_last_error()->message);
+		
+		if (expected == NULL)
+			continue;
+		
+		// a buffer that holds the document is enough, whatever the length of the array head
+		size_t out_len = size;
+		
+		TEST_CHECK(senml_transcode_json_to_cbor_s(json, len, buf, &out_len) == 0,
+		           "%zu records: %s", counts[i], senml_last_error()->message);
+		TEST_CHECK(out_len == size && memcmp(buf, expected, size) == 0,
+		           "%zu records: %zu bytes, expected %zu", counts[i], out_len, size);
+		
+		out_len = size - 1;
+		TEST_CHECK(senml_transcode_json_to_cbor_s(json, len, buf, &out_len) == -2 &&
+		           senml_last_error()->code == SENML_ERROR_NO_SPACE,
+		           "%zu records: no room for the last byte", counts[i]);
+		
+		senml_free(expected);
+	}
+}
+
+
+/**
+ * Records the first time a range scan passes.
+ */
+static int test_store_first(const double *times, const double *values, size_t count, void *ctx)
+{
+	(void)values;
+	(void)count;
+	
+	*(double *)ctx = times[0];
+	
+	return 1;
+}
+
+
+static void test_store_max_age(void)
+{
+	senml_store_opts_t opts   = { .max_age = 100 };
+	senml_record_t     record = { .value_type = SENML_TYPE_FLOAT, .value.value_f = 1 };
+	senml_pack_t       pack   = { .records = &record, .num = 1 };
+	senml_store_t     *store  = senml_store_new(&opts);
+	double             time, value, first = 0;
+	
+	TEST_CHECK(store != NULL, "no store");
+	
+	if (!store)
+		return;
+	
+	record.name = "idle";
+	record.time = 0;
+	TEST_CHECK(senml_store_add(store, &pack) == 0, "%s", senml_last_error()->message);
+	
+	// only the busy sensor advances the newest sample, which expires the idle one as well
+	record.name = "busy";
+	
+	for (int i = 1; i <= 600; i++) {
+		record.time = i;
+		TEST_CHECK(senml_store_add(store, &pack) == 0, "%s", senml_last_error()->message);
+	}
+	
+	TEST_CHECK(!senml_store_latest(store, "idle", &time, &value), "idle sample at %g", time);
+	TEST_CHECK(senml_store_latest(store, "busy", &time, &value) && time == 600, "busy sample");
+	
+	senml_store_range(store, "busy", 0, 1000, test_store_first, &first);
+	TEST_CHECK(first > 1 && first <= 500, "oldest busy sample at %g", first);
+	
+	record.time = NAN;
+	TEST_CHECK(senml_store_add(store, &pack) == -1 &&
+	           strcmp(senml_last_error()->message, "time is not a number") == 0, "%s",
+	           senml_last_error()->message);
+	
+	senml_store_free(store);
+}
+
+
+#define TEST_STORE_SENSORS (20000)  //!< Sensors the writer of the concurrent test adds
+#define TEST_STORE_READERS (3)      //!< Threads that read while it does
+
+
+/*! A thread that reads a store while another one writes it */
+typedef struct {
+	senml_store_t  *store;
+	const bool     *done;     //!< Set once the writer has finished
+	const unsigned *newest;   //!< Number of the sensor the writer adds next
+	unsigned int    seed;
+	size_t          reads;    //!< Rounds of lookups and scans made
+	size_t          samples;  //!< Samples the scans passed
+	size_t          wrong;    //!< Samples whose value is not twice their time or out of order
+} test_store_reader_t;
+
+
+/**
+ * Checks the samples of a range scan, every value is twice its time and the times increase.
+ */
+static int test_store_check(const double *times, const double *values, size_t count, void *ctx)
+{
+	test_store_reader_t *reader = ctx;
+	
+	for (size_t i = 0; i < count; i++) {
+		if (values[i] != times[i] * 2 || (i > 0 && !(times[i - 1] < times[i])))
+			reader->wrong++;
+	}
+	
+	reader->samples += count;
+	
+	return 0;
+}
+
+
+static void *test_store_read(void *arg)
+{
+	test_store_reader_t *reader = arg;
+	char                 name[16];
+	double               time, value;
+	
+	while (!__atomic_load_n(reader->done, __ATOMIC_ACQUIRE)) {
+		// the sensor that is being added gets its first chunk and ring while it is looked up
+		snprintf(name, sizeof(name), "s%u", __atomic_load_n(reader->newest, __ATOMIC_RELAXED) +
+		         rand_r(&reader->seed) % 2);
+		
+		if (senml_store_latest(reader->store, name, &time, &value) && value != time * 2)
+			reader->wrong++;
+		
+		if (senml_store_latest(reader->store, "hot", &time, &value) && value != time * 2)
+			reader->wrong++;
+		
+		senml_store_range(reader->store, name, 0, INFINITY, test_store_check, reader);
+		
+		// scanning the hot sensor takes much longer than the rest, so it is done less often
+		if (++reader->reads % 64 == 0)
+			senml_store_range(reader->store, "hot", 0, INFINITY, test_store_check, reader);
+	}
+	
+	return NULL;
+}
+
+
+static void test_store_concurrent(void)
+{
+	senml_store_opts_t  opts   = { .max_age = 2000 };
+	senml_record_t      record = { .value_type = SENML_TYPE_FLOAT };
+	senml_pack_t        pack   = { .records = &record, .num = 1 };
+	senml_store_t      *store  = senml_store_new(&opts);
+	test_store_reader_t readers[TEST_STORE_READERS];
+	pthread_t           threads[TEST_STORE_READERS];
+	bool                done   = false;
+	unsigned int        newest = 0;
+	char                name[16];
+	size_t              started = 0;
+	
+	TEST_CHECK(store != NULL, "no store");
+	
+	if (!store)
+		return;
+	
+	for (size_t i = 0; i < TEST_STORE_READERS; i++) {
+		readers[i] = (test_store_reader_t){
+			.store  = store,
+			.done   = &done,
+			.newest = &newest,
+			.seed   = (unsigned int)i
+		};
+		
+		if (pthread_create(&threads[i], NULL, test_store_read, &readers[i]) == 0)
+			started++;
+	}
+	
+	// the hot sensor grows its ring and drops chunks as they expire
+	for (unsigned int i = 0; i < TEST_STORE_SENSORS * 8; i++) {
+		if (i % 8 == 0) {
+			__atomic_store_n(&newest, i / 8, __ATOMIC_RELAXED);
+			snprintf(name, sizeof(name), "s%u", i / 8);
+			record.name = name;
+		} else {
+			record.name = "hot";
+		}
+		
+		record.time          = i;
+		record.value.value_f = i * 2.0;
+		TEST_CHECK(senml_store_add(store, &pack) == 0, "%s", senml_last_error()->message);
+	}
+	
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+		TEST_CHECK(readers[i].wrong == 0, "reader %zu: %zu wrong samples among %zu", i,
+		           readers[i].wrong, readers[i].samples);
+	}
+	
+	TEST_CHECK(started == TEST_STORE_READERS, "%zu readers started", started);
+	senml_store_free(store);
+}
+
+
+#define TEST_AGGREGATE_MAX (67)   //!< Longest input of the kernel tests, not a multiple of 2 or 8
+
+
+static bool test_same_double(double a, double b)
+{
+	return a == b || (isnan(a) && isnan(b));
+}
+
+
+/**
+ * Compares the result of a kernel with the one of the scalar kernel. The sums are added in a
+ * different order, so they only have to be close.
+ */
+static bool test_same_aggregate(const senml_aggregate_t *a, const senml_aggregate_t *b,
+                                double magnitude)
+{
+	double tolerance = magnitude * 1e-12;
+	
+	return a->count == b->count && test_same_double(a->min, b->min) &&
+	       test_same_double(a->max, b->max) &&
+	       (test_same_double(a->sum, b->sum) || fabs(a->sum - b->sum) <= tolerance) &&
+	       (test_same_double(a->mean, b->mean) || fabs(a->mean - b->mean) <= tolerance);
+}
+
+
+static void test_aggregate_kernels(void)
+{
+	static const senml_kernel_t kernels[] = { SENML_KERNEL_SSE2, SENML_KERNEL_AVX2 };
+	static const char *const    names[]   = { "sse2", "avx2" };
+	
+	double             values[TEST_AGGREGATE_MAX];
+	uint8_t            types[TEST_AGGREGATE_MAX];
+	senml_base_info_t  base_info = {
+		.base_value_type         = SENML_TYPE_FLOAT,
+		.base_value.base_value_f = 0.5
+	};
+	senml_columns_t    columns   = { .value_f = values, .value_type = types };
+	uint64_t           state     = 0x2545f4914f6cdd1du;
+	
+	for (unsigned int round = 0; round < 400; round++) {
+		senml_aggregate_t expected;
+		double            magnitude = 0;
+		
+		columns.num       = round % (TEST_AGGREGATE_MAX + 1);
+		columns.base_info = round % 3 == 0 ? &base_info : NULL;
+		
+		for (size_t i = 0; i < columns.num; i++) {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			
+			uint64_t r = state * 2685821657736338717u;
+			
+			// rounds of different kinds: all numeric, none numeric and mixed, some with NaN
+			if (round % 5 == 1)
+				types[i] = SENML_TYPE_FLOAT;
+			else if (round % 5 == 2)
+				types[i] = r & 1 ? SENML_TYPE_BOOL : SENML_TYPE_STRING;
+			else
+				types[i] = r % 3 == 0 ? SENML_TYPE_BOOL : SENML_TYPE_FLOAT;
+			
+			values[i]  = (double)(int64_t)(r >> 11) / 1e9 - 4.5e6;
+			magnitude += fabs(values[i]) + 1;
+			
+			if (round % 7 == 3 && ((r >> 60) == 0 || i == columns.num / 2))
+				values[i] = NAN;
+		}
+		
+		senml_aggregate_force(SENML_KERNEL_SCALAR);
+		senml_aggregate(&columns, &expected);
+		
+		for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+			senml_aggregate_t result;
+			
+			if (senml_aggregate_force(kernels[k]))
+				continue;
+			
+			senml_aggregate(&columns, &result);
+			TEST_CHECK(test_same_aggregate(&result, &expected, magnitude),
+			           "%s, %zu records: count %zu min %a max %a sum %a, scalar %zu %a %a %a",
+			           names[k], columns.num, result.count, result.min, result.max, result.sum,
+			           expected.count, expected.min, expected.max, expected.sum);
+		}
+	}
+	
+	senml_aggregate_force(SENML_KERNEL_AUTO);
+}
+
+
+static void test_columns_binary(void)
+{
+	uint8_t            base[]    = { 0xde, 0x00, 0xad };
+	uint8_t            data[]    = { 0x00, 0xff, 0x00, 0x7f };
+	senml_base_info_t  base_info = {
+		.base_value_type           = SENML_TYPE_BINARY,
+		.base_value.base_value_bin = { .p = base, .len = sizeof(base) }
+	};
+	senml_record_t     records[] = {
+		{ .name = "a", .value_type = SENML_TYPE_BINARY,
+		  .value.value_bin = { .p = data, .len = sizeof(data) } },
+		{ .name = "b", .value_type = SENML_TYPE_BINARY, .value.value_bin = { .p = data, .len = 0 } },
+		{ .name = "c", .value_type = SENML_TYPE_FLOAT, .value.value_f = 2 }
+	};
+	senml_pack_t       pack      = { .base_info = &base_info, .records = records, .num = 3 };
+	senml_columns_t   *columns   = senml_columns_from_pack(&pack);
+	senml_pack_t      *copy;
+	
+	TEST_CHECK(columns != NULL, "senml_columns_from_pack failed");
+	
+	if (!columns)
+		return;
+	
+	// the columns must not refer to the pack they were converted from
+	memset(base, 0x55, sizeof(base));
+	memset(data, 0x55, sizeof(data));
+	
+	TEST_CHECK(columns->base_info->base_value.base_value_bin.len == 3 &&
+	           memcmp(columns->base_info->base_value.base_value_bin.p, "\xde\x00\xad", 3) == 0,
+	           "binary base value not copied");
+	TEST_CHECK(columns->value_type[0] == SENML_TYPE_BINARY && columns->value_s[0].len == 4 &&
+	           memcmp(columns->value_s[0].p, "\x00\xff\x00\x7f", 4) == 0,
+	           "binary value not copied");
+	TEST_CHECK(columns->value_s[1].p != NULL && columns->value_s[1].len == 0,
+	           "empty binary value lost");
+	TEST_CHECK(columns->value_s[2].p == NULL && columns->value_f[2] == 2, "float value changed");
+	
+	copy = senml_columns_to_pack(columns);
+	senml_columns_free(columns);
+	TEST_CHECK(copy != NULL, "senml_columns_to_pack failed");
+	
+	if (!copy)
+		return;
+	
+	TEST_CHECK(copy->num == 3 && copy->records[0].value_type == SENML_TYPE_BINARY &&
+	           copy->records[0].value.value_bin.len == 4 &&
+	           memcmp(copy->records[0].value.value_bin.p, "\x00\xff\x00\x7f", 4) == 0,
+	           "binary value lost on the way back");
+	TEST_CHECK(copy->records[1].value_type == SENML_TYPE_BINARY &&
+	           copy->records[1].value.value_bin.p != NULL &&
+	           copy->records[1].value.value_bin.len == 0, "empty binary value lost on the way back");
+	
+	senml_pack_free(copy);
+}
+
+
+/**
+ * Tells if \p view lies within \p len bytes at \p input.
+ */
+static bool test_view_within(senml_str_t view, const void *input, size_t len)
+{
+	const char *begin = input;
+	
+	return view.p && view.p >= begin && view.p + view.len <= begin + len;
+}
+
+
+static void test_zero_copy(void)
+{
+	static const char json[] = "[{\"bn\":\"dev/\",\"bu\":\"Cel\"},"
+	                           "{\"n\":\"a\",\"u\":\"%\",\"vs\":\"x\"},"
+	                           "{\"n\":\"b\\u00e9\",\"vs\":\"y\\tz\"}]";
+	static const unsigned char cbor[] = "\x82\xa2\x21\x64" "dev/" "\x00\x61" "a"
+	                                    "\xa2\x00\x7f\x61" "b" "\x61" "c" "\xff\x03\x61" "x";
+	
+	senml_decode_opts_t  opts  = { .flags = SENML_DECODE_ZERO_COPY };
+	size_t               len   = sizeof(json) - 1;
+	char                *input = malloc(len);
+	senml_pack_t        *pack;
+	
+	TEST_CHECK(input != NULL, "out of memory");
+	
+	if (!input)
+		return;
+	
+	// the input is not terminated, the views have to stop at their lengths
+	memcpy(input, json, len);
+	pack = senml_decode_json_ex(input, len, &opts);
+	TEST_CHECK(pack && pack->num == 3, "%s", senml_last_error()->message);
+	
+	if (pack) {
+		const senml_record_t *a = &pack->records[1];
+		const senml_record_t *b = &pack->records[2];
+		
+		TEST_CHECK(!pack->base_info->base_name && !a->name && !a->unit && !a->value.value_s &&
+		           !b->name && !b->value.value_s, "char * members set");
+		TEST_CHECK(test_view_within(pack->base_info->base_name_view, input, len) &&
+		           test_view_within(pack->base_info->base_unit_view, input, len) &&
+		           test_view_within(a->name_view, input, len) &&
+		           test_view_within(a->unit_view, input, len) &&
+		           test_view_within(a->value_view, input, len), "unescaped view copied");
+		TEST_CHECK(a->name_view.len == 1 && a->name_view.p[0] == 'a', "%.*s",
+		           (int)a->name_view.len, a->name_view.p);
+		TEST_CHECK(!test_view_within(b->name_view, input, len) &&
+		           !test_view_within(b->value_view, input, len), "escaped view borrowed");
+		
+		// escaped strings were copied into the pack, so they outlive the input
+		free(input);
+		input = NULL;
+		TEST_CHECK(b->name_view.len == 3 && memcmp(b->name_view.p, "b\xc3\xa9", 3) == 0,
+		           "%.*s", (int)b->name_view.len, b->name_view.p);
+		TEST_CHECK(b->value_view.len == 3 && memcmp(b->value_view.p, "y\tz", 3) == 0, "%.*s",
+		           (int)b->value_view.len, b->value_view.p);
+	}
+	
+	senml_pack_free(pack);
+	free(input);
+	
+	// definite CBOR strings are borrowed, indefinite ones are joined into the pack
+	pack = senml_decode_cbor_ex(cbor, sizeof(cbor) - 1, &opts);
+	TEST_CHECK(pack && pack->num == 2, "%s", senml_last_error()->message);
+	
+	if (pack) {
+		const senml_record_t *a = &pack->records[0];
+		const senml_record_t *b = &pack->records[1];
+		
+		TEST_CHECK(test_view_within(pack->base_info->base_name_view, cbor, sizeof(cbor)) &&
+		           test_view_within(a->name_view, cbor, sizeof(cbor)) &&
+		           test_view_within(b->value_view, cbor, sizeof(cbor)), "definite view copied");
+		TEST_CHECK(!test_view_within(b->name_view, cbor, sizeof(cbor)) &&
+		           b->name_view.len == 2 && memcmp(b->name_view.p, "bc", 2) == 0, "%.*s",
+		           (int)b->name_view.len, b->name_view.p);
+		TEST_CHECK(!a->name && !b->name && !b->value.value_s, "char * members set");
+	}
+	
+	senml_pack_free(pack);
+}
+
+
+static void test_pack_arena(void)
+{
+	static const char json[] = "[{\"bn\":\"dev/\",\"bu\":\"Cel\",\"bver\":5},"
+	                           "{\"n\":\"a\",\"u\":\"%\",\"v\":1},"
+	                           "{\"n\":\"b\\u00e9\",\"vs\":\"xyz\"}]";
+	static const unsigned char cbor[] = "\x82\xa2\x21\x64" "dev/" "\x00\x61" "a"
+	                                    "\xa2\x00\x61" "b" "\x03\x63" "xyz";
+	
+	size_t               blocks = test_blocks;
+	size_t               allocs;
+	char                *input  = malloc(sizeof(json));
+	senml_pack_t        *pack;
+	senml_decode_opts_t  opts   = { .flags = 0 };
+	
+	TEST_CHECK(input != NULL, "out of memory");
+	
+	if (!input)
+		return;
+	
+	// the strings of a pack live in its arena, not in the input
+	memcpy(input, json, sizeof(json));
+	pack = senml_decode_json(input, 0);
+	free(input);
+	TEST_CHECK(pack && pack->num == 3 && pack->arena, "%s", senml_last_error()->message);
+	
+	if (pack) {
+		TEST_CHECK(strcmp(pack->base_info->base_name, "dev/") == 0 &&
+		           strcmp(pack->base_info->base_unit, "Cel") == 0 &&
+		           strcmp(pack->records[1].name, "a") == 0 &&
+		           strcmp(pack->records[2].name, "b\xc3\xa9") == 0 &&
+		           strcmp(pack->records[2].value.value_s, "xyz") == 0, "strings changed");
+		
+		// a reset pack decodes a document of the same size without calling malloc again
+		senml_pack_reset(pack);
+		TEST_CHECK(pack->num == 0, "%zu records after the reset", pack->num);
+		opts.pack = pack;
+		allocs    = test_allocs;
+		TEST_CHECK(senml_decode_json_ex(json, 0, &opts) == pack && pack->num == 3, "%s",
+		           senml_last_error()->message);
+		TEST_CHECK(test_allocs == allocs, "%zu allocations", test_allocs - allocs);
+		
+		// a failure leaves the pack empty but usable
+		TEST_CHECK(!senml_decode_json_ex("[{\"n\":1}]", 0, &opts) && pack->num == 0,
+		           "%zu records", pack->num);
+		TEST_CHECK(senml_decode_cbor_ex(cbor, sizeof(cbor) - 1, &opts) == pack &&
+		           pack->num == 2 && strcmp(pack->records[1].value.value_s, "xyz") == 0, "%s",
+		           senml_last_error()->message);
+	}
+	
+	senml_pack_free(pack);
+	TEST_CHECK(test_blocks == blocks, "%ld blocks left", (long)(test_blocks - blocks));
+	
+	// nothing is left behind by documents that fail halfway
+	pack = senml_decode_json("[{\"n\":\"a\",\"v\":1},{\"n\":\"b\",\"v\":", 0);
+	TEST_CHECK(!pack, "truncated document decoded");
+	pack = senml_decode_cbor(cbor, sizeof(cbor) - 2);
+	TEST_CHECK(!pack, "truncated document decoded");
+	TEST_CHECK(test_blocks == blocks, "%ld blocks left", (long)(test_blocks - blocks));
+	
+	senml_pack_free(NULL);
+}
+
+
+static void test_encode_cbor(void)
+{
+	static const unsigned char expected[] =
+		"\x85\xa2\x20\x0a\x21\x62" "d/"
+		"\xa2\x00\x61" "a" "\x02\xf9\x3e\x00"
+		"\xa3\x00\x61" "b" "\x07\x18\x3c\x04\xf5"
+		"\xa3\x00\x61" "c" "\x06\xfa\x47\xc3\x50\x20\x02\xfb\x3f\xb9\x99\x99\x99\x99\x99\x9a"
+		"\xa2\x00\x61" "s" "\x03\x62" "xy";
+	
+	senml_base_info_t  base_info = { .version = 10, .base_name = "d/" };
+	senml_record_t     records[] = {
+		{ .name = "a", .value_type = SENML_TYPE_FLOAT, .value.value_f = 1.5 },
+		{ .name = "b", .update_time = 60, .value_type = SENML_TYPE_BOOL, .value.value_b = true },
+		{ .name = "c", .time = 100000.25, .value_type = SENML_TYPE_FLOAT, .value.value_f = 0.1 },
+		{ .name = "s", .value_type = SENML_TYPE_STRING, .value_view = { "xyz", 2 } }
+	};
+	senml_pack_t       pack      = { .base_info = &base_info, .records = records, .num = 4 };
+	unsigned char      buf[sizeof(expected)];
+	unsigned char     *cbor;
+	size_t             len       = 0;
+	senml_pack_t      *decoded;
+	
+	// the base info is a map of its own, floats take the smallest width that is exact
+	cbor = senml_encode_cbor(&pack, &len);
+	TEST_CHECK(cbor && len == sizeof(expected) - 1 && memcmp(cbor, expected, len) == 0,
+	           "%zu bytes, expected %zu", len, sizeof(expected) - 1);
+	
+	decoded = cbor ? senml_decode_cbor(cbor, len) : NULL;
+	TEST_CHECK(decoded && decoded->num == 5, "%s", senml_last_error()->message);
+	
+	if (decoded && decoded->num == 5) {
+		senml_pack_t records = { decoded->base_info, decoded->records + 1, 4, NULL };
+		
+		TEST_CHECK(!test_same_pack(&pack, &records), "round trip: %s",
+		           test_same_pack(&pack, &records));
+	}
+	
+	senml_pack_free(decoded);
+	senml_free(cbor);
+	
+	// the buffer variant writes the same bytes and needs exactly as much room
+	len = sizeof(expected) - 1;
+	TEST_CHECK(senml_encode_cbor_s(&pack, buf, &len) == 0 && len == sizeof(expected) - 1 &&
+	           memcmp(buf, expected, len) == 0, "%s", senml_last_error()->message);
+	
+	len = sizeof(expected) - 2;
+	TEST_CHECK(senml_encode_cbor_s(&pack, buf, &len) == -2 &&
+	           senml_last_error()->code == SENML_ERROR_NO_SPACE, "no room for the last byte");
+	
+	// a string value without a string is rejected rather than written as an empty map entry
+	records[3].value_view = (senml_str_t){ .p = NULL, .len = 0 };
+	len                   = sizeof(buf);
+	TEST_CHECK(senml_encode_cbor_s(&pack, buf, &len) == -1 &&
+	           senml_last_error()->code == SENML_ERROR_INVALID_PACK, "missing string value");
+	TEST_CHECK(!senml_encode_cbor(&pack, &len), "missing string value");
+}
+
+
+/*! The records a parser or decoder passed on, written out one line each */
+typedef struct {
+	char   text[2048];
+	size_t len;
+	int    stop;   //!< Records after which the callback stops, 0 to never stop
+	size_t count;  //!< Records received
+} test_records_t;
+
+
+static int test_record_text(const senml_record_t *record, const senml_base_info_t *base_info,
+                            void *ctx)
+{
+	test_records_t *records = ctx;
+	senml_str_t     name    = senml_str_of(record->name, &record->name_view);
+	senml_str_t     unit    = senml_str_of(record->unit, &record->unit_view);
+	senml_str_t     str     = { .p = NULL, .len = 0 };
+	senml_str_t     bn      = { .p = NULL, .len = 0 };
+	size_t          room    = sizeof(records->text) - records->len;
+	int             len;
+	
+	if (base_info)
+		bn = senml_str_of(base_info->base_name, &base_info->base_name_view);
+	
+	if (record->value_type == SENML_TYPE_STRING)
+		str = senml_str_of(record->value.value_s, &record->value_view);
+	
+	len = snprintf(records->text + records->len, room, "%.*s|%a|%.*s|%.*s|%a|%u|%d|%a|%d|%.*s\n",
+	               (int)bn.len, bn.p ? bn.p : "", base_info ? base_info->base_time : 0,
+	               (int)name.len, name.p ? name.p : "", (int)unit.len, unit.p ? unit.p : "",
+	               record->time, record->update_time, (int)record->value_type,
+	               record->value_type == SENML_TYPE_FLOAT ? record->value.value_f : 0,
+	               record->value_type == SENML_TYPE_BOOL && record->value.value_b,
+	               (int)str.len, str.p ? str.p : "");
+	
+	if (len > 0 && (size_t)len < room)
+		records->len += (size_t)len;
+	
+	records->count++;
+	
+	return records->stop && records->count == (size_t)records->stop ? 7 : 0;
+}
+
+
+/**
+ * Compares the texts of two lists of records without the base name and time, which are written
+ * first on every line.
+ */
+static bool test_same_resolved(const char *a, const char *b)
+{
+	while (*a && *b) {
+		const char *a_end = strchr(a, '\n');
+		const char *b_end = strchr(b, '\n');
+		const char *a_rec = strchr(strchr(a, '|') + 1, '|');
+		const char *b_rec = strchr(strchr(b, '|') + 1, '|');
+		
+		if (a_end - a_rec != b_end - b_rec || memcmp(a_rec, b_rec, (size_t)(a_end - a_rec)) != 0)
+			return false;
+		
+		a = a_end + 1;
+		b = b_end + 1;
+	}
+	
+	return !*a && !*b;
+}
+
+
+/**
+ * Feeds \p json to a new parser in chunks of which the first ends at \p split and the others are
+ * \p step bytes long.
+ * @return What the last call of <code>senml_parser_feed</code> or
+ * <code>senml_parser_finish</code> returned.
+ */
+static int test_parser_run(const char *json, size_t len, size_t split, size_t step,
+                           test_records_t *records)
+{
+	senml_parser_t *parser = senml_parser_new(test_record_text, records);
+	int             rc     = 0;
+	
+	if (!parser)
+		return -2;
+	
+	for (size_t offset = 0; offset < len && rc == 0; ) {
+		size_t chunk = offset < split ? split - offset : step;
+		
+		chunk   = chunk < len - offset ? chunk : len - offset;
+		rc      = senml_parser_feed(parser, json + offset, chunk);
+		offset += chunk;
+	}
+	
+	return senml_parser_finish(parser) ? (rc ? rc : -1) : rc;
+}
+
+
+static void test_parser_split(void)
+{
+	static const char json[] = "[{\"bn\":\"dev\\/\",\"bt\":1.25e3,\"bu\":\"Cel\",\"bver\":5},"
+	                           "{\"n\":\"t\\u00e9\",\"v\":-12.5e-3,\"t\":-1},"
+	                           "{\"n\":\"\xf0\x9f\x98\x80\",\"vb\":false,\"ut\":60} ,"
+	                           "{\"n\":\"s\",\"u\":\"%\",\"vs\":\"a\\\"b\\ud83d\\ude00\"},"
+	                           "{\"n\":\"x\",\"v\":12345678901234567890,\"x\":[1,{\"y\":null}]}]";
+	
+	const char     *invalid  = "[{\"n\":\"a\",\"v\":1},{\"n\":2,\"v\":1}]";
+	size_t          len      = sizeof(json) - 1;
+	senml_pack_t   *pack     = senml_decode_json(json, len);
+	test_records_t  expected = { .len = 0 };
+	test_records_t  records;
+	
+	TEST_CHECK(pack && pack->num == 5, "%s", senml_last_error()->message);
+	
+	if (!pack)
+		return;
+	
+	// the parser passes on the records as they are in the document, like the decoder
+	for (size_t i = 0; i < pack->num; i++)
+		test_record_text(&pack->records[i], pack->base_info, &expected);
+	
+	senml_pack_free(pack);
+	
+	// every split into two chunks, and every byte on its own, give the records of the whole
+	for (size_t split = 0; split <= len; split++) {
+		records = (test_records_t){ .len = 0 };
+		records = (test_records_t){ .len = 0 };
+		TEST_CHECK(test_parser_run(json, len, split, len, &records) == 0 &&
+		           records.len == expected.len &&
+		           memcmp(records.text, expected.text, expected.len) == 0, "split at %zu: %s",
+		           split, senml_last_error()->message);
+	}
+	
+	records = (test_records_t){ .len = 0 };
+	TEST_CHECK(test_parser_run(json, len, 0, 1, &records) == 0 && records.len == expected.len &&
+	           memcmp(records.text, expected.text, expected.len) == 0, "byte by byte: %s",
+	           senml_last_error()->message);
+	
+	// a document cut short is not complete, wherever the cut is
+	for (size_t cut = 0; cut < len; cut++) {
+		records = (test_records_t){ .len = 0 };
+		TEST_CHECK(test_parser_run(json, cut, 0, 1, &records) == -1, "cut at %zu", cut);
+	}
+	
+	// the callback stops the parser, which then rejects all further input
+	records = (test_records_t){ .stop = 2 };
+	TEST_CHECK(test_parser_run(json, len, 0, 1, &records) == 7 && records.count == 2,
+	           "stopped after %zu records", records.count);
+	
+	// an invalid record is reported after the records before it
+	records = (test_records_t){ .len = 0 };
+	TEST_CHECK(test_parser_run(invalid, strlen(invalid), 0, 1, &records) == -1 &&
+	           records.count == 1 && senml_last_error()->code == SENML_ERROR_RECORD,
+	           "%zu records, %s", records.count, senml_last_error()->message);
+}
+
+
+/**
+ * Decodes a document of \p count records with <code>senml_decode_json_each</code>.
+ * @return The number of allocations it made.
+ */
+static size_t test_decode_each_allocs(size_t count)
+{
+	static char    json[1000 * 32];
+	size_t         len     = 0;
+	size_t         allocs;
+	test_records_t records = { .len = 0 };
+	
+	len += (size_t)sprintf(json + len, "[{\"bn\":\"dev/\",\"bt\":1e9}");
+	
+	for (size_t i = 0; i < count; i++)
+		len += (size_t)sprintf(json + len, ",{\"n\":\"s%zu\",\"vs\":\"x\\ty\"}", i);
+	
+	json[len++] = ']';
+	allocs      = test_allocs;
+	
+	TEST_CHECK(senml_decode_json_each(json, len, test_record_text, &records) == 0 &&
+	           records.count == count + 1, "%s", senml_last_error()->message);
+	
+	return test_allocs - allocs;
+}
+
+
+static void test_decode_each(void)
+{
+	static const char json[] = "[{\"bn\":\"d/\",\"bt\":100,\"bu\":\"C\",\"bv\":10,"
+	                           "\"n\":\"a\",\"v\":1,\"t\":-5},{\"n\":\"b\",\"vb\":true},"
+	                           "{\"n\":\"c\",\"u\":\"%\",\"v\":2,\"t\":1}]";
+	static const char expected[] = "d/|0x1.9p+6|d/a|C|0x1.7cp+6|0|1|0x1.6p+3|0|\n"
+	                               "d/|0x1.9p+6|d/b|C|0x1.9p+6|0|3|0x0p+0|1|\n"
+	                               "d/|0x1.9p+6|d/c|%|0x1.94p+6|0|1|0x1.8p+3|0|\n";
+	
+	test_records_t  records = { .len = 0 };
+	unsigned char  *cbor;
+	size_t          cbor_len = 0;
+	size_t          small;
+	
+	// every record arrives with the base name, time, unit and value applied
+	TEST_CHECK(senml_decode_json_each(json, 0, test_record_text, &records) == 0, "%s",
+	           senml_last_error()->message);
+	TEST_CHECK(records.len == sizeof(expected) - 1 && strcmp(records.text, expected) == 0,
+	           "%s", records.text);
+	
+	// the same for the CBOR version of the document
+	cbor = senml_transcode_json_to_cbor(json, 0, &cbor_len);
+	TEST_CHECK(cbor != NULL, "%s", senml_last_error()->message);
+	
+	if (cbor) {
+		records = (test_records_t){ .len = 0 };
+		TEST_CHECK(senml_decode_cbor_each(cbor, cbor_len, test_record_text, &records) == 0 &&
+		           strcmp(records.text, expected) == 0, "%s", records.text);
+		
+		records = (test_records_t){ .stop = 2 };
+		TEST_CHECK(senml_decode_cbor_each(cbor, cbor_len, test_record_text, &records) == 7 &&
+		           records.count == 2, "stopped after %zu records", records.count);
+		senml_free(cbor);
+	}
+	
+	// a callback stops decoding with a value of its own
+	records = (test_records_t){ .stop = 1 };
+	TEST_CHECK(senml_decode_json_each(json, 0, test_record_text, &records) == 7 &&
+	           records.count == 1, "stopped after %zu records", records.count);
+	
+	// records before an invalid one have been passed on already
+	records = (test_records_t){ .len = 0 };
+	TEST_CHECK(senml_decode_json_each("[{\"n\":\"a\",\"v\":1},{\"n\":\"b\",\"v\":\"1\"}]", 0,
+	                                  test_record_text, &records) == -1 &&
+	           records.count == 1 && senml_last_error()->code == SENML_ERROR_RECORD &&
+	           senml_last_error()->record == 2, "%zu records, %s", records.count,
+	           senml_last_error()->message);
+	
+	// memory does not grow with the number of records
+	small = test_decode_each_allocs(10);
+	TEST_CHECK(test_decode_each_allocs(1000) == small, "%zu allocations for 10 records",
+	           small);
+}
+
+
+#define TEST_BATCH_COUNT (500)  //!< Documents in a batch
+#define TEST_BATCH_BAD   (321)  //!< Index of the invalid document
+
+
+static void test_batch(void)
+{
+	static char          docs[TEST_BATCH_COUNT][64];
+	static const char   *inputs[TEST_BATCH_COUNT];
+	static size_t        lens[TEST_BATCH_COUNT];
+	static senml_pack_t *packs[TEST_BATCH_COUNT];
+	static char         *outputs[TEST_BATCH_COUNT];
+	
+	size_t        blocks = test_blocks;
+	senml_pool_t *pool   = senml_pool_new(4);
+	
+	TEST_CHECK(pool != NULL, "no pool");
+	
+	// every other document has a length and is followed by bytes that must not be read
+	for (size_t i = 0; i < TEST_BATCH_COUNT; i++) {
+		int len = sprintf(docs[i], "[{\"n\":\"s%zu\",\"v\":%zu}]", i, i);
+		
+		inputs[i] = docs[i];
+		lens[i]   = i % 2 ? (size_t)len : 0;
+		
+		if (i % 2)
+			strcpy(docs[i] + len, "]x");
+	}
+	
+	strcpy(docs[TEST_BATCH_BAD], "[{\"n\":\"bad\",\"v\":true}]");
+	lens[TEST_BATCH_BAD] = 0;
+	
+	// the same results on the pool and on the calling thread
+	for (int threaded = 1; threaded >= 0; threaded--) {
+		senml_pool_t *on = threaded ? pool : NULL;
+		
+		TEST_CHECK(senml_decode_json_batch(on, inputs, lens, TEST_BATCH_COUNT, packs) == -1 &&
+		           senml_last_error()->code == SENML_ERROR_RECORD &&
+		           senml_last_error()->record == 1, "%s", senml_last_error()->message);
+		
+		for (size_t i = 0; i < TEST_BATCH_COUNT; i++) {
+			char name[16];
+			
+			snprintf(name, sizeof(name), "s%zu", i);
+			
+			if (i == TEST_BATCH_BAD) {
+				TEST_CHECK(!packs[i], "invalid document %zu decoded", i);
+				packs[i] = senml_decode_json("[{\"n\":\"ok\",\"v\":0}]", 0);
+				continue;
+			}
+			
+			TEST_CHECK(packs[i] && packs[i]->num == 1 &&
+			           strcmp(packs[i]->records[0].name, name) == 0 &&
+			           packs[i]->records[0].value.value_f == (double)i, "pack %zu", i);
+		}
+		
+		TEST_CHECK(senml_encode_json_batch(on, (const senml_pack_t *const *)packs,
+		                                   TEST_BATCH_COUNT, outputs) == 0, "%s",
+		           senml_last_error()->message);
+		
+		for (size_t i = 0; i < TEST_BATCH_COUNT; i++) {
+			char *expected = senml_encode_json(packs[i]);
+			
+			TEST_CHECK(outputs[i] && expected && strcmp(outputs[i], expected) == 0,
+			           "document %zu: %s", i, outputs[i]);
+			senml_free(expected);
+			senml_free(outputs[i]);
+		}
+		
+		// a pack that cannot be encoded fails on its own
+		packs[TEST_BATCH_BAD]->records[0].value_type = SENML_TYPE_STRING;
+		TEST_CHECK(senml_encode_json_batch(on, (const senml_pack_t *const *)packs,
+		                                   TEST_BATCH_COUNT, outputs) == -1 &&
+		           senml_last_error()->code == SENML_ERROR_INVALID_PACK, "%s",
+		           senml_last_error()->message);
+		
+		for (size_t i = 0; i < TEST_BATCH_COUNT; i++) {
+			TEST_CHECK((i == TEST_BATCH_BAD) == !outputs[i], "document %zu", i);
+			senml_free(outputs[i]);
+			senml_pack_free(packs[i]);
+		}
+	}
+	
+	senml_pool_free(pool);
+	TEST_CHECK(test_blocks == blocks, "%ld blocks left", (long)(test_blocks - blocks));
+}
+
+
+#define TEST_COMPACT_RECORDS (8)  //!< Records of each random pack
+
+
+/**
+ * Checks that the compact JSON and CBOR documents of \p pack resolve to the same records as
+ * \p pack itself.
+ */
+static void test_compact_pack(const senml_pack_t *pack, unsigned int round)
+{
+	const senml_base_info_t *base_info = pack->base_info;
+	
+	senml_encode_opts_t  opts     = { .flags = SENML_ENCODE_COMPACT };
+	char                *compact  = senml_encode_json_ex(pack, &opts);
+	size_t               cbor_len = 0;
+	unsigned char       *cbor     = senml_encode_cbor_ex(pack, &cbor_len, &opts);
+	test_records_t       expected = { .len = 0 };
+	test_records_t       records  = { .len = 0 };
+	
+	TEST_CHECK(compact && cbor, "round %u: %s", round, senml_last_error()->message);
+	
+	// resolved the way the decoders do it
+	for (size_t i = 0; i < pack->num && base_info; i++) {
+		senml_record_t record = pack->records[i];
+		char           name[32];
+		
+		snprintf(name, sizeof(name), "%s%s", base_info->base_name ? base_info->base_name : "",
+		         record.name);
+		record.name  = name;
+		record.unit  = record.unit ? record.unit : base_info->base_unit;
+		record.time += base_info->base_time;
+		
+		if (record.value_type == SENML_TYPE_FLOAT &&
+		    base_info->base_value_type == SENML_TYPE_FLOAT)
+			record.value.value_f += base_info->base_value.base_value_f;
+		
+		test_record_text(&record, NULL, &expected);
+	}
+	
+	for (size_t i = 0; i < pack->num && !base_info; i++)
+		test_record_text(&pack->records[i], NULL, &expected);
+	
+	if (compact && cbor) {
+		TEST_CHECK(senml_decode_json_each(compact, 0, test_record_text, &records) == 0, "%s",
+		           senml_last_error()->message);
+		
+		// the base name and time of the documents differ, so only the resolved parts count
+		TEST_CHECK(records.count == expected.count, "round %u: %zu records", round,
+		           records.count);
+		TEST_CHECK(test_same_resolved(records.text, expected.text), "round %u: %s\n%s", round,
+		           compact, records.text);
+		
+		records = (test_records_t){ .len = 0 };
+		TEST_CHECK(senml_decode_cbor_each(cbor, cbor_len, test_record_text, &records) == 0 &&
+		           test_same_resolved(records.text, expected.text), "round %u: CBOR %s", round,
+		           records.text);
+	}
+	
+	senml_free(compact);
+	senml_free(cbor);
+}
+
+
+static void test_compact_exact(void)
+{
+	static const char *const names[] = { "dev/a/x", "dev/a/y", "dev/b", "dev/", "", "other" };
+	static const char *const units[] = { NULL, "Cel", "Cel", "%RH" };
+	
+	senml_record_t     records[TEST_COMPACT_RECORDS];
+	senml_base_info_t  base_info;
+	senml_pack_t       pack  = { .records = records };
+	uint64_t           state = 0x9e3779b97f4a7c15u;
+	
+	for (unsigned int round = 0; round < 2000; round++) {
+		memset(&base_info, 0, sizeof(base_info));
+		memset(records, 0, sizeof(records));
+		
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		
+		// sometimes a base info of the pack's own, which has to be resolved first
+		pack.base_info = round % 3 ? &base_info : NULL;
+		pack.num       = 1 + state % TEST_COMPACT_RECORDS;
+		
+		base_info.base_name       = state & 8 ? "dev/" : NULL;
+		base_info.base_time       = state & 16 ? 1.7e9 + (double)(state >> 40) / 1024 : 0;
+		base_info.base_unit       = state & 32 ? "Cel" : NULL;
+		base_info.base_value_type = state & 64 ? SENML_TYPE_FLOAT : SENML_TYPE_UNDEF;
+		base_info.base_value.base_value_f = 0.1;
+		
+		for (size_t i = 0; i < pack.num; i++) {
+			senml_record_t *record = &records[i];
+			
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			
+			record->name_id = SENML_NO_ID;
+			record->name    = (char *)names[state % 6];
+			record->unit    = (char *)units[(state >> 3) % 4];
+			
+			// times near now, fractions of a second and times relative to now
+			switch ((state >> 5) % 4) {
+			case 0:
+				record->time = 0;
+				break;
+			
+			case 1:
+				record->time = 1.7e9 + (double)((state >> 8) % 100000) / 1000;
+				break;
+			
+			case 2:
+				record->time = -(double)(1 + (state >> 8) % 1000) / 10;
+				break;
+			
+			default:
+				record->time = 1.7e9 + (double)(state >> 11) * 0x1p-53;
+				break;
+			}
+			
+			switch ((state >> 7) % 3) {
+			case 0:
+				record->value_type    = SENML_TYPE_FLOAT;
+				record->value.value_f = (double)(int64_t)(state >> 20) * 1e-7;
+				break;
+			
+			case 1:
+				record->value_type    = SENML_TYPE_BOOL;
+				record->value.value_b = state & 1;
+				break;
+			
+			default:
+				record->value_type    = SENML_TYPE_STRING;
+				record->value.value_s = "on";
+				break;
+			}
+		}
+		
+		test_compact_pack(&pack, round);
+	}
+}
+
+
+/*! What a matcher was asked */
+typedef struct {
+	size_t calls;
+	bool   resolved;  //!< Every name started with the base name
+} test_matcher_t;
+
+
+static bool test_match_temp(const char *name, size_t len, void *ctx)
+{
+	test_matcher_t *matcher = ctx;
+	
+	matcher->calls++;
+	matcher->resolved = matcher->resolved && len >= 4 && memcmp(name, "dev/", 4) == 0;
+	
+	return len == 8 && memcmp(name, "dev/temp", 8) == 0;
+}
+
+
+/**
+ * Decodes \p json, and its CBOR version, with \p filter and \p fields.
+ * @return The values of the records that were kept, one digit each, or "error".
+ */
+static const char *test_filter_values(const char *json, const senml_filter_t *filter,
+                                      unsigned int fields)
+{
+	static char         values[2][16];
+	senml_decode_opts_t opts     = { .filter = filter, .fields = fields };
+	size_t              cbor_len = 0;
+	unsigned char      *cbor     = senml_transcode_json_to_cbor(json, 0, &cbor_len);
+	
+	for (int i = 0; i < 2; i++) {
+		senml_pack_t *pack = i ? senml_decode_cbor_ex(cbor, cbor_len, &opts) :
+		                         senml_decode_json_ex(json, 0, &opts);
+		size_t        len  = 0;
+		
+		strcpy(values[i], "error");
+		
+		for (size_t j = 0; pack && j < pack->num && len < sizeof(values[i]) - 1; j++)
+			values[i][len++] = (char)('0' + (int)pack->records[j].value.value_f);
+		
+		if (pack)
+			values[i][len] = '\0';
+		
+		senml_pack_free(pack);
+	}
+	
+	senml_free(cbor);
+	
+	return cbor && strcmp(values[0], values[1]) == 0 ? values[0] : "CBOR differs";
+}
+
+
+static void test_filter(void)
+{
+	static const char json[] = "[{\"bn\":\"dev/\",\"n\":\"temp\",\"v\":1},{\"n\":\"hum\",\"v\":2},"
+	                           "{\"n\":\"te\\u006dp\",\"u\":\"Cel\",\"v\":3},"
+	                           "{\"n\":\"temperature\",\"v\":4,\"t\":-1},{\"v\":5}]";
+	static const char *const some[]  = { "dev/temp", "dev/", "dev/missing" };
+	static const char *const local[] = { "temp", "hum" };
+	
+	senml_filter_t      *filter;
+	senml_decode_opts_t  opts    = { .fields = SENML_FIELD_VALUE };
+	test_matcher_t       matcher = { .calls = 0, .resolved = true };
+	senml_pack_t        *pack;
+	const char          *values;
+	
+	// names are compared resolved and unescaped, a record without a name is the base name
+	filter = senml_filter_names(some, 3);
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "135") == 0, "names: %s", values);
+	values = test_filter_values(json, filter, SENML_FIELD_VALUE);
+	TEST_CHECK(strcmp(values, "135") == 0, "names without decoding them: %s", values);
+	senml_filter_free(filter);
+	
+	filter = senml_filter_names(local, 2);
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "") == 0, "unresolved names: %s", values);
+	senml_filter_free(filter);
+	
+	filter = senml_filter_names(NULL, 0);
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "") == 0, "no names: %s", values);
+	senml_filter_free(filter);
+	
+	// prefixes, including the empty one and the whole base name
+	filter = senml_filter_prefix("dev/te");
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "134") == 0, "prefix: %s", values);
+	senml_filter_free(filter);
+	
+	filter = senml_filter_prefix("");
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "12345") == 0, "empty prefix: %s", values);
+	senml_filter_free(filter);
+	
+	filter = senml_filter_prefix("dev/temperatures");
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "") == 0, "longer prefix: %s", values);
+	senml_filter_free(filter);
+	
+	// a matcher sees every resolved name once per decoder
+	filter = senml_filter_match(test_match_temp, &matcher);
+	values = test_filter_values(json, filter, 0);
+	TEST_CHECK(strcmp(values, "13") == 0, "matcher: %s", values);
+	TEST_CHECK(matcher.calls == 10 && matcher.resolved, "%zu calls", matcher.calls);
+	
+	// the projection leaves out every attribute but the value
+	opts.filter = filter;
+	pack        = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(pack && pack->num == 2 && !pack->records[0].name && !pack->records[1].unit &&
+	           pack->records[1].value.value_f == 3, "%s", senml_last_error()->message);
+	senml_pack_free(pack);
+	
+	opts.filter = NULL;
+	pack        = senml_decode_json_ex(json, 0, &opts);
+	TEST_CHECK(pack && pack->num == 5 && !pack->records[2].name_view.p &&
+	           !pack->records[2].unit_view.p && pack->records[3].time == 0 &&
+	           pack->records[3].value.value_f == 4, "%s", senml_last_error()->message);
+	senml_pack_free(pack);
+	senml_filter_free(filter);
+	
+	// errors count the records the filter left out
+	filter = senml_filter_names(local, 2);
+	opts   = (senml_decode_opts_t){ .filter = filter };
+	pack   = senml_decode_json_ex("[{\"n\":\"a\",\"v\":1},{\"n\":\"b\",\"v\":1},"
+	                              "{\"n\":\"hum\",\"v\":\"x\"}]", 0, &opts);
+	TEST_CHECK(!pack && senml_last_error()->code == SENML_ERROR_RECORD &&
+	           senml_last_error()->record == 3, "%s", senml_last_error()->message);
+	senml_filter_free(filter);
+}
+
+
+/*
+ * Offsets of the header fields of a flat pack that the test corrupts, see senml_flat.c, and of
+ * the name reference within a record.
+ */
+#define TEST_FLAT_VERSION     (4)
+#define TEST_FLAT_ORDER       (6)
+#define TEST_FLAT_RECORD_SIZE (12)
+#define TEST_FLAT_NUM         (16)
+#define TEST_FLAT_STRINGS     (24)
+#define TEST_FLAT_SIZE        (32)
+#define TEST_FLAT_NAME        (16)
+
+
+/**
+ * Opens \p len bytes of \p flat_pack after writing \p size bytes of \p value at \p offset.
+ * @return The error senml_flat_open reported, SENML_OK if it opened the pack.
+ */
+static senml_error_code_t test_flat_corrupt(const uint64_t *flat_pack, size_t len, size_t offset,
+                                            uint64_t value, size_t size)
+{
+	static uint64_t buf[512];
+	senml_flat_t    flat;
+	
+	memcpy(buf, flat_pack, len);
+	memcpy((char *)buf + offset, &value, size);
+	
+	return senml_flat_open(buf, len, &flat) == 0 ? SENML_OK : senml_last_error()->code;
+}
+
+
+static void test_flat_open(void)
+{
+	// offsets past the table, that wrap around, lengths past the table and no NUL at the end
+	static const uint32_t refs[][2] = {
+		{ 0xffffffff, 0 }, { 0xfffffff0, 0x20 }, { 0, 0xffffffff }, { 0, 1000 }, { 2, 0 }
+	};
+	
+	senml_base_info_t  base_info = { .base_name = "dev/", .base_time = 1.5,
+	                                 .base_value_type = SENML_TYPE_STRING,
+	                                 .base_value.base_value_s = "x" };
+	senml_record_t     records[] = {
+		{ .name = "a", .unit = "Cel", .time = 2, .value_type = SENML_TYPE_FLOAT,
+		  .value.value_f = 21.5 },
+		{ .name = "b", .unit = "Cel", .update_time = 9, .value_type = SENML_TYPE_STRING,
+		  .value.value_s = "on" },
+		{ .name = "c", .value_type = SENML_TYPE_BOOL, .value.value_b = true }
+	};
+	senml_pack_t       pack      = { .base_info = &base_info, .records = records, .num = 3 };
+	uint64_t           buf[64];
+	size_t             len       = sizeof(buf);
+	senml_flat_t       flat;
+	senml_base_info_t  base_out;
+	senml_record_t     record_out[3];
+	senml_pack_t       pack_out  = { .base_info = &base_out, .records = record_out, .num = 3 };
+	uint64_t           strings;
+	uint32_t           record_size;
+	size_t             name;
+	
+	TEST_CHECK(senml_encode_flat_s(&pack, (unsigned char *)buf, &len) == 0, "%s",
+	           senml_last_error()->message);
+	
+	// opening reads back every attribute, with a larger buffer too
+	TEST_CHECK(senml_flat_open(buf, sizeof(buf), &flat) == 0 && flat.num == 3 &&
+	           senml_flat_base_info(&flat, &base_out), "%s", senml_last_error()->message);
+	
+	for (size_t i = 0; i < 3; i++)
+		senml_flat_record(&flat, i, &record_out[i]);
+	
+	TEST_CHECK(!test_same_pack(&pack, &pack_out), "%s", test_same_pack(&pack, &pack_out));
+	TEST_CHECK(senml_flat_value_b(&flat, 2) && senml_flat_update_time(&flat, 1) == 9 &&
+	           senml_flat_value_s(&flat, 1).len == 2 && !senml_flat_unit(&flat, 2).p,
+	           "single attributes");
+	
+	// a pack that is cut short never opens, wherever it is cut
+	for (size_t cut = 0; cut < len; cut++)
+		TEST_CHECK(test_flat_corrupt(buf, cut, 0, 'S', 1) == SENML_ERROR_TRUNCATED, "cut at %zu",
+		           cut);
+	
+	// every field of the header is checked
+	TEST_CHECK(senml_flat_open((char *)buf + 4, len - 4, &flat) == -1 &&
+	           senml_last_error()->code == SENML_ERROR_SYNTAX, "misaligned");
+	TEST_CHECK(test_flat_corrupt(buf, len, 0, 'X', 1) == SENML_ERROR_SYNTAX, "magic");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_VERSION, SENML_FLAT_VERSION + 1, 2) ==
+	           SENML_ERROR_SYNTAX, "version");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_ORDER, 0x0201, 2) == SENML_ERROR_SYNTAX,
+	           "byte order");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_SIZE, len + 1, 8) == SENML_ERROR_TRUNCATED,
+	           "size beyond the buffer");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_SIZE, 8, 8) == SENML_ERROR_SYNTAX,
+	           "size within the header");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_NUM, 4, 8) == SENML_ERROR_SYNTAX,
+	           "one record too many");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_NUM, UINT64_MAX / 8, 8) ==
+	           SENML_ERROR_SYNTAX, "overflowing number of records");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_RECORD_SIZE, 8, 4) == SENML_ERROR_SYNTAX,
+	           "record size");
+	TEST_CHECK(test_flat_corrupt(buf, len, TEST_FLAT_STRINGS, len + 8, 8) == SENML_ERROR_SYNTAX,
+	           "string table beyond the pack");
+	
+	// string references outside of the table read as not set, the others are not affected
+	memcpy(&strings, (char *)buf + TEST_FLAT_STRINGS, sizeof(strings));
+	memcpy(&record_size, (char *)buf + TEST_FLAT_RECORD_SIZE, sizeof(record_size));
+	name = (size_t)strings - 3 * record_size + TEST_FLAT_NAME;
+	
+	for (size_t i = 0; i < sizeof(refs) / sizeof(refs[0]); i++) {
+		uint64_t corrupt[64];
+		
+		memcpy(corrupt, buf, len);
+		memcpy((char *)corrupt + name, refs[i], sizeof(refs[i]));
+		
+		TEST_CHECK(senml_flat_open(corrupt, len, &flat) == 0, "%s", senml_last_error()->message);
+		TEST_CHECK(!senml_flat_name(&flat, 0).p && senml_flat_name(&flat, 1).p &&
+		           senml_flat_unit(&flat, 0).p, "reference %u %u", refs[i][0], refs[i][1]);
+		
+		senml_flat_record(&flat, 0, &record_out[0]);
+		TEST_CHECK(!record_out[0].name_view.p && record_out[0].value.value_f == 21.5,
+		           "reference %u %u", refs[i][0], refs[i][1]);
+	}
+}
+
+
+/**
+ * Encodes \p pack with \p tmpl and checks that the document decodes to the same pack as the
+ * document the plain encoder creates.
+ */
+static void test_template_pack(senml_template_t *tmpl, bool cbor, const senml_pack_t *pack,
+                               unsigned int round)
+{
+	size_t        allocs    = test_allocs;
+	size_t        len       = 0;
+	size_t        plain_len = 0;
+	const void   *doc       = senml_template_encode(tmpl, pack, &len);
+	size_t        encoded   = test_allocs;
+	void         *plain     = cbor ? (void *)senml_encode_cbor(pack, &plain_len) :
+	                                 (void *)senml_encode_json(pack);
+	senml_pack_t *patched   = NULL;
+	senml_pack_t *expected  = NULL;
+	
+	TEST_CHECK(doc && plain, "round %u: %s", round, senml_last_error()->message);
+	TEST_CHECK(encoded == allocs, "round %u: %zu allocations", round, encoded - allocs);
+	
+	if (doc && plain) {
+		patched  = cbor ? senml_decode_cbor(doc, len) : senml_decode_json(doc, len);
+		expected = cbor ? senml_decode_cbor(plain, plain_len) : senml_decode_json(plain, 0);
+		
+		TEST_CHECK(patched && expected && !test_same_pack(patched, expected), "round %u: %s",
+		           round, patched && expected ? test_same_pack(patched, expected) :
+		                                        senml_last_error()->message);
+		TEST_CHECK(cbor || strlen(doc) == len, "round %u: length %zu", round, len);
+	}
+	
+	senml_pack_free(patched);
+	senml_pack_free(expected);
+	senml_free(plain);
+}
+
+
+static void test_template_patch(void)
+{
+	static const double samples[] = {
+		0, 1, -1, 0.1, 1e-300, 5e-324, 1.7976931348623157e308, 123456789.125, -2.5e-7, 1e21, 1.5
+	};
+	
+	senml_base_info_t  base_info = { .base_name = "dev/", .base_unit = "Cel" };
+	senml_record_t     records[] = {
+		{ .name = "a", .value_type = SENML_TYPE_FLOAT },
+		{ .name = "b", .unit = "%RH", .value_type = SENML_TYPE_BOOL },
+		{ .name = "c", .value_type = SENML_TYPE_STRING, .value.value_s = "on" },
+		{ .name = "d", .time = 5, .value_type = SENML_TYPE_FLOAT }
+	};
+	senml_pack_t       pack      = { .base_info = &base_info, .records = records, .num = 4 };
+	uint64_t           state     = 0x2545f4914f6cdd1du;
+	size_t             len;
+	
+	for (int cbor = 0; cbor <= 1; cbor++) {
+		static const unsigned int fields[] = {
+			0, SENML_FIELD_VALUE, SENML_FIELD_TIME | SENML_FIELD_UPDATE_TIME | SENML_FIELD_VALUE
+		};
+		
+		for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+			senml_template_t *tmpl = cbor ? senml_template_cbor(&pack, fields[f]) :
+			                                senml_template_json(&pack, fields[f]);
+			
+			TEST_CHECK(tmpl != NULL, "%s", senml_last_error()->message);
+			
+			if (!tmpl)
+				continue;
+			
+			// only the attributes of the template change, the plain encoder sees all of them
+			for (unsigned int round = 0; round < 300; round++) {
+				for (size_t i = 0; i < pack.num; i++) {
+					senml_record_t *record = &records[i];
+					
+					state ^= state >> 12;
+					state ^= state << 25;
+					state ^= state >> 27;
+					
+					// + 0.0 turns -0 into 0, which the plain encoder leaves out like 0
+					if (!fields[f] || fields[f] & SENML_FIELD_TIME)
+						record->time = samples[state % 11] * (state & 16 ? -1 : 1) + 0.0;
+					
+					if (fields[f] & SENML_FIELD_UPDATE_TIME)
+						record->update_time = (unsigned int)(state >> 32);
+					
+					if (record->value_type == SENML_TYPE_FLOAT)
+						record->value.value_f = samples[(state >> 8) % 11];
+					else if (record->value_type == SENML_TYPE_BOOL)
+						record->value.value_b = state & 32;
+				}
+				
+				test_template_pack(tmpl, cbor, &pack, round);
+			}
+			
+			// a pack of another shape does not fit
+			records[1].value_type = SENML_TYPE_FLOAT;
+			TEST_CHECK(!senml_template_encode(tmpl, &pack, &len), "value type changed");
+			records[1].value_type = SENML_TYPE_BOOL;
+			pack.num              = 3;
+			TEST_CHECK(!senml_template_encode(tmpl, &pack, &len), "record removed");
+			pack.num              = 4;
+			
+			// JSON has no representation for NaN and infinity
+			records[0].value.value_f = NAN;
+			TEST_CHECK(!senml_template_encode(tmpl, &pack, &len) == !cbor, "NaN");
+			records[0].value.value_f = 1;
+			
+			senml_template_free(tmpl);
+		}
+	}
+}
+
+
+/**
+ * Checks that iterating a series from \p time gives the samples of \p times and \p values from
+ * the first one at or after \p time, to the end or for at most \p limit samples.
+ */
+static void test_series_from(const senml_series_t *series, const double *times,
+                             const double *values, size_t count, double time, size_t limit)
+{
+	senml_series_iter_t iter;
+	size_t              first = 0;
+	double              t;
+	double              v;
+	
+	while (first < count && times[first] < time)
+		first++;
+	
+	senml_series_seek(series, time, &iter);
+	
+	for (size_t i = first; i < count && i - first < limit; i++) {
+		if (!senml_series_next(&iter, &t, &v)) {
+			TEST_CHECK(false, "seek %.17g: ends at %zu of %zu", time, i, count);
+			return;
+		}
+		
+		TEST_CHECK(!memcmp(&t, &times[i], sizeof(t)) && !memcmp(&v, &values[i], sizeof(v)),
+		           "seek %.17g: sample %zu is %.17g %.17g", time, i, t, v);
+	}
+	
+	TEST_CHECK(first + limit < count || !senml_series_next(&iter, &t, &v),
+	           "seek %.17g: sample after the end", time);
+}
+
+
+static void test_series_samples(void)
+{
+	enum { COUNT = 3000 };
+	
+	static double   times[COUNT];
+	static double   values[COUNT];
+	static double   decoded_times[COUNT];
+	static double   decoded_values[COUNT];
+	senml_series_t *series  = senml_series_new("dev/temp", "Cel");
+	senml_series_t *regular = senml_series_new("dev/temp", NULL);
+	senml_series_t *copy    = NULL;
+	senml_pack_t   *pack    = NULL;
+	uint64_t        state   = 0x9e3779b97f4a7c15u;
+	double          time    = 1.7e9;
+	double          value   = 21.5;
+	
+	TEST_CHECK(series && regular, "out of memory");
+	
+	if (!series || !regular)
+		goto out;
+	
+	// regular intervals, then irregular ones, repeated times and times of no whole microsecond
+	for (size_t i = 0; i < COUNT; i++) {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		
+		if (i < 1000)
+			time += 1;
+		else if (i % 97 == 0)
+			time += (double)(state % 1000) * 1e-7;
+		else if (i % 13 != 0)
+			time += (double)(state % 100000) / 1000;
+		
+		switch (state >> 60) {
+		case 0:
+			value = -value;
+			break;
+		case 1:
+			value = (double)(state >> 11) * 0x1p-53 * 1e300;
+			break;
+		case 2:
+			value = (state & 1) ? NAN : -0.0;
+			break;
+		case 3:
+			value = INFINITY;
+			break;
+		default:
+			if (!isfinite(value) || value == 0)
+				value = 21.5;
+			
+			value += (state & 3) * 0.125;
+			break;
+		}
+		
+		times[i]  = time;
+		values[i] = value;
+		TEST_CHECK(senml_series_append(series, time, value) == 0, "sample %zu", i);
+		TEST_CHECK(i >= 1000 || senml_series_append(regular, time, 21.5) == 0, "sample %zu", i);
+	}
+	
+	TEST_CHECK(senml_series_append(series, time - 1, 0) == -1, "time before the previous one");
+	TEST_CHECK(senml_series_append(series, NAN, 0) == -1, "time not a number");
+	TEST_CHECK(senml_series_count(series) == COUNT, "%zu samples", senml_series_count(series));
+	TEST_CHECK(senml_series_size(regular) < 1000 * 2, "%zu bytes for 1000 regular samples",
+	           senml_series_size(regular));
+	
+	// decoding in chunks that straddle the blocks gives back the exact bits
+	for (size_t first = 0, n; first < COUNT; first += n) {
+		n = senml_series_decode(series, first, decoded_times + first, decoded_values + first, 211);
+		TEST_CHECK(n == (first + 211 < COUNT ? 211 : COUNT - first), "%zu at %zu", n, first);
+		
+		if (n == 0)
+			break;
+	}
+	
+	TEST_CHECK(!memcmp(times, decoded_times, sizeof(times)), "times differ");
+	TEST_CHECK(!memcmp(values, decoded_values, sizeof(values)), "values differ");
+	TEST_CHECK(senml_series_decode(series, COUNT, decoded_times, decoded_values, 1) == 0, "end");
+	
+	test_series_from(series, times, values, COUNT, -INFINITY, COUNT);
+	test_series_from(series, times, values, COUNT, times[0] - 1, 5);
+	test_series_from(series, times, values, COUNT, time + 1, 1);
+	
+	for (size_t i = 1; i < COUNT; i += 37) {
+		test_series_from(series, times, values, COUNT, times[i], 20);
+		test_series_from(series, times, values, COUNT, (times[i - 1] + times[i]) / 2, 20);
+		test_series_from(series, times, values, COUNT, nextafter(times[i], 0), 3);
+	}
+	
+	// through a pack and back
+	pack = senml_series_to_pack(series);
+	copy = pack ? senml_series_from_pack(pack, "dev/temp") : NULL;
+	
+	TEST_CHECK(copy != NULL, "%s", senml_last_error()->message);
+	
+	if (copy)
+		test_series_from(copy, times, values, COUNT, -INFINITY, COUNT);
+	
+out:
+	senml_pack_free(pack);
+	senml_series_free(copy);
+	senml_series_free(series);
+	senml_series_free(regular);
+}
+
+
+static const test_case_t test_cases[] = {
+	{ "json_differential", test_json_differential },
+	{ "json_divergence",   test_json_divergence   },
+	{ "json_depth",        test_json_depth        },
+	{ "json_presize",      test_json_presize      },
+	{ "heap_free",         test_heap_free         },
+	{ "double_edges",      test_double_edges      },
+	{ "double_random",     test_double_random     },
+	{ "double_parse",      test_double_parse      },
+	{ "double_parse_long", test_double_parse_long },
+	{ "encode_json_exact", test_encode_json_exact },
+	{ "names_decode",      test_names_decode      },
+	{ "cbor_decode",       test_cbor_decode       },
+	{ "cbor_tags",         test_cbor_tags         },
+	{ "transcode_exact",   test_transcode_exact   },
+	{ "store_max_age",     test_store_max_age     },
+	{ "store_concurrent",  test_store_concurrent  },
+	{ "aggregate_kernels", test_aggregate_kernels },
+	{ "columns_binary",    test_columns_binary    },
+	{ "zero_copy",         test_zero_copy         },
+	{ "pack_arena",        test_pack_arena        },
+	{ "encode_cbor",       test_encode_cbor       },
+	{ "parser_split",      test_parser_split      },
+	{ "decode_each",       test_decode_each       },
+	{ "batch",             test_batch             },
+	{ "compact_exact",     test_compact_exact     },
+	{ "filter",            test_filter            },
+	{ "flat_open",         test_flat_open         },
+	{ "template_patch",    test_template_patch    },
+	{ "series_samples",    test_series_samples    },
+};
+
+
+int main(int argc, char **argv)
+{
+	senml_allocator_t allocator = {
+		.malloc  = test_malloc,
+		.realloc = test_realloc,
+		.free    = test_free
+	};
+	
+	const char   *filter = NULL;
+	unsigned int  failed = 0;
+	
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--filter=", 9) == 0) {
+			filter = argv[i] + 9;
+		} else {
+			fprintf(stderr, "usage: %s [--filter=SUBSTRING]\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	senml_set_allocator(&allocator);
+	
+	for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+		if (filter && !strstr(test_cases[i].name, filter))
+			continue;
+		
+		test_checks   = 0;
+		test_failures = 0;
+		test_cases[i].run();
+		
+		printf("%-4s %s (%u checks)\n", test_failures ? "FAIL" : "ok", test_cases[i].name,
+		       test_checks);
+		
+		if (test_failures)
+			failed++;
+	}
+	
+	return failed ? 1 : 0;
+}